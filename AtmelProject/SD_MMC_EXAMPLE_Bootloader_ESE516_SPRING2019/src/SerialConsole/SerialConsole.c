@@ -29,17 +29,18 @@
 /******************************************************************************
 * Defines
 ******************************************************************************/
-#define RX_BUFFER_SIZE 1024	///<Size of character buffer for RX, in bytes
-#define TX_BUFFER_SIZE 1024	///<Size of character buffers for TX, in bytes
+#define RX_BUFFER_SIZE 1024	///<Size of character buffer for RX, in bytes. Must be a power of two.
+#define TX_BUFFER_SIZE 1024	///<Size of character buffers for TX, in bytes. Must be a power of two.
 
 /******************************************************************************
 * Structures and Enumerations
 ******************************************************************************/
-cbuf_handle_t cbufRx;	///<Circular buffer handler for receiving characters from the Serial Interface
-cbuf_handle_t cbufTx;	///<Circular buffer handler for transmitting characters from the Serial Interface
+static struct byte_ring rxRing;	///<Ring of characters received from the Serial Interface. Filled by the RX interrupt, read by the main loop.
+static struct byte_ring txRing;	///<Ring of characters to transmit on the Serial Interface. Emptied by the TX interrupt.
 
 char latestRx;	///< Holds the latest character that was received
-char latestTx;	///< Holds the latest character to be transmitted.
+static volatile bool txBusy = false;	///<Set while a span of the TX ring is being sent
+static uint32_t txSpan = 0;				///<Number of bytes of the TX ring handed to the usart write job
 
 /******************************************************************************
 *  Callback Declaration
@@ -52,13 +53,14 @@ void usart_read_callback(struct usart_module *const usart_module);	//Callback fo
 ******************************************************************************/
 static void configure_usart(void);
 static void configure_usart_callbacks(void);
+static void SerialConsoleStartTx(void);
 
 /******************************************************************************
 * Global Local Variables
 ******************************************************************************/
 struct usart_module usart_instance;
-char rxCharacterBuffer[RX_BUFFER_SIZE]; ///<Buffer to store received characters
-char txCharacterBuffer[TX_BUFFER_SIZE]; ///<Buffer to store characters to be sent
+uint8_t rxCharacterBuffer[RX_BUFFER_SIZE]; ///<Buffer to store received characters
+uint8_t txCharacterBuffer[TX_BUFFER_SIZE]; ///<Buffer to store characters to be sent
 enum eDebugLogLevels currentDebugLevel = LOG_INFO_LVL; ///<Variable that holds the level of debug log messages to show. Defaults to showing all debug values
 
 
@@ -79,9 +81,9 @@ enum eDebugLogLevels currentDebugLevel = LOG_INFO_LVL; ///<Variable that holds t
 void InitializeSerialConsole()
 {
 
-	//Initialize circular buffers for RX and TX
-	cbufRx = circular_buf_init((uint8_t*)rxCharacterBuffer, RX_BUFFER_SIZE);
-	cbufTx = circular_buf_init((uint8_t*)txCharacterBuffer, RX_BUFFER_SIZE);
+	//Initialize ring buffers for RX and TX
+	byte_ring_init(&rxRing, rxCharacterBuffer, RX_BUFFER_SIZE);
+	byte_ring_init(&txRing, txCharacterBuffer, TX_BUFFER_SIZE);
 
 	//Configure USART and Callbacks
 	configure_usart();
@@ -101,23 +103,23 @@ void DeinitializeSerialConsole()
 /**************************************************************************//**
 * @fn			void SerialConsoleWriteString(char * string)
 * @brief		Writes a string to be written to the uart. Copies the string to a ring buffer that is used to hold the text send to the uart
-* @details		Uses the ringbuffer 'cbufTx', which in turn uses the array 'txCharacterBuffer'
+* @details		Uses the ringbuffer 'txRing', which in turn uses the array 'txCharacterBuffer'. The main loop and the
+*				echo in the RX interrupt both write, so interrupts are masked while the text is added. Characters
+*				that do not fit in the ring are dropped and counted (see SerialConsoleGetTxOverflow).
 * @note			Use to send a string of characters to the user via UART
 *****************************************************************************/
 void SerialConsoleWriteString(char * string)
 {
 	if(string != NULL)
 	{
-		for (size_t iter = 0; iter < strlen(string); iter++)
-		{
-			circular_buf_put(cbufTx, string[iter]);
-		}
-		
-		if(usart_get_job_status(&usart_instance, USART_TRANSCEIVER_TX) == STATUS_OK)
+		system_interrupt_enter_critical_section();
+		byte_ring_put_n(&txRing, (const uint8_t*) string, strlen(string));
+
+		if(!txBusy)
 		{
-			circular_buf_get(cbufTx, (uint8_t*) &latestTx); //Perform only if the SERCOM TX is free (not busy)
-			usart_write_buffer_job(&usart_instance, (uint8_t*) &latestTx, 1);
+			SerialConsoleStartTx(); //Perform only if the SERCOM TX is free (not busy)
 		}
+		system_interrupt_leave_critical_section();
 	}
 }
 
@@ -127,16 +129,33 @@ void SerialConsoleWriteString(char * string)
 * @brief		Reads a character from the RX ring buffer and stores it on the pointer given as an argument.
 *				Also, returns -1 if there is no characters on the buffer
 *				This buffer has values added to it when the UART receives ASCII characters from the terminal
-* @details		Uses the ringbuffer 'cbufTx', which in turn uses the array 'txCharacterBuffer'
+* @details		Uses the ringbuffer 'rxRing', which in turn uses the array 'rxCharacterBuffer'. The caller is the only
+*				reader of the ring and the RX interrupt the only writer, so no lock is needed.
 * @param[in]	Pointer to a character. This function will return the character from the RX buffer into this pointer
 * @return		Returns -1 if there are no characters in the buffer
 * @note			Use to receive characters from the RX buffer (FIFO)
 *****************************************************************************/
 int SerialConsoleReadCharacter(uint8_t *rxChar)
 {
+	return byte_ring_get(&rxRing, rxChar);
+}
 
-	return circular_buf_get(cbufRx, (uint8_t*) rxChar);
+/**************************************************************************//**
+* @fn			uint32_t SerialConsoleGetRxOverflow(void)
+* @brief		Returns the number of received characters dropped because the RX buffer was full
+*****************************************************************************/
+uint32_t SerialConsoleGetRxOverflow(void)
+{
+	return byte_ring_overflow(&rxRing);
+}
 
+/**************************************************************************//**
+* @fn			uint32_t SerialConsoleGetTxOverflow(void)
+* @brief		Returns the number of characters dropped because the TX buffer was full
+*****************************************************************************/
+uint32_t SerialConsoleGetTxOverflow(void)
+{
+	return byte_ring_overflow(&txRing);
 }
 
 
@@ -220,6 +239,27 @@ static void configure_usart(void)
 }
 
 
+/**************************************************************************//**
+* @fn			static void SerialConsoleStartTx(void)
+* @brief		Sends the oldest contiguous span of the TX ring to the UART with one usart write job
+* @details		The span stays in the ring while it is on the wire and is removed by the write callback, which then
+*				calls this function again for the next span.
+* @note			Called with interrupts masked or from the TX interrupt
+*****************************************************************************/
+static void SerialConsoleStartTx(void)
+{
+	uint8_t *data;
+	uint32_t len = byte_ring_peek_contiguous(&txRing, &data);
+	txBusy = false;
+	txSpan = 0;
+	if(len == 0) return;
+
+	if(STATUS_OK == usart_write_buffer_job(&usart_instance, data, len)){
+		txSpan = len;
+		txBusy = true;
+	}
+}
+
 /**************************************************************************//**
 * @fn			static void configure_usart_callbacks(void)
 * @brief		Code to register callbacks
@@ -252,15 +292,17 @@ static void configure_usart_callbacks(void)
 void usart_read_callback(struct usart_module *const usart_module)
 {
 	//Order Echo
-	SerialConsoleWriteString(&latestRx);
+	char echo[2] = {latestRx, 0};
+	SerialConsoleWriteString(echo);
 	if(latestRx == 0x08)
 	{
 	char a[3];
 	a[0] = 0x20;
 	a[1]= 0x08;
-	SerialConsoleWriteString(&a);
+	a[2] = 0;
+	SerialConsoleWriteString(a);
 	}
-	circular_buf_put(cbufRx, (uint8_t) latestRx); //Add the latest read character into the RX circular Buffer
+	byte_ring_put(&rxRing, (uint8_t) latestRx); //Add the latest read character into the RX ring. Dropped and counted if full.
 
 	usart_read_buffer_job(&usart_instance, (uint8_t*) &latestRx, 1);	//Order the MCU to keep reading
 }
@@ -268,14 +310,12 @@ void usart_read_callback(struct usart_module *const usart_module)
 
 /**************************************************************************//**
 * @fn			void usart_write_callback(struct usart_module *const usart_module)
-* @brief		Callback called when the system finishes sending all the bytes requested from a UART read job
+* @brief		Callback called when the system finishes sending all the bytes requested from a UART write job
+* @details		Removes the span that was sent from the TX ring and starts the next one, if any.
 * @note
 *****************************************************************************/
 void usart_write_callback(struct usart_module *const usart_module)
 {
-	if(circular_buf_get(cbufTx, (uint8_t*) &latestTx) != -1) //Only continue if there are more characters to send
-	{
-		usart_write_buffer_job(&usart_instance, (uint8_t*) &latestTx, 1);
-	}
-	
+	byte_ring_skip(&txRing, txSpan);
+	SerialConsoleStartTx(); //Only continues if there are more characters to send
 }
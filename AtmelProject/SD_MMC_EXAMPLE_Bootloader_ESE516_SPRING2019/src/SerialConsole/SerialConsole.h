@@ -30,7 +30,7 @@
 ******************************************************************************/
 #include <asf.h>
 #include "string.h"
-#include "circular_buffer.h"
+#include "byte_ring.h"
 #include <stdarg.h>
 
 /******************************************************************************
@@ -59,6 +59,8 @@ enum eDebugLogLevels {
 void InitializeSerialConsole(void);
 void SerialConsoleWriteString(char * string);
 int SerialConsoleReadCharacter(uint8_t *rxChar);
+uint32_t SerialConsoleGetRxOverflow(void);
+uint32_t SerialConsoleGetTxOverflow(void);
 void LogMessage(enum eDebugLogLevels level, const char *format, ...);
 void setLogLevel(enum eDebugLogLevels debugLevel);
 enum eDebugLogLevels getLogLevel(void);
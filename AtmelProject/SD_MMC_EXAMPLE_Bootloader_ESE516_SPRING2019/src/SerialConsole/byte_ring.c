@@ -0,0 +1,241 @@
+/**************************************************************************//**
+* @file        byte_ring.c
+* @ingroup 	   Serial Console
+* @brief       Single-producer/single-consumer byte ring used by the Serial Console
+* @details     See byte_ring.h. The producer fills the storage first and publishes the bytes by moving the head, the
+*				consumer reads them first and frees the room by moving the tail. A memory barrier sits between the
+*				two steps on each side, so the other side never sees an index ahead of the data.
+*
+* @copyright
+* @author		Kenny Zhang and Chen Chen
+* @date        2021-05-14
+* @version		0.1
+*****************************************************************************/
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stddef.h>
+#include <string.h>
+#include "byte_ring.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define BYTE_RING_BARRIER()	__sync_synchronize()	///<Orders the data accesses against the index update (DMB on Cortex-M)
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn			bool byte_ring_init(struct byte_ring *ring, uint8_t *storage, uint32_t size)
+* @brief		Sets up an empty ring on the given storage
+* @param[in]	ring Ring to set up
+* @param[in]	storage Storage of the ring. Must stay valid as long as the ring is used.
+* @param[in]	size Size of the storage in bytes. Must be a power of two.
+* @return		false if an argument is not valid. The ring is not usable then.
+* @note			Call before the producer and the consumer start
+*****************************************************************************/
+bool byte_ring_init(struct byte_ring *ring, uint8_t *storage, uint32_t size)
+{
+	if(ring == NULL || storage == NULL || !BYTE_RING_IS_POW2(size)) return false;
+
+	ring->buffer = storage;
+	ring->mask = size - 1;
+	byte_ring_reset(ring);
+	return true;
+}
+
+/**************************************************************************//**
+* @fn			void byte_ring_reset(struct byte_ring *ring)
+* @brief		Empties the ring and clears the overflow count
+* @note			Neither the producer nor the consumer may run at the same time
+*****************************************************************************/
+void byte_ring_reset(struct byte_ring *ring)
+{
+	ring->head = 0;
+	ring->tail = 0;
+	ring->overflow = 0;
+}
+
+/**************************************************************************//**
+* @fn			uint32_t byte_ring_capacity(const struct byte_ring *ring)
+* @brief		Returns the number of bytes the ring can hold
+*****************************************************************************/
+uint32_t byte_ring_capacity(const struct byte_ring *ring)
+{
+	return ring->mask + 1;
+}
+
+/**************************************************************************//**
+* @fn			uint32_t byte_ring_count(const struct byte_ring *ring)
+* @brief		Returns the number of bytes in the ring
+* @note			Exact for the consumer. For the producer, it may be more than there is once the consumer runs.
+*****************************************************************************/
+uint32_t byte_ring_count(const struct byte_ring *ring)
+{
+	return ring->head - ring->tail;	//Counters are free running, the unsigned difference is the fill level
+}
+
+/**************************************************************************//**
+* @fn			uint32_t byte_ring_space(const struct byte_ring *ring)
+* @brief		Returns the number of bytes that can still be put in the ring
+* @note			Exact for the producer. For the consumer, it may be less than there is once the producer runs.
+*****************************************************************************/
+uint32_t byte_ring_space(const struct byte_ring *ring)
+{
+	return byte_ring_capacity(ring) - byte_ring_count(ring);
+}
+
+/**************************************************************************//**
+* @fn			bool byte_ring_empty(const struct byte_ring *ring)
+* @brief		Returns true if there is nothing to read
+*****************************************************************************/
+bool byte_ring_empty(const struct byte_ring *ring)
+{
+	return ring->head == ring->tail;
+}
+
+/**************************************************************************//**
+* @fn			bool byte_ring_full(const struct byte_ring *ring)
+* @brief		Returns true if there is no room to write
+*****************************************************************************/
+bool byte_ring_full(const struct byte_ring *ring)
+{
+	return byte_ring_count(ring) > ring->mask;
+}
+
+/**************************************************************************//**
+* @fn			uint32_t byte_ring_overflow(const struct byte_ring *ring)
+* @brief		Returns the number of bytes dropped since the ring was reset because it was full
+*****************************************************************************/
+uint32_t byte_ring_overflow(const struct byte_ring *ring)
+{
+	return ring->overflow;
+}
+
+/**************************************************************************//**
+* @fn			int byte_ring_put(struct byte_ring *ring, uint8_t data)
+* @brief		Adds one byte to the ring
+* @return		0 on success, -1 if the ring is full. The byte is then dropped and counted.
+* @note			Producer only
+*****************************************************************************/
+int byte_ring_put(struct byte_ring *ring, uint8_t data)
+{
+	uint32_t head = ring->head;
+	if(head - ring->tail > ring->mask)
+	{
+		ring->overflow++;
+		return -1;
+	}
+
+	ring->buffer[head & ring->mask] = data;
+	BYTE_RING_BARRIER();
+	ring->head = head + 1;
+	return 0;
+}
+
+/**************************************************************************//**
+* @fn			uint32_t byte_ring_put_n(struct byte_ring *ring, const uint8_t *data, uint32_t len)
+* @brief		Adds up to len bytes to the ring
+* @details		Copies in at most two pieces (before and after the end of the storage) and publishes them at once.
+* @return		Number of bytes added. The ones that did not fit are dropped and counted.
+* @note			Producer only
+*****************************************************************************/
+uint32_t byte_ring_put_n(struct byte_ring *ring, const uint8_t *data, uint32_t len)
+{
+	uint32_t head = ring->head;
+	uint32_t room = byte_ring_capacity(ring) - (head - ring->tail);
+	if(len > room)
+	{
+		ring->overflow += len - room;
+		len = room;
+	}
+	if(len == 0) return 0;
+
+	uint32_t start = head & ring->mask;
+	uint32_t first = byte_ring_capacity(ring) - start;
+	if(first > len) first = len;
+	memcpy(&ring->buffer[start], data, first);
+	memcpy(ring->buffer, data + first, len - first);
+
+	BYTE_RING_BARRIER();
+	ring->head = head + len;
+	return len;
+}
+
+/**************************************************************************//**
+* @fn			int byte_ring_get(struct byte_ring *ring, uint8_t *data)
+* @brief		Removes the oldest byte from the ring
+* @return		0 on success, -1 if the ring is empty
+* @note			Consumer only
+*****************************************************************************/
+int byte_ring_get(struct byte_ring *ring, uint8_t *data)
+{
+	uint32_t tail = ring->tail;
+	if(ring->head == tail) return -1;
+
+	BYTE_RING_BARRIER();
+	*data = ring->buffer[tail & ring->mask];
+	BYTE_RING_BARRIER();
+	ring->tail = tail + 1;
+	return 0;
+}
+
+/**************************************************************************//**
+* @fn			uint32_t byte_ring_get_n(struct byte_ring *ring, uint8_t *data, uint32_t len)
+* @brief		Removes up to len of the oldest bytes from the ring
+* @return		Number of bytes copied to data
+* @note			Consumer only
+*****************************************************************************/
+uint32_t byte_ring_get_n(struct byte_ring *ring, uint8_t *data, uint32_t len)
+{
+	uint32_t tail = ring->tail;
+	uint32_t count = ring->head - tail;
+	if(len > count) len = count;
+	if(len == 0) return 0;
+
+	BYTE_RING_BARRIER();
+	uint32_t start = tail & ring->mask;
+	uint32_t first = byte_ring_capacity(ring) - start;
+	if(first > len) first = len;
+	memcpy(data, &ring->buffer[start], first);
+	memcpy(data + first, ring->buffer, len - first);
+
+	BYTE_RING_BARRIER();
+	ring->tail = tail + len;
+	return len;
+}
+
+/**************************************************************************//**
+* @fn			uint32_t byte_ring_peek_contiguous(const struct byte_ring *ring, uint8_t **data)
+* @brief		Looks at the oldest bytes without removing them
+* @details		Used to hand the ring to a DMA channel or a usart job without a copy. Remove the bytes with
+*				byte_ring_skip once they are used.
+* @param[out]	data Points at the oldest byte
+* @return		Number of bytes stored in one piece from the oldest one (they stop at the end of the storage)
+* @note			Consumer only
+*****************************************************************************/
+uint32_t byte_ring_peek_contiguous(const struct byte_ring *ring, uint8_t **data)
+{
+	uint32_t tail = ring->tail;
+	uint32_t count = ring->head - tail;
+	uint32_t start = tail & ring->mask;
+	uint32_t first = byte_ring_capacity(ring) - start;
+
+	BYTE_RING_BARRIER();
+	*data = &ring->buffer[start];
+	return (count < first) ? count : first;
+}
+
+/**************************************************************************//**
+* @fn			void byte_ring_skip(struct byte_ring *ring, uint32_t len)
+* @brief		Removes len of the oldest bytes from the ring
+* @note			Consumer only. len must not be more than byte_ring_count.
+*****************************************************************************/
+void byte_ring_skip(struct byte_ring *ring, uint32_t len)
+{
+	BYTE_RING_BARRIER();
+	ring->tail += len;
+}
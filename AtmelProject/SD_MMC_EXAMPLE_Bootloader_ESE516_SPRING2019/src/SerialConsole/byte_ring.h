@@ -0,0 +1,80 @@
+/**************************************************************************//**
+* @file        byte_ring.h
+* @ingroup 	   Serial Console
+* @brief       Single-producer/single-consumer byte ring used by the Serial Console
+* @details     The storage is given by the caller (a static array) and its size must be a power of two, so an index
+*				is wrapped with a mask instead of a division. The head and tail are free-running counters: only the
+*				producer writes the head and only the consumer writes the tail, so one side can be an interrupt and
+*				the other a task without any lock. Bytes that do not fit are dropped and counted.
+*
+*				Usage:
+*				static uint8_t storage[256];
+*				static struct byte_ring ring;
+*				byte_ring_init(&ring, storage, sizeof(storage));
+*
+*				If several tasks write to the same ring, they must be serialized by the caller (they are all the
+*				"single producer"). The same goes for several readers.
+*
+* @copyright
+* @author		Kenny Zhang and Chen Chen
+* @date        2021-05-14
+* @version		0.1
+*****************************************************************************/
+#ifndef BYTE_RING_H_
+#define BYTE_RING_H_
+
+#ifdef __cplusplus
+extern "C" {
+	#endif
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define BYTE_RING_IS_POW2(size)	(((size) != 0) && (((size) & ((size) - 1)) == 0))	///<True if size can be used as the storage size of a ring
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///Byte ring. Fields are private, use the functions below.
+struct byte_ring {
+	uint8_t *buffer;			///<Storage given at init
+	uint32_t mask;				///<Storage size - 1
+	volatile uint32_t head;		///<Number of bytes ever written. Only changed by the producer.
+	volatile uint32_t tail;		///<Number of bytes ever read. Only changed by the consumer.
+	volatile uint32_t overflow;	///<Number of bytes dropped because the ring was full. Only changed by the producer.
+};
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+bool byte_ring_init(struct byte_ring *ring, uint8_t *storage, uint32_t size);
+void byte_ring_reset(struct byte_ring *ring);
+
+uint32_t byte_ring_capacity(const struct byte_ring *ring);
+uint32_t byte_ring_count(const struct byte_ring *ring);
+uint32_t byte_ring_space(const struct byte_ring *ring);
+bool byte_ring_empty(const struct byte_ring *ring);
+bool byte_ring_full(const struct byte_ring *ring);
+uint32_t byte_ring_overflow(const struct byte_ring *ring);
+
+//Producer side
+int byte_ring_put(struct byte_ring *ring, uint8_t data);
+uint32_t byte_ring_put_n(struct byte_ring *ring, const uint8_t *data, uint32_t len);
+
+//Consumer side
+int byte_ring_get(struct byte_ring *ring, uint8_t *data);
+uint32_t byte_ring_get_n(struct byte_ring *ring, uint8_t *data, uint32_t len);
+uint32_t byte_ring_peek_contiguous(const struct byte_ring *ring, uint8_t **data);
+void byte_ring_skip(struct byte_ring *ring, uint32_t len);
+
+#ifdef __cplusplus
+}
+	#endif
+
+#endif //BYTE_RING_H_
@@ -281,6 +281,20 @@ void nm_bsp_register_isr(tpfNmBspIsr pfIsr);
 void nm_bsp_interrupt_ctrl(uint8 u8Enable);
   /**@}*/
 
+#ifdef __FREERTOS__
+/*!
+ * @fn           void nm_bsp_wait_for_event(uint32);
+ * @brief        Blocks the calling task until the WINC interrupt fires or the timeout expires
+ *				 Call m2m_wifi_handle_events afterwards to process whatever the interrupt signalled. An interrupt that
+ *				 fired since the last call makes it return at once, so none is lost between the two calls.
+ * @param [in]   u32TimeoutMsec
+ *               Longest time to block, in milliseconds
+ * @note         Only one task may wait for WINC events (the one that calls m2m_wifi_handle_events).
+ * @return       None
+ */
+void nm_bsp_wait_for_event(uint32 u32TimeoutMsec);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
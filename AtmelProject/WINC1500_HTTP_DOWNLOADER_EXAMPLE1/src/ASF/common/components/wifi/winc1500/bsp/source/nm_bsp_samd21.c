@@ -39,12 +39,22 @@
 #include "conf_winc.h"
 
 static tpfNmBspIsr gpfIsr;
+#ifdef __FREERTOS__
+static TaskHandle_t gxEventTask = NULL;	/* Task blocked in nm_bsp_wait_for_event */
+#endif
 
 static void chip_isr(void)
 {
 	if (gpfIsr) {
 		gpfIsr();
 	}
+#ifdef __FREERTOS__
+	if (gxEventTask) {
+		BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+		vTaskNotifyGiveFromISR(gxEventTask, &xHigherPriorityTaskWoken);
+		portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+	}
+#endif
 }
 
 /*
@@ -139,6 +149,20 @@ void nm_bsp_sleep(uint32 u32TimeMsec)
 #endif
 }
 
+#ifdef __FREERTOS__
+/*
+ *	@fn		nm_bsp_wait_for_event
+ *	@brief	Block the calling task until the WINC interrupt fires
+ *	@param[IN]	u32TimeoutMsec
+ *				Longest time to block, in milliseconds
+ */
+void nm_bsp_wait_for_event(uint32 u32TimeoutMsec)
+{
+	gxEventTask = xTaskGetCurrentTaskHandle();
+	ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(u32TimeoutMsec));
+}
+#endif
+
 /*
  *	@fn		nm_bsp_register_isr
  *	@brief	Register interrupt service routine
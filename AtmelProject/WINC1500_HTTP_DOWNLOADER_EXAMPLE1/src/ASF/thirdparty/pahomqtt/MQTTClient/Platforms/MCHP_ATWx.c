@@ -21,23 +21,50 @@
 #include "MQTTClient/Wrapper/mqtt.h"
 #include "driver/include/m2m_wifi.h"
 #include "socket/include/socket.h"
+#include "bsp/include/nm_bsp.h"
 #include "string.h"
 
 #define IPV4_BYTE(val,index) 	((val >> (index * 8)) & 0xFF)
 #define MQTT_RX_POOL_SIZE		256
+#define MQTT_EVENT_POLL_MS		100		/* Longest sleep between two m2m_wifi_handle_events calls, in case an interrupt edge is missed */
+#define MQTT_DNS_TIMEOUT_MS		10000	/* Time allowed for the broker name to resolve */
+#define MQTT_CONNECT_TIMEOUT_MS	15000	/* Time allowed for the broker socket to connect (TLS handshake included) */
+#define MQTT_WAIT_FOREVER		(-1)
+#define MQTT_IO_MARGIN_MS		2000	/* Added to the timeout of a read or write, for the WINC to report the result itself */
 
 static unsigned long MilliTimer=0;
 static int32_t gi32MQTTBrokerIp=0;
 static int32_t gi32MQTTBrokerRxLen=0;
-static bool gbMQTTBrokerIpresolved=false;
-static bool gbMQTTBrokerConnected=false;
-static bool gbMQTTBrokerSendDone=false;
-static bool gbMQTTBrokerRecvDone=false;
+static volatile bool gbMQTTBrokerIpresolved=false;
+static volatile bool gbMQTTBrokerConnected=false;
+static volatile bool gbMQTTBrokerSendDone=false;
+static volatile bool gbMQTTBrokerRecvDone=false;
 static unsigned char gcMQTTRxFIFO[MQTT_RX_POOL_SIZE];
 static uint32_t gu32MQTTRxFIFOPtr=0;
 static uint32_t gu32MQTTRxFIFOLen=0;
 static char *gpcHostAddr;
 
+/* Processes WINC events until *pbFlag is set by a callback or timeout_ms expires (MQTT_WAIT_FOREVER for no limit).
+ * Between two passes the task sleeps until the WINC interrupt fires instead of spinning on the HIF. */
+static bool WINC1500_wait_for_flag(volatile bool *pbFlag, int timeout_ms)
+{
+	Timer timer;
+	if(timeout_ms != MQTT_WAIT_FOREVER) TimerCountdownMS(&timer, timeout_ms);
+
+	m2m_wifi_handle_events(NULL);
+	while(false == *pbFlag){
+		uint32_t sleep_ms = MQTT_EVENT_POLL_MS;
+		if(timeout_ms != MQTT_WAIT_FOREVER){
+			int left_ms = TimerLeftMS(&timer);
+			if(left_ms <= 0) return false;
+			if((uint32_t)left_ms < sleep_ms) sleep_ms = left_ms;
+		}
+		nm_bsp_wait_for_event(sleep_ms);
+		m2m_wifi_handle_events(NULL);
+	}
+	return true;
+}
+
 static bool isMQTTSocket(SOCKET sock)
 {
 	unsigned int cIdx;
@@ -158,9 +185,13 @@ static int WINC1500_read(Network* n, unsigned char* buffer, int len, int timeout
 		  #endif
 		  return -1;
 	  }
-	  //call handle_events until we get rx callback 
-	  while (false==gbMQTTBrokerRecvDone){
-		  m2m_wifi_handle_events(NULL);
+	  //sleep until we get rx callback. The WINC reports SOCK_ERR_TIMEOUT itself after timeout_ms.
+	  //The wait is still bounded: no callback comes once the socket is closed or the WiFi link dropped.
+	  if(!WINC1500_wait_for_flag(&gbMQTTBrokerRecvDone, timeout_ms + MQTT_IO_MARGIN_MS)){
+		  #ifdef MQTT_PLATFORM_DBG
+		  printf("ERROR >> recv callback timeout\r\n");
+		  #endif
+		  return -1;
 	  }
 	  
 	  //update current FIFO length
@@ -212,9 +243,12 @@ static int WINC1500_write(Network* n, unsigned char* buffer, int len, int timeou
 	  #endif
 	  return -1;
   }
-  //wait for send callback
-  while (false==gbMQTTBrokerSendDone){
-	  m2m_wifi_handle_events(NULL);
+  //wait for send callback, bounded in case the socket is closed or the WiFi link dropped
+  if(!WINC1500_wait_for_flag(&gbMQTTBrokerSendDone, timeout_ms + MQTT_IO_MARGIN_MS)){
+	  #ifdef MQTT_PLATFORM_DBG
+	  printf("ERROR >> send callback timeout\r\n");
+	  #endif
+	  return -1;
   }
   
   #ifdef MQTT_PLATFORM_DBG
@@ -254,8 +288,11 @@ int ConnectNetwork(Network* n, char* addr, int port, int TLSFlag){
   gethostbyname((uint8*)addr);
  
   //wait for resolver callback
-  while (false==gbMQTTBrokerIpresolved){
-	  m2m_wifi_handle_events(NULL);
+  if (!WINC1500_wait_for_flag(&gbMQTTBrokerIpresolved, MQTT_DNS_TIMEOUT_MS)){
+   #ifdef MQTT_PLATFORM_DBG
+   printf("ERROR >> could not resolve %s.\r\n", addr);
+   #endif
+   return SOCK_ERR_TIMEOUT;
   }
   
   n->hostIP = gi32MQTTBrokerIp;
@@ -290,8 +327,13 @@ int ConnectNetwork(Network* n, char* addr, int port, int TLSFlag){
   gbMQTTBrokerConnected = false;
   
   /*wait for SOCKET_MSG_CONNECT event */
-  while(false==gbMQTTBrokerConnected){
-    m2m_wifi_handle_events(NULL);
+  if (!WINC1500_wait_for_flag(&gbMQTTBrokerConnected, MQTT_CONNECT_TIMEOUT_MS)){
+   #ifdef MQTT_PLATFORM_DBG
+   printf("ERROR >> connect timeout.\r\n");
+   #endif
+   close(n->socket);
+   n->socket = -1;
+   return SOCK_ERR_TIMEOUT;
   }
   
   /* Success */
@@ -59,6 +59,17 @@ static const CLI_Command_Definition_t xNeotrellisProcessButtonCommand =
 	0
 };
 
+static const CLI_Command_Definition_t xLogLevelCommand =
+{
+	"log",
+	"log [module][level]: Sets a module log level (0-5)\r\n",
+	(const pdCOMMAND_LINE_CALLBACK)CLI_SetLogLevel,
+	2
+};
+
+///Names of the log modules for the "log" command, in eLogModules order
+static const char * const pcLogModuleNames[N_LOG_MODULES] = {"wifi", "i2c", "ui", "control", "cli", "boot"};
+
 
 
 //Clear screen command
@@ -92,6 +103,7 @@ FreeRTOS_CLIRegisterCommand( &xClearScreen );
 FreeRTOS_CLIRegisterCommand( &xResetCommand );
 FreeRTOS_CLIRegisterCommand( &xNeotrellisTurnLEDCommand );
 FreeRTOS_CLIRegisterCommand( &xNeotrellisProcessButtonCommand );
+FreeRTOS_CLIRegisterCommand( &xLogLevelCommand );
 
 uint8_t cRxedChar[2], cInputIndex = 0;
 BaseType_t xMoreDataToFollow;
@@ -112,11 +124,12 @@ static uint8_t pcEscapeCodePos = 0;
     for( ;; )
     {
         /* This implementation reads a single character at a time.  Wait in the
-        Blocked state until a character is received. */
-        int recv = SerialConsoleReadCharacter(&cRxedChar);
-		if(recv == -1) //If no characters in the buffer, thread goes to sleep for a while
+        Blocked state until a character is received. The RX interrupt wakes the
+        thread, and a pasted burst is read without sleeping in between. */
+        int recv = SerialConsoleWaitCharacter(&cRxedChar[0], portMAX_DELAY);
+		if(recv == -1) //Only if the wait was cut short, nothing to process
 		{
-			vTaskDelay( CLI_TASK_DELAY);
+			continue;
 		}else if( cRxedChar[0] == '\n' || cRxedChar[0] == '\r'  )
         {
             /* A newline character was received, so the input command string is
@@ -133,6 +146,8 @@ static uint8_t pcEscapeCodePos = 0;
             explanation of why this is. */
             do
             {
+				//A command that writes no reply must not send the last one again
+				pcOutputString[0] = 0;
                 /* Send the command string to the command interpreter.  Any
                 output generated by the command interpreter will be placed in the
                 pcOutputString buffer. */
@@ -221,8 +236,9 @@ static uint8_t pcEscapeCodePos = 0;
                 /* A character was entered.  It was not a new line, backspace
                 or carriage return, so it is accepted as part of the input and
                 placed into the input buffer.  When a n is entered the complete
-                string will be passed to the command interpreter. */
-                if( cInputIndex < MAX_INPUT_LENGTH_CLI )
+                string will be passed to the command interpreter. The last byte
+                is kept for the terminator, the interpreter reads up to it. */
+                if( cInputIndex < MAX_INPUT_LENGTH_CLI - 1 )
                 {
                     pcInputString[ cInputIndex ] = cRxedChar[0];
                     cInputIndex++;
@@ -364,4 +380,46 @@ BaseType_t CLI_NeotrellProcessButtonBuffer( int8_t *pcWriteBuffer,size_t xWriteB
 
 
 
+/**************************************************************************//**
+BaseType_t CLI_SetLogLevel( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString )
+* @brief	CLI command to set the run time log level of one module, or the global level with "all"
+			Modules: wifi, i2c, ui, control, cli, boot. Levels: 0 info, 1 debug, 2 warning, 3 error, 4 fatal, 5 off.
+* @param[out] *pcWriteBuffer. Buffer we can use to write the CLI command response to!
+* @param[in] xWriteBufferLen. How much we can write into the buffer
+* @param[in] *pcCommandString. Buffer that contains the complete input: module name and level number
+* @return		Returns pdFALSE if the CLI command finished.
+* @note         Messages below the build time level of a module (LOG_BUILD_LEVEL_*) stay off whatever the level set here.
+*****************************************************************************/
+BaseType_t CLI_SetLogLevel( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString )
+{
+	BaseType_t moduleLength, levelLength;
+	const char *module = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &moduleLength);
+	const char *level = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 2, &levelLength);
+
+	if(module == NULL || level == NULL || levelLength != 1 || level[0] < '0' || level[0] > ('0' + LOG_OFF_LVL))
+	{
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Level must be 0 to %d\r\n", LOG_OFF_LVL);
+		return pdFALSE;
+	}
+	enum eDebugLogLevels debugLevel = (enum eDebugLogLevels)(level[0] - '0');
+
+	if(moduleLength == 3 && strncmp(module, "all", 3) == 0)
+	{
+		setLogLevel(debugLevel);
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "all: level %d\r\n", debugLevel);
+		return pdFALSE;
+	}
+
+	for(uint8_t i = 0; i < N_LOG_MODULES; i++)
+	{
+		if(strlen(pcLogModuleNames[i]) == (size_t)moduleLength && strncmp(module, pcLogModuleNames[i], moduleLength) == 0)
+		{
+			setLogModuleLevel((enum eLogModules)i, debugLevel);
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "%s: level %d\r\n", pcLogModuleNames[i], debugLevel);
+			return pdFALSE;
+		}
+	}
 
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Unknown module\r\n");
+	return pdFALSE;
+}
@@ -15,7 +15,6 @@
 
 #define CLI_TASK_SIZE	200		///<STUDENT FILL
 #define CLI_PRIORITY (configMAX_PRIORITIES - 1) ///<STUDENT FILL
-#define CLI_TASK_DELAY 150	///STUDENT FILL
 
 #define MAX_INPUT_LENGTH_CLI    15	//STUDENT FILL
 #define MAX_OUTPUT_LENGTH_CLI   50	//STUDENT FILL
@@ -48,4 +47,5 @@ BaseType_t CLI_ResetDevice( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const i
 BaseType_t CLI_SendDummyGameData( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString );
 BaseType_t CLI_OLEDdrawCircle( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString );
 BaseType_t CLI_ClearOLED( char *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString );
+BaseType_t CLI_SetLogLevel( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString );
 BaseType_t CLI_OLEDwriteChar( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString );
\ No newline at end of file
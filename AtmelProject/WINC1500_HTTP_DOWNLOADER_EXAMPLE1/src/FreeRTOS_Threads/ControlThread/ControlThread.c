@@ -19,7 +19,7 @@
 #include "stdio_serial.h"
 #include "SerialConsole.h"
 #include "shtc3.h"
-#include "OLED_driver/OLED_driver.h"
+#include "FreeRTOS_Threads/OLEDThread/OLEDThread.h"
 /******************************************************************************
 * Defines
 ******************************************************************************/
@@ -32,10 +32,13 @@ QueueHandle_t xQueueRgbColorBuffer = NULL; ///<Queue to receive an LED Color pac
 QueueHandle_t xQueueStatusBuffer = NULL; ///<Queue to send the distance to the cloud
 
 controlStateMachine_state controlState; ///<Holds the current state of the control thread
+static TaskHandle_t controlTaskHandle = NULL; ///<Handle of the control task, notified with CONTROL_EVENT_* bits
 GAME_STATUS gameStatus;
 /******************************************************************************
 * Forward Declarations
 ******************************************************************************/
+static void ControlNotify(uint32_t event);
+static void ControlShowScreen(oledScreen_t screen);
 
 /******************************************************************************
 * Callback Functions
@@ -52,7 +55,10 @@ GAME_STATUS gameStatus;
 * @brief	Control thread which is a finite state machine for controlState to control the status of the game. 
 * @details 	The default state is CONTROL_WAIT_FOR_STATUS, which waits for queue receive of status from WiFi.
 			When the status shows its my turn, this thread enters CONTROL_WAIT_FOR_GAME, which ask for data from queue of game packet.
-			After receiving game packet, this thread enters CONTROL_PLAYING_MOVE, and waits for user to press.		 				
+			After receiving game packet, this thread enters CONTROL_PLAYING_MOVE, and waits for user to press.
+			The thread blocks until it is notified with a CONTROL_EVENT_* bit. Each state only reads its own queue, so data
+			that arrives early stays queued until the state that wants it is reached. The thread only sleeps after a pass
+			that consumed nothing and did not change state.
 * @param[in]	Parameters passed when task is initialized. In this case we can ignore them!
 * @return		Should not return! This is a task defining function.
 * @note         
@@ -60,6 +66,7 @@ GAME_STATUS gameStatus;
 void vControlHandlerTask( void *pvParameters )
 {
 	SerialConsoleWriteString("ESE516 - Control Init Code\r\n");
+	controlTaskHandle = xTaskGetCurrentTaskHandle();
 
 	//Initialize Queues
 	xQueueGameBufferIn = xQueueCreate( 2, sizeof( struct GameDataPacket ) );
@@ -72,22 +79,26 @@ void vControlHandlerTask( void *pvParameters )
 	controlState = CONTROL_WAIT_FOR_STATUS; //Initial state
 	
 	uint8_t gamestatus;
+	uint32_t events;
 	while(1)
 	{
+		controlStateMachine_state lastState = controlState;
+		bool consumed = false; //Set when this pass took something out of a queue or the UI
 		switch(controlState)
 		{
 			case (CONTROL_WAIT_FOR_STATUS):
 			{	//Should set the UI to ignore button presses and should wait until there is a message from the server with a new play.
 					
-				if (pdPASS == xQueueReceive( xQueueStatusBuffer , &gamestatus, 10 ))
+				if (pdPASS == xQueueReceive( xQueueStatusBuffer , &gamestatus, 0 ))
 				{
+					consumed = true;
 					switch (gamestatus){
 						case P2_turn:{
 							#ifdef PLAYER1
-								MicroOLEDdrawWait();
+								ControlShowScreen(OLED_SCREEN_WAIT);
 								controlState = CONTROL_WAIT_FOR_STATUS;
 							#else
-								MicroOLEDdrawWait();
+								ControlShowScreen(OLED_SCREEN_WAIT);
 								controlState = CONTROL_WAIT_FOR_GAME;
 							#endif
 							break;							
@@ -95,10 +106,10 @@ void vControlHandlerTask( void *pvParameters )
 						case P1_turn:{	// OLED PRINT YOUR TURN
 							#ifdef PLAYER1
 								//start to receive MQTT msg from P2
-								MicroOLEDdrawWait();
+								ControlShowScreen(OLED_SCREEN_WAIT);
 								controlState = CONTROL_WAIT_FOR_GAME;
 							#else
-								MicroOLEDdrawWait();
+								ControlShowScreen(OLED_SCREEN_WAIT);
 								controlState = CONTROL_WAIT_FOR_STATUS;
 							#endif
 							break;
@@ -106,10 +117,10 @@ void vControlHandlerTask( void *pvParameters )
 						case P1_Lose:{
 							#ifdef PLAYER1
 							//OLED Display Lose
-							MicroOLEDdrawLoser();
+							ControlShowScreen(OLED_SCREEN_LOSER);
 							#else
 							//OLED Display Win
-							MicroOLEDdrawWinner();
+							ControlShowScreen(OLED_SCREEN_WINNER);
 							#endif			
 							controlState = CONTROL_END_GAME;
 							break;
@@ -117,10 +128,10 @@ void vControlHandlerTask( void *pvParameters )
 						case P2_Lose:{
 							#ifdef PLAYER1
 							//OLED Display Win
-							MicroOLEDdrawWinner();
+							ControlShowScreen(OLED_SCREEN_WINNER);
 							#else
 							//OLED Display Lose
-							MicroOLEDdrawLoser();
+							ControlShowScreen(OLED_SCREEN_LOSER);
 							#endif
 							controlState = CONTROL_END_GAME;
 							break;
@@ -131,6 +142,7 @@ void vControlHandlerTask( void *pvParameters )
 						}
 					}
 				}
+				break;
 			}
 
 			
@@ -140,10 +152,11 @@ void vControlHandlerTask( void *pvParameters )
 			case (CONTROL_WAIT_FOR_GAME):
 			{	//Should set the UI to ignore button presses and should wait until there is a message from the server with a new play.
 				struct GameDataPacket gamePacketIn;
-				if(pdPASS == xQueueReceive( xQueueGameBufferIn , &gamePacketIn, 10 ))
+				if(pdPASS == xQueueReceive( xQueueGameBufferIn , &gamePacketIn, 0 ))
 				{
-					LogMessage(LOG_DEBUG_LVL, "Control Thread: Consumed game packet!\r\n");
-					MicroOLEDdrawTurns();
+					consumed = true;
+					LogControl(LOG_DEBUG_LVL, "Control Thread: Consumed game packet!\r\n");
+					ControlShowScreen(OLED_SCREEN_TURNS);
 					UiOrderShowMoves(&gamePacketIn);
 					controlState = CONTROL_PLAYING_MOVE;
 				}
@@ -158,10 +171,11 @@ void vControlHandlerTask( void *pvParameters )
 				//after posting the game to MQTT
 				if(UiPlayIsDone() == true)
 				{
+					consumed = true;
 					//Send back local game packet
 					if( pdTRUE != WifiAddGameDataToQueue(UiGetGamePacketOut()))
 					{
-						LogMessage(LOG_DEBUG_LVL, "Control Thread: Could not send game packet!\r\n");
+						LogControl(LOG_DEBUG_LVL, "Control Thread: Could not send game packet!\r\n");
 					}
 					controlState = CONTROL_WAIT_FOR_STATUS;
 				}
@@ -177,7 +191,12 @@ void vControlHandlerTask( void *pvParameters )
 			default:
 				controlState = CONTROL_WAIT_FOR_STATUS;
 		}
-	vTaskDelay(5);
+
+		//Nothing left to do in this state: sleep until a producer posts an event
+		if(!consumed && controlState == lastState)
+		{
+			xTaskNotifyWait(0, CONTROL_EVENT_ALL, &events, portMAX_DELAY);
+		}
 	}
 }
 
@@ -195,6 +214,7 @@ int ControlAddGameData(struct GameDataPacket *gameIn);
 int ControlAddGameData(struct GameDataPacket *gameIn)
 {
 	int error = xQueueSend(xQueueGameBufferIn , gameIn, ( TickType_t ) 10);
+	if(pdTRUE == error) ControlNotify(CONTROL_EVENT_GAME);
 	return error;
 }
 
@@ -210,5 +230,42 @@ void WifiAddImuDataToQueue(struct ImuDataPacket* imuPacket)
 int ControlAddStatusDataToQueue(uint8_t *statusdada)
 {
 	int error = xQueueSend(xQueueStatusBuffer , statusdada, ( TickType_t ) 10);
+	if(pdTRUE == error) ControlNotify(CONTROL_EVENT_STATUS);
 	return error;
-}
\ No newline at end of file
+}
+
+/**************************************************************************//**
+void ControlNotifyPlayDone(void)
+* @brief	Tells the control thread that the UI has the player's move ready (see UiPlayIsDone)
+* @note		Called by the UI thread
+*****************************************************************************/
+void ControlNotifyPlayDone(void)
+{
+	ControlNotify(CONTROL_EVENT_UI_DONE);
+}
+
+/**************************************************************************//**
+static void ControlNotify(uint32_t event)
+* @brief	Sets an event bit in the control thread notification value, waking it up
+* @param[in]	event One or more CONTROL_EVENT_* bits
+*****************************************************************************/
+static void ControlNotify(uint32_t event)
+{
+	if(controlTaskHandle != NULL)
+	{
+		xTaskNotify(controlTaskHandle, event, eSetBits);
+	}
+}
+
+/**************************************************************************//**
+static void ControlShowScreen(oledScreen_t screen)
+* @brief	Posts a game screen to the OLED render thread, logging it if the post fails
+* @param[in]	screen Screen to show
+*****************************************************************************/
+static void ControlShowScreen(oledScreen_t screen)
+{
+	if(pdTRUE != OledPostScreen(screen))
+	{
+		LogControl(LOG_DEBUG_LVL, "Control Thread: Could not post screen %d to the OLED!\r\n", screen);
+	}
+}
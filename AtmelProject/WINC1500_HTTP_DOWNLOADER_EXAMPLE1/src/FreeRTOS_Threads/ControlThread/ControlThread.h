@@ -23,6 +23,11 @@ extern "C" {
 #define CONTROL_TASK_SIZE			256//<Size of stack to assign to the UI thread. In words
 #define CONTROL_TASK_PRIORITY		(configMAX_PRIORITIES - 1)
 
+#define CONTROL_EVENT_STATUS		(1UL << 0)	///<Notification bit: a game status was added to the status queue
+#define CONTROL_EVENT_GAME			(1UL << 1)	///<Notification bit: a game packet was added to the game queue
+#define CONTROL_EVENT_UI_DONE		(1UL << 2)	///<Notification bit: the UI has the player's move ready
+#define CONTROL_EVENT_ALL			(CONTROL_EVENT_STATUS | CONTROL_EVENT_GAME | CONTROL_EVENT_UI_DONE)
+
 /******************************************************************************
 * Structures and Enumerations
 ******************************************************************************/
@@ -54,6 +59,7 @@ typedef enum GAME_STATUS
 void vControlHandlerTask( void *pvParameters );
 int ControlAddGameData(struct GameDataPacket *gameIn);
 int ControlAddStatusDataToQueue(uint8_t *statusdada);
+void ControlNotifyPlayDone(void);
 	 #ifdef __cplusplus
  }
  #endif
\ No newline at end of file
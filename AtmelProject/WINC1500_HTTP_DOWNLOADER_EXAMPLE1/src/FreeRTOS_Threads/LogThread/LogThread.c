@@ -0,0 +1,140 @@
+/**************************************************************************//**
+* @file      LogThread.c
+* @brief     Deferred logging: call sites queue a format string and its arguments, a low priority thread prints them
+* @details   LogDeferred copies the address of the format string and up to LOG_MAX_ARGS 32-bit arguments into a
+			 fixed size record of a ring. The caller does not run vsnprintf and does not touch the console, so
+			 logging from the WiFi callbacks no longer slows down the download or the MQTT handling. The log thread
+			 runs at the lowest application priority, formats the records in order into its own buffer and writes
+			 them to the console. The ring has several producers (any task), so a record is reserved and filled
+			 with interrupts masked for a few instructions. The log thread is the only consumer and needs no lock.
+			 When the ring is full, new messages are dropped and counted, and the log thread reports the count.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdio.h>
+#include "LogThread.h"
+#include "task.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///One queued message
+struct LogRecord
+{
+	const char *format;				///<Format string. A literal, so it is still valid when printed.
+	uint32_t args[LOG_MAX_ARGS];	///<Arguments, unused ones are 0
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+static struct LogRecord logRecords[LOG_QUEUE_DEPTH];	///<Ring of queued messages
+static volatile uint32_t logHead = 0;		///<Number of messages ever queued. Changed with interrupts masked.
+static volatile uint32_t logTail = 0;		///<Number of messages ever printed. Only changed by the log thread.
+static volatile uint32_t logDropped = 0;	///<Number of messages dropped because the ring was full
+static TaskHandle_t logTaskHandle = NULL;	///<Log thread, woken when a message is queued in an empty ring
+static char logLine[LOG_LINE_SIZE];			///<Formatted message. Only used by the log thread.
+
+/******************************************************************************
+* Task Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		void vLogTask( void *pvParameters )
+* @brief	Prints the queued messages
+* @details 	Prints until the ring is empty, then sleeps until LogDeferredPost queues a message in an empty ring.
+* @param[in]	Parameters passed when task is initialized. In this case we can ignore them!
+* @return		Should not return! This is a task defining function.
+* @note
+*****************************************************************************/
+void vLogTask( void *pvParameters )
+{
+	struct LogRecord record;
+	uint32_t reportedDropped = 0;
+
+	logTaskHandle = xTaskGetCurrentTaskHandle();
+
+	for(;;)
+	{
+		while(logTail != logHead)
+		{
+			record = logRecords[logTail & (LOG_QUEUE_DEPTH - 1)];
+			logTail++;	//The record is copied, its slot can be reused
+
+			snprintf(logLine, LOG_LINE_SIZE, record.format, record.args[0], record.args[1], record.args[2], record.args[3]);
+			SerialConsoleWriteString(logLine);
+		}
+
+		if(logDropped != reportedDropped)
+		{
+			snprintf(logLine, LOG_LINE_SIZE, "[%lu log messages dropped]\r\n", (unsigned long)(logDropped - reportedDropped));
+			reportedDropped = logDropped;
+			SerialConsoleWriteString(logLine);
+		}
+
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	}
+}
+
+/******************************************************************************
+* Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		void LogDeferredPost(enum eDebugLogLevels level, const char *format, const uint32_t *args)
+* @brief	Queues a message for the log thread. Use through the LogDeferred macro.
+* @param[in]	level Level of the message. Nothing is queued if it is below the current log level.
+* @param[in]	format Format string. Must stay valid until printed, so a literal.
+* @param[in]	args LOG_MAX_ARGS arguments of the format string
+* @note		Call from tasks only. If the ring is full, the message is dropped and counted.
+*****************************************************************************/
+void LogDeferredPost(enum eDebugLogLevels level, const char *format, const uint32_t *args)
+{
+	struct LogRecord *record;
+	bool wasEmpty;
+
+	if(getLogLevel() > level) return;
+
+	taskENTER_CRITICAL();
+	uint32_t head = logHead;
+	if(head - logTail >= LOG_QUEUE_DEPTH)
+	{
+		logDropped++;
+		taskEXIT_CRITICAL();
+		return;
+	}
+
+	record = &logRecords[head & (LOG_QUEUE_DEPTH - 1)];
+	record->format = format;
+	for(uint8_t i = 0; i < LOG_MAX_ARGS; i++)
+	{
+		record->args[i] = args[i];
+	}
+	wasEmpty = (head == logTail);
+	logHead = head + 1;
+	taskEXIT_CRITICAL();
+
+	//If the ring was not empty, the log thread is awake or already has a notification pending
+	if(wasEmpty && logTaskHandle != NULL)
+	{
+		xTaskNotifyGive(logTaskHandle);
+	}
+}
+
+/**************************************************************************//**
+* @fn		uint32_t LogDeferredDropped(void)
+* @brief	Returns the number of deferred messages dropped because the ring was full
+*****************************************************************************/
+uint32_t LogDeferredDropped(void)
+{
+	return logDropped;
+}
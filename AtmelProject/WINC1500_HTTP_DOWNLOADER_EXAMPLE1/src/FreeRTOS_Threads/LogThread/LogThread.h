@@ -0,0 +1,61 @@
+/**************************************************************************//**
+* @file      LogThread.h
+* @brief     Deferred logging: call sites queue a format string and its arguments, a low priority thread prints them
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdint.h>
+#include "asf.h"
+#include "SerialConsole/SerialConsole.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define LOG_TASK_PRIORITY	(configMAX_PRIORITIES - 4)	///<Lowest application priority, so messages are only formatted when the other threads are idle
+#define LOG_TASK_SIZE		160		///<Size of stack to assign to the log thread. In words. Mostly used by snprintf.
+#define LOG_QUEUE_DEPTH		32		///<Number of messages that can wait to be printed. Must be a power of two.
+#define LOG_MAX_ARGS		4		///<Maximum number of arguments of a deferred message
+#define LOG_LINE_SIZE		128		///<Longest printed message, like LogMessage
+
+#if (LOG_QUEUE_DEPTH & (LOG_QUEUE_DEPTH - 1)) != 0
+#error "LOG_QUEUE_DEPTH must be a power of two"
+#endif
+
+/**
+ * Queues a message to be printed by the log thread, instead of formatting it in the caller like LogMessage.
+ * Costs a level check and a copy of the arguments. Takes up to LOG_MAX_ARGS arguments of at most 32 bits
+ * (integers and characters: no %s, %f or %ll, since the data could be gone by the time it is printed).
+ * format must be a string literal. Call from tasks only, not from interrupts.
+ * Messages are printed in the order they were queued, but after any LogMessage output done in the meantime.
+ */
+#define LogDeferred(level, ...)	LOG_DEFERRED_POST((level), __VA_ARGS__, 0)
+
+///Helper of LogDeferred. The 0 it appends keeps the argument list from being empty for a message without arguments.
+#define LOG_DEFERRED_POST(level, format, ...)	\
+	LogDeferredPost((level), (format), (const uint32_t[LOG_MAX_ARGS + 1]){ __VA_ARGS__ })
+
+///Same as LogDeferred, filtered by the build time and run time levels of a module (see LogModule)
+#define LogModuleDeferred(module, level, ...)	\
+	do { if(LOG_ENABLED(module, level)) LogDeferred((level), __VA_ARGS__); } while(0)
+
+#define LogWifiDeferred(level, ...)	LogModuleDeferred(WIFI, level, __VA_ARGS__)	///<Deferred WiFi, HTTP download or MQTT message
+
+/******************************************************************************
+* Global Function Declaration
+******************************************************************************/
+void vLogTask( void *pvParameters );
+void LogDeferredPost(enum eDebugLogLevels level, const char *format, const uint32_t *args);
+uint32_t LogDeferredDropped(void);
+
+#ifdef __cplusplus
+}
+#endif
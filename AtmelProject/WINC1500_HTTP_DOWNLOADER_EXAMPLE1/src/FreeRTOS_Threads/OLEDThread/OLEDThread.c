@@ -1,6 +1,9 @@
 /**************************************************************************//**
-* @file      OLED.c
-* @brief     File for OLED witting Characters
+* @file      OLEDThread.c
+* @brief     Render thread that owns the OLED screen buffer
+* @details   Other threads never touch the OLED driver directly. They post a screen, a text or an invalidate
+			 request and return at once. This thread draws the requests into the screen buffer and flushes it
+			 at most once every OLED_FRAME_PERIOD_MS, so a burst of requests costs a single I2C transfer.
 * @author    Chen Chen
 * @date      2021-05-11
 
@@ -10,11 +13,12 @@
 /******************************************************************************
 * Includes
 ******************************************************************************/
+#include <string.h>
 #include "OLEDThread.h"
-#include "LightSensor_Driver/VEML6030.h"
 #include "SerialConsole/SerialConsole.h"
-#include "stdio.h"
-#include "FreeRTOS_Threads/UiHandlerThread/UiHandlerThread.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
 /******************************************************************************
 * Defines
 ******************************************************************************/
@@ -22,48 +26,186 @@
 /******************************************************************************
 * Variables
 ******************************************************************************/
+static QueueHandle_t xQueueOledScreen = NULL;	///<Mailbox (length 1) holding the latest screen request. Newer requests overwrite older ones.
+static QueueHandle_t xQueueOledCommand = NULL;	///<Queue of text and invalidate commands
+static SemaphoreHandle_t xSemaphoreOledWake = NULL;	///<Given by every post to wake the render thread. Binary, so a burst of posts wakes it once.
 
 /******************************************************************************
 * Forward Declarations
 ******************************************************************************/
+static void OledWakeRenderTask(void);
+static void OledHandleCommand(struct OledCommand *command);
 
 /******************************************************************************
-* Callback Functions
+* Task Functions
 ******************************************************************************/
 
+/**************************************************************************//**
+* @fn		int OledThreadInit(void)
+* @brief	Creates the queues of the render thread
+* @details 	Must be called from main before the scheduler starts, so the queues exist before any thread can post
+			to them, whatever order the threads start in.
+* @return		Returns pdPASS if everything was created, pdFAIL otherwise
+* @note
+*****************************************************************************/
+int OledThreadInit(void)
+{
+	xQueueOledScreen = xQueueCreate( 1, sizeof( oledScreen_t ) );
+	xQueueOledCommand = xQueueCreate( OLED_CMD_QUEUE_SIZE, sizeof( struct OledCommand ) );
+	xSemaphoreOledWake = xSemaphoreCreateBinary();
+	if(xQueueOledScreen == NULL || xQueueOledCommand == NULL || xSemaphoreOledWake == NULL){
+		return pdFAIL;
+	}
+	return pdPASS;
+}
 
+/**************************************************************************//**
+* @fn		void vOledRenderTask( void *pvParameters )
+* @brief	Render thread for the OLED
+* @details 	Sleeps until a request is posted, applies every pending request to the screen buffer,
+			flushes the dirty part of the buffer and then waits one frame period before looking again.
+			The queues are created by OledThreadInit.
+* @param[in]	Parameters passed when task is initialized. In this case we can ignore them!
+* @return		Should not return! This is a task defining function.
+* @note
+*****************************************************************************/
+void vOledRenderTask( void *pvParameters )
+{
+	struct OledCommand command;
+	oledScreen_t screen;
 
+	if(xSemaphoreOledWake == NULL){
+		SerialConsoleWriteString("ERROR OLED queues not initialized!\r\n");
+		vTaskSuspend(NULL);
+	}
 
-void vLightReadTask( void *pvParameters )
+	for( ;; )
+	{
+		xSemaphoreTake(xSemaphoreOledWake, portMAX_DELAY);
+
+		//Screens replace the whole buffer, so only the latest one matters. Text is drawn on top of it.
+		if(pdPASS == xQueueReceive(xQueueOledScreen, &screen, 0)){
+			MicroOLEDloadScreen(screen);
+		}
+		while(pdPASS == xQueueReceive(xQueueOledCommand, &command, 0)){
+			OledHandleCommand(&command);
+		}
+
+		if(ERROR_NONE != MicroOLEDdisplay()){
+			LogUi(LOG_DEBUG_LVL, "OLED Thread: Could not flush screen!\r\n");
+			xSemaphoreGive(xSemaphoreOledWake); //Dirty pages are kept, retry on the next frame
+		}
+
+		vTaskDelay(OLED_FRAME_PERIOD_MS);
+	}
+}
+
+/******************************************************************************
+* Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		int OledPostScreen(oledScreen_t screen)
+* @brief	Asks the render thread to show one of the game screens
+* @details 	Never blocks. If several screens are posted within a frame, only the last one is drawn.
+* @param[in]	screen Screen to show
+* @return		Returns pdTRUE if the request was posted, pdFALSE if the screen is invalid or OledThreadInit failed
+* @note
+*****************************************************************************/
+int OledPostScreen(oledScreen_t screen)
 {
+	if(xQueueOledScreen == NULL || screen >= OLED_SCREEN_MAX) return pdFALSE;
+	xQueueOverwrite(xQueueOledScreen, &screen);
+	OledWakeRenderTask();
+	return pdTRUE;
+}
 
-/* The input and output buffers are declared static to keep them off the stack. */
-uint32_t lightdata = 0;
-VEML_Reset();
-delay_ms(100);
-/* Send a welcome message to the user knows they are connected. */
-VEML_Power_On();
-for( ;; )
+/**************************************************************************//**
+* @fn		int OledPostText(uint8_t x, uint8_t y, const char *text)
+* @brief	Asks the render thread to draw a string on the screen
+* @details 	Never blocks. Text longer than OLED_TEXT_SIZE is cut.
+* @param[in]	x Column of the first character
+* @param[in]	y Row of the first character
+* @param[in]	text Null terminated string to draw
+* @return		Returns pdTRUE if the request was posted, pdFALSE if the command queue is full
+* @note
+*****************************************************************************/
+int OledPostText(uint8_t x, uint8_t y, const char *text)
 {
-VEML_Power_On();
-// After starting sensor, wait 200ms to collect data
-vTaskDelay(200);
-VEML_ReadALSData(&lightdata);
-
-uint8_t R = lightdata/10;
-uint8_t G = lightdata/20;
-uint8_t B = 255 - lightdata/10;
-UIChangeColors(R,G,B);
-//SerialConsoleWriteString("Light!\r\n");
-// 		SerialConsoleWriteString(sensormsg);
-// 		vTaskDelay(500);
-// 		VEML_Power_Saving();
-// 		vTaskDelay(500);
-// 		VEML_Read_Power_Saving(&powersaving);
-// 		snprintf(sensormsg, 15, "Power saving:%d\r\n", powersaving);
-//		SerialConsoleWriteString(sensormsg);
-VEML_Power_Off();
-
-vTaskDelay(4000);
+	struct OledCommand command;
+	if(xQueueOledCommand == NULL || text == NULL) return pdFALSE;
+
+	command.type = OLED_CMD_TEXT;
+	command.x = x;
+	command.y = y;
+	strncpy(command.text, text, OLED_TEXT_SIZE);
+	command.text[OLED_TEXT_SIZE] = 0;
+
+	int error = xQueueSend(xQueueOledCommand, &command, 0);
+	OledWakeRenderTask();
+	return error;
+}
+
+/**************************************************************************//**
+* @fn		int OledPostInvalidate(void)
+* @brief	Asks the render thread to resend the whole screen on the next frame
+* @details 	Never blocks.
+* @return		Returns pdTRUE if the request was posted, pdFALSE if the command queue is full
+* @note
+*****************************************************************************/
+int OledPostInvalidate(void)
+{
+	struct OledCommand command;
+	if(xQueueOledCommand == NULL) return pdFALSE;
+
+	command.type = OLED_CMD_INVALIDATE;
+	int error = xQueueSend(xQueueOledCommand, &command, 0);
+	OledWakeRenderTask();
+	return error;
+}
+
+/**************************************************************************//**
+* @fn		static void OledWakeRenderTask(void)
+* @brief	Wakes the render thread up
+* @details 	The semaphore is binary, so several posts within a frame wake the thread once.
+* @return
+* @note
+*****************************************************************************/
+static void OledWakeRenderTask(void)
+{
+	if(xSemaphoreOledWake != NULL){
+		xSemaphoreGive(xSemaphoreOledWake);
+	}
+}
+
+/**************************************************************************//**
+* @fn		static void OledHandleCommand(struct OledCommand *command)
+* @brief	Applies one command to the screen buffer
+* @details 	Does not send anything to the OLED. The render thread flushes once all commands are applied.
+* @param[in]	command Command to apply
+* @return
+* @note
+*****************************************************************************/
+static void OledHandleCommand(struct OledCommand *command)
+{
+	switch(command->type)
+	{
+		case OLED_CMD_TEXT:
+		{
+			MicroOLEDsetCursor(command->x, command->y);
+			for(uint8_t i = 0; i < OLED_TEXT_SIZE && command->text[i] != 0; i++){
+				MicroOLEDwrite(command->text[i]);
+			}
+			break;
+		}
+
+		case OLED_CMD_INVALIDATE:
+		{
+			MicroOLEDinvalidate();
+			break;
+		}
+
+		default:
+			break;
+	}
 }
-}
\ No newline at end of file
@@ -1,6 +1,6 @@
 /**************************************************************************//**
-* @file      OLED.h
-* @brief
+* @file      OLEDThread.h
+* @brief     Render thread that owns the OLED screen buffer
 * @author    Chen Chen
 * @date      2021-04-15
 
@@ -15,22 +15,43 @@ extern "C" {
 * Includes
 ******************************************************************************/
 #include "FreeRTOS.h"
+#include "OLED_driver/OLED_driver.h"
 /******************************************************************************
 * Defines
 ******************************************************************************/
-#define LIGHTSENSOR_PRIORITY (configMAX_PRIORITIES - 4)
-#define LIGHT_TASK_SIZE	200
+#define OLED_TASK_PRIORITY (configMAX_PRIORITIES - 4)
+#define OLED_TASK_SIZE	200		///<Size of stack to assign to the OLED thread. In words
+#define OLED_FRAME_PERIOD_MS	100	///<Minimum time between two flushes of the screen buffer. Requests arriving in between are merged.
+#define OLED_CMD_QUEUE_SIZE	4	///<Number of text/invalidate commands that can wait for the next frame
+#define OLED_TEXT_SIZE	11	///<Maximum number of characters in one text command (a 64 pixel line fits 10 characters of the 5x7 font)
+
 /******************************************************************************
 * Structures and Enumerations
 ******************************************************************************/
+typedef enum oledCommandType
+{
+	OLED_CMD_TEXT = 0,		///<Draw a string on top of the current screen
+	OLED_CMD_INVALIDATE,	///<Resend the whole screen buffer on the next frame
+	OLED_CMD_MAX			///<Number of commands
+}oledCommandType;
 
-
+struct OledCommand
+{
+	uint8_t type;	///<One of oledCommandType
+	uint8_t x;		///<Column of the text cursor
+	uint8_t y;		///<Row of the text cursor
+	char text[OLED_TEXT_SIZE + 1];	///<Null terminated text
+};
 
 /******************************************************************************
 * Global Function Declaration
 ******************************************************************************/
-void vLightReadTask( void *pvParameters );
+int OledThreadInit(void);
+void vOledRenderTask( void *pvParameters );
+int OledPostScreen(oledScreen_t screen);
+int OledPostText(uint8_t x, uint8_t y, const char *text);
+int OledPostInvalidate(void);
 
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
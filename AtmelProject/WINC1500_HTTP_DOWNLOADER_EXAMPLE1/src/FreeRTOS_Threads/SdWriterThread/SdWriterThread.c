@@ -0,0 +1,334 @@
+/**************************************************************************//**
+* @file      SdWriterThread.c
+* @brief     Thread that writes downloaded data to the SD card while the next chunk is received
+* @details   The producer (the WiFi thread) copies received data into one of SD_WRITER_BUFFER_COUNT sector sized
+			 buffers. A full buffer is handed over to this thread, which writes it with f_write while the producer
+			 fills the next one, so the network is no longer stalled for every SD write. Buffers are passed by
+			 index through two queues: full buffers to this thread, written buffers back to the producer.
+			 Only one file is written at a time, and FatFs is only used by the producer while this thread is idle.
+			 A CRC32 of the written bytes is kept, so a partial file can be checked and continued later.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "SdWriterThread.h"
+#include "SerialConsole/SerialConsole.h"
+#include "task.h"
+#include "queue.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define SD_WRITER_NO_BUFFER	0xFF	///<sdFillIndex value when the producer holds no buffer
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///One write buffer
+struct SdWriterBuffer
+{
+	uint8_t data[SD_WRITER_BUFFER_SIZE] __attribute__((aligned(4)));	///<Data to write. Word aligned for the SPI transfer.
+	uint16_t len;	///<Number of bytes in data
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+static struct SdWriterBuffer sdBuffers[SD_WRITER_BUFFER_COUNT];	///<Write buffers
+static QueueHandle_t xQueueSdFull = NULL;	///<Indexes of the buffers waiting to be written
+static QueueHandle_t xQueueSdFree = NULL;	///<Indexes of the buffers the producer can fill
+static FIL sdFile;							///<File being written
+static bool sdFileOpen = false;				///<True between SdWriterBegin and SdWriterFinish
+static uint8_t sdFillIndex = SD_WRITER_NO_BUFFER;	///<Buffer the producer is filling. Only used by the producer.
+static volatile FRESULT sdWriterResult = FR_OK;	///<First error of the current file. Once set, nothing more is written.
+static volatile uint32_t sdBytesWritten = 0;	///<Bytes of the current file written to the card
+static crc32_t sdCrc = 0;					///<CRC32 of the bytes written to the card
+static uint32_t sdLastCheckpoint = 0;		///<Value of sdBytesWritten at the last checkpoint
+static SdWriterCheckpoint sdCheckpoint = NULL;	///<Hook told about every checkpoint of the current file
+
+/******************************************************************************
+* Forward Declarations
+******************************************************************************/
+static void SdWriterHandOver(void);
+static void SdWriterStart(uint32_t offset, crc32_t crc, SdWriterCheckpoint checkpoint);
+
+/******************************************************************************
+* Task Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		void vSdWriterTask( void *pvParameters )
+* @brief	Writes the buffers handed over by the producer to the open file
+* @details 	Sleeps on the queue of full buffers. Each buffer goes back to the producer once written, also when
+			the write failed, so the producer never waits forever.
+* @param[in]	Parameters passed when task is initialized. In this case we can ignore them!
+* @return		Should not return! This is a task defining function.
+* @note
+*****************************************************************************/
+void vSdWriterTask( void *pvParameters )
+{
+	uint8_t index;
+
+	xQueueSdFull = xQueueCreate( SD_WRITER_BUFFER_COUNT, sizeof( uint8_t ) );
+	xQueueSdFree = xQueueCreate( SD_WRITER_BUFFER_COUNT, sizeof( uint8_t ) );
+	if(xQueueSdFull == NULL || xQueueSdFree == NULL){
+		SerialConsoleWriteString("ERROR Initializing SD writer queues!\r\n");
+		vTaskSuspend(NULL);
+	}
+	for(index = 0; index < SD_WRITER_BUFFER_COUNT; index++){
+		xQueueSend(xQueueSdFree, &index, 0);
+	}
+
+	for( ;; )
+	{
+		xQueueReceive(xQueueSdFull, &index, portMAX_DELAY);
+
+		struct SdWriterBuffer *buffer = &sdBuffers[index];
+		if(sdWriterResult == FR_OK){
+			UINT written = 0;
+			FRESULT res = f_write(&sdFile, buffer->data, buffer->len, &written);
+			if(res == FR_OK && written != buffer->len){
+				res = FR_DENIED; //Card full
+			}
+			crc32_recalculate(buffer->data, written, &sdCrc);
+			sdBytesWritten += written;
+
+			//Make the data safe on the card every so often, so an interrupted file can be continued from there
+			if(res == FR_OK && sdCheckpoint != NULL && sdBytesWritten - sdLastCheckpoint >= SD_WRITER_CHECKPOINT_BYTES){
+				res = f_sync(&sdFile);
+				if(res == FR_OK){
+					sdLastCheckpoint = sdBytesWritten;
+					sdCheckpoint(sdBytesWritten, sdCrc);
+				}
+			}
+
+			if(res != FR_OK){
+				sdWriterResult = res;
+				LogWifi(LOG_DEBUG_LVL, "SD Writer: write error %d!\r\n", res);
+			}
+		}
+
+		buffer->len = 0;
+		xQueueSend(xQueueSdFree, &index, 0);
+	}
+}
+
+/******************************************************************************
+* Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		FRESULT SdWriterBegin(const char *path, SdWriterCheckpoint checkpoint)
+* @brief	Creates (or truncates) a file and gets the writer ready to receive its data
+* @param[in]	path Path of the file to write
+* @param[in]	checkpoint Hook called at every checkpoint of the file. May be NULL.
+* @return		FR_OK if the file is open, FR_NOT_READY if the writer is not running or already busy with a
+				file, the f_open error otherwise
+* @note		Producer side. Must not be called again before SdWriterFinish.
+*****************************************************************************/
+FRESULT SdWriterBegin(const char *path, SdWriterCheckpoint checkpoint)
+{
+	FRESULT res;
+	if(xQueueSdFree == NULL || sdFileOpen || path == NULL) return FR_NOT_READY;
+
+	res = f_open(&sdFile, path, FA_CREATE_ALWAYS | FA_WRITE);
+	if(res != FR_OK) return res;
+
+	SdWriterStart(0, 0, checkpoint);
+	return FR_OK;
+}
+
+/**************************************************************************//**
+* @fn		FRESULT SdWriterResume(const char *path, uint32_t offset, crc32_t crc, SdWriterCheckpoint checkpoint)
+* @brief	Opens a partial file and gets the writer ready to append to it at offset
+* @details 	The first offset bytes of the file are read back and must match crc. Anything after them is cut.
+* @param[in]	path Path of the partial file
+* @param[in]	offset Number of bytes of the file to keep
+* @param[in]	crc CRC32 of those bytes, as given to the checkpoint hook
+* @param[in]	checkpoint Hook called at every checkpoint of the file. May be NULL.
+* @return		FR_OK if the file is open, FR_INT_ERR if it is shorter than offset or its CRC does not match,
+				FR_NOT_READY if the writer is not running or busy, the FatFs error otherwise
+* @note		Producer side. Reads the whole partial file, so it takes a while for large files.
+*****************************************************************************/
+FRESULT SdWriterResume(const char *path, uint32_t offset, crc32_t crc, SdWriterCheckpoint checkpoint)
+{
+	FRESULT res;
+	crc32_t check = 0;
+	uint32_t left = offset;
+	UINT read;
+	if(xQueueSdFree == NULL || sdFileOpen || path == NULL) return FR_NOT_READY;
+
+	res = f_open(&sdFile, path, FA_OPEN_EXISTING | FA_READ | FA_WRITE);
+	if(res != FR_OK) return res;
+	if(f_size(&sdFile) < offset) res = FR_INT_ERR;
+
+	//The buffers are all free while no file is open, borrow one to read the file back
+	while(res == FR_OK && left > 0)
+	{
+		UINT chunk = (left > SD_WRITER_BUFFER_SIZE) ? SD_WRITER_BUFFER_SIZE : left;
+		res = f_read(&sdFile, sdBuffers[0].data, chunk, &read);
+		if(res == FR_OK && read != chunk) res = FR_INT_ERR;
+		if(res == FR_OK)
+		{
+			crc32_recalculate(sdBuffers[0].data, read, &check);
+			left -= read;
+		}
+	}
+	if(res == FR_OK && check != crc) res = FR_INT_ERR;
+
+	//The file pointer is now at offset: drop whatever came after the last checkpoint
+	if(res == FR_OK) res = f_truncate(&sdFile);
+	if(res != FR_OK)
+	{
+		f_close(&sdFile);
+		return res;
+	}
+
+	SdWriterStart(offset, crc, checkpoint);
+	return FR_OK;
+}
+
+/**************************************************************************//**
+* @fn		bool SdWriterAppend(const void *data, uint32_t length)
+* @brief	Copies data into the current buffer and hands every full buffer over to the writer thread
+* @details 	Only blocks when every buffer is waiting to be written, which paces the producer on the card.
+* @param[in]	data Data to append to the file
+* @param[in]	length Number of bytes in data
+* @return		false if the file is not open or a write already failed. The file must then be finished.
+* @note		Producer side
+*****************************************************************************/
+bool SdWriterAppend(const void *data, uint32_t length)
+{
+	const uint8_t *src = (const uint8_t *)data;
+	if(!sdFileOpen || (data == NULL && length != 0)) return false;
+
+	while(length > 0 && sdWriterResult == FR_OK)
+	{
+		if(sdFillIndex == SD_WRITER_NO_BUFFER && pdPASS != xQueueReceive(xQueueSdFree, &sdFillIndex, pdMS_TO_TICKS(SD_WRITER_WAIT_MS)))
+		{
+			sdFillIndex = SD_WRITER_NO_BUFFER;
+			sdWriterResult = FR_TIMEOUT;
+			break;
+		}
+
+		struct SdWriterBuffer *buffer = &sdBuffers[sdFillIndex];
+		uint32_t chunk = SD_WRITER_BUFFER_SIZE - buffer->len;
+		if(chunk > length) chunk = length;
+		memcpy(&buffer->data[buffer->len], src, chunk);
+		buffer->len += chunk;
+		src += chunk;
+		length -= chunk;
+
+		if(buffer->len == SD_WRITER_BUFFER_SIZE)
+		{
+			SdWriterHandOver();
+		}
+	}
+
+	return sdWriterResult == FR_OK;
+}
+
+/**************************************************************************//**
+* @fn		FRESULT SdWriterFinish(void)
+* @brief	Writes what is left, waits for the writer thread to be done and closes the file
+* @details 	If every byte reached the card, the checkpoint hook is called one last time with the full size.
+* @return		FR_OK if every byte reached the card, the first error otherwise
+* @note		Producer side. Also used to abandon a file: the file is closed in every case.
+*****************************************************************************/
+FRESULT SdWriterFinish(void)
+{
+	uint8_t index;
+	uint8_t collected = 0;
+	FRESULT res;
+	if(!sdFileOpen) return FR_NOT_READY;
+
+	if(sdFillIndex != SD_WRITER_NO_BUFFER)
+	{
+		if(sdBuffers[sdFillIndex].len > 0)
+		{
+			SdWriterHandOver();
+		}
+		else
+		{
+			xQueueSend(xQueueSdFree, &sdFillIndex, 0);
+			sdFillIndex = SD_WRITER_NO_BUFFER;
+		}
+	}
+
+	//Every buffer back in the free queue means every write is done
+	while(collected < SD_WRITER_BUFFER_COUNT)
+	{
+		xQueueReceive(xQueueSdFree, &index, portMAX_DELAY);
+		collected++;
+	}
+	for(index = 0; index < SD_WRITER_BUFFER_COUNT; index++)
+	{
+		xQueueSend(xQueueSdFree, &index, 0);
+	}
+
+	res = f_close(&sdFile);
+	sdFileOpen = false;
+	if(sdWriterResult != FR_OK) return sdWriterResult;
+
+	if(res == FR_OK && sdCheckpoint != NULL)
+	{
+		sdCheckpoint(sdBytesWritten, sdCrc);
+	}
+	return res;
+}
+
+/**************************************************************************//**
+* @fn		bool SdWriterIsOpen(void)
+* @brief	Returns true while a file is being written
+*****************************************************************************/
+bool SdWriterIsOpen(void)
+{
+	return sdFileOpen;
+}
+
+/**************************************************************************//**
+* @fn		uint32_t SdWriterBytesWritten(void)
+* @brief	Returns the number of bytes of the current file already written to the card
+*****************************************************************************/
+uint32_t SdWriterBytesWritten(void)
+{
+	return sdBytesWritten;
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		static void SdWriterStart(uint32_t offset, crc32_t crc, SdWriterCheckpoint checkpoint)
+* @brief	Resets the state of the writer for a file that was just opened
+* @param[in]	offset Number of bytes already in the file
+* @param[in]	crc CRC32 of those bytes
+* @param[in]	checkpoint Hook called at every checkpoint of the file
+*****************************************************************************/
+static void SdWriterStart(uint32_t offset, crc32_t crc, SdWriterCheckpoint checkpoint)
+{
+	sdWriterResult = FR_OK;
+	sdBytesWritten = offset;
+	sdCrc = crc;
+	sdLastCheckpoint = offset;
+	sdCheckpoint = checkpoint;
+	sdFillIndex = SD_WRITER_NO_BUFFER;
+	sdFileOpen = true;
+}
+
+/**************************************************************************//**
+* @fn		static void SdWriterHandOver(void)
+* @brief	Passes the buffer the producer is filling to the writer thread
+* @note		Never blocks: the full queue has room for every buffer
+*****************************************************************************/
+static void SdWriterHandOver(void)
+{
+	xQueueSend(xQueueSdFull, &sdFillIndex, 0);
+	sdFillIndex = SD_WRITER_NO_BUFFER;
+}
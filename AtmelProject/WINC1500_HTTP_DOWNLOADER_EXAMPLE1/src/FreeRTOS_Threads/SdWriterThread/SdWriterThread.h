@@ -0,0 +1,56 @@
+/**************************************************************************//**
+* @file      SdWriterThread.h
+* @brief     Thread that writes downloaded data to the SD card while the next chunk is received
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "asf.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define SD_WRITER_TASK_PRIORITY	(configMAX_PRIORITIES - 3)	///<Below the WiFi thread, so receiving preempts writing
+#define SD_WRITER_TASK_SIZE		256		///<Size of stack to assign to the SD writer thread. In words
+#define SD_WRITER_BUFFER_SIZE	1024	///<Size of one write buffer. Must be a multiple of the 512 byte sector.
+#define SD_WRITER_BUFFER_COUNT	2		///<Number of write buffers: one filled by the producer while the other is written
+#define SD_WRITER_WAIT_MS		2000	///<Longest wait of the producer for a free buffer before the write is failed
+#define SD_WRITER_CHECKPOINT_BYTES	(16 * 1024)	///<The file is synced and the checkpoint hook called every time this many bytes were written
+
+#if (SD_WRITER_BUFFER_SIZE % 512) != 0
+#error "SD_WRITER_BUFFER_SIZE must be a multiple of 512"
+#endif
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+/**
+ * Called with the number of bytes safely on the card and the CRC32 of those bytes. Runs in the writer thread
+ * after each periodic sync, and in the producer thread when a file is finished without error. May use FatFs.
+ */
+typedef void (*SdWriterCheckpoint)(uint32_t bytes, crc32_t crc);
+
+/******************************************************************************
+* Global Function Declaration
+******************************************************************************/
+void vSdWriterTask( void *pvParameters );
+FRESULT SdWriterBegin(const char *path, SdWriterCheckpoint checkpoint);
+FRESULT SdWriterResume(const char *path, uint32_t offset, crc32_t crc, SdWriterCheckpoint checkpoint);
+bool SdWriterAppend(const void *data, uint32_t length);
+FRESULT SdWriterFinish(void);
+bool SdWriterIsOpen(void);
+uint32_t SdWriterBytesWritten(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -13,6 +13,7 @@
 #include <errno.h>
 #include "asf.h"
 #include "FreeRTOS_Threads/UiHandlerThread/UiHandlerThread.h"
+#include "FreeRTOS_Threads/ControlThread/ControlThread.h"
 #include "SeesawDriver/Seesaw.h"
 #include "FreeRTOS_Threads/WifiHandlerThread/WifiHandler.h"
 #include "SerialConsole.h"
@@ -38,9 +39,14 @@ uint8_t pressedKeys = 0; ///<Variable to count how many presses the player has d
 uint8_t keysToPress = 0; ///<Variable that holds the number of new key presses the user should do
 bool playIsDone = false; ///<Boolean flag to indicate if the player has finished moving. Useful for COntrol to determine when to send back a play.
 uint8_t buttons[BUTTON_PRESSES_MAX]; ///<Array to hold button presses
+static TaskHandle_t uiTaskHandle = NULL; ///<Handle of the UI task, used to wake it up when the control thread gives it work
+static struct UiPlayback playback; ///<State of the move playback
 /******************************************************************************
 * Forward Declarations
 ******************************************************************************/
+static void UiPlaybackStart(void);
+static TickType_t UiPlaybackRun(void);
+static void UiDiscardKeypadEvents(void);
 
 /******************************************************************************
 * Callback Functions
@@ -65,10 +71,13 @@ void vUiHandlerTask( void *pvParameters )
 //Do initialization code here
 SerialConsoleWriteString("UI Task Started!");
 uiState = UI_STATE_IGNORE_PRESSES; //Initial state
+uiTaskHandle = xTaskGetCurrentTaskHandle();
+SeesawRegisterKeypadNotify(uiTaskHandle); //Keypad events wake us up instead of polling
 
 //Here we start the loop for the UI State Machine
 while(1)
 {
+	TickType_t waitTicks = UI_KEYPAD_POLL_MS; //Longest time to sleep at the end of this pass
 	switch(uiState)
 	{
 		case(UI_STATE_IGNORE_PRESSES):
@@ -76,41 +85,29 @@ while(1)
 			//Ignore any presses until we receive a command from the control thread to go to UI_STATE_SHOW_MOVES
 			//Will be changed by control with the function void UiOrderShowMoves(struct GameDataPacket *packetIn) which gets called when a valid
 			//MQTT Package comes in!
+			//The presses are still read out of the FIFO, otherwise INT stays low and the task never gets to sleep.
+			UiDiscardKeypadEvents();
 			break;
 		}
 
 		case(UI_STATE_SHOW_MOVES):
 		{
-			//Set initial state variable that will be used on the UI_STATE_Handle_Buttons and need to be initialized once
-			pressedKeys = 0; //Set number of keys pressed by player to 0.
-			memset(gamePacketOut.game,0xff, sizeof(gamePacketOut.game)); //Erase gamePacketOut to an initial state
-			playIsDone = false; //Set play to false
-			uint8_t presses = SeesawGetKeypadCount();
-			if(presses >= BUTTON_PRESSES_MAX) presses = BUTTON_PRESSES_MAX;
-			if(presses != 0) SeesawReadKeypad(buttons,presses); //Empty Seesaw buffer just in case it has latent presses on it!
-			memset(buttons, 0, BUTTON_PRESSES_MAX);
-			//Make this function show the moves of the gamePacketIn.
-			//You can use a static delay to show each move but a quicker delay as the message gets longer might be more fun!
-			//After you finish showing the move should go to state UI_STATE_HANDLE_BUTTONS
-			
-			for (int i =0; i < GAME_SIZE;i++)
+			//Show the moves of gamePacketIn one LED change at a time. The task never waits inside this state: it
+			//sleeps at the bottom of the loop until the next change is due, so it keeps reacting to notifications.
+			//Key presses during playback do not count and are thrown away.
+			if(!playback.active)
 			{
-				//quit if it reaches the end of the move
-				if (gamePacketIn.game[i]==0xff)
-				{
-					keysToPress = i+1;
-					break;
-				}
-				uint8_t keyToShow = gamePacketIn.game[i];
-				SeesawSetLed(keyToShow, red, green, blue); //Turn button 1 on
-				SeesawOrderLedUpdate();
-				vTaskDelay(2000);			
-				SeesawSetLed(keyToShow, 0, 0, 0); //Turn button 1 on
-				SeesawOrderLedUpdate();
+				UiPlaybackStart();
 			}
-			
-			uiState = UI_STATE_HANDLE_BUTTONS;
+			UiDiscardKeypadEvents();
+			waitTicks = UiPlaybackRun();
 
+			if(!playback.active)
+			{
+				//Done showing, the player can repeat the sequence now
+				uiState = UI_STATE_HANDLE_BUTTONS;
+				waitTicks = 0;
+			}
 			break;
 		}
 
@@ -157,6 +154,7 @@ while(1)
 			//Tell control gamePacketOut is ready to be send out AND go back to UI_STATE_IGNORE_PRESSES
 			playIsDone = true;
 			uiState = UI_STATE_IGNORE_PRESSES;
+			ControlNotifyPlayDone();
 		}
 
 
@@ -170,8 +168,13 @@ while(1)
 		break;
 	}
 
-	//After execution, you can put a thread to sleep for some time.
-	vTaskDelay(50);
+	//Sleep until the keypad interrupt, the control thread or the next playback step wakes us up. If the FIFO got new
+	//events while we were reading it, INT is still low and there will be no new edge, so go around again right away.
+	//Only the player's turn reads the FIFO to the end; the other states drain at most one batch, so they just sleep.
+	if(waitTicks != 0 && !(uiState == UI_STATE_HANDLE_BUTTONS && SeesawKeypadHasEvents()))
+	{
+		ulTaskNotifyTake(pdTRUE, waitTicks);
+	}
 }
 
 
@@ -194,8 +197,10 @@ while(1)
 *****************************************************************************/
 void UiOrderShowMoves(struct GameDataPacket *packetIn){
 	memcpy(&gamePacketIn, packetIn, sizeof(gamePacketIn));
+	playback.active = false; //Restart the playback with the new packet
 	uiState = UI_STATE_SHOW_MOVES;
 	playIsDone = false; //Set play to false
+	if(uiTaskHandle != NULL) xTaskNotifyGive(uiTaskHandle);
 }
 
 /**************************************************************************//**
@@ -234,4 +239,99 @@ void UIChangeColors(uint8_t r, uint8_t g, uint8_t b)
 	red = r;
 	green = g;
 	blue = b;
-}
\ No newline at end of file
+}
+
+
+/**************************************************************************//**
+* @fn		static void UiPlaybackStart(void)
+* @brief	Prepares the playback of gamePacketIn and the player's turn that follows it
+* @details 	The on and off times get shorter as the sequence grows, down to UI_PLAYBACK_ON_MIN_MS and
+			UI_PLAYBACK_OFF_MIN_MS. The first move is lit on the next call to UiPlaybackRun.
+* @note
+*****************************************************************************/
+static void UiPlaybackStart(void)
+{
+	uint32_t onMs, offMs, speedUp;
+
+	//Set initial state variable that will be used on the UI_STATE_Handle_Buttons and need to be initialized once
+	pressedKeys = 0; //Set number of keys pressed by player to 0.
+	memset(gamePacketOut.game, 0xff, sizeof(gamePacketOut.game)); //Erase gamePacketOut to an initial state
+	playIsDone = false; //Set play to false
+
+	playback.numMoves = 0;
+	while(playback.numMoves < GAME_SIZE && gamePacketIn.game[playback.numMoves] != 0xff)
+	{
+		playback.numMoves++;
+	}
+	keysToPress = playback.numMoves + 1; //Repeat the sequence and add a new move
+
+	speedUp = (playback.numMoves > 1) ? (playback.numMoves - 1) * UI_PLAYBACK_SPEEDUP_MS : 0;
+	onMs = (UI_PLAYBACK_ON_MS > UI_PLAYBACK_ON_MIN_MS + speedUp) ? UI_PLAYBACK_ON_MS - speedUp : UI_PLAYBACK_ON_MIN_MS;
+	offMs = (UI_PLAYBACK_OFF_MS > UI_PLAYBACK_OFF_MIN_MS + speedUp) ? UI_PLAYBACK_OFF_MS - speedUp : UI_PLAYBACK_OFF_MIN_MS;
+	playback.onTicks = pdMS_TO_TICKS(onMs);
+	playback.offTicks = pdMS_TO_TICKS(offMs);
+
+	//A packet that arrives mid-playback restarts it, maybe while a move is lit
+	if(playback.ledOn)
+	{
+		SeesawSetLed(playback.litKey, 0, 0, 0);
+	}
+
+	playback.step = 0;
+	playback.ledOn = false;
+	playback.nextTick = xTaskGetTickCount();
+	playback.active = true;
+}
+
+/**************************************************************************//**
+* @fn		static TickType_t UiPlaybackRun(void)
+* @brief	Applies every LED change of the playback that is due
+* @details 	Each move is lit for onTicks and followed by offTicks of darkness. Deadlines are kept in absolute
+			ticks, so a late wake up does not shift the rest of the sequence. Clears playback.active when the
+			last move has been shown.
+* @return	Number of ticks until the next change is due
+* @note
+*****************************************************************************/
+static TickType_t UiPlaybackRun(void)
+{
+	TickType_t now = xTaskGetTickCount();
+
+	while(playback.active && (TickType_t)(now - playback.nextTick) < portMAX_DELAY / 2)
+	{
+		if(playback.ledOn)
+		{
+			SeesawSetLed(playback.litKey, 0, 0, 0);
+			playback.ledOn = false;
+			playback.step++;
+			playback.nextTick += playback.offTicks;
+		}
+		else if(playback.step < playback.numMoves)
+		{
+			playback.litKey = gamePacketIn.game[playback.step];
+			SeesawSetLed(playback.litKey, red, green, blue);
+			playback.ledOn = true;
+			playback.nextTick += playback.onTicks;
+		}
+		else
+		{
+			playback.active = false;
+		}
+	}
+	SeesawCommitLeds();
+
+	return playback.active ? (TickType_t)(playback.nextTick - now) : 0;
+}
+
+/**************************************************************************//**
+* @fn		static void UiDiscardKeypadEvents(void)
+* @brief	Empties the Seesaw keypad FIFO without acting on the events
+* @details 	Used while the moves are shown, so presses made during the playback never count as moves.
+* @note
+*****************************************************************************/
+static void UiDiscardKeypadEvents(void)
+{
+	uint8_t presses = SeesawGetKeypadCount();
+	if(presses >= BUTTON_PRESSES_MAX) presses = BUTTON_PRESSES_MAX;
+	if(presses != 0) SeesawReadKeypad(buttons, presses);
+	memset(buttons, 0, BUTTON_PRESSES_MAX);
+}
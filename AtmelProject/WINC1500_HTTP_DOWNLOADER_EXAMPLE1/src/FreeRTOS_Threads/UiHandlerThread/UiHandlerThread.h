@@ -21,6 +21,14 @@ extern "C" {
 #define UI_TASK_SIZE			410//<Size of stack to assign to the UI thread. In words
 #define UI_TASK_PRIORITY		(configMAX_PRIORITIES - 2)
 
+#define UI_KEYPAD_POLL_MS		50		///<Longest time the UI sleeps between two keypad reads. With SEESAW_USE_INT_PIN the INT edge wakes it sooner.
+
+#define UI_PLAYBACK_ON_MS		1000	///<Time a move stays lit when the sequence has one move
+#define UI_PLAYBACK_OFF_MS		250		///<Dark gap between two moves when the sequence has one move
+#define UI_PLAYBACK_ON_MIN_MS	300		///<Shortest time a move stays lit, however long the sequence is
+#define UI_PLAYBACK_OFF_MIN_MS	100		///<Shortest dark gap between two moves
+#define UI_PLAYBACK_SPEEDUP_MS	50		///<On and off times shrink by this much for every extra move in the sequence
+
 /******************************************************************************
 * Structures and Enumerations
 ******************************************************************************/
@@ -33,6 +41,19 @@ typedef enum uiStateMachine_state
 
 }uiStateMachine_state;
 
+///Progress of the move playback in UI_STATE_SHOW_MOVES
+struct UiPlayback
+{
+	bool active;			///<Set once the playback of the current gamePacketIn has started
+	bool ledOn;				///<True while the current move is lit
+	uint8_t step;			///<Index of the move being shown
+	uint8_t litKey;			///<Key lit while ledOn. Kept apart from gamePacketIn, which a new packet can overwrite mid-playback.
+	uint8_t numMoves;		///<Number of moves in gamePacketIn
+	TickType_t onTicks;		///<Time each move stays lit for this sequence
+	TickType_t offTicks;	///<Dark gap between moves for this sequence
+	TickType_t nextTick;	///<Tick count at which the next LED change is due
+};
+
 /******************************************************************************
 * Global Function Declaration
 ******************************************************************************/
@@ -0,0 +1,133 @@
+/**************************************************************************//**
+* @file      DownloadJournal.c
+* @brief     Small record on the SD card that lets an interrupted HTTP download continue where it stopped
+* @details   The journal holds the URL, the name and total size of the file, how many bytes are safely on the
+			 card and their CRC32. It is rewritten at every checkpoint of the SD writer and removed once the
+			 download is complete. The record carries a magic number and its own CRC32, so a journal torn by a
+			 reset is ignored rather than trusted.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stddef.h>
+#include <string.h>
+#include "FreeRTOS_Threads/WifiHandlerThread/DownloadJournal.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define DOWNLOAD_JOURNAL_MAGIC	0x4A524E31	///<"JRN1"
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///Journal as stored on the card
+struct DownloadJournalRecord
+{
+	uint32_t magic;					///<DOWNLOAD_JOURNAL_MAGIC
+	struct DownloadJournal journal;	///<Journal
+	crc32_t check;					///<CRC32 of magic and journal
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+static FIL journalFile;						///<Journal file. Kept off the stacks of the callers.
+static struct DownloadJournalRecord journalRecord;	///<Record being read or written
+
+/******************************************************************************
+* Forward Declarations
+******************************************************************************/
+static void DownloadJournalPath(char *path);
+
+/******************************************************************************
+* Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		bool DownloadJournalLoad(struct DownloadJournal *journal)
+* @brief	Reads the journal of the download in progress
+* @param[out]	journal Journal read from the card. Only valid if the function returns true.
+* @return		true if there is a valid journal
+* @note		Must not run while the SD writer thread has a file open
+*****************************************************************************/
+bool DownloadJournalLoad(struct DownloadJournal *journal)
+{
+	char path[] = DOWNLOAD_JOURNAL_FILE;
+	UINT read = 0;
+	crc32_t check;
+	FRESULT res;
+	if(journal == NULL) return false;
+
+	DownloadJournalPath(path);
+	res = f_open(&journalFile, path, FA_OPEN_EXISTING | FA_READ);
+	if(res != FR_OK) return false;
+	res = f_read(&journalFile, &journalRecord, sizeof(journalRecord), &read);
+	f_close(&journalFile);
+	if(res != FR_OK || read != sizeof(journalRecord) || journalRecord.magic != DOWNLOAD_JOURNAL_MAGIC) return false;
+
+	crc32_calculate(&journalRecord, offsetof(struct DownloadJournalRecord, check), &check);
+	if(check != journalRecord.check) return false;
+
+	//Strings come from the card, make sure they end
+	journalRecord.journal.url[DOWNLOAD_JOURNAL_URL_SIZE - 1] = 0;
+	journalRecord.journal.file[DOWNLOAD_JOURNAL_NAME_SIZE - 1] = 0;
+	*journal = journalRecord.journal;
+	return true;
+}
+
+/**************************************************************************//**
+* @fn		FRESULT DownloadJournalSave(const struct DownloadJournal *journal)
+* @brief	Replaces the journal on the card
+* @param[in]	journal Journal to write
+* @return		FR_OK if the journal was written, the FatFs error otherwise
+* @note		Called from the SD writer thread at each checkpoint, otherwise only while no file is open
+*****************************************************************************/
+FRESULT DownloadJournalSave(const struct DownloadJournal *journal)
+{
+	char path[] = DOWNLOAD_JOURNAL_FILE;
+	UINT written = 0;
+	FRESULT res;
+	if(journal == NULL) return FR_INVALID_OBJECT;
+
+	journalRecord.magic = DOWNLOAD_JOURNAL_MAGIC;
+	journalRecord.journal = *journal;
+	crc32_calculate(&journalRecord, offsetof(struct DownloadJournalRecord, check), &journalRecord.check);
+
+	DownloadJournalPath(path);
+	res = f_open(&journalFile, path, FA_CREATE_ALWAYS | FA_WRITE);
+	if(res != FR_OK) return res;
+	res = f_write(&journalFile, &journalRecord, sizeof(journalRecord), &written);
+	if(res == FR_OK && written != sizeof(journalRecord)) res = FR_DENIED;
+	if(f_close(&journalFile) != FR_OK && res == FR_OK) res = FR_DISK_ERR;
+	return res;
+}
+
+/**************************************************************************//**
+* @fn		void DownloadJournalClear(void)
+* @brief	Removes the journal, so the next download starts from the beginning
+* @note		Must not run while the SD writer thread has a file open
+*****************************************************************************/
+void DownloadJournalClear(void)
+{
+	char path[] = DOWNLOAD_JOURNAL_FILE;
+	DownloadJournalPath(path);
+	f_unlink(path);
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		static void DownloadJournalPath(char *path)
+* @brief	Puts the drive number of the SD card in front of the journal path
+*****************************************************************************/
+static void DownloadJournalPath(char *path)
+{
+	path[0] = LUN_ID_SD_MMC_0_MEM + '0';
+}
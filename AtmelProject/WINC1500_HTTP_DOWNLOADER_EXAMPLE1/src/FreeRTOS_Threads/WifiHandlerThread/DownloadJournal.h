@@ -0,0 +1,49 @@
+/**************************************************************************//**
+* @file      DownloadJournal.h
+* @brief     Small record on the SD card that lets an interrupted HTTP download continue where it stopped
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "asf.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define DOWNLOAD_JOURNAL_FILE		"0:Download.jrn"	///<Journal file. The first character is replaced by the drive number.
+#define DOWNLOAD_JOURNAL_URL_SIZE	96	///<Longest URL the journal can hold, NUL included
+#define DOWNLOAD_JOURNAL_NAME_SIZE	65	///<Longest file name the journal can hold, NUL included
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///State of the download that is in progress
+struct DownloadJournal
+{
+	char url[DOWNLOAD_JOURNAL_URL_SIZE];		///<URL the file comes from
+	char file[DOWNLOAD_JOURNAL_NAME_SIZE];		///<Path of the partial file on the SD card
+	uint32_t length;		///<Total size of the file, from the Content-Length of the first response
+	uint32_t committed;		///<Bytes of the file safely on the card
+	crc32_t crc;			///<CRC32 of the committed bytes
+};
+
+/******************************************************************************
+* Global Function Declaration
+******************************************************************************/
+bool DownloadJournalLoad(struct DownloadJournal *journal);
+FRESULT DownloadJournalSave(const struct DownloadJournal *journal);
+void DownloadJournalClear(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,103 @@
+/**************************************************************************//**
+* @file      DownloadManifest.c
+* @brief     Manifest of the firmware image: the size and CRC32 the downloaded file must have
+* @details   The manifest is a short text file next to the image: the size in decimal and the CRC32 in 8 hex
+			 digits, separated by spaces, optionally followed by a line end. It is fetched before the image, which
+			 is then refused early if its Content-Length differs, and deleted if the bytes that reached the card
+			 do not have the size and CRC32 of the manifest.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "FreeRTOS_Threads/WifiHandlerThread/DownloadManifest.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define DOWNLOAD_MANIFEST_SIZE_DIGITS	9	///<Most digits of the size, so it cannot overflow
+#define DOWNLOAD_MANIFEST_CRC_DIGITS	8	///<Hex digits of the CRC32
+
+/******************************************************************************
+* Forward Declarations
+******************************************************************************/
+static int DownloadManifestHexDigit(char c);
+
+/******************************************************************************
+* Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		bool DownloadManifestParse(const char *text, uint32_t length, struct DownloadManifest *manifest)
+* @brief	Parses the manifest text
+* @param[in]	text Manifest text. Does not need to be NUL terminated.
+* @param[in]	length Length of the text
+* @param[out]	manifest Size and CRC32 of the image. Only set if the function returns true.
+* @return		true if the manifest is well formed and the size is not 0
+* @note		A truncated manifest is refused: the CRC32 must have all its digits and nothing but spaces and a line
+*			end may follow it.
+*****************************************************************************/
+bool DownloadManifestParse(const char *text, uint32_t length, struct DownloadManifest *manifest)
+{
+	uint32_t pos = 0, size = 0, crc = 0;
+	uint8_t digits = 0;
+
+	while(pos < length && text[pos] == ' ') pos++;
+	for(; pos < length && text[pos] >= '0' && text[pos] <= '9'; pos++, digits++)
+	{
+		if(digits == DOWNLOAD_MANIFEST_SIZE_DIGITS) return false;
+		size = size * 10 + (text[pos] - '0');
+	}
+	if(digits == 0 || pos >= length || text[pos] != ' ') return false;
+
+	while(pos < length && text[pos] == ' ') pos++;
+	for(digits = 0; pos < length && DownloadManifestHexDigit(text[pos]) >= 0; pos++, digits++)
+	{
+		if(digits == DOWNLOAD_MANIFEST_CRC_DIGITS) return false;
+		crc = (crc << 4) | (uint32_t)DownloadManifestHexDigit(text[pos]);
+	}
+	if(digits != DOWNLOAD_MANIFEST_CRC_DIGITS || size == 0) return false;
+
+	for(; pos < length; pos++)
+	{
+		if(text[pos] != ' ' && text[pos] != '\r' && text[pos] != '\n') return false;
+	}
+
+	manifest->size = size;
+	manifest->crc = crc;
+	return true;
+}
+
+/**************************************************************************//**
+* @fn		bool DownloadManifestMatches(const struct DownloadManifest *manifest, uint32_t size, crc32_t crc)
+* @brief	Checks a downloaded image against the manifest
+* @param[in]	manifest Manifest of the image
+* @param[in]	size Bytes of the image on the card
+* @param[in]	crc CRC32 of those bytes
+* @return		true if the image has the size and CRC32 of the manifest
+* @note
+*****************************************************************************/
+bool DownloadManifestMatches(const struct DownloadManifest *manifest, uint32_t size, crc32_t crc)
+{
+	return size == manifest->size && crc == manifest->crc;
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		static int DownloadManifestHexDigit(char c)
+* @brief	Value of a hex digit, either case
+* @return	Value of the digit, -1 if c is not one
+*****************************************************************************/
+static int DownloadManifestHexDigit(char c)
+{
+	if(c >= '0' && c <= '9') return c - '0';
+	if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
@@ -0,0 +1,38 @@
+/**************************************************************************//**
+* @file      DownloadManifest.h
+* @brief     Manifest of the firmware image: the size and CRC32 the downloaded file must have
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "asf.h"
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///What the image must look like
+struct DownloadManifest
+{
+	uint32_t size;		///<Size of the image in bytes
+	crc32_t crc;		///<CRC32 of the whole image
+};
+
+/******************************************************************************
+* Global Function Declaration
+******************************************************************************/
+bool DownloadManifestParse(const char *text, uint32_t length, struct DownloadManifest *manifest);
+bool DownloadManifestMatches(const struct DownloadManifest *manifest, uint32_t size, crc32_t crc);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,234 @@
+/**************************************************************************//**
+* @file      GameCodec.c
+* @brief     Encoder and decoder for the game and status MQTT payloads
+* @details   Game payloads look like {"game":[1,5,12]} and status payloads like status:2. Both directions work in a
+			 single pass over caller buffers with explicit lengths: nothing is allocated, payloads do not need to be
+			 NUL terminated and no libc formatting or parsing is used.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-13
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "FreeRTOS_Threads/WifiHandlerThread/GameCodec.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define GAME_CODEC_EMPTY_MOVE	0xFF	///<Value that marks the end of the moves in a GameDataPacket
+
+/******************************************************************************
+* Forward Declarations
+******************************************************************************/
+static size_t GameCodecPutString(const char *str, char *out, size_t pos, size_t outSize);
+static size_t GameCodecPutNumber(uint8_t value, char *out, size_t pos, size_t outSize);
+static bool GameCodecGetNumber(const char *payload, size_t len, size_t *pos, uint8_t *value);
+static void GameCodecSkipSpaces(const char *payload, size_t len, size_t *pos);
+static bool GameCodecMatch(const char *payload, size_t len, size_t *pos, const char *str);
+
+/******************************************************************************
+* Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		size_t GameCodecEncodeGame(const struct GameDataPacket *game, char *out, size_t outSize)
+* @brief	Writes a game packet as {"game":[a,b,...]}
+* @details 	Moves are written up to the first 0xFF. The output is NUL terminated.
+* @param[in]	game Game packet to encode
+* @param[out]	out Buffer to write to. GAME_CODEC_MAX_GAME_LEN + 1 bytes always fit.
+* @param[in]	outSize Size of the out buffer
+* @return		Number of characters written (without the NUL), 0 if the buffer is too small
+* @note
+*****************************************************************************/
+size_t GameCodecEncodeGame(const struct GameDataPacket *game, char *out, size_t outSize)
+{
+	size_t pos = 0;
+	if(game == NULL || out == NULL) return 0;
+
+	pos = GameCodecPutString(GAME_CODEC_GAME_PREFIX, out, pos, outSize);
+	for(uint8_t iter = 0; iter < GAME_SIZE && pos != 0; iter++)
+	{
+		if(game->game[iter] == GAME_CODEC_EMPTY_MOVE) break;
+		if(iter != 0) pos = GameCodecPutString(",", out, pos, outSize);
+		if(pos != 0) pos = GameCodecPutNumber(game->game[iter], out, pos, outSize);
+	}
+	if(pos != 0) pos = GameCodecPutString("]}", out, pos, outSize);
+
+	if(pos == 0 || pos >= outSize) return 0; //No room for the terminator
+	out[pos] = 0;
+	return pos;
+}
+
+/**************************************************************************//**
+* @fn		bool GameCodecDecodeGame(const char *payload, size_t len, struct GameDataPacket *game)
+* @brief	Parses a {"game":[a,b,...]} payload in place
+* @details 	Spaces are allowed around numbers and brackets. Unused moves are set to 0xFF. Moves after the
+			first GAME_SIZE are ignored.
+* @param[in]	payload Payload to parse. Does not need to be NUL terminated.
+* @param[in]	len Number of bytes in payload
+* @param[out]	game Parsed game packet. Only valid if the function returns true.
+* @return		true if the payload is a well formed game message
+* @note
+*****************************************************************************/
+bool GameCodecDecodeGame(const char *payload, size_t len, struct GameDataPacket *game)
+{
+	size_t pos = 0;
+	uint8_t nb = 0;
+	uint8_t value;
+	if(payload == NULL || game == NULL) return false;
+
+	memset(game->game, GAME_CODEC_EMPTY_MOVE, sizeof(game->game));
+	GameCodecSkipSpaces(payload, len, &pos);
+	if(!GameCodecMatch(payload, len, &pos, GAME_CODEC_GAME_PREFIX)) return false;
+	GameCodecSkipSpaces(payload, len, &pos);
+
+	//Empty game
+	if(GameCodecMatch(payload, len, &pos, "]")) goto close;
+
+	while(1)
+	{
+		GameCodecSkipSpaces(payload, len, &pos);
+		if(!GameCodecGetNumber(payload, len, &pos, &value)) return false;
+		if(nb < GAME_SIZE) game->game[nb++] = value;
+		GameCodecSkipSpaces(payload, len, &pos);
+		if(GameCodecMatch(payload, len, &pos, "]")) break;
+		if(!GameCodecMatch(payload, len, &pos, ",")) return false;
+	}
+
+close:
+	GameCodecSkipSpaces(payload, len, &pos);
+	return GameCodecMatch(payload, len, &pos, "}");
+}
+
+/**************************************************************************//**
+* @fn		size_t GameCodecEncodeStatus(uint8_t status, char *out, size_t outSize)
+* @brief	Writes a status as status:N
+* @param[in]	status Status to encode (see GAME_STATUS)
+* @param[out]	out Buffer to write to. GAME_CODEC_MAX_STATUS_LEN + 1 bytes always fit.
+* @param[in]	outSize Size of the out buffer
+* @return		Number of characters written (without the NUL), 0 if the buffer is too small
+* @note
+*****************************************************************************/
+size_t GameCodecEncodeStatus(uint8_t status, char *out, size_t outSize)
+{
+	size_t pos = 0;
+	if(out == NULL) return 0;
+
+	pos = GameCodecPutString(GAME_CODEC_STATUS_PREFIX, out, pos, outSize);
+	if(pos != 0) pos = GameCodecPutNumber(status, out, pos, outSize);
+
+	if(pos == 0 || pos >= outSize) return 0;
+	out[pos] = 0;
+	return pos;
+}
+
+/**************************************************************************//**
+* @fn		bool GameCodecDecodeStatus(const char *payload, size_t len, uint8_t *status)
+* @brief	Parses a status:N payload in place
+* @param[in]	payload Payload to parse. Does not need to be NUL terminated.
+* @param[in]	len Number of bytes in payload
+* @param[out]	status Parsed status. Only valid if the function returns true.
+* @return		true if the payload is a well formed status message
+* @note		Anything after the number is ignored, as the broker may append a line ending.
+*****************************************************************************/
+bool GameCodecDecodeStatus(const char *payload, size_t len, uint8_t *status)
+{
+	size_t pos = 0;
+	if(payload == NULL || status == NULL) return false;
+
+	if(!GameCodecMatch(payload, len, &pos, GAME_CODEC_STATUS_PREFIX)) return false;
+	GameCodecSkipSpaces(payload, len, &pos);
+	return GameCodecGetNumber(payload, len, &pos, status);
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		static size_t GameCodecPutString(const char *str, char *out, size_t pos, size_t outSize)
+* @brief	Appends a NUL terminated string at out[pos]
+* @return	New position, 0 if it does not fit
+*****************************************************************************/
+static size_t GameCodecPutString(const char *str, char *out, size_t pos, size_t outSize)
+{
+	while(*str)
+	{
+		if(pos >= outSize) return 0;
+		out[pos++] = *str++;
+	}
+	return pos;
+}
+
+/**************************************************************************//**
+* @fn		static size_t GameCodecPutNumber(uint8_t value, char *out, size_t pos, size_t outSize)
+* @brief	Appends a number in decimal at out[pos]
+* @return	New position, 0 if it does not fit
+*****************************************************************************/
+static size_t GameCodecPutNumber(uint8_t value, char *out, size_t pos, size_t outSize)
+{
+	uint8_t digits = (value >= 100) ? 3 : (value >= 10) ? 2 : 1;
+	if(pos + digits > outSize) return 0;
+
+	for(uint8_t i = digits; i > 0; i--)
+	{
+		out[pos + i - 1] = '0' + (value % 10);
+		value /= 10;
+	}
+	return pos + digits;
+}
+
+/**************************************************************************//**
+* @fn		static bool GameCodecGetNumber(const char *payload, size_t len, size_t *pos, uint8_t *value)
+* @brief	Reads a decimal number between 0 and 255 at payload[*pos] and moves *pos past it
+* @return	false if there is no digit or the number is larger than 255
+*****************************************************************************/
+static bool GameCodecGetNumber(const char *payload, size_t len, size_t *pos, uint8_t *value)
+{
+	uint16_t number = 0;
+	size_t start = *pos;
+
+	while(*pos < len && payload[*pos] >= '0' && payload[*pos] <= '9')
+	{
+		number = number * 10 + (payload[*pos] - '0');
+		if(number > 0xFF) return false;
+		(*pos)++;
+	}
+	if(*pos == start) return false;
+
+	*value = (uint8_t)number;
+	return true;
+}
+
+/**************************************************************************//**
+* @fn		static void GameCodecSkipSpaces(const char *payload, size_t len, size_t *pos)
+* @brief	Moves *pos past spaces, tabs and line endings
+*****************************************************************************/
+static void GameCodecSkipSpaces(const char *payload, size_t len, size_t *pos)
+{
+	while(*pos < len && (payload[*pos] == ' ' || payload[*pos] == '\t' || payload[*pos] == '\r' || payload[*pos] == '\n'))
+	{
+		(*pos)++;
+	}
+}
+
+/**************************************************************************//**
+* @fn		static bool GameCodecMatch(const char *payload, size_t len, size_t *pos, const char *str)
+* @brief	Checks that payload continues with str at *pos. If it does, moves *pos past it.
+* @return	true if str was found
+*****************************************************************************/
+static bool GameCodecMatch(const char *payload, size_t len, size_t *pos, const char *str)
+{
+	size_t i = *pos;
+	while(*str)
+	{
+		if(i >= len || payload[i] != *str) return false;
+		i++;
+		str++;
+	}
+	*pos = i;
+	return true;
+}
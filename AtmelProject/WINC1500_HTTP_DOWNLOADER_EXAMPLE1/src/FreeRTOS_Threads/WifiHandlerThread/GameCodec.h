@@ -0,0 +1,39 @@
+/**************************************************************************//**
+* @file      GameCodec.h
+* @brief     Encoder and decoder for the game and status MQTT payloads
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-13
+
+******************************************************************************/
+
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "FreeRTOS_Threads/WifiHandlerThread/GameData.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define GAME_CODEC_GAME_PREFIX		"{\"game\":["	///<Start of a game payload
+#define GAME_CODEC_STATUS_PREFIX	"status:"		///<Start of a status payload
+#define GAME_CODEC_MAX_GAME_LEN		(sizeof(GAME_CODEC_GAME_PREFIX) - 1 + GAME_SIZE * 4 + 2) ///<Longest game payload: every move 3 digits plus a comma, then "]}"
+#define GAME_CODEC_MAX_STATUS_LEN	(sizeof(GAME_CODEC_STATUS_PREFIX) - 1 + 3) ///<Longest status payload
+
+/******************************************************************************
+* Global Function Declaration
+******************************************************************************/
+size_t GameCodecEncodeGame(const struct GameDataPacket *game, char *out, size_t outSize);
+bool GameCodecDecodeGame(const char *payload, size_t len, struct GameDataPacket *game);
+size_t GameCodecEncodeStatus(uint8_t status, char *out, size_t outSize);
+bool GameCodecDecodeStatus(const char *payload, size_t len, uint8_t *status);
+
+#ifdef __cplusplus
+}
+#endif
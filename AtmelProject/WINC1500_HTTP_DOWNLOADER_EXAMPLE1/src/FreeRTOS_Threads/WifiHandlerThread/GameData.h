@@ -0,0 +1,35 @@
+/**************************************************************************//**
+* @file      GameData.h
+* @brief     Game packet shared by the control, UI and WiFi threads
+* @details   Kept free of ASF and FreeRTOS includes, so the game codec can also be built and tested on a host.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdint.h>
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define GAME_SIZE		20 ///<Number of plays in game
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+//Structure to hold a game packet
+struct GameDataPacket
+{
+	uint8_t game[GAME_SIZE];
+};
+
+#ifdef __cplusplus
+}
+#endif
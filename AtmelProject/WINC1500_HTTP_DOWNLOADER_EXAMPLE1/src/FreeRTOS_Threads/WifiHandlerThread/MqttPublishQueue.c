@@ -0,0 +1,141 @@
+/**************************************************************************//**
+* @file      MqttPublishQueue.c
+* @brief     Ring of encoded MQTT messages waiting to be published by the WiFi thread
+* @details   Any thread can push a message. Only the WiFi thread peeks and pops. The message at the head stays
+			 in the ring while it is being published and is only popped once the publish succeeded, so a message
+			 that fails (broker gone, no PUBACK) is sent again on the next drain.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-13
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "FreeRTOS_Threads/WifiHandlerThread/MqttPublishQueue.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define MQTT_QUEUE_MASK	(MQTT_QUEUE_SIZE - 1)
+
+#if (MQTT_QUEUE_SIZE & MQTT_QUEUE_MASK) != 0
+#error "MQTT_QUEUE_SIZE must be a power of two"
+#endif
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+static struct MqttQueuedMessage mqttQueue[MQTT_QUEUE_SIZE];	///<Messages waiting to be published
+static volatile uint8_t mqttQueueHead = 0;	///<Index of the oldest message. Only moved by the WiFi thread.
+static volatile uint8_t mqttQueueTail = 0;	///<Index of the next free slot. Only moved with interrupts masked.
+static struct MqttPublishStats mqttStats;	///<Counters of the pipeline
+
+/******************************************************************************
+* Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		bool MqttQueuePush(const char *topic, const char *payload, uint8_t len, uint8_t qos)
+* @brief	Adds an encoded message to the ring. Never blocks.
+* @param[in]	topic Topic to publish to. Must stay valid (use a string constant).
+* @param[in]	payload Encoded payload. Copied into the ring.
+* @param[in]	len Number of bytes in payload, at most MQTT_QUEUE_PAYLOAD_SIZE - 1
+* @param[in]	qos QoS to publish with
+* @return		true if the message was queued, false if the ring was full or the message too long
+* @note		Safe to call from any thread
+*****************************************************************************/
+bool MqttQueuePush(const char *topic, const char *payload, uint8_t len, uint8_t qos)
+{
+	bool queued = false;
+	if(topic == NULL || payload == NULL || len >= MQTT_QUEUE_PAYLOAD_SIZE) return false;
+
+	taskENTER_CRITICAL();
+	uint8_t count = (uint8_t)(mqttQueueTail - mqttQueueHead);
+	if(count < MQTT_QUEUE_SIZE)
+	{
+		struct MqttQueuedMessage *msg = &mqttQueue[mqttQueueTail & MQTT_QUEUE_MASK];
+		msg->topic = topic;
+		msg->qos = qos;
+		msg->len = len;
+		memcpy(msg->payload, payload, len);
+		msg->payload[len] = 0;
+		mqttQueueTail++;
+
+		mqttStats.queued++;
+		if(count + 1 > mqttStats.highWater) mqttStats.highWater = count + 1;
+		queued = true;
+	}
+	else
+	{
+		mqttStats.dropped++;
+	}
+	taskEXIT_CRITICAL();
+
+	return queued;
+}
+
+/**************************************************************************//**
+* @fn		struct MqttQueuedMessage *MqttQueuePeek(void)
+* @brief	Returns the oldest message without removing it
+* @return	Oldest message, NULL if the ring is empty
+* @note		WiFi thread only
+*****************************************************************************/
+struct MqttQueuedMessage *MqttQueuePeek(void)
+{
+	if(mqttQueueHead == mqttQueueTail) return NULL;
+	return &mqttQueue[mqttQueueHead & MQTT_QUEUE_MASK];
+}
+
+/**************************************************************************//**
+* @fn		void MqttQueuePop(void)
+* @brief	Removes the oldest message once it has been published
+* @note		WiFi thread only
+*****************************************************************************/
+void MqttQueuePop(void)
+{
+	taskENTER_CRITICAL();
+	if(mqttQueueHead != mqttQueueTail)
+	{
+		mqttQueueHead++;
+		mqttStats.published++;
+	}
+	taskEXIT_CRITICAL();
+}
+
+/**************************************************************************//**
+* @fn		void MqttQueueRetry(void)
+* @brief	Counts a failed publish of the oldest message. The message stays in the ring.
+* @note		WiFi thread only
+*****************************************************************************/
+void MqttQueueRetry(void)
+{
+	taskENTER_CRITICAL();
+	mqttStats.retries++;
+	taskEXIT_CRITICAL();
+}
+
+/**************************************************************************//**
+* @fn		uint8_t MqttQueueCount(void)
+* @brief	Returns the number of messages in the ring
+*****************************************************************************/
+uint8_t MqttQueueCount(void)
+{
+	return (uint8_t)(mqttQueueTail - mqttQueueHead);
+}
+
+/**************************************************************************//**
+* @fn		void MqttQueueGetStats(struct MqttPublishStats *stats)
+* @brief	Copies the pipeline counters
+* @param[out]	stats Where to copy the counters
+*****************************************************************************/
+void MqttQueueGetStats(struct MqttPublishStats *stats)
+{
+	if(stats == NULL) return;
+	taskENTER_CRITICAL();
+	*stats = mqttStats;
+	taskEXIT_CRITICAL();
+}
@@ -0,0 +1,60 @@
+/**************************************************************************//**
+* @file      MqttPublishQueue.h
+* @brief     Ring of encoded MQTT messages waiting to be published by the WiFi thread
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-13
+
+******************************************************************************/
+
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "FreeRTOS_Threads/WifiHandlerThread/GameCodec.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define MQTT_QUEUE_SIZE			8	///<Number of messages the ring holds. Must be a power of two.
+#define MQTT_QUEUE_PAYLOAD_SIZE	(GAME_CODEC_MAX_GAME_LEN + 1)	///<Largest payload of a queued message, NUL included
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///One message waiting in the ring
+struct MqttQueuedMessage
+{
+	const char *topic;		///<Topic to publish to. Must be a string constant.
+	uint8_t qos;			///<QoS of the publish. QoS 1 messages stay in the ring until the broker acknowledges them.
+	uint8_t len;			///<Number of bytes in payload
+	char payload[MQTT_QUEUE_PAYLOAD_SIZE];	///<Encoded payload
+};
+
+///Counters of the publish pipeline, to see how hard the producers push
+struct MqttPublishStats
+{
+	uint32_t queued;		///<Messages accepted into the ring
+	uint32_t published;		///<Messages sent (and acknowledged for QoS 1)
+	uint32_t dropped;		///<Messages refused because the ring was full
+	uint32_t retries;		///<Failed publish attempts of the message at the head of the ring
+	uint8_t highWater;		///<Largest number of messages that waited in the ring at once
+};
+
+/******************************************************************************
+* Global Function Declaration
+******************************************************************************/
+bool MqttQueuePush(const char *topic, const char *payload, uint8_t len, uint8_t qos);
+struct MqttQueuedMessage *MqttQueuePeek(void);
+void MqttQueuePop(void);
+void MqttQueueRetry(void);
+uint8_t MqttQueueCount(void);
+void MqttQueueGetStats(struct MqttPublishStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -23,18 +23,28 @@
 #include "FreeRTOS_Threads/WifiHandlerThread/WifiHandler.h"
 #include "FreeRTOS_Threads/ControlThread/ControlThread.h"
 #include "FreeRTOS_Threads/UiHandlerThread/UiHandlerThread.h"
+#include "FreeRTOS_Threads/WifiHandlerThread/GameCodec.h"
+#include "FreeRTOS_Threads/WifiHandlerThread/MqttPublishQueue.h"
+#include "FreeRTOS_Threads/SdWriterThread/SdWriterThread.h"
+#include "FreeRTOS_Threads/WifiHandlerThread/DownloadJournal.h"
+#include "FreeRTOS_Threads/WifiHandlerThread/DownloadManifest.h"
+#include "FreeRTOS_Threads/LogThread/LogThread.h"
 /******************************************************************************
 * Defines
 ******************************************************************************/
+#define DOWNLOAD_LOG_STEP	(16 * 1024)	///<Download progress is logged every time this many bytes came in
+
+#if (GAME_SIZE % 4) != 0
+#error "GAME_SIZE must be a multiple of 4, a parsed game is logged 4 plays per message"
+#endif
 
 /******************************************************************************
 * Variables
 ******************************************************************************/
-volatile char mqtt_msg [64]= "{\"d\":{\"temp\":17}}\"";
 volatile uint32_t temperature = 1;
 int8_t wifiStateMachine = WIFI_MQTT_INIT; ///<Global variable that determines the state of the WIFI handler.
 QueueHandle_t xQueueWifiState = NULL; ///<Queue to determine the Wifi state from other threads.
-QueueHandle_t xQueueGameBuffer = NULL; ///<Queue to send the next play to the cloud
+static TaskHandle_t wifiTaskNotifyHandle = NULL; ///<Handle of the WiFi task, woken when a message is queued for publishing
 
 
 /*HTTP DOWNLOAD RELATED DEFINES AND VARIABLES*/
@@ -52,6 +62,21 @@ static uint32_t http_file_size = 0;
 static uint32_t received_file_size = 0;
 /** File name to download. */
 static char save_file_name[MAIN_MAX_FILE_NAME_LENGTH + 1] = "0:IoT.bin";
+/** Journal of the download in progress, used to continue it after a drop. */
+static struct DownloadJournal download_journal;
+/** Byte the current request asked the server to start from. 0 for a full download. */
+static uint32_t resume_offset = 0;
+/** Receive buffer of the HTTP client. */
+static char http_recv_buffer[MAIN_BUFFER_MAX_SIZE];
+/** Range header of a resumed request. */
+static char range_header[32];
+/** Size and CRC32 the image must have, from the manifest. */
+static struct DownloadManifest manifest;
+/** Manifest text received so far. */
+static char manifest_buffer[MAIN_MANIFEST_MAX_SIZE];
+static uint32_t manifest_length = 0;
+/** Set once the manifest is in: the image is requested on the next pass of the WiFi thread. */
+static bool download_image_pending = false;
 
 
 /** UART module for debug. */
@@ -77,15 +102,31 @@ static struct mqtt_module mqtt_inst;
 static unsigned char mqtt_read_buffer[MAIN_MQTT_BUFFER_SIZE];
 static unsigned char mqtt_send_buffer[MAIN_MQTT_BUFFER_SIZE];
 
+static volatile bool mqttLinkLost = false;	///<Set when the broker socket fails. The WiFi thread then closes it and schedules a reconnect.
+static bool mqttSessionUp = false;			///<Set by mqtt_callback once the broker accepted the session and the topics are subscribed
+static uint32_t mqttReconnectDelayMs = MQTT_RECONNECT_MIN_MS;	///<Backoff before the next reconnect attempt. Doubles after each failure.
+static TickType_t mqttReconnectTick = 0;	///<Tick at which the next reconnect attempt may start
+static uint8_t mqttPublishFails = 0;		///<Failed publishes in a row
+static uint32_t mqttJitterSeed = 0;			///<State of the generator that spreads reconnect attempts
+
 
 
 /******************************************************************************
 * Forward Declarations
 ******************************************************************************/
 static void MQTT_InitRoutine(void);
-static void MQTT_HandleGameMessages(void);
+static void MQTT_HandleTransactions(void);
+static void MQTT_HandleReconnect(void);
+static void MQTT_TryConnect(void);
+static void MQTT_LinkDown(void);
+static void MQTT_ScheduleReconnect(void);
+static void MQTT_HandlePublishQueue(void);
+static void WifiWakeTask(void);
+static void WifiWaitForEvent(uint32_t maxMs);
 static void HTTP_DownloadFileInit(void);
 static void HTTP_DownloadFileTransaction(void);
+static void socket_event_handler(SOCKET sock, uint8_t msg_type, void *msg_data);
+static void socket_resolve_handler(uint8_t *doamin_name, uint32_t server_ip);
 /******************************************************************************
 * Callback Functions
 ******************************************************************************/
@@ -232,32 +273,101 @@ static bool rename_to_unique(FIL *fp, char *file_path_name, uint8_t max_len)
 static void start_download(void)
 {
 	if (!is_state_set(STORAGE_READY)) {
-		LogMessage(LOG_DEBUG_LVL,"start_download: MMC storage not ready.\r\n");
+		LogWifi(LOG_DEBUG_LVL,"start_download: MMC storage not ready, download canceled.\r\n");
+		add_state(CANCELED);
 		return;
 	}
 
 	if (!is_state_set(WIFI_CONNECTED)) {
-		LogMessage(LOG_DEBUG_LVL,"start_download: Wi-Fi is not connected.\r\n");
+		LogWifi(LOG_DEBUG_LVL,"start_download: Wi-Fi is not connected.\r\n");
 		return;
 	}
 
 	if (is_state_set(GET_REQUESTED)) {
-		LogMessage(LOG_DEBUG_LVL,"start_download: request is sent already.\r\n");
+		LogWifi(LOG_DEBUG_LVL,"start_download: request is sent already.\r\n");
 		return;
 	}
 
 	if (is_state_set(DOWNLOADING)) {
-		LogMessage(LOG_DEBUG_LVL,"start_download: running download already.\r\n");
+		LogWifi(LOG_DEBUG_LVL,"start_download: running download already.\r\n");
+		return;
+	}
+
+	/* The manifest comes first, the image is only fetched once it is known what it must look like. */
+	if (!is_state_set(MANIFEST_READY)) {
+		LogWifi(LOG_DEBUG_LVL,"start_download: requesting manifest...\r\n");
+		manifest_length = 0;
+		http_client_send_request(&http_client_module_inst, MAIN_HTTP_MANIFEST_URL, HTTP_METHOD_GET, NULL, NULL);
 		return;
 	}
 
+	/* Continue an interrupted download of the same file from its last checkpoint. */
+	resume_offset = 0;
+	if (!SdWriterIsOpen() && DownloadJournalLoad(&download_journal) && !strcmp(download_journal.url, MAIN_HTTP_FILE_URL)
+			&& download_journal.committed > 0 && download_journal.committed < download_journal.length) {
+		resume_offset = download_journal.committed;
+		snprintf(range_header, sizeof(range_header), "Range: bytes=%lu-\r\n", (unsigned long)resume_offset);
+		LogWifi(LOG_DEBUG_LVL,"start_download: resuming [%s] at byte %lu\r\n", download_journal.file, (unsigned long)resume_offset);
+	}
+
 	/* Send the HTTP request. */
-	LogMessage(LOG_DEBUG_LVL,"start_download: sending HTTP request...\r\n");
-	http_client_send_request(&http_client_module_inst, MAIN_HTTP_FILE_URL, HTTP_METHOD_GET, NULL, NULL);
+	LogWifi(LOG_DEBUG_LVL,"start_download: sending HTTP request...\r\n");
+	http_client_send_request(&http_client_module_inst, MAIN_HTTP_FILE_URL, HTTP_METHOD_GET, NULL,
+			(resume_offset != 0) ? range_header : NULL);
+}
+
+/**
+ * \brief Store received manifest data.
+ * \param[in] data Packet data.
+ * \param[in] length Packet data length.
+ * \return false if the manifest is too long.
+ */
+static bool store_manifest_packet(const char *data, uint32_t length)
+{
+	if (length > MAIN_MANIFEST_MAX_SIZE - manifest_length) {
+		return false;
+	}
+	memcpy(&manifest_buffer[manifest_length], data, length);
+	manifest_length += length;
+	return true;
+}
+
+/**
+ * \brief Handle the end of the manifest response.
+ * \param[in] ok false if the response was refused or too long.
+ */
+static void finish_manifest(bool ok)
+{
+	if (!ok || !DownloadManifestParse(manifest_buffer, manifest_length, &manifest)) {
+		LogWifi(LOG_DEBUG_LVL,"finish_manifest: no valid manifest, download canceled.\r\n");
+		add_state(CANCELED);
+		return;
+	}
+
+	LogWifi(LOG_DEBUG_LVL,"finish_manifest: image is %lu bytes, CRC32 %08lx\r\n", (unsigned long)manifest.size, (unsigned long)manifest.crc);
+	add_state(MANIFEST_READY);
+	clear_state(GET_REQUESTED);
+	download_image_pending = true;
+}
+
+/**
+ * \brief Checkpoint hook of the SD writer: records how much of the file is safely on the card.
+ * \param[in] bytes Number of bytes of the file on the card.
+ * \param[in] crc CRC32 of those bytes.
+ */
+static void store_file_checkpoint(uint32_t bytes, crc32_t crc)
+{
+	download_journal.committed = bytes;
+	download_journal.crc = crc;
+	DownloadJournalSave(&download_journal);
 }
 
 /**
  * \brief Store received packet to file.
+ *
+ * The data is only copied into a write buffer of the SD writer thread. The SD write of a full buffer overlaps
+ * the reception of the next packets.
+ *
  * \param[in] data Packet data.
  * \param[in] length Packet data length.
  */
@@ -265,11 +375,23 @@ static void store_file_packet(char *data, uint32_t length)
 {
 	FRESULT ret;
 	if ((data == NULL) || (length < 1)) {
-		LogMessage(LOG_DEBUG_LVL,"store_file_packet: empty data.\r\n");
+		LogWifi(LOG_DEBUG_LVL,"store_file_packet: empty data.\r\n");
 		return;
 	}
 
-	if (!is_state_set(DOWNLOADING)) {
+	if (!is_state_set(DOWNLOADING) && resume_offset != 0) {
+		/* Check the partial file against the journal before adding to it. */
+		ret = SdWriterResume(download_journal.file, resume_offset, download_journal.crc, store_file_checkpoint);
+		if (ret != FR_OK) {
+			LogWifi(LOG_DEBUG_LVL,"store_file_packet: partial file [%s] does not match the journal (ret:%d). Download canceled.\r\n", download_journal.file, ret);
+			DownloadJournalClear();
+			add_state(CANCELED);
+			return;
+		}
+
+		received_file_size = resume_offset;
+		add_state(DOWNLOADING);
+	} else if (!is_state_set(DOWNLOADING)) {
 		char *cp = NULL;
 		save_file_name[0] = LUN_ID_SD_MMC_0_MEM + '0';
 		save_file_name[1] = ':';
@@ -281,16 +403,24 @@ static void store_file_packet(char *data, uint32_t length)
 			cp++;
 			strcpy(&save_file_name[2], cp);
 		} else {
-			LogMessage(LOG_DEBUG_LVL,"store_file_packet: file name is invalid. Download canceled.\r\n");
+			LogWifi(LOG_DEBUG_LVL,"store_file_packet: file name is invalid. Download canceled.\r\n");
 			add_state(CANCELED);
 			return;
 		}
 
 		rename_to_unique(&file_object, save_file_name, MAIN_MAX_FILE_NAME_LENGTH);
-		LogMessage(LOG_DEBUG_LVL,"store_file_packet: creating file [%s]\r\n", save_file_name);
-		ret = f_open(&file_object, (char const *)save_file_name, FA_CREATE_ALWAYS | FA_WRITE);
+		LogWifi(LOG_DEBUG_LVL,"store_file_packet: creating file [%s]\r\n", save_file_name);
+
+		/* New journal for this file. The SD writer keeps it up to date. */
+		memset(&download_journal, 0, sizeof(download_journal));
+		strncpy(download_journal.url, MAIN_HTTP_FILE_URL, DOWNLOAD_JOURNAL_URL_SIZE - 1);
+		strncpy(download_journal.file, save_file_name, DOWNLOAD_JOURNAL_NAME_SIZE - 1);
+		download_journal.length = http_file_size;
+		DownloadJournalSave(&download_journal);
+
+		ret = SdWriterBegin(save_file_name, store_file_checkpoint);
 		if (ret != FR_OK) {
-			LogMessage(LOG_DEBUG_LVL,"store_file_packet: file creation error! ret:%d\r\n", ret);
+			LogWifi(LOG_DEBUG_LVL,"store_file_packet: file creation error! ret:%d\r\n", ret);
 			return;
 		}
 
@@ -299,20 +429,36 @@ static void store_file_packet(char *data, uint32_t length)
 	}
 
 	if (data != NULL) {
-		UINT wsize = 0;
-		ret = f_write(&file_object, (const void *)data, length, &wsize);
-		if (ret != FR_OK) {
-			f_close(&file_object);
+		if (!SdWriterAppend(data, length)) {
+			SdWriterFinish();
+			clear_state(DOWNLOADING);
 			add_state(CANCELED);
-			LogMessage(LOG_DEBUG_LVL,"store_file_packet: file write error, download canceled.\r\n");
+			LogWifi(LOG_DEBUG_LVL,"store_file_packet: file write error, download canceled.\r\n");
 			return;
 		}
 
-		received_file_size += wsize;
-		LogMessage(LOG_DEBUG_LVL,"store_file_packet: received[%lu], file size[%lu]\r\n", (unsigned long)received_file_size, (unsigned long)http_file_size);
+		if ((received_file_size + length) / DOWNLOAD_LOG_STEP != received_file_size / DOWNLOAD_LOG_STEP) {
+			LogWifiDeferred(LOG_DEBUG_LVL,"store_file_packet: received[%lu], file size[%lu]\r\n", received_file_size + length, http_file_size);
+		}
+		received_file_size += length;
 		if (received_file_size >= http_file_size) {
-			f_close(&file_object);
-			LogMessage(LOG_DEBUG_LVL,"store_file_packet: file downloaded successfully.\r\n");
+			ret = SdWriterFinish();
+			clear_state(DOWNLOADING);
+			if (ret != FR_OK) {
+				LogWifi(LOG_DEBUG_LVL,"store_file_packet: file write error %d, download canceled.\r\n", ret);
+				add_state(CANCELED);
+				return;
+			}
+			/* The writer called the checkpoint hook with the size and CRC32 of the whole file. */
+			DownloadJournalClear();
+			if (!DownloadManifestMatches(&manifest, download_journal.committed, download_journal.crc)) {
+				LogWifi(LOG_DEBUG_LVL,"store_file_packet: CRC32 %08lx does not match the manifest, image deleted.\r\n", (unsigned long)download_journal.crc);
+				f_unlink(download_journal.file);
+				add_state(CANCELED);
+				return;
+			}
+			LogWifi(LOG_DEBUG_LVL,"store_file_packet: file downloaded and verified.\r\n");
+			add_state(VERIFIED);
 			port_pin_set_output_level(LED_0_PIN, false);
 			add_state(COMPLETED);
 			return;
@@ -331,33 +477,75 @@ static void http_client_callback(struct http_client_module *module_inst, int typ
 {
 	switch (type) {
 	case HTTP_CLIENT_CALLBACK_SOCK_CONNECTED:
-		LogMessage(LOG_DEBUG_LVL,"http_client_callback: HTTP client socket connected.\r\n");
+		LogWifi(LOG_DEBUG_LVL,"http_client_callback: HTTP client socket connected.\r\n");
 		break;
 
 	case HTTP_CLIENT_CALLBACK_REQUESTED:
-		LogMessage(LOG_DEBUG_LVL,"http_client_callback: request completed.\r\n");
+		LogWifi(LOG_DEBUG_LVL,"http_client_callback: request completed.\r\n");
 		add_state(GET_REQUESTED);
 		break;
 
 	case HTTP_CLIENT_CALLBACK_RECV_RESPONSE:
-		LogMessage(LOG_DEBUG_LVL,"http_client_callback: received response %u data size %u\r\n",
-				(unsigned int)data->recv_response.response_code,
-				(unsigned int)data->recv_response.content_length);
+		LogWifiDeferred(LOG_DEBUG_LVL,"http_client_callback: received response %u data size %u\r\n",
+				data->recv_response.response_code,
+				data->recv_response.content_length);
+		if (!is_state_set(MANIFEST_READY)) {
+			/* Manifest response. Short enough to come in one piece, unless it is sent chunked. */
+			if ((unsigned int)data->recv_response.response_code != 200) {
+				finish_manifest(false);
+			} else if (data->recv_response.content != NULL) {
+				finish_manifest(store_manifest_packet(data->recv_response.content, data->recv_response.content_length));
+			} else if (!data->recv_response.is_chunked && data->recv_response.content_length == 0) {
+				/* Empty body: no chunk or content will follow, so nothing else would end the wait. */
+				finish_manifest(false);
+			}
+			return;
+		}
+
 		if ((unsigned int)data->recv_response.response_code == 200) {
+			/* Whole file. A server that does not support Range answers this way too: start over. */
+			resume_offset = 0;
 			http_file_size = data->recv_response.content_length;
 			received_file_size = 0;
 		} 
+		else if ((unsigned int)data->recv_response.response_code == 206 && resume_offset != 0
+				&& resume_offset + data->recv_response.content_length == download_journal.length) {
+			/* Rest of the file, from resume_offset on. */
+			http_file_size = download_journal.length;
+			received_file_size = resume_offset;
+		}
 		else {
+			/* The file on the server changed or the range is refused: the next try starts from zero. */
+			if (resume_offset != 0) {
+				DownloadJournalClear();
+			}
 			add_state(CANCELED);
 			return;
 		}
-		if (data->recv_response.content_length <= MAIN_BUFFER_MAX_SIZE) {
+
+		/* Do not spend airtime on an image the manifest already rules out. */
+		if (http_file_size != manifest.size) {
+			LogWifi(LOG_DEBUG_LVL,"http_client_callback: image is %lu bytes, manifest says %lu. Download canceled.\r\n",
+					(unsigned long)http_file_size, (unsigned long)manifest.size);
+			DownloadJournalClear();
+			add_state(CANCELED);
+			return;
+		}
+		if (data->recv_response.content != NULL) {
 			store_file_packet(data->recv_response.content, data->recv_response.content_length);
 			add_state(COMPLETED);
 		}
 		break;
 
 	case HTTP_CLIENT_CALLBACK_RECV_CHUNKED_DATA:
+		if (!is_state_set(MANIFEST_READY)) {
+			if (!store_manifest_packet(data->recv_chunked_data.data, data->recv_chunked_data.length)) {
+				finish_manifest(false);
+			} else if (data->recv_chunked_data.is_complete) {
+				finish_manifest(true);
+			}
+			break;
+		}
 		store_file_packet(data->recv_chunked_data.data, data->recv_chunked_data.length);
 		if (data->recv_chunked_data.is_complete) {
 			add_state(COMPLETED);
@@ -366,23 +554,27 @@ static void http_client_callback(struct http_client_module *module_inst, int typ
 		break;
 
 	case HTTP_CLIENT_CALLBACK_DISCONNECTED:
-		LogMessage(LOG_DEBUG_LVL,"http_client_callback: disconnection reason:%d\r\n", data->disconnected.reason);
+		LogWifi(LOG_DEBUG_LVL,"http_client_callback: disconnection reason:%d\r\n", data->disconnected.reason);
 
 		/* If disconnect reason is equal to -ECONNRESET(-104),
 		 * It means the server has closed the connection (timeout).
-		 * This is normal operation.
+		 * This is normal operation once the response is complete.
 		 */
-		if (data->disconnected.reason == -EAGAIN) {
-			/* Server has not responded. Retry immediately. */
+		if (data->disconnected.reason != 0 && (is_state_set(DOWNLOADING) || is_state_set(GET_REQUESTED))) {
+			/* The transfer was cut short. Closing the file keeps its last checkpoint in the journal. */
 			if (is_state_set(DOWNLOADING)) {
-				f_close(&file_object);
-				clear_state(DOWNLOADING);
+				SdWriterFinish();
 			}
+			clear_state(DOWNLOADING | GET_REQUESTED);
 
-			if (is_state_set(GET_REQUESTED)) {
-				clear_state(GET_REQUESTED);
+			/* Any other error ends this try. The next one resumes from the checkpoint with a Range request. */
+			if (data->disconnected.reason != -EAGAIN && !is_state_set(COMPLETED)) {
+				add_state(CANCELED);
 			}
+		}
 
+		if (data->disconnected.reason == -EAGAIN) {
+			/* Server has not responded. Retry immediately, from the checkpoint if there is one. */
 			start_download();
 		}
 
@@ -422,12 +614,46 @@ static void socket_cb(SOCKET sock, uint8_t u8Msg, void *pvMsg)
  */
 static void resolve_cb(uint8_t *pu8DomainName, uint32_t u32ServerIP)
 {
-	LogMessage(LOG_DEBUG_LVL,"resolve_cb: %s IP address is %d.%d.%d.%d\r\n\r\n", pu8DomainName,
+	LogWifi(LOG_DEBUG_LVL,"resolve_cb: %s IP address is %d.%d.%d.%d\r\n\r\n", pu8DomainName,
 			(int)IPV4_BYTE(u32ServerIP, 0), (int)IPV4_BYTE(u32ServerIP, 1),
 			(int)IPV4_BYTE(u32ServerIP, 2), (int)IPV4_BYTE(u32ServerIP, 3));
 	http_client_socket_resolve_handler(pu8DomainName, u32ServerIP);
 }
 
+/**
+ * \brief Socket callback registered with the WINC. Routes each event to the client that owns the socket.
+ *
+ * MQTT and HTTP sockets stay open side by side, so a download does not drop the game session.
+ * Events for sockets that belong to neither client (e.g. one that was just closed) are dropped.
+ *
+ * \param[in] sock socket handler.
+ * \param[in] u8Msg socket event type.
+ * \param[in] pvMsg is a pointer to message structure.
+ */
+static void wifi_socket_dispatch_cb(SOCKET sock, uint8_t u8Msg, void *pvMsg)
+{
+	if (sock < 0 || sock >= TCP_SOCK_MAX) {
+		return;
+	}
+
+	if (sock == mqtt_inst.network.socket) {
+		socket_event_handler(sock, u8Msg, pvMsg);
+	} else if (sock == http_client_module_inst.sock) {
+		socket_cb(sock, u8Msg, pvMsg);
+	}
+}
+
+/**
+ * \brief DNS callback registered with the WINC. Both clients check the host name themselves, so the answer goes to both.
+ * \param[in] pu8DomainName Domain name of the host.
+ * \param[in] u32ServerIP Server IPv4 address encoded in NW byte order format. If it is Zero, then the DNS resolution failed.
+ */
+static void wifi_resolve_dispatch_cb(uint8_t *pu8DomainName, uint32_t u32ServerIP)
+{
+	socket_resolve_handler(pu8DomainName, u32ServerIP);
+	resolve_cb(pu8DomainName, u32ServerIP);
+}
+
 /**
  * \brief Callback to get the Wi-Fi status update.
  *
@@ -460,13 +686,13 @@ static void wifi_cb(uint8_t u8MsgType, void *pvMsg)
 	{
 		tstrM2mWifiStateChanged *pstrWifiState = (tstrM2mWifiStateChanged *)pvMsg;
 		if (pstrWifiState->u8CurrState == M2M_WIFI_CONNECTED) {
-			LogMessage(LOG_DEBUG_LVL,"wifi_cb: M2M_WIFI_CONNECTED\r\n");
+			LogWifi(LOG_DEBUG_LVL,"wifi_cb: M2M_WIFI_CONNECTED\r\n");
 			m2m_wifi_request_dhcp_client();
 		} else if (pstrWifiState->u8CurrState == M2M_WIFI_DISCONNECTED) {
-			LogMessage(LOG_DEBUG_LVL,"wifi_cb: M2M_WIFI_DISCONNECTED\r\n");
+			LogWifi(LOG_DEBUG_LVL,"wifi_cb: M2M_WIFI_DISCONNECTED\r\n");
 			clear_state(WIFI_CONNECTED);
 			if (is_state_set(DOWNLOADING)) {
-				f_close(&file_object);
+				SdWriterFinish();
 				clear_state(DOWNLOADING);
 			}
 
@@ -476,8 +702,9 @@ static void wifi_cb(uint8_t u8MsgType, void *pvMsg)
 
 
 			/* Disconnect from MQTT broker. */
-			/* Force close the MQTT connection, because cannot send a disconnect message to the broker when network is broken. */
-			mqtt_disconnect(&mqtt_inst, 1);
+			/* The WiFi thread force closes the MQTT connection on its next pass, because cannot send a disconnect message to the broker when network is broken. */
+			/* Not closed here: this callback runs inside m2m_wifi_handle_events, where the socket close cannot be waited for. */
+			mqttLinkLost = true;
 
 			m2m_wifi_connect((char *)MAIN_WLAN_SSID, sizeof(MAIN_WLAN_SSID),
 					MAIN_WLAN_AUTH, (char *)MAIN_WLAN_PSK, M2M_WIFI_CH_ALL);
@@ -489,22 +716,18 @@ static void wifi_cb(uint8_t u8MsgType, void *pvMsg)
 	case M2M_WIFI_REQ_DHCP_CONF:
 	{
 		uint8_t *pu8IPAddress = (uint8_t *)pvMsg;
-		LogMessage(LOG_DEBUG_LVL,"wifi_cb: IP address is %u.%u.%u.%u\r\n",
+		LogWifi(LOG_DEBUG_LVL,"wifi_cb: IP address is %u.%u.%u.%u\r\n",
 				pu8IPAddress[0], pu8IPAddress[1], pu8IPAddress[2], pu8IPAddress[3]);
 		add_state(WIFI_CONNECTED);
 
+		/* Reconnect to the MQTT broker right away on the next pass of the WiFi thread. */
+		mqttReconnectDelayMs = MQTT_RECONNECT_MIN_MS;
+		mqttReconnectTick = xTaskGetTickCount();
+
+		/* Resume a download that was cut by the Wi-Fi drop */
 		if(do_download_flag == 1)
 		{
 			start_download();
-		
-		}
-		else
-		{
-				/* Try to connect to MQTT broker when Wi-Fi was connected. */
-		if (mqtt_connect(&mqtt_inst, main_mqtt_broker))
-		{
-			LogMessage(LOG_DEBUG_LVL,"Error connecting to MQTT Broker!\r\n");
-		}
 		}
 	}
 		break;
@@ -517,40 +740,45 @@ static void wifi_cb(uint8_t u8MsgType, void *pvMsg)
 
 /**
  * \brief Initialize SD/MMC storage.
+ *
+ * Called when a download starts, and sets STORAGE_READY once the card is mounted. Does not wait for a card
+ * to be plugged in, so an empty slot cancels the download instead of stalling the WiFi thread and MQTT with it.
  */
 void init_storage(void)
 {
+	static bool sd_mmc_started = false;
 	FRESULT res;
-	Ctrl_status status;
+	Ctrl_status status = CTRL_BUSY;
+
+	if (is_state_set(STORAGE_READY)) {
+		return;
+	}
 
 	/* Initialize SD/MMC stack. */
-	sd_mmc_init();
-	while (true) {
-		LogMessage(LOG_DEBUG_LVL,"init_storage: please plug an SD/MMC card in slot...\r\n");
-
-		/* Wait card present and ready. */
-		do {
-			status = sd_mmc_test_unit_ready(0);
-			if (CTRL_FAIL == status) {
-				LogMessage(LOG_DEBUG_LVL,"init_storage: SD Card install failed.\r\n");
-				LogMessage(LOG_DEBUG_LVL,"init_storage: try unplug and re-plug the card.\r\n");
-				while (CTRL_NO_PRESENT != sd_mmc_check(0)) {
-				}
-			}
-		} while (CTRL_GOOD != status);
+	if (!sd_mmc_started) {
+		sd_mmc_init();
+		sd_mmc_started = true;
+	}
 
-		LogMessage(LOG_DEBUG_LVL,"init_storage: mounting SD card...\r\n");
-		memset(&fatfs, 0, sizeof(FATFS));
-		res = f_mount(LUN_ID_SD_MMC_0_MEM, &fatfs);
-		if (FR_INVALID_DRIVE == res) {
-			LogMessage(LOG_DEBUG_LVL,"init_storage: SD card mount failed! (res %d)\r\n", res);
-			return;
-		}
+	/* The card needs a few checks to go through its initialization. */
+	for (uint8_t i = 0; i < MAIN_STORAGE_INIT_ATTEMPTS && CTRL_BUSY == status; i++) {
+		status = sd_mmc_test_unit_ready(0);
+	}
+	if (CTRL_GOOD != status) {
+		LogWifi(LOG_DEBUG_LVL,"init_storage: no SD/MMC card ready in slot (status %d).\r\n", status);
+		return;
+	}
 
-		LogMessage(LOG_DEBUG_LVL,"init_storage: SD card mount OK.\r\n");
-		add_state(STORAGE_READY);
+	LogWifi(LOG_DEBUG_LVL,"init_storage: mounting SD card...\r\n");
+	memset(&fatfs, 0, sizeof(FATFS));
+	res = f_mount(LUN_ID_SD_MMC_0_MEM, &fatfs);
+	if (FR_INVALID_DRIVE == res) {
+		LogWifi(LOG_DEBUG_LVL,"init_storage: SD card mount failed! (res %d)\r\n", res);
 		return;
 	}
+
+	LogWifi(LOG_DEBUG_LVL,"init_storage: SD card mount OK.\r\n");
+	add_state(STORAGE_READY);
 }
 
 /**
@@ -599,14 +827,16 @@ static void configure_http_client(void)
 
 	http_client_get_config_defaults(&httpc_conf);
 
+	httpc_conf.recv_buffer = http_recv_buffer;
 	httpc_conf.recv_buffer_size = MAIN_BUFFER_MAX_SIZE;
 	httpc_conf.timer_inst = &swt_module_inst;
 	httpc_conf.port = 443;
 	httpc_conf.tls = 1;
+	httpc_conf.keep_alive_timeout = MAIN_HTTP_KEEP_ALIVE_MS;
 
 	ret = http_client_init(&http_client_module_inst, &httpc_conf);
 	if (ret < 0) {
-		LogMessage(LOG_DEBUG_LVL,"configure_http_client: HTTP client initialization failed! (res %d)\r\n", ret);
+		LogWifi(LOG_DEBUG_LVL,"configure_http_client: HTTP client initialization failed! (res %d)\r\n", ret);
 		while (1) {
 		} /* Loop forever. */
 	}
@@ -643,6 +873,18 @@ void SubscribeHandler(MessageData *msgData);
  */
 static void socket_event_handler(SOCKET sock, uint8_t msg_type, void *msg_data)
 {
+	//A receive or send error other than a timeout means the broker closed or lost the connection
+	if (msg_type == SOCKET_MSG_RECV) {
+		tstrSocketRecvMsg *pstrRx = (tstrSocketRecvMsg *)msg_data;
+		if (pstrRx->s16BufferSize <= 0 && pstrRx->s16BufferSize != SOCK_ERR_TIMEOUT) {
+			mqttLinkLost = true;
+		}
+	} else if (msg_type == SOCKET_MSG_SEND) {
+		if (*(int16_t *)msg_data <= 0) {
+			mqttLinkLost = true;
+		}
+	}
+
 	mqtt_socket_event_handler(sock, msg_type, msg_data);
 }
 
@@ -668,81 +910,73 @@ static void socket_resolve_handler(uint8_t *doamin_name, uint32_t server_ip)
 void SubscribeHandlerStatusTopic(MessageData *msgData)
 {
 	uint8_t status;
-	LogMessage(LOG_DEBUG_LVL,"\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
-	//Will receive something of the style "rgb(222, 224, 189)"
-	if (strncmp(msgData->message->payload, "status:", 7)== 0)
-	{
-		char *p = (char *)&msgData->message->payload[7];
-		status = p[0]-'0';
-//	int nb = 0;
-	
-// 	while(nb <=2  && *p)
-// 	{
-// 		rgb[nb++] = strtol(p, &p, 10);
-// 		if (*p != ',')
-// 		break;
-// 		p++; /* skip, */
-// 	}
-	LogMessage(LOG_DEBUG_LVL,"\r\nSTATUS Receive%d\r\n", status);
-	if(pdTRUE == ControlAddStatusDataToQueue(&status))
+	LogWifi(LOG_DEBUG_LVL,"\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
+	//Will receive something of the style "status:2"
+	if (GameCodecDecodeStatus(msgData->message->payload, msgData->message->payloadlen, &status))
 	{
-		LogMessage(LOG_DEBUG_LVL,"\r\nSent status to control!\r\n");
-	}
-	//UIChangeColors(rgb[0],rgb[1], rgb[2]);
+		LogWifiDeferred(LOG_DEBUG_LVL,"\r\nSTATUS Receive%d\r\n", status);
+		if(pdTRUE == ControlAddStatusDataToQueue(&status))
+		{
+			LogWifiDeferred(LOG_DEBUG_LVL,"\r\nSent status to control!\r\n");
+		}
 	}
 }
 
 void SubscribeHandlerGameTopic(MessageData *msgData)
 {
 	struct GameDataPacket game;
-	memset(game.game, 0xff, sizeof(game.game));
 
-	//Parse input. The start string must be '{"game":['
-	if (strncmp(msgData->message->payload, "{\"game\":[", 9) == 0)
+	//Parse input. It must look like '{"game":[1,2,3]}'
+	if (GameCodecDecodeGame(msgData->message->payload, msgData->message->payloadlen, &game))
 	{
-		LogMessage(LOG_DEBUG_LVL,"\r\nGame message received!\r\n");
-		LogMessage(LOG_DEBUG_LVL,"\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
-		LogMessage(LOG_DEBUG_LVL,"%.*s",msgData->message->payloadlen,(char *)msgData->message->payload);
-
-		int nb = 0;
-		char *p = &msgData->message->payload[9];
-		while (nb < GAME_SIZE && *p) {
-			game.game[nb++] = strtol(p, &p, 10);
-			if (*p != ',')
-			break;
-			p++; /* skip, */
-		}
-		LogMessage(LOG_DEBUG_LVL,"\r\nParsed Command: ");
-		for(int i = 0; i < GAME_SIZE; i++)
+		LogWifi(LOG_DEBUG_LVL,"\r\nGame message received!\r\n");
+		LogWifi(LOG_DEBUG_LVL,"\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
+		LogWifi(LOG_DEBUG_LVL,"%.*s",msgData->message->payloadlen,(char *)msgData->message->payload);
+
+		LogWifiDeferred(LOG_DEBUG_LVL,"\r\nParsed Command: ");
+		for(int i = 0; i < GAME_SIZE; i += 4)
 		{
-			LogMessage(LOG_DEBUG_LVL,"%d,", game.game[i]);
+			LogWifiDeferred(LOG_DEBUG_LVL,"%d,%d,%d,%d,", game.game[i], game.game[i + 1], game.game[i + 2], game.game[i + 3]);
 		}
 
 		if(pdTRUE == ControlAddGameData(&game))
 		{
-			LogMessage(LOG_DEBUG_LVL,"\r\nSent play to control!\r\n");
+			LogWifiDeferred(LOG_DEBUG_LVL,"\r\nSent play to control!\r\n");
 		}
 
 	}else
 	{
-		LogMessage(LOG_DEBUG_LVL,"\r\nGame message received but not understood!\r\n");
-		LogMessage(LOG_DEBUG_LVL,"\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
-		LogMessage(LOG_DEBUG_LVL,"%.*s",msgData->message->payloadlen,(char *)msgData->message->payload);
+		LogWifi(LOG_DEBUG_LVL,"\r\nGame message received but not understood!\r\n");
+		LogWifi(LOG_DEBUG_LVL,"\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
+		LogWifi(LOG_DEBUG_LVL,"%.*s",msgData->message->payloadlen,(char *)msgData->message->payload);
 	}
+}
 
-
-
-
+/**
+ * \brief Callback for messages on a topic that has no handler.
+ *
+ * A resumed session may deliver queued messages right after the CONNACK, before the topics are subscribed again.
+ * Those are routed here by topic name so no play is lost.
+ *
+ * \param[in] msgData Data to be received.
+ */
+void SubscribeHandlerDefault(MessageData *msgData)
+{
+	if (MQTTPacket_equals(msgData->topicName, GAME_TOPIC_IN)) {
+		SubscribeHandlerGameTopic(msgData);
+	} else if (MQTTPacket_equals(msgData->topicName, STATUS_TOPIC)) {
+		SubscribeHandlerStatusTopic(msgData);
+	}
 }
 
 // void SubscribeHandlerStatusTopic(MessageData *msgData)
 // {
-// 	LogMessage(LOG_DEBUG_LVL,"\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
+// 	LogWifi(LOG_DEBUG_LVL,"\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
 // }
 
 // void SubscribeHandlerDistanceTopic(MessageData *msgData)
 // {
-// 	LogMessage(LOG_DEBUG_LVL,"\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
+// 	LogWifi(LOG_DEBUG_LVL,"\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
 // }
 
 
@@ -750,9 +984,9 @@ void SubscribeHandlerGameTopic(MessageData *msgData)
 // {
 // 	/* You received publish message which you had subscribed. */
 // 	/* Print Topic and message */
-// 	LogMessage(LOG_DEBUG_LVL,"\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
-// 	LogMessage(LOG_DEBUG_LVL," >> ");
-// 	LogMessage(LOG_DEBUG_LVL,"%.*s",msgData->message->payloadlen,(char *)msgData->message->payload);	
+// 	LogWifi(LOG_DEBUG_LVL,"\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
+// 	LogWifi(LOG_DEBUG_LVL," >> ");
+// 	LogWifi(LOG_DEBUG_LVL,"%.*s",msgData->message->payloadlen,(char *)msgData->message->payload);	
 // 
 // 	//Handle LedData message
 // 	if(strncmp((char *) msgData->topicName->lenstring.data, LED_TOPIC, msgData->message->payloadlen) == 0)
@@ -790,45 +1024,44 @@ static void mqtt_callback(struct mqtt_module *module_inst, int type, union mqtt_
 	{
 		/*
 		 * If connecting to broker server is complete successfully, Start sending CONNECT message of MQTT.
-		 * Or else retry to connect to broker server.
+		 * Or else the WiFi thread retries later, see MQTT_ScheduleReconnect.
 		 */
 		if (data->sock_connected.result >= 0) {
-			LogMessage(LOG_DEBUG_LVL,"\r\nConnecting to Broker...");
-			if(0 != mqtt_connect_broker(module_inst, 1, CLOUDMQTT_USER_ID, CLOUDMQTT_USER_PASSWORD, CLOUDMQTT_USER_ID, NULL, NULL, 0, 0, 0))
+			LogWifi(LOG_DEBUG_LVL,"\r\nConnecting to Broker...");
+			if(0 != mqtt_connect_broker(module_inst, MQTT_CLEAN_SESSION, CLOUDMQTT_USER_ID, CLOUDMQTT_USER_PASSWORD, MQTT_CLIENT_ID, NULL, NULL, 0, 0, 0))
 			{
-				LogMessage(LOG_DEBUG_LVL,"MQTT  Error - NOT Connected to broker\r\n");
+				LogWifi(LOG_DEBUG_LVL,"MQTT  Error - NOT Connected to broker\r\n");
 			}
 			else
 			{
-				LogMessage(LOG_DEBUG_LVL,"MQTT Connected to broker\r\n");
+				LogWifi(LOG_DEBUG_LVL,"MQTT Connected to broker\r\n");
 			}
 		} else {
-			LogMessage(LOG_DEBUG_LVL,"Connect fail to server(%s)! retry it automatically.\r\n", main_mqtt_broker);
-			mqtt_connect(module_inst, main_mqtt_broker); /* Retry that. */
+			LogWifi(LOG_DEBUG_LVL,"Connect fail to server(%s)! Will retry.\r\n", main_mqtt_broker);
 		}
 	}
 	break;
 
 	case MQTT_CALLBACK_CONNECTED:
 		if (data->connected.result == MQTT_CONN_RESULT_ACCEPT) {
-			/* Subscribe chat topic. */
-			mqtt_subscribe(module_inst, GAME_TOPIC_IN, 0, SubscribeHandlerGameTopic);
-			mqtt_subscribe(module_inst, STATUS_TOPIC, 0, SubscribeHandlerStatusTopic);
+			/* Subscribe again after every connect. QoS 1 so the broker keeps our messages while we are away. */
+			mqttSessionUp = (0 == mqtt_subscribe(module_inst, GAME_TOPIC_IN, 1, SubscribeHandlerGameTopic));
+			mqttSessionUp = mqttSessionUp && (0 == mqtt_subscribe(module_inst, STATUS_TOPIC, 1, SubscribeHandlerStatusTopic));
 			//mqtt_subscribe(module_inst, IMU_TOPIC, 2, SubscribeHandlerImuTopic);
 			//mqtt_subscribe(module_inst, DISTANCE_TOPIC, 2, SubscribeHandlerDistanceTopic);
 			/* Enable USART receiving callback. */
 			
-			LogMessage(LOG_DEBUG_LVL,"MQTT Connected\r\n");
+			LogWifi(LOG_DEBUG_LVL,"MQTT Connected\r\n");
 		} else {
 			/* Cannot connect for some reason. */
-			LogMessage(LOG_DEBUG_LVL,"MQTT broker decline your access! error code %d\r\n", data->connected.result);
+			LogWifi(LOG_DEBUG_LVL,"MQTT broker decline your access! error code %d\r\n", data->connected.result);
 		}
 
 		break;
 
 	case MQTT_CALLBACK_DISCONNECTED:
 		/* Stop timer and USART callback. */
-		LogMessage(LOG_DEBUG_LVL,"MQTT disconnected\r\n");
+		LogWifi(LOG_DEBUG_LVL,"MQTT disconnected\r\n");
 		//usart_disable_callback(&cdc_uart_module, USART_CALLBACK_BUFFER_RECEIVED);
 		break;
 	}
@@ -851,21 +1084,22 @@ static void configure_mqtt(void)
 	mqtt_conf.send_buffer = mqtt_send_buffer;
 	mqtt_conf.send_buffer_size = MAIN_MQTT_BUFFER_SIZE;
 	mqtt_conf.port = CLOUDMQTT_PORT;
-	mqtt_conf.keep_alive = 6000;
+	mqtt_conf.keep_alive = MQTT_COMMAND_TIMEOUT_S; //The wrapper uses this as the command timeout, not as the MQTT keep alive
 	
 	result = mqtt_init(&mqtt_inst, &mqtt_conf);
 	if (result < 0) {
-		LogMessage(LOG_DEBUG_LVL,"MQTT initialization failed. Error code is (%d)\r\n", result);
+		LogWifi(LOG_DEBUG_LVL,"MQTT initialization failed. Error code is (%d)\r\n", result);
 		while (1) {
 		}
 	}
 
 	result = mqtt_register_callback(&mqtt_inst, mqtt_callback);
 	if (result < 0) {
-		LogMessage(LOG_DEBUG_LVL,"MQTT register callback failed. Error code is (%d)\r\n", result);
+		LogWifi(LOG_DEBUG_LVL,"MQTT register callback failed. Error code is (%d)\r\n", result);
 		while (1) {
 		}
 	}
+	mqtt_inst.client->defaultMessageHandler = SubscribeHandlerDefault;
 }
 
 //SETUP FOR EXTERNAL BUTTON INTERRUPT -- Used to send an MQTT Message
@@ -913,25 +1147,12 @@ static void HTTP_DownloadFileInit(void)
 *****************************************************************************/
 static void HTTP_DownloadFileInit(void)
 {
-	
-	if(mqtt_disconnect(&mqtt_inst, main_mqtt_broker))
-	{
-		LogMessage(LOG_DEBUG_LVL,"Error connecting to MQTT Broker!\r\n");
-	}
-	while((mqtt_inst.isConnected))
-	{
-		m2m_wifi_handle_events(NULL);
-	}
-	socketDeinit();
-	//DOWNLOAD A FILE
+	//DOWNLOAD A FILE. The MQTT session stays up, the HTTP client gets its own socket.
 	do_download_flag = true;
-	/* Register socket callback function. */
-	registerSocketCallback(socket_cb, resolve_cb);
-	/* Initialize socket module. */
-	socketInit();
-	
-
+	clear_state(COMPLETED | CANCELED | MANIFEST_READY | VERIFIED);
+	download_image_pending = false;
 
+	init_storage();
 	start_download();
 	wifiStateMachine = WIFI_DOWNLOAD_HANDLE;
 }
@@ -940,27 +1161,47 @@ static void HTTP_DownloadFileInit(void)
 /**************************************************************************//**
 static void HTTP_DownloadFileTransaction(void)
 * @brief	Routine to handle the HTTP transaction of downloading a file
+* @details	Runs one pass and returns, so MQTT keeps being served while the file comes in. Goes back to
+			WIFI_MQTT_HANDLE once the download is completed or canceled.
 * @note
 
 *****************************************************************************/
 static void HTTP_DownloadFileTransaction(void)
 {
+	//Serves both sockets: events of the HTTP socket are dispatched while MQTT waits for its own data
+	MQTT_HandleTransactions();
+	if(!mqtt_inst.isConnected)
+	{
+		WifiWaitForEvent(WIFI_DOWNLOAD_POLL_MS);
+	}
 
-	/* Connect to router. */
-	while (!(is_state_set(COMPLETED) || is_state_set(CANCELED))) {
-		/* Handle pending events from network controller. */
-		m2m_wifi_handle_events(NULL);
-		/* Checks the timer timeout. */
-		sw_timer_task(&swt_module_inst);
-		//vTaskDelay(5);
+	//Manifest is in, ask for the image. Not from the HTTP callback: the client may close the socket after it.
+	if (download_image_pending && !is_state_set(CANCELED)) {
+		download_image_pending = false;
+		start_download();
 	}
 
-	//Disable socket for HTTP Transfer
-	socketDeinit();
-	vTaskDelay(1000);
-	//CONNECT TO MQTT BROKER
+	if (!(is_state_set(COMPLETED) || is_state_set(CANCELED))) {
+		return;
+	}
+
+	//A finished response leaves the connection to the keep-alive timer. One cut short must not be reused.
+	if (is_state_set(CANCELED)) {
+		http_client_close(&http_client_module_inst);
+	}
+	if (is_state_set(DOWNLOADING)) {
+		SdWriterFinish();
+		clear_state(DOWNLOADING);
+	}
 	do_download_flag = false;
 
+	//A canceled download is kept for the next try, it must not be flashed. Neither must an image that was not checked.
+	if (is_state_set(CANCELED) || !is_state_set(VERIFIED)) {
+		SerialConsoleWriteString("Download canceled, run fw again to resume it.\r\n");
+		wifiStateMachine = WIFI_MQTT_HANDLE;
+		return;
+	}
+
 	//Write Flag
 	char test_file_name[] = "0:Update.txt";
 	test_file_name[0] = LUN_ID_SD_MMC_0_MEM + '0';
@@ -969,41 +1210,34 @@ static void HTTP_DownloadFileTransaction(void)
 	FA_CREATE_ALWAYS | FA_WRITE);
 	if (res != FR_OK)
 	{
-		LogMessage(LOG_INFO_LVL ,"[FAIL] res %d\r\n", res);
+		LogWifi(LOG_INFO_LVL ,"[FAIL] res %d\r\n", res);
 	}
 	else
 	{
 		SerialConsoleWriteString("Update.txt added!\r\n");
 	}
 	f_close(&file_object);
-	wifiStateMachine = WIFI_MQTT_INIT;	
+	wifiStateMachine = WIFI_MQTT_HANDLE;
 }
 
 /**************************************************************************//**
 static void MQTT_InitRoutine(void)
-* @brief	Routine to initialize the MQTT socket to prepare for MQTT transactions
-* @note         
+* @brief	Routine to connect the MQTT client to the broker
+* @note         Sockets are not touched: the WINC socket layer is set up once in vWifiTask, the MQTT client in
+				configure_mqtt. Reconnects after a drop are handled by MQTT_HandleReconnect.
 
 *****************************************************************************/
 static void MQTT_InitRoutine(void)
 {
-	socketDeinit();
-	configure_mqtt();
-	//Re-enable socket for MQTT Transfer
-	registerSocketCallback(socket_event_handler, socket_resolve_handler);
-	socketInit();
 	/* Connect to router. */
-	if(!(mqtt_inst.isConnected))
+	if(!(mqtt_inst.isConnected) && is_state_set(WIFI_CONNECTED))
 	{
-		if (mqtt_connect(&mqtt_inst, main_mqtt_broker))
-		{
-			LogMessage(LOG_DEBUG_LVL,"Error connecting to MQTT Broker!\r\n");
-		}
+		MQTT_TryConnect();
 	}
 
 	if(mqtt_inst.isConnected)
 	{
-		LogMessage(LOG_DEBUG_LVL,"Connected to MQTT Broker!\r\n");
+		LogWifi(LOG_DEBUG_LVL,"Connected to MQTT Broker!\r\n");
 	}
 	wifiStateMachine = WIFI_MQTT_HANDLE;
 }
@@ -1021,9 +1255,11 @@ static void MQTT_HandleTransactions(void)
 	m2m_wifi_handle_events(NULL);
 	sw_timer_task(&swt_module_inst);
 
+	//Bring the broker link back if it dropped
+	MQTT_HandleReconnect();
 
 	//Check if data has to be sent!
-	MQTT_HandleGameMessages();
+	MQTT_HandlePublishQueue();
 
 	//Handle MQTT messages
 	if(mqtt_inst.isConnected)
@@ -1031,34 +1267,165 @@ static void MQTT_HandleTransactions(void)
 }
 
 
-static void MQTT_HandleGameMessages(void)
+/**************************************************************************//**
+static void MQTT_HandlePublishQueue(void)
+* @brief	Publishes every message waiting in the publish ring
+* @details	A message is only removed once mqtt_publish succeeded, which for QoS 1 means the PUBACK came back.
+			If a publish fails, draining stops and the same message is sent again on the next pass, once the
+			broker is reachable again.
+* @note
+
+*****************************************************************************/
+static void MQTT_HandlePublishQueue(void)
 {
-	struct GameDataPacket gamePacket;
-	if  (pdPASS == xQueueReceive( xQueueGameBuffer , &gamePacket, 0 ))
+	struct MqttQueuedMessage *msg;
+	while(mqtt_inst.isConnected && (msg = MqttQueuePeek()) != NULL)
 	{
-		snprintf(mqtt_msg, 63, "{\"game\":[");
-			for(int iter = 0; iter < GAME_SIZE; iter++)
+		LogWifi(LOG_DEBUG_LVL,"%s\r\n", msg->payload);
+		if(SUCCESS != mqtt_publish(&mqtt_inst, msg->topic, msg->payload, msg->len, msg->qos, 0))
+		{
+			MqttQueueRetry();
+			LogWifi(LOG_DEBUG_LVL,"MQTT publish failed, will retry!\r\n");
+			if(++mqttPublishFails >= MQTT_MAX_PUBLISH_FAILS)
 			{
-				char numGame[5];
-				if(gamePacket.game[iter] != 0xFF)
-				{
-					snprintf(numGame, 3, "%d", gamePacket.game[iter]);
-					strcat(mqtt_msg, numGame);
-					if(gamePacket.game[iter+1] != 0xFF && iter+1 <GAME_SIZE)
-					{
-						snprintf(numGame, 5, ",");
-						strcat(mqtt_msg, numGame);
-					}
-				}else
-				{
-					break;
-				}
+				mqttLinkLost = true;
 			}
-		strcat(mqtt_msg, "]}");
-		LogMessage(LOG_DEBUG_LVL,mqtt_msg);LogMessage(LOG_DEBUG_LVL,"\r\n");
-		mqtt_publish(&mqtt_inst, GAME_TOPIC_OUT, mqtt_msg, strlen(mqtt_msg), 1, 0);
+			break;
+		}
+		mqttPublishFails = 0;
+		MqttQueuePop();
 	}
 }
+
+
+/**************************************************************************//**
+static void MQTT_HandleReconnect(void)
+* @brief	Closes a dead broker link and reconnects once its backoff has elapsed
+* @details	The link is considered dead when the broker socket reports an error, when MQTT_MAX_PUBLISH_FAILS
+			publishes failed in a row or when a ping stayed unanswered for a whole keep alive period.
+			Reconnects only run while WiFi is up; the WiFi callback restarts them with no backoff on DHCP.
+* @note
+
+*****************************************************************************/
+static void MQTT_HandleReconnect(void)
+{
+	//Paho sends pings but never checks that they are answered
+	if(mqtt_inst.isConnected && mqtt_inst.client->ping_outstanding && TimerIsExpired(&mqtt_inst.client->ping_timer))
+	{
+		mqttLinkLost = true;
+	}
+
+	if(mqttLinkLost)
+	{
+		mqttLinkLost = false;
+		if(mqtt_inst.isConnected)
+		{
+			LogWifi(LOG_DEBUG_LVL,"MQTT broker link lost!\r\n");
+			MQTT_LinkDown();
+			MQTT_ScheduleReconnect();
+		}
+	}
+
+	if(mqtt_inst.isConnected || !is_state_set(WIFI_CONNECTED))
+	{
+		return;
+	}
+
+	if((int32_t)(xTaskGetTickCount() - mqttReconnectTick) >= 0)
+	{
+		MQTT_TryConnect();
+	}
+}
+
+
+/**************************************************************************//**
+static void MQTT_TryConnect(void)
+* @brief	Opens the broker socket, resumes the session and subscribes the game and status topics
+* @details	Blocks for at most the DNS, socket and command timeouts. On failure the link is closed and the next
+			attempt is scheduled with a longer backoff. Messages still in the publish ring go out on the next
+			drain, so plays that were not acknowledged before the drop are sent again.
+* @note
+
+*****************************************************************************/
+static void MQTT_TryConnect(void)
+{
+	LogWifi(LOG_DEBUG_LVL,"Connecting to MQTT Broker...\r\n");
+	mqttSessionUp = false;
+	mqtt_connect(&mqtt_inst, main_mqtt_broker);
+
+	if(mqttSessionUp)
+	{
+		mqttReconnectDelayMs = MQTT_RECONNECT_MIN_MS;
+		mqttPublishFails = 0;
+		LogWifi(LOG_DEBUG_LVL,"MQTT session up, %d messages to send\r\n", MqttQueueCount());
+	}
+	else
+	{
+		LogWifi(LOG_DEBUG_LVL,"Error connecting to MQTT Broker!\r\n");
+		MQTT_LinkDown();
+		MQTT_ScheduleReconnect();
+	}
+}
+
+
+/**************************************************************************//**
+static void MQTT_LinkDown(void)
+* @brief	Closes the broker socket and resets the client so it can connect again
+* @details	The socket is closed first, so no DISCONNECT reaches the broker and it keeps the session.
+			Message handlers are cleared as every connect subscribes again.
+* @note
+
+*****************************************************************************/
+static void MQTT_LinkDown(void)
+{
+	if(mqtt_inst.network.socket >= 0)
+	{
+		mqtt_inst.network.disconnect(&mqtt_inst.network);
+	}
+	mqtt_disconnect(&mqtt_inst, 1);
+
+	mqtt_inst.client->ping_outstanding = 0;
+	for(int i = 0; i < MAX_MESSAGE_HANDLERS; i++)
+	{
+		mqtt_inst.client->messageHandlers[i].topicFilter = 0;
+	}
+	mqttSessionUp = false;
+}
+
+
+/**************************************************************************//**
+static void MQTT_ScheduleReconnect(void)
+* @brief	Sets the time of the next reconnect attempt and doubles the backoff
+* @details	The wait is drawn between half and all of the current backoff, so boards that lost the broker
+			together do not all come back at the same tick.
+* @note
+
+*****************************************************************************/
+static void MQTT_ScheduleReconnect(void)
+{
+	uint32_t waitMs;
+
+	//xorshift32, seeded from the tick count the first time
+	if(mqttJitterSeed == 0)
+	{
+		mqttJitterSeed = xTaskGetTickCount() | 1;
+	}
+	mqttJitterSeed ^= mqttJitterSeed << 13;
+	mqttJitterSeed ^= mqttJitterSeed >> 17;
+	mqttJitterSeed ^= mqttJitterSeed << 5;
+
+	waitMs = mqttReconnectDelayMs / 2 + mqttJitterSeed % (mqttReconnectDelayMs / 2 + 1);
+	mqttReconnectTick = xTaskGetTickCount() + pdMS_TO_TICKS(waitMs);
+
+	mqttReconnectDelayMs *= 2;
+	if(mqttReconnectDelayMs > MQTT_RECONNECT_MAX_MS)
+	{
+		mqttReconnectDelayMs = MQTT_RECONNECT_MAX_MS;
+	}
+
+	LogWifiDeferred(LOG_DEBUG_LVL,"MQTT reconnect in %lu ms\r\n", waitMs);
+}
+
 /**
  * \brief Main application function.
  *
@@ -1071,12 +1438,12 @@ void vWifiTask( void *pvParameters )
 	tstrWifiInitParam param;
 	int8_t ret;
 	vTaskDelay(100);
+	wifiTaskNotifyHandle = xTaskGetCurrentTaskHandle();
 	init_state();
 	//Create buffers to send data
-	xQueueWifiState = xQueueCreate( 5, sizeof( uint32_t ) );
-	xQueueGameBuffer = xQueueCreate( 2, sizeof( struct GameDataPacket ) );
+	xQueueWifiState = xQueueCreate( 5, sizeof( uint8_t ) );
 
-	if(xQueueWifiState == NULL || xQueueGameBuffer == NULL)
+	if(xQueueWifiState == NULL)
 	{
 		SerialConsoleWriteString("ERROR Initializing Wifi Data queues!\r\n");
 	}
@@ -1091,9 +1458,6 @@ void vWifiTask( void *pvParameters )
 	/* Initialize the MQTT service. */
 	configure_mqtt();
 
-	/* Initialize SD/MMC storage. */
-	//init_storage();
-
 	/*Initialize BUTTON 0 as an external interrupt*/
 	configure_extint_channel();
 	configure_extint_callbacks();
@@ -1108,16 +1472,16 @@ void vWifiTask( void *pvParameters )
 	param.pfAppWifiCb = wifi_cb;
 	ret = m2m_wifi_init(&param);
 	if (M2M_SUCCESS != ret) {
-		LogMessage(LOG_DEBUG_LVL,"main: m2m_wifi_init call error! (res %d)\r\n", ret);
+		LogWifi(LOG_DEBUG_LVL,"main: m2m_wifi_init call error! (res %d)\r\n", ret);
 		while (1) {
 				}
 		}
 
-	LogMessage(LOG_DEBUG_LVL,"main: connecting to WiFi AP %s...\r\n", (char *)MAIN_WLAN_SSID);
+	LogWifi(LOG_DEBUG_LVL,"main: connecting to WiFi AP %s...\r\n", (char *)MAIN_WLAN_SSID);
 	
-	//Re-enable socket for MQTT Transfer
+	//Sockets are set up once. MQTT and HTTP share them through the dispatcher.
 	socketInit();
-	registerSocketCallback(socket_event_handler, socket_resolve_handler);
+	registerSocketCallback(wifi_socket_dispatch_cb, wifi_resolve_dispatch_cb);
 
 	m2m_wifi_connect((char *)MAIN_WLAN_SSID, sizeof(MAIN_WLAN_SSID), MAIN_WLAN_AUTH, (char *)MAIN_WLAN_PSK, M2M_WIFI_CH_ALL);
 
@@ -1127,6 +1491,7 @@ void vWifiTask( void *pvParameters )
 		m2m_wifi_handle_events(NULL);
 		/* Checks the timer timeout. */
 		sw_timer_task(&swt_module_inst);
+		WifiWaitForEvent(WIFI_DOWNLOAD_POLL_MS);
 	}
 
 	vTaskDelay(1000);
@@ -1170,7 +1535,11 @@ void vWifiTask( void *pvParameters )
 		wifiStateMachine = DataToReceive; // Update new state
 	}
 	
-	vTaskDelay(100);	
+	//A download paces itself on the WINC events. Otherwise sleep, but wake up at once if a message is queued.
+	if(wifiStateMachine != WIFI_DOWNLOAD_HANDLE)
+	{
+		ulTaskNotifyTake(pdTRUE, 100);
+	}
 	}
 	return 0;
 }
@@ -1185,16 +1554,70 @@ void WifiHandlerSetState(uint8_t state)
 
 
 /**************************************************************************//**
-void WifiAddGameToQueue(struct ImuDataPacket* imuPacket)
+int WifiAddGameDataToQueue(struct GameDataPacket *game)
 * @brief	Adds an game to the queue to send via MQTT. Game data must have 0xFF IN BYTES THAT WILL NOT BE SENT!
-* @param[out] 
-                				
+* @details	The packet is encoded right away, so the WiFi thread only has to send it. It is published with QoS 1
+			and stays queued until the broker acknowledges it.
+* @param[in]	game Game packet to send
+
 * @return		Returns pdTrue if data can be added to queue, pdFalse if queue is full
-* @note         
+* @note         Never blocks
 
 *****************************************************************************/
 int WifiAddGameDataToQueue(struct GameDataPacket *game)
 {
-	int error = xQueueSend(xQueueGameBuffer , game, ( TickType_t ) 10);
-	return error;
-}
\ No newline at end of file
+	char payload[GAME_CODEC_MAX_GAME_LEN + 1];
+	size_t len = GameCodecEncodeGame(game, payload, sizeof(payload));
+	if(len == 0 || !MqttQueuePush(GAME_TOPIC_OUT, payload, len, 1))
+	{
+		LogWifi(LOG_DEBUG_LVL,"Could not queue game packet!\r\n");
+		return pdFALSE;
+	}
+	WifiWakeTask();
+	return pdTRUE;
+}
+
+/**************************************************************************//**
+int WifiAddStatusDataToQueue(uint8_t *statusdada)
+* @brief	Adds a game status to the queue to send via MQTT on STATUS_TOPIC
+* @param[in]	statusdada Status to send (see GAME_STATUS)
+
+* @return		Returns pdTrue if data can be added to queue, pdFalse if queue is full
+* @note         Never blocks. Goes through the same ring as the game packets, so both are sent in order.
+
+*****************************************************************************/
+int WifiAddStatusDataToQueue(uint8_t *statusdada)
+{
+	char payload[GAME_CODEC_MAX_STATUS_LEN + 1];
+	size_t len = GameCodecEncodeStatus(*statusdada, payload, sizeof(payload));
+	if(len == 0 || !MqttQueuePush(STATUS_TOPIC, payload, len, 1))
+	{
+		LogWifi(LOG_DEBUG_LVL,"Could not queue status!\r\n");
+		return pdFALSE;
+	}
+	WifiWakeTask();
+	return pdTRUE;
+}
+
+/**************************************************************************//**
+static void WifiWakeTask(void)
+* @brief	Wakes the WiFi thread so it publishes queued messages without waiting for its next pass
+*****************************************************************************/
+static void WifiWakeTask(void)
+{
+	if(wifiTaskNotifyHandle != NULL)
+	{
+		xTaskNotifyGive(wifiTaskNotifyHandle);
+	}
+}
+
+/**************************************************************************//**
+static void WifiWaitForEvent(uint32_t maxMs)
+* @brief	Blocks until the WINC interrupt fires or the next sw_timer deadline, at most maxMs
+* @param[in]	maxMs Longest wait. Bounds the wait for work that is not driven by the WINC or the timers.
+*****************************************************************************/
+static void WifiWaitForEvent(uint32_t maxMs)
+{
+	uint32_t waitMs = sw_timer_next_deadline(&swt_module_inst);
+	nm_bsp_wait_for_event((waitMs < maxMs) ? waitMs : maxMs);
+}
@@ -18,6 +18,7 @@
 * Includes
 ******************************************************************************/
 #include "asf.h"
+#include "FreeRTOS_Threads/WifiHandlerThread/GameData.h"
 /******************************************************************************
 * Defines
 ******************************************************************************/
@@ -26,6 +27,13 @@
 #define WIFI_MQTT_HANDLE		1	///<State for Wifi handler to Handle MQTT Connection
 #define WIFI_DOWNLOAD_INIT		2	///<State for Wifi handler to Initialize Download Connection
 #define WIFI_DOWNLOAD_HANDLE	3	///<State for Wifi handler to Handle Download Connection
+#define WIFI_DOWNLOAD_POLL_MS	100	///<Longest wait for a WINC event or an sw_timer deadline while MQTT is not connected
+
+#define MQTT_RECONNECT_MIN_MS		1000	///<Wait before the first attempt to reconnect to the broker
+#define MQTT_RECONNECT_MAX_MS		60000	///<Longest wait between two attempts to reconnect to the broker
+#define MQTT_MAX_PUBLISH_FAILS		3		///<Failed publishes in a row after which the broker link is considered dead
+#define MQTT_COMMAND_TIMEOUT_S		10		///<Longest wait for the broker to answer a CONNECT, SUBSCRIBE or QoS 1 PUBLISH
+#define MQTT_CLEAN_SESSION			0		///<0 keeps the broker session (subscriptions and QoS 1 messages) across reconnects
 
 #define WIFI_TASK_SIZE	1000
 #define WIFI_PRIORITY (configMAX_PRIORITIES - 2) 
@@ -40,16 +48,22 @@
 
 /** Content URI for download. */
 #define MAIN_HTTP_FILE_URL                   "https://www.seas.upenn.edu/~wujizh/IoT.bin" ///<Change me to the URL to download your OTAU binary file from!
-
-/** Maximum size for packet buffer. */
-#define MAIN_BUFFER_MAX_SIZE                 (512)
+/** Manifest of the image: its size in bytes and its CRC32 in hex, e.g. "123456 1a2b3c4d". */
+#define MAIN_HTTP_MANIFEST_URL               "https://www.seas.upenn.edu/~wujizh/IoT.crc"
+#define MAIN_MANIFEST_MAX_SIZE               (32) ///<Longest manifest accepted
+
+/** Maximum size for packet buffer. One WINC socket MTU, so a TLS record is taken in one go. */
+#define MAIN_BUFFER_MAX_SIZE                 (1400)
+/** Time the HTTP connection is kept for the next request. Below the 5 s most servers allow. */
+#define MAIN_HTTP_KEEP_ALIVE_MS              (4000)
 /** Maximum file name length. */
 #define MAIN_MAX_FILE_NAME_LENGTH            (64)
 /** Maximum file extension length. */
 #define MAIN_MAX_FILE_EXT_LENGTH             (8)
+/** Checks of the SD/MMC slot while the card initializes, before a download is canceled for lack of storage. */
+#define MAIN_STORAGE_INIT_ATTEMPTS           (10)
 /** Output format with '0'. */
 #define MAIN_ZERO_FMT(SZ)                    (SZ == 4) ? "%04d" : (SZ == 3) ? "%03d" : (SZ == 2) ? "%02d" : "%d"
-#define GAME_SIZE		20 ///<Number of plays in game
 
 typedef enum {
 	NOT_READY = 0, /*!< Not ready. */
@@ -58,7 +72,9 @@ typedef enum {
 	GET_REQUESTED = 0x04, /*!< GET request is sent. */
 	DOWNLOADING = 0x08, /*!< Running to download. */
 	COMPLETED = 0x10, /*!< Download completed. */
-	CANCELED = 0x20 /*!< Download canceled. */
+	CANCELED = 0x20, /*!< Download canceled. */
+	MANIFEST_READY = 0x40, /*!< Manifest of the image received. */
+	VERIFIED = 0x80 /*!< Downloaded image matches the manifest. */
 } download_state;
 
 
@@ -70,12 +86,6 @@ struct ImuDataPacket
 	int16_t zmg;
 };
 
-//Structure to hold a game packet
-struct GameDataPacket
-{
-	uint8_t game[GAME_SIZE];
-};
-
 //Structure to hold an RGB LED Color packet
 struct RgbColorPacket
 {
@@ -118,6 +128,13 @@ struct RgbColorPacket
 //Cloud MQTT User
 #define CLOUDMQTT_USER_ID	"voodoomagic2"
 
+//MQTT client ID. Must be unique per board, the broker keeps the persistent session under it.
+#ifdef PLAYER1
+#define MQTT_CLIENT_ID		CLOUDMQTT_USER_ID "_P1"
+#else
+#define MQTT_CLIENT_ID		CLOUDMQTT_USER_ID "_P2"
+#endif
+
 
 //Cloud MQTT pASSWORD
 #define CLOUDMQTT_USER_PASSWORD	"ESE516Voodoomagic2"
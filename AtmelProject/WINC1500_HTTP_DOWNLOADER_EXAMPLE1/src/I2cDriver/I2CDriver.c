@@ -1,6 +1,10 @@
 /**************************************************************************//**
 * @file      I2cDriver.c
 * @brief     FreeRTOS compatible driver for I2C communications
+* @details   All transactions on the sensor bus go through a queue of I2C jobs. A job is a chain of steps (write, write
+			 without stop, read) to one device. The I2C and DMA interrupts run the steps of the job on the bus and start the next
+			 queued job as soon as one ends, so the bus is never left idle waiting for a thread to wake up. Threads either
+			 submit a job and carry on (I2cSubmitJob) or submit it and sleep until it ends (I2cRunJob and the *Wait functions).
 * @author    Eduardo Garcia, Kenny Zhang, and Chen Chen
 * @date      2021-05-05
 
@@ -19,18 +23,33 @@
 /******************************************************************************
 * Variables
 ******************************************************************************/
-SemaphoreHandle_t sensorI2cMutexHandle;						 ///<Mutex to handle the sensor I2C bus thread access.
-SemaphoreHandle_t sensorI2cSemaphoreHandle;		///<Binary semaphore to notify task that we have received an I2C interrupt on the Sensor bus
-static volatile TaskHandle_t xTaskToNotifySensorDone = NULL; ///< Stores the handle of the task that will be notified when the SENSOR transmission is complete. */
-static uint8_t sensorTransmitError = false;					 ///<Flag used to indicate that there was an I2C transmission error on the SENSOR bus.
-
 struct i2c_master_module i2cSensorBusInstance;
 static I2C_Bus_State I2cSensorBusState;   ///<Structure that defines the I2C Bus used for the sensors.
 
-struct i2c_master_packet sensorPacketWrite;
+struct i2c_master_packet sensorPacketWrite;	///<ASF packet of the step currently on the bus
+
+static I2C_Job *i2cJobHead = NULL;	///<Job currently on the bus, followed by the jobs waiting for it. NULL if the bus is idle.
+static I2C_Job *i2cJobTail = NULL;	///<Last job of the queue
+
+static I2C_Device_Profile i2cDeviceProfiles[I2C_MAX_DEVICES] = I2C_BOARD_DEVICES;	///<Speed profile of each known device. Unused entries have address 0.
+static uint8_t i2cBaudReg[I2C_SPEED_MAX_PROFILES];	///<SERCOM BAUD register value of each speed profile. 0 if the profile cannot be reached with the SERCOM clock.
+static uint8_t i2cBusSpeed = I2C_SPEED_100KHZ;		///<Speed profile the bus is currently clocked at
+
+#if I2C_USE_DMA_WRITES
+static struct dma_resource sensorI2cDmaTxResource;		///<DMA channel used to stream long writes into the SERCOM0 DATA register
+COMPILER_ALIGNED(16) DmacDescriptor sensorI2cDmaTxDescriptor SECTION_DMAC_DESCRIPTOR; ///<Transfer descriptor for the SERCOM0 TX DMA channel
+static bool sensorI2cDmaReady = false;					///<Set when the DMA channel was allocated at init. If false, DMA writes fall back to the interrupt driven job.
+static volatile bool sensorI2cDmaBusy = false;			///<Set while the step on the bus is a DMA write
+#endif
 /******************************************************************************
 * Forward Declarations
 ******************************************************************************/
+static int32_t I2cJobStartStep(I2C_Job *job);
+static void I2cJobComplete(I2C_Job *job, int32_t result, BaseType_t *pxHigherPriorityTaskWoken);
+static void I2cJobStepDone(int32_t result, BaseType_t *pxHigherPriorityTaskWoken);
+static int32_t I2cSetBusSpeed(uint8_t speed);
+static void I2cAutoprobeDevices(void);
+
 static int32_t I2cDriverConfigureSensorBus(void)
 {
 	int32_t error = STATUS_OK;
@@ -38,13 +57,13 @@ static int32_t I2cDriverConfigureSensorBus(void)
 	/* Initialize config structure and software module */
 	struct i2c_master_config config_i2c_master;
 	i2c_master_get_config_defaults(&config_i2c_master);
-	//config_i2c_master.baud_rate = I2C_MASTER_BAUD_RATE_400KHZ;
+	//Starts at 100 kHz. Faster devices are switched to their own speed profile per job (see I2cSetBusSpeed).
 	config_i2c_master.pinmux_pad0 = PINMUX_PA08C_SERCOM0_PAD0;
 	config_i2c_master.pinmux_pad1 = PINMUX_PA09C_SERCOM0_PAD1;
 	/* Change buffer timeout to something longer */
 	config_i2c_master.buffer_timeout = 1000;
 	/* Initialize and enable device with config. Try three times to initialize */
-	
+
 	for(uint8_t i = I2C_INIT_ATTEMPTS; i != 0; i--){
 		errCodeAsf = i2c_master_init(&i2cSensorBusInstance, SERCOM0, &config_i2c_master);
 		if(STATUS_OK == errCodeAsf){
@@ -54,56 +73,218 @@ static int32_t I2cDriverConfigureSensorBus(void)
 			i2c_master_reset(&i2cSensorBusInstance);
 		}
 	}
-	
+
 	if(STATUS_OK != error) goto exit;
-	
+
+	//Work out the BAUD value of each speed profile, the same way ASF does for config_i2c_master.baud_rate
+	static const uint32_t profileHz[I2C_SPEED_MAX_PROFILES] = {0, 100000, 400000, 1000000};
+	uint32_t fgclk = system_gclk_chan_get_hz(SERCOM0_GCLK_ID_CORE);
+	uint32_t riseCycles = ((fgclk / 1000) * config_i2c_master.sda_scl_rise_time_ns) / 1000000;
+	for(uint8_t i = I2C_SPEED_100KHZ; i < I2C_SPEED_MAX_PROFILES; i++){
+		int32_t baud = ((int32_t)fgclk - (int32_t)(profileHz[i] * (10 + riseCycles)) + (int32_t)(2 * profileHz[i]) - 1) / (int32_t)(2 * profileHz[i]);
+		i2cBaudReg[i] = (baud > 0 && baud <= 255) ? (uint8_t)baud : 0;
+	}
+	i2cBusSpeed = I2C_SPEED_100KHZ;
+
 	i2c_master_enable(&i2cSensorBusInstance);
-	
+
 	exit:
 	return error;
 }
+
+/**************************************************************************//**
+ * @fn			static bool I2cWaitSync(SercomI2cm *const i2cHw)
+ * @brief       Waits (bounded by I2C_BUS_IDLE_TIMEOUT) for the SERCOM registers to be synchronized
+ * @param[in]   i2cHw SERCOM of the sensor bus
+ * @return      Returns true if the registers are synchronized.
+ * @note
+ *****************************************************************************/
+static bool I2cWaitSync(SercomI2cm *const i2cHw){
+	for(uint32_t i = I2C_BUS_IDLE_TIMEOUT; i != 0; i--){
+		if(i2cHw->SYNCBUSY.reg == 0) return true;
+	}
+	return false;
+}
+
+/**************************************************************************//**
+ * @fn			static int32_t I2cSetBusSpeed(uint8_t speed)
+ * @brief       Re-clocks the sensor bus to the given speed profile
+ * @details     BAUD and the SPEED field of CTRLA can only be written with the SERCOM disabled, so the module is briefly turned off.
+				Called between jobs with the queue locked, often from the I2C interrupt, so every wait is bounded by I2C_BUS_IDLE_TIMEOUT.
+				If the STOP of the previous job is not on the wire by then, the bus is left alone and the caller fails the job
+				instead of spinning.
+ * @param[in]   speed Speed profile to switch to (eI2cSpeed)
+ * @return      Returns ERROR_NONE if the bus runs at the speed, ERROR_BUSY if it did not go idle, ERROR_IO if the SERCOM did not sync.
+ * @note
+ *****************************************************************************/
+static int32_t I2cSetBusSpeed(uint8_t speed){
+	SercomI2cm *const i2cHw = &(i2cSensorBusInstance.hw->I2CM);
+	uint32_t i;
+
+	if(speed == i2cBusSpeed || speed >= I2C_SPEED_MAX_PROFILES || i2cBaudReg[speed] == 0) return ERROR_NONE;
+
+	for(i = I2C_BUS_IDLE_TIMEOUT; i != 0; i--){
+		if((i2cHw->STATUS.reg & SERCOM_I2CM_STATUS_BUSSTATE_Msk) == SERCOM_I2CM_STATUS_BUSSTATE(1)) break;
+	}
+	if(i == 0 || !I2cWaitSync(i2cHw)) return ERROR_BUSY;
+
+	i2cHw->CTRLA.reg &= ~SERCOM_I2CM_CTRLA_ENABLE;
+	if(!I2cWaitSync(i2cHw)) return ERROR_IO;
+
+	i2cHw->BAUD.reg = SERCOM_I2CM_BAUD_BAUD(i2cBaudReg[speed]);
+	i2cHw->CTRLA.reg = (i2cHw->CTRLA.reg & ~SERCOM_I2CM_CTRLA_SPEED_Msk) |
+			SERCOM_I2CM_CTRLA_SPEED((speed == I2C_SPEED_1MHZ) ? 1 : 0);
+	i2cBusSpeed = speed;
+
+	i2cHw->CTRLA.reg |= SERCOM_I2CM_CTRLA_ENABLE;
+	if(!I2cWaitSync(i2cHw)) return ERROR_IO;
+	//Bus state is unknown after enabling. We were the last master on it, so force it to idle.
+	i2cHw->STATUS.reg = SERCOM_I2CM_STATUS_BUSSTATE(1);
+	if(!I2cWaitSync(i2cHw)) return ERROR_IO;
+
+	return ERROR_NONE;
+}
+
+/**************************************************************************//**
+ * @fn			uint8_t I2cGetDeviceSpeed(uint8_t address)
+ * @brief       Returns the speed profile a device is run at
+ * @param[in]   address Address of the I2C device
+ * @return      Returns the speed (eI2cSpeed) of the device, or I2C_SPEED_100KHZ if the device is not in the profile table.
+ * @note
+ *****************************************************************************/
+uint8_t I2cGetDeviceSpeed(uint8_t address){
+	for(uint8_t i = 0; i < I2C_MAX_DEVICES; i++){
+		if(i2cDeviceProfiles[i].address == address && address != 0){
+			return i2cDeviceProfiles[i].speed;
+		}
+	}
+	return I2C_SPEED_100KHZ;
+}
+
+/**************************************************************************//**
+ * @fn			static void I2cAutoprobeDevices(void)
+ * @brief       Finds the fastest speed each device of the profile table answers at reliably
+ * @details     Starting at the rated speed of the device, sends its address with no data I2C_PROBE_ATTEMPTS times. If every address
+				is acknowledged, the device keeps that speed, otherwise the next slower profile is tried. Devices that never answer stay
+				at 100 kHz. Only the address ACK is checked, so write-only devices (the SSD1306) are found too and no register is touched.
+				The interrupt driven jobs cannot send a write without data, so the probe uses the blocking ASF call. It must therefore
+				run before any job is queued, from I2cInitializeDriver; the waits are bounded by the ASF buffer_timeout.
+ * @note
+ *****************************************************************************/
+static void I2cAutoprobeDevices(void){
+	struct i2c_master_packet probe = {.data = NULL, .data_length = 0};
+
+	for(uint8_t i = 0; i < I2C_MAX_DEVICES; i++){
+		I2C_Device_Profile *device = &i2cDeviceProfiles[i];
+		if(device->address == 0) continue;
+
+		probe.address = device->address;
+		device->speed = I2C_SPEED_100KHZ;
+		for(uint8_t speed = device->maxSpeed; speed > I2C_SPEED_100KHZ; speed--){
+			uint8_t attempt = 0;
+			if(i2cBaudReg[speed] == 0) continue;
+
+			if(ERROR_NONE != I2cSetBusSpeed(speed)) continue;
+			for(; attempt < I2C_PROBE_ATTEMPTS; attempt++){
+				if(STATUS_OK != i2c_master_write_packet_wait(&i2cSensorBusInstance, &probe)) break;
+			}
+			if(attempt == I2C_PROBE_ATTEMPTS){
+				device->speed = speed;
+				break;
+			}
+		}
+	}
+}
+
+#if I2C_USE_DMA_WRITES
+static void I2cSensorsDmaTxDone(struct dma_resource *const resource);
+
+/**************************************************************************//**
+ * @fn			static int32_t I2cDriverConfigureSensorDma(void)
+ * @brief       Allocates a DMA channel triggered by the SERCOM0 TX request
+ * @details     The channel moves one byte from RAM into the SERCOM DATA register each time the I2C master asks for one,
+				so a long write (an OLED page, for example) costs one interrupt instead of one per byte.
+ * @return      Returns STATUS_OK if the channel was allocated.
+ * @note
+ *****************************************************************************/
+static int32_t I2cDriverConfigureSensorDma(void)
+{
+	struct dma_resource_config config;
+	dma_get_config_defaults(&config);
+	config.peripheral_trigger = SERCOM0_DMAC_ID_TX;
+	config.trigger_action = DMA_TRIGGER_ACTION_BEAT;
+
+	enum status_code errCodeAsf = dma_allocate(&sensorI2cDmaTxResource, &config);
+	if(STATUS_OK != errCodeAsf) goto exit;
+
+	struct dma_descriptor_config descriptor_config;
+	dma_descriptor_get_config_defaults(&descriptor_config);
+	descriptor_config.beat_size = DMA_BEAT_SIZE_BYTE;
+	descriptor_config.dst_increment_enable = false;
+	descriptor_config.block_transfer_count = 1;
+	descriptor_config.source_address = (uint32_t)&sensorPacketWrite;
+	descriptor_config.destination_address = (uint32_t)(&i2cSensorBusInstance.hw->I2CM.DATA.reg);
+	dma_descriptor_create(&sensorI2cDmaTxDescriptor, &descriptor_config);
+
+	errCodeAsf = dma_add_descriptor(&sensorI2cDmaTxResource, &sensorI2cDmaTxDescriptor);
+	if(STATUS_OK != errCodeAsf) goto exit;
+
+	dma_register_callback(&sensorI2cDmaTxResource, I2cSensorsDmaTxDone, DMA_CALLBACK_TRANSFER_DONE);
+	dma_enable_callback(&sensorI2cDmaTxResource, DMA_CALLBACK_TRANSFER_DONE);
+	sensorI2cDmaReady = true;
+
+	exit:
+	return errCodeAsf;
+}
+#endif
 /******************************************************************************
 * Callback Functions
 ******************************************************************************/
 /**************************************************************************//**
  * @fn			void I2cSensorsTxComplete(struct i2c_m_async_desc *const i2c)
  * @brief       Callback function for when the SENSORS I2C bus ends transmissions
- * @details     This callback sets a flag that tells us that the bus is not busy, and the last transmission is done. With USE_FREERTOS flag, this
-				callback notifies the registered thread that the I2C transfer has finished. The registered thread is the thread that initiated the I2C transaction,
-				and is currently waiting for a notification that it has finished.
+ * @details     Moves the job on the bus to its next step, or completes it and starts the next queued job. Also ends the DMA
+				writes, see I2cSensorsDmaTxDone.
  * @param[in]   i2c Pointer to I2C structure used inside the Atmel ASFv3  framework
  * @return      This function is a callback, and it is registered as such when we send an I2C transmission on this I2C bus.
- * @note        
+ * @note
  *****************************************************************************/
 void I2cSensorsTxComplete(struct i2c_master_module *const module){
-	
+
 	I2cSensorBusState.i2cState = I2C_BUS_READY;
-	I2cSensorBusState.rxDoneFlag = true;			
+	I2cSensorBusState.txDoneFlag = true;
 	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-	
-	xSemaphoreGiveFromISR( sensorI2cSemaphoreHandle, &xHigherPriorityTaskWoken );
-	sensorTransmitError = false;
+	int32_t error = ERROR_NONE;
+
+#if I2C_USE_DMA_WRITES
+	//End of a DMA write. ASF only checks the ACK of the bytes it sent itself, so check the last one here.
+	if(sensorI2cDmaBusy){
+		sensorI2cDmaBusy = false;
+		if(module->hw->I2CM.STATUS.reg & SERCOM_I2CM_STATUS_RXNACK){
+			error = ERROR_ABORTED;
+		}
+	}
+#endif
+
+	I2cJobStepDone(error, &xHigherPriorityTaskWoken);
 	portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
 }
 
 /**************************************************************************//**
  * @fn				void I2cSensorRxComplete(struct i2c_m_async_desc *const i2c)
  * @brief			Callback function for when the SENSOR I2C bus ends data reception
- * @details			This callback sets a flag that tells us that the bus is not busy, and the last reception is done. With USE_FREERTOS flag, this
-					callback notifies the registered thread that the I2C transfer has finished. The registered thread is the thread that initiated the I2C transaction,
-					and is currently waiting for a notification that it has finished.
+ * @details			Moves the job on the bus to its next step, or completes it and starts the next queued job.
  * @param[in]		i2c Pointer to I2C structure used inside the Atmel ASFv3  framework
  * @return			This function is a callback, and it is registered as such when we send an I2C reception on this I2C bus.
- * @note        
+ * @note
  *****************************************************************************/
 void I2cSensorsRxComplete(struct i2c_master_module *const module){
-	
+
 	I2cSensorBusState.i2cState = I2C_BUS_READY;
 	I2cSensorBusState.rxDoneFlag = true;
 	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-	
-	xSemaphoreGiveFromISR( sensorI2cSemaphoreHandle, &xHigherPriorityTaskWoken );
-	sensorTransmitError = false;
+
+	I2cJobStepDone(ERROR_NONE, &xHigherPriorityTaskWoken);
 	portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
 }
 
@@ -112,35 +293,54 @@ void I2cSensorsRxComplete(struct i2c_master_module *const module){
 /**************************************************************************//**
  * @fn				void I2cSensorError(struct i2c_m_async_desc *const i2c)
  * @brief			Callback function for when the LED I2C bus encounters an error while transmitting/receiving
- * @details			This callback sets a flag that tells us that the bus is not busy, and the last reception is done. With USE_FREERTOS flag, this
-					callback notifies the registered thread that the I2C transfer has finished. The registered thread is the thread that initiated the I2C transaction,
-					and is currently waiting for a notification that it has finished.
+ * @details			Completes the job on the bus with an error (remaining steps are skipped) and starts the next queued job.
  * @param[in]		i2c Pointer to I2C structure used inside the Atmel ASFv3  framework
  * @return			This function is a callback, and it is registered as such when we send an I2C reception on this I2C bus.
- * @note        
+ * @note
  *****************************************************************************/
 void I2cSensorsError(struct i2c_master_module *const module){
-	
+
 	I2cSensorBusState.i2cState = I2C_BUS_READY;
 	I2cSensorBusState.txDoneFlag = true;
 	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-	
-	xSemaphoreGiveFromISR( sensorI2cSemaphoreHandle, &xHigherPriorityTaskWoken );
-	sensorTransmitError = false;
+
+	I2cJobStepDone(ERROR_ABORTED, &xHigherPriorityTaskWoken);
 	portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
 }
 
 
 
+#if I2C_USE_DMA_WRITES
+/**************************************************************************//**
+ * @fn				static void I2cSensorsDmaTxDone(struct dma_resource *const resource)
+ * @brief			Callback function for when the DMA channel has moved the last byte of a write into the SERCOM
+ * @details			The last byte is still on the wire at this point, so the step is not over yet. Hands the end of the write to
+					the ASF interrupt handler, as if it had sent every byte itself, and enables the SERCOM MB interrupt: once the
+					last byte is acknowledged, the handler sends the STOP and calls I2cSensorsTxComplete. Nothing waits here.
+ * @param[in]		resource Pointer to the DMA resource that finished
+ * @note
+ *****************************************************************************/
+static void I2cSensorsDmaTxDone(struct dma_resource *const resource){
+	if(!sensorI2cDmaBusy) return;	//Job was cancelled by a timeout
+
+	i2cSensorBusInstance.buffer_length = sensorPacketWrite.data_length;
+	i2cSensorBusInstance.buffer_remaining = 0;
+	i2cSensorBusInstance.transfer_direction = I2C_TRANSFER_WRITE;
+	i2cSensorBusInstance.send_stop = true;
+	i2cSensorBusInstance.status = STATUS_BUSY;
+	i2cSensorBusInstance.hw->I2CM.INTENSET.reg = SERCOM_I2CM_INTENSET_MB;
+}
+#endif
+
 void I2cDriverRegisterSensorBusCallbacks(void)
 {
 	/* Register callback function. */
 	i2c_master_register_callback(&i2cSensorBusInstance, I2cSensorsTxComplete,I2C_MASTER_CALLBACK_WRITE_COMPLETE);
 	i2c_master_enable_callback(&i2cSensorBusInstance,I2C_MASTER_CALLBACK_WRITE_COMPLETE);
-	
+
 	i2c_master_register_callback(&i2cSensorBusInstance, I2cSensorsRxComplete, I2C_MASTER_CALLBACK_READ_COMPLETE);
 	i2c_master_enable_callback(&i2cSensorBusInstance,I2C_MASTER_CALLBACK_READ_COMPLETE);
-	
+
 	i2c_master_register_callback(&i2cSensorBusInstance, I2cSensorsError,I2C_MASTER_CALLBACK_ERROR);
 	i2c_master_enable_callback(&i2cSensorBusInstance,I2C_MASTER_CALLBACK_ERROR);
 }
@@ -150,466 +350,451 @@ void I2cDriverRegisterSensorBusCallbacks(void)
  * @fn			int32_t I2cInitializeDriver(void)
  * @brief       Function call to initialize the I2C driver\
  * @details     This function must be called from an RTOS thread if using RTOS, and must be called before any I2C call
- * @note        
+ * @note
  *****************************************************************************/
  int32_t I2cInitializeDriver(void){
-	
+
 	int32_t error = STATUS_OK;
 
 
 	error = I2cDriverConfigureSensorBus();
 	if(STATUS_OK != error) goto exit;
-	
+
 	I2cDriverRegisterSensorBusCallbacks();
-	
-		
-	sensorI2cMutexHandle = xSemaphoreCreateMutex();
-	
-	sensorI2cSemaphoreHandle = xSemaphoreCreateBinary();
-	//xSemaphoreGive(sensorI2cSemaphoreHandle);
-
-	
-	if(NULL == sensorI2cMutexHandle || NULL == sensorI2cSemaphoreHandle){
-		error = STATUS_SUSPEND;	//Could not initialize mutex!
-		goto exit;
+
+#if I2C_USE_DMA_WRITES
+	//Not fatal: without a channel, DMA writes use the interrupt driven job instead
+	if(STATUS_OK != I2cDriverConfigureSensorDma()){
+		sensorI2cDmaReady = false;
 	}
+#endif
+
+	i2cJobHead = NULL;
+	i2cJobTail = NULL;
+
+	I2cAutoprobeDevices();
 
 	exit:
-	return error;		
+	return error;
 }
 
 
+/******************************************************************************
+* Job Queue Functions
+******************************************************************************/
+
 /**************************************************************************//**
- * @fn    int32_t I2cWriteData(I2C_Data *data)
- * @brief       Function call to write an specified number of bytes on the given I2C bus
- * @details     
- * @param[in]   data Pointer to I2C data structure which has all the information needed to send an I2C message
- * @return      Returns an error message in case of error. See ErrCodes.h
- * @note        
+ * @fn			static int32_t I2cJobStartStep(I2C_Job *job)
+ * @brief       Puts the current step of a job on the bus
+ * @details     Called with the queue locked (critical section or I2C/DMA interrupt).
+ * @param[in]   job Job at the head of the queue
+ * @return      Returns ERROR_NONE if the step was started, ERROR_BUSY or ERROR_IO if the bus could not be re-clocked for it.
+ * @note
  *****************************************************************************/
+static int32_t I2cJobStartStep(I2C_Job *job){
+	enum status_code hwError = STATUS_ERR_INVALID_ARG;
+	const I2C_Step *step = &job->steps[job->currentStep];
 
-int32_t I2cWriteData(I2C_Data *data){
-	
-	int32_t error = ERROR_NONE;
-	enum status_code hwError;
-	struct i2c_master_module *I2CBusHw = NULL;
-	I2C_Bus_State * busI2cState;
-	struct i2c_master_packet *writePacket = NULL;
-	struct i2c_master_packet *readPacket = NULL;
-	
-	//Check parameters
-	if(data == NULL || data->msgOut == NULL){
-		error = ERR_INVALID_ARG;
-		goto exit;
+	if(job->currentStep == 0){
+		int32_t error = I2cSetBusSpeed((job->speed != I2C_SPEED_AUTO) ? job->speed : I2cGetDeviceSpeed(job->address));
+		if(ERROR_NONE != error) return error;
 	}
 
-	//Prepare to write
-	sensorPacketWrite.address = data->address;
-	sensorPacketWrite.data = (uint8_t*) data->msgOut;
-	sensorPacketWrite.data_length = data->lenOut;
-	
-	//Write
+	sensorPacketWrite.address = job->address;
+	sensorPacketWrite.data = step->data;
+	sensorPacketWrite.data_length = step->len;
+	I2cSensorBusState.i2cState = I2C_BUS_BUSY;
+	I2cSensorBusState.currentAddress = job->address;
 
-	hwError = i2c_master_write_packet_job(&i2cSensorBusInstance, &sensorPacketWrite);
-	
-	if(STATUS_OK != hwError)
+	switch(step->type)
 	{
-		error = ERROR_IO;
-		goto exit;
+		case I2C_STEP_WRITE_DMA:
+#if I2C_USE_DMA_WRITES
+			if(sensorI2cDmaReady && step->len <= I2C_DMA_MAX_TRANSFER){
+				//DMA source address is the address AFTER the last beat
+				sensorI2cDmaTxDescriptor.SRCADDR.reg = (uint32_t)step->data + step->len;
+				sensorI2cDmaTxDescriptor.BTCNT.reg = step->len;
+				hwError = dma_start_transfer_job(&sensorI2cDmaTxResource);
+				if(STATUS_OK == hwError){
+					sensorI2cDmaBusy = true;
+					//Writing the address with LENEN set starts the transfer. The SERCOM then requests bytes from the DMAC.
+					i2c_master_dma_set_transfer(&i2cSensorBusInstance, job->address, step->len, I2C_TRANSFER_WRITE);
+					break;
+				}
+				//The channel could not be started: send the step as an interrupt driven write instead
+			}
+#endif
+			hwError = i2c_master_write_packet_job(&i2cSensorBusInstance, &sensorPacketWrite);
+			break;
+
+		case I2C_STEP_WRITE:
+			hwError = i2c_master_write_packet_job(&i2cSensorBusInstance, &sensorPacketWrite);
+			break;
+
+		case I2C_STEP_WRITE_NO_STOP:
+			hwError = i2c_master_write_packet_job_no_stop(&i2cSensorBusInstance, &sensorPacketWrite);
+			break;
+
+		case I2C_STEP_READ:
+			hwError = i2c_master_read_packet_job(&i2cSensorBusInstance, &sensorPacketWrite);
+			break;
+
+		default:
+			break;
 	}
-	
-	exit:
-	return error;
+
+	if(STATUS_OK != hwError){
+		I2cSensorBusState.i2cState = I2C_BUS_READY;
+		return ERROR_IO;
+	}
+	return ERROR_NONE;
 }
 
 /**************************************************************************//**
- * @fn    int32_t I2cWriteData_No_Stop(I2C_Data *data)
- * @brief       Function call to write an specified number of bytes on the given I2C bus 
- * @details     
- * @param[in]   data Pointer to I2C data structure which has all the information needed to send an I2C message
- * @return      Returns an error message in case of error. See ErrCodes.h
- * @note        
+ * @fn			static void I2cJobComplete(I2C_Job *job, int32_t result, BaseType_t *pxHigherPriorityTaskWoken)
+ * @brief       Hands a finished job back to its owner
+ * @details     Stores the result, calls the job callback and notifies the job task. Once "done" is set the owner may reuse the
+				job memory, so the job is not touched after that.
+ * @param[in]   job Job that finished. Must already be out of the queue.
+ * @param[in]   result Result of the job
+ * @param[out]  pxHigherPriorityTaskWoken Set when called from an interrupt. NULL when called from a thread.
+ * @note
  *****************************************************************************/
+static void I2cJobComplete(I2C_Job *job, int32_t result, BaseType_t *pxHigherPriorityTaskWoken){
+	TaskHandle_t task = job->notifyTask;
 
-int32_t I2cWriteData_No_Stop(I2C_Data *data){
-	
-	int32_t error = ERROR_NONE;
-	enum status_code hwError;
-	struct i2c_master_module *I2CBusHw = NULL;
-	I2C_Bus_State * busI2cState;
-	struct i2c_master_packet *writePacket = NULL;
-	struct i2c_master_packet *readPacket = NULL;
-	
-	//Check parameters
-	if(data == NULL || data->msgOut == NULL){
-		error = ERR_INVALID_ARG;
-		goto exit;
+	job->result = result;
+	if(job->callback != NULL){
+		job->callback(job);
 	}
+	job->done = true;
 
-	//Prepare to write
-	sensorPacketWrite.address = data->address;
-	sensorPacketWrite.data = (uint8_t*) data->msgOut;
-	sensorPacketWrite.data_length = data->lenOut;
-	
-	//Write
-
-	hwError = i2c_master_write_packet_job_no_stop(&i2cSensorBusInstance, &sensorPacketWrite);
-	
-	if(STATUS_OK != hwError)
-	{
-		error = ERROR_IO;
-		goto exit;
+	if(task != NULL){
+		if(pxHigherPriorityTaskWoken != NULL){
+			vTaskNotifyGiveFromISR(task, pxHigherPriorityTaskWoken);
+		}else{
+			xTaskNotifyGive(task);
+		}
 	}
-	
-	exit:
-	return error;
 }
+
 /**************************************************************************//**
- * @fn    int32_t I2cReadData(I2C_Data *data)
- * @brief       Function call to read an specified number of bytes on the given I2C bus
- * @details     
- * @param[in]   data Pointer to I2C data structure which has all the information needed to send an I2C message
- * @return      Returns an error message in case of error. See ErrCodes.h
- * @note        
+ * @fn			static void I2cJobStartNext(BaseType_t *pxHigherPriorityTaskWoken)
+ * @brief       Pops finished jobs and starts the job at the head of the queue
+ * @details     Jobs that cannot be started are completed with an error, so one broken job never stalls the queue.
+				Called with the queue locked.
+ * @param[out]  pxHigherPriorityTaskWoken Set when called from an interrupt. NULL when called from a thread.
+ * @note
  *****************************************************************************/
-int32_t I2cReadData(I2C_Data *data){
-	
-	int32_t error = ERROR_NONE;
-	enum status_code hwError;
-	struct i2c_master_module *I2CBusHw = NULL;
-	I2C_Bus_State * busI2cState;
-	struct i2c_master_packet *writePacket = NULL;
-	struct i2c_master_packet *readPacket = NULL;
-	
-	
-	//Check parameters
-	if(data == NULL || data->msgOut == NULL){
-		error = ERR_INVALID_ARG;
-		goto exit;
+static void I2cJobStartNext(BaseType_t *pxHigherPriorityTaskWoken){
+	while(i2cJobHead != NULL){
+		int32_t error = I2cJobStartStep(i2cJobHead);
+		if(ERROR_NONE == error) return;
+
+		I2C_Job *failed = i2cJobHead;
+		i2cJobHead = failed->next;
+		if(i2cJobHead == NULL) i2cJobTail = NULL;
+		I2cJobComplete(failed, error, pxHigherPriorityTaskWoken);
 	}
+}
+
+/**************************************************************************//**
+ * @fn			static void I2cJobStepDone(int32_t result, BaseType_t *pxHigherPriorityTaskWoken)
+ * @brief       Called from the I2C and DMA interrupts when the step on the bus ends
+ * @details     Starts the next step of the job, or completes the job and starts the next one in the queue
+				without going back to a thread.
+ * @param[in]   result Result of the step that ended
+ * @param[out]  pxHigherPriorityTaskWoken Set if a task was woken up
+ * @note
+ *****************************************************************************/
+static void I2cJobStepDone(int32_t result, BaseType_t *pxHigherPriorityTaskWoken){
+	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+	I2C_Job *job = i2cJobHead;
 
-	//Prepare to read
-	sensorPacketWrite.address = data->address;
-	sensorPacketWrite.data = data->msgIn;
-	sensorPacketWrite.data_length = data->lenIn;
-	
-	//Read
+	if(job == NULL) goto exit;	//Job was cancelled by a timeout
 
-	hwError = i2c_master_read_packet_job(&i2cSensorBusInstance, &sensorPacketWrite);
-	
-	if(STATUS_OK != hwError)
-	{
-		error = ERROR_IO;
-		goto exit;
+	if(ERROR_NONE == result && ++job->currentStep < job->numSteps){
+		result = I2cJobStartStep(job);
+		if(ERROR_NONE == result) goto exit;
 	}
-	
-	exit:
-	return error;
-}
 
+	i2cJobHead = job->next;
+	if(i2cJobHead == NULL) i2cJobTail = NULL;
+	I2cJobComplete(job, result, pxHigherPriorityTaskWoken);
+	I2cJobStartNext(pxHigherPriorityTaskWoken);
 
+	exit:
+	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+}
 
 /**************************************************************************//**
- * @fn			int32_t I2cFreeMutex(void)
- * @brief       Frees the mutex of the given I2C bus (sensorI2cMutexHandle)
- * @details     
- * @param[out]   bus Enum that represents the bus in which we are interested to free the mutex of.
- * @return      Returns (ERROR_NONE) if the bus is ready, (ERROR_NOT_INITIALIZED) if it is busy.
- * @note        STUDENTS TO FILL OUT!
+ * @fn			int32_t I2cSubmitJob(I2C_Job *job)
+ * @brief       Adds a job to the end of the I2C queue and returns without waiting for it
+ * @details     If the bus is idle the first step starts right away. The job memory (and every buffer its steps point to) belongs to
+				the driver until job->done is set. When the job ends, the driver calls job->callback (from the interrupt) and notifies
+				job->notifyTask, if they are set.
+ * @param[in]   job Job to run. address, steps, numSteps, notifyTask and callback must be filled in.
+ * @return      Returns ERROR_NONE if the job was queued, ERROR_INVALID_ARG if the job is malformed, ERROR_IO or ERROR_BUSY if it could not be started.
+ * @note
  *****************************************************************************/
-int32_t I2cFreeMutex(void){
-	
+int32_t I2cSubmitJob(I2C_Job *job){
 	int32_t error = ERROR_NONE;
-	if(pdTRUE != xSemaphoreGive(sensorI2cMutexHandle))
-	{
-		error = ERROR_NOT_INITIALIZED;
+
+	if(job == NULL || job->steps == NULL || job->numSteps == 0){
+		return ERROR_INVALID_ARG;
 	}
+
+	job->next = NULL;
+	job->currentStep = 0;
+	job->result = ERROR_NONE;
+	job->done = false;
+
+	taskENTER_CRITICAL();
+	if(i2cJobHead == NULL){
+		i2cJobHead = job;
+		i2cJobTail = job;
+		error = I2cJobStartStep(job);
+		if(ERROR_NONE != error){
+			i2cJobHead = NULL;
+			i2cJobTail = NULL;
+			job->done = true;
+			job->result = error;
+		}
+	}else{
+		i2cJobTail->next = job;
+		i2cJobTail = job;
+	}
+	taskEXIT_CRITICAL();
+
 	return error;
 }
 
-
 /**************************************************************************//**
- * @fn			int32_t I2cGetMutex(TickType_t waitTime)
- * @brief       Frees the mutex of the given I2C bus
- * @details     
- * @param[in]   waitTime Time to wait for the mutex to be freed.
- * @return      Returns (ERROR_NONE) if we got the mutex, (ERROR_NOT_READY) if we time out before we got it
- * @note        
+ * @fn			static void I2cCancelJob(I2C_Job *job)
+ * @brief       Takes a job out of the queue after its owner gave up waiting for it
+ * @details     If the job is on the bus, the transfer is aborted with a STOP and the next job is started.
+ * @param[in]   job Job to cancel
+ * @note
  *****************************************************************************/
-int32_t I2cGetMutex(TickType_t waitTime){
-	
-	int32_t error = ERROR_NONE;
-	if(pdTRUE != xSemaphoreTake(sensorI2cMutexHandle, waitTime))
-	{
-		error = ERROR_NOT_READY;
+static void I2cCancelJob(I2C_Job *job){
+	taskENTER_CRITICAL();
+	if(!job->done){
+		job->notifyTask = NULL;
+		job->callback = NULL;
+		if(job == i2cJobHead){
+#if I2C_USE_DMA_WRITES
+			if(sensorI2cDmaBusy){
+				dma_abort_job(&sensorI2cDmaTxResource);
+				sensorI2cDmaBusy = false;
+			}
+#endif
+			i2c_master_cancel_job(&i2cSensorBusInstance);
+			//So a late MB or SB of the aborted transfer does not end the next job
+			i2cSensorBusInstance.hw->I2CM.INTENCLR.reg = SERCOM_I2CM_INTENCLR_MB | SERCOM_I2CM_INTENCLR_SB;
+			i2c_master_send_stop(&i2cSensorBusInstance);
+			I2cSensorBusState.i2cState = I2C_BUS_READY;
+			i2cJobHead = job->next;
+			if(i2cJobHead == NULL) i2cJobTail = NULL;
+			I2cJobComplete(job, ERROR_TIMEOUT, NULL);
+			I2cJobStartNext(NULL);
+		}else{
+			I2C_Job *prev = i2cJobHead;
+			while(prev != NULL && prev->next != job) prev = prev->next;
+			if(prev != NULL){
+				prev->next = job->next;
+				if(i2cJobTail == job) i2cJobTail = prev;
+			}
+			I2cJobComplete(job, ERROR_TIMEOUT, NULL);
+		}
 	}
-	return error;
+	taskEXIT_CRITICAL();
 }
 
-static int32_t I2cGetSemaphoreHandle(SemaphoreHandle_t *handle){
-	int32_t error = ERROR_NONE;
-	*handle = sensorI2cSemaphoreHandle;
-	return error;
-}
-
-
 /**************************************************************************//**
- * @fn			static uint8_t I2cGetTaskErrorStatus(I2C_Data *data)
- * @brief       Sets the error state of the latest I2C bus transaction for a given I2C data, which holds which physical I2C bus we are using.
- * @details     This error flag is set to indicate when a I2C transaction has failed on a given I2C bus (encapsulated in the I2C data structure).
- * @return      Returns an error message in case of error. See ErrCodes.h
- * @note        
+ * @fn			int32_t I2cWaitJob(I2C_Job *job, const TickType_t xMaxBlockTime)
+ * @brief       Sleeps until a submitted job ends
+ * @details     The job must have been submitted with notifyTask set to the calling thread. Notifications that belong to
+				something else (e.g. a thread wake up posted while we slept) are given back before returning.
+				If the job has not ended after xMaxBlockTime, it is cancelled.
+ * @param[in]   job Job to wait for
+ * @param[in]   xMaxBlockTime Maximum time to wait for the job to end
+ * @return      Returns the result of the job, or ERROR_TIMEOUT.
+ * @note
  *****************************************************************************/
- static uint8_t I2cGetTaskErrorStatus(void){
-	 return sensorTransmitError;
- }
+int32_t I2cWaitJob(I2C_Job *job, const TickType_t xMaxBlockTime){
+	TimeOut_t xTimeOut;
+	TickType_t xTicksToWait = xMaxBlockTime;
+	uint32_t foreignNotifications = 0;
+
+	vTaskSetTimeOutState(&xTimeOut);
+	while(!job->done){
+		foreignNotifications += ulTaskNotifyTake(pdTRUE, xTicksToWait);
+		if(!job->done && xTaskCheckForTimeOut(&xTimeOut, &xTicksToWait) != pdFALSE){
+			I2cCancelJob(job);
+		}
+	}
+
+	//A job that was not cancelled notified us exactly once, in the same interrupt that set "done"
+	if(job->notifyTask != NULL){
+		foreignNotifications += ulTaskNotifyTake(pdTRUE, 0);
+		if(foreignNotifications != 0) foreignNotifications--;
+	}
+	for(; foreignNotifications != 0; foreignNotifications--){
+		xTaskNotifyGive(xTaskGetCurrentTaskHandle());
+	}
+	return job->result;
+}
 
 /**************************************************************************//**
- * @fn			static uint8_t I2cSetTaskErrorStatus(I2C_Data *data, uint8_t value)
- * @brief       Sets the error state of the latest I2C bus transaction for a given I2C data, which holds which physical I2C bus we are using.
- * @details     This error flag is set to indicate when a I2C transaction has failed on a given I2C bus (encapsulated in the I2C data structure).
- * @param[in]   value Value to which to set the error flag to.
- * @return      Returns an error message in case of error. See ErrCodes.h
- * @note        
+ * @fn			int32_t I2cRunJob(I2C_Job *job, const TickType_t xMaxBlockTime)
+ * @brief       Submits a job and sleeps until it ends. This function is blocking.
+ * @param[in]   job Job to run. notifyTask and callback are overwritten.
+ * @param[in]   xMaxBlockTime Maximum time to wait for the queue and the job
+ * @return      Returns the result of the job
+ * @note
  *****************************************************************************/
- static void I2cSetTaskErrorStatus(uint8_t value){
-	sensorTransmitError = value;
- }
+int32_t I2cRunJob(I2C_Job *job, const TickType_t xMaxBlockTime){
+	job->notifyTask = xTaskGetCurrentTaskHandle();
+	job->callback = NULL;
+
+	int32_t error = I2cSubmitJob(job);
+	if(ERROR_NONE != error) return error;
 
+	return I2cWaitJob(job, xMaxBlockTime);
+}
 
 
+/******************************************************************************
+* Functions
+******************************************************************************/
+
 /**************************************************************************//**
  * @fn			int32_t I2cWriteDataWait(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime)
  * @brief       This is the main function to use to write data from an I2C device on a given I2C Bus. This function is blocking.
- * @details     This function writes data from an I2C device, by writing the requested bytes.This function is blocking (bare-metal) or it
-				makes the current thread sleep until the I2C bus has finished the transaction (FREERTOS version).
-				On FreeRtos, this function gets the mutex for the respective I2C bus.
+ * @details     This function writes data from an I2C device, by writing the requested bytes. It queues a one step job and makes
+				the current thread sleep until the I2C bus has finished the transaction.
  * @param[in]   data Pointer to I2C data structure which has all the information needed to send an I2C message
- * @param[in]   delay Delay that the I2C device needs to return the response. Can be 0 if the response is ready instantly. It can be 
-				the delay an I2C device needs to make a measurement.
- * @param[in]   xMaxBlockTime Maximum time for the thread to wait until the I2C mutex is free.
+ * @param[in]   xMaxBlockTime Maximum time for the thread to wait until the transaction is done.
  * @return      Returns an error message in case of error.
- * @note        
+ * @note
  *****************************************************************************/
 int32_t I2cWriteDataWait(I2C_Data *data, const TickType_t xMaxBlockTime){
+	I2C_Step step;
+	I2C_Job job;
 
-int32_t error = ERROR_NONE;
-SemaphoreHandle_t semHandle = NULL;
-
-
-//---0. Get Mutex
-error = 0; //Students to fill out
-error = I2cGetMutex(xMaxBlockTime);
-if(ERROR_NONE != error) goto exit;
-
-
-//---1. Get Semaphore Handle
-error = I2cGetSemaphoreHandle(&semHandle);
-if(ERROR_NONE != error) goto exit;
-
-//---2. Initiate sending data
-
-error = I2cWriteData(data);
-if (ERROR_NONE != error){
-	goto exitError0;
-}
-
-//---2. Wait for binary semaphore to tell us that we are done!
-if( xSemaphoreTake( semHandle, xMaxBlockTime ) == pdTRUE ){
-	/* The transmission ended as expected. We now delay until the I2C sensor is finished */
-	if(I2cGetTaskErrorStatus()){
-		I2cSetTaskErrorStatus(false);
-		if(error != ERROR_NONE){
-    		error = ERROR_I2C_HANG_RESET;
-    	}else{
-    		error = ERROR_ABORTED;
-		}
-		goto exitError0;
+	//Check parameters
+	if(data == NULL || data->msgOut == NULL){
+		return ERROR_INVALID_ARG;
 	}
-}else{
-	/* The call to ulTaskNotifyTake() timed out. */
-	error = ERR_TIMEOUT;
-	goto exitError0;
-}
-
-//---8. Release Mutex
-error = I2cFreeMutex();
 
-exit:
-return error;
-
-exitError0:
-error = I2cFreeMutex();
-
-return error;
+	step.type = I2C_STEP_WRITE;
+	step.data = (uint8_t*) data->msgOut;
+	step.len = data->lenOut;
+	job.address = data->address;
+	job.speed = data->speed;
+	job.steps = &step;
+	job.numSteps = 1;
 
+	return I2cRunJob(&job, xMaxBlockTime);
 }
 
 
-
 /**************************************************************************//**
  * @fn			int32_t I2cReadDataWait(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime)
  * @brief       This is the main function to use to read data from an I2C device on a given I2C Bus. This function is blocking.
- * @details     This function reads data from an I2C device, by first writing to the address (I2C device address + register) and then reading the requested bytes. This
-				function is blocking (bare-metal) or it makes the current thread sleep until the I2C bus has finished the transaction (FREERTOS version).
-				On FreeRtos, this function gets the mutex for the respective I2C bus.
+ * @details     This function reads data from an I2C device, by first writing to the address (I2C device address + register) and then reading the requested bytes.
+				Both transfers are queued as one job, so no other device can use the bus in between, and the thread sleeps until the read is done.
  * @param[in]   data Pointer to I2C data structure which has all the information needed to send an I2C message
  * @param[in]   delay Delay that the I2C device needs to return the response. Can be 0 if the response is ready instantly. It can be the delay an I2C device needs to make a measurement.
- * @param[in]   xMaxBlockTime Maximum time for the thread to wait until the I2C mutex is free.
+ * @param[in]   xMaxBlockTime Maximum time for the thread to wait until the transaction is done.
  * @return      Returns an error message in case of error. See ErrCodes.h
- * @note        THIS IS THE FREERTOS VERSION! DO NOT Declare #define USE_FREERTOS if you wish to use the baremetal version!      
-				students to fill!
+ * @note
  *****************************************************************************/
 int32_t I2cReadDataWait(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime){
-	int32_t error = ERROR_NONE;
-	SemaphoreHandle_t semHandle = NULL;
-	
-
-	//---0. Get Mutex
-	//STUDENTS FILL
-	error = 0;
-	error = I2cGetMutex(xMaxBlockTime);
-	if(ERROR_NONE != error) goto exit;
-	//---1. Get Semaphore Handle
-	error = I2cGetSemaphoreHandle(&semHandle);
-	if(ERROR_NONE != error) goto exit;
-	//---2. Initiate sending data
-	error = I2cWriteData(data);
-	if (ERROR_NONE != error){
-		goto exitError0;
-	}
-	//---3. Wait for binary semaphore to tell us that we are done!
-	if( xSemaphoreTake( semHandle, xMaxBlockTime ) == pdTRUE ){
-		/* The transmission ended as expected. We now delay until the I2C sensor is finished */
-		if(I2cGetTaskErrorStatus()){
-			I2cSetTaskErrorStatus(false);
-			if(error != ERROR_NONE){
-				error = ERROR_I2C_HANG_RESET;
-				}else{
-				error = ERROR_ABORTED;
-			}
-			goto exitError0;
-		}
-		}else{
-		/* The call to ulTaskNotifyTake() timed out. */
-		error = ERR_TIMEOUT;
-		goto exitError0;
-	}
-	//---6. Initiate Read data //TIP: SEE "I2cReadData", which is analogous to "I2cWriteData"
-	error = I2cReadData(data);
-	//---7. Wait for notification
-	if( xSemaphoreTake( semHandle, xMaxBlockTime ) == pdTRUE ){
-		/* The transmission ended as expected. We now delay until the I2C sensor is finished */
-		if(I2cGetTaskErrorStatus()){
-			I2cSetTaskErrorStatus(false);
-			if(error != ERROR_NONE){
-				error = ERROR_I2C_HANG_RESET;
-				}else{
-				error = ERROR_ABORTED;
-			}
-			goto exitError0;
-		}
-		}else{
-		/* The call to ulTaskNotifyTake() timed out. */
-		error = ERR_TIMEOUT;
-		goto exitError0;
-	}	
-
-	
-	//---8. Release Mutex
-	error = I2cFreeMutex();
-	
-	exit:
-	return error;
-
-	exitError0:
-	error = I2cFreeMutex();
+	I2C_Step steps[2];
+	I2C_Job job;
 
-	return error;
+	//Check parameters
+	if(data == NULL || data->msgOut == NULL || data->msgIn == NULL){
+		return ERROR_INVALID_ARG;
+	}
 
-	
+	steps[0].type = I2C_STEP_WRITE;
+	steps[0].data = (uint8_t*) data->msgOut;
+	steps[0].len = data->lenOut;
+	steps[1].type = I2C_STEP_READ;
+	steps[1].data = data->msgIn;
+	steps[1].len = data->lenIn;
+	job.address = data->address;
+	job.speed = data->speed;
+	job.steps = steps;
+	job.numSteps = 2;
+
+	return I2cRunJob(&job, xMaxBlockTime);
 }
 /**************************************************************************//**
  * @fn			int32_t I2cReadDataWait_NoStop(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime)
  * @brief       This is the main function to use to read data from an I2C device on a given I2C Bus. This function is blocking.
 				Difference from I2cReadDataWait is that the first write action will not send a stop signal.
- * @details     This function reads data from an I2C device, by first writing to the address (I2C device address + register) and then reading the requested bytes. This
-				function is blocking (bare-metal) or it makes the current thread sleep until the I2C bus has finished the transaction (FREERTOS version).
-				On FreeRtos, this function gets the mutex for the respective I2C bus.
+ * @details     This function reads data from an I2C device, by first writing to the address (I2C device address + register) and then reading the requested bytes
+				after a repeated start. Both transfers are queued as one job and the thread sleeps until the read is done.
  * @param[in]   data Pointer to I2C data structure which has all the information needed to send an I2C message
  * @param[in]   delay Delay that the I2C device needs to return the response. Can be 0 if the response is ready instantly. It can be the delay an I2C device needs to make a measurement.
- * @param[in]   xMaxBlockTime Maximum time for the thread to wait until the I2C mutex is free.
+ * @param[in]   xMaxBlockTime Maximum time for the thread to wait until the transaction is done.
  * @return      Returns an error message in case of error. See ErrCodes.h
- * @note        THIS IS THE FREERTOS VERSION! DO NOT Declare #define USE_FREERTOS if you wish to use the baremetal version!      
-				students to fill!
+ * @note
  *****************************************************************************/
 int32_t I2cReadDataWait_NoStop(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime){
-	int32_t error = ERROR_NONE;
-	SemaphoreHandle_t semHandle = NULL;
-	
-
-	//---0. Get Mutex
-	//STUDENTS FILL
-	error = 0;
-	error = I2cGetMutex(xMaxBlockTime);
-	if(ERROR_NONE != error) goto exit;
-	//---1. Get Semaphore Handle
-	error = I2cGetSemaphoreHandle(&semHandle);
-	if(ERROR_NONE != error) goto exit;
-	//---2. Initiate sending data
-	error = I2cWriteData_No_Stop(data);
-	if (ERROR_NONE != error){
-		goto exitError0;
-	}
-	//---3. Wait for binary semaphore to tell us that we are done!
-	if( xSemaphoreTake( semHandle, xMaxBlockTime ) == pdTRUE ){
-		/* The transmission ended as expected. We now delay until the I2C sensor is finished */
-		if(I2cGetTaskErrorStatus()){
-			I2cSetTaskErrorStatus(false);
-			if(error != ERROR_NONE){
-				error = ERROR_I2C_HANG_RESET;
-				}else{
-				error = ERROR_ABORTED;
-			}
-			goto exitError0;
-		}
-		}else{
-		/* The call to ulTaskNotifyTake() timed out. */
-		error = ERR_TIMEOUT;
-		goto exitError0;
+	I2C_Step steps[2];
+	I2C_Job job;
+
+	//Check parameters
+	if(data == NULL || data->msgOut == NULL || data->msgIn == NULL){
+		return ERROR_INVALID_ARG;
 	}
-	//---6. Initiate Read data //TIP: SEE "I2cReadData", which is analogous to "I2cWriteData"
-	error = I2cReadData(data);
-	//---7. Wait for notification
-	if( xSemaphoreTake( semHandle, xMaxBlockTime ) == pdTRUE ){
-		/* The transmission ended as expected. We now delay until the I2C sensor is finished */
-		if(I2cGetTaskErrorStatus()){
-			I2cSetTaskErrorStatus(false);
-			if(error != ERROR_NONE){
-				error = ERROR_I2C_HANG_RESET;
-				}else{
-				error = ERROR_ABORTED;
-			}
-			goto exitError0;
-		}
-		}else{
-		/* The call to ulTaskNotifyTake() timed out. */
-		error = ERR_TIMEOUT;
-		goto exitError0;
-	}	
-
-	
-	//---8. Release Mutex
-	error = I2cFreeMutex();
-	
-	exit:
-	return error;
 
-	exitError0:
-	error = I2cFreeMutex();
+	steps[0].type = I2C_STEP_WRITE_NO_STOP;
+	steps[0].data = (uint8_t*) data->msgOut;
+	steps[0].len = data->lenOut;
+	steps[1].type = I2C_STEP_READ;
+	steps[1].data = data->msgIn;
+	steps[1].len = data->lenIn;
+	job.address = data->address;
+	job.speed = data->speed;
+	job.steps = steps;
+	job.numSteps = 2;
+
+	return I2cRunJob(&job, xMaxBlockTime);
+}
 
-	return error;
 
-	
-}
+/**************************************************************************//**
+ * @fn			int32_t I2cWriteDataDmaWait(I2C_Data *data, const TickType_t xMaxBlockTime)
+ * @brief       Writes a long buffer to an I2C device using the DMAC. This function is blocking.
+ * @details     Same contract as I2cWriteDataWait, but the bytes are fed to the SERCOM by a DMA channel, so the CPU only takes one
+				interrupt at the end of the transfer. Use it for bulk writes like OLED pages. If the DMA channel is not available, or the
+				message is longer than I2C_DMA_MAX_TRANSFER, the write uses the interrupt driven job instead.
+ * @param[in]   data Pointer to I2C data structure which has all the information needed to send an I2C message
+ * @param[in]   xMaxBlockTime Maximum time for the thread to wait until the transaction is done.
+ * @return      Returns an error message in case of error.
+ * @note        The buffer pointed by data->msgOut must stay valid until this function returns.
+ *****************************************************************************/
+int32_t I2cWriteDataDmaWait(I2C_Data *data, const TickType_t xMaxBlockTime){
+	I2C_Step step;
+	I2C_Job job;
+
+	//Check parameters
+	if(data == NULL || data->msgOut == NULL || data->lenOut == 0){
+		return ERROR_INVALID_ARG;
+	}
+
+	step.type = I2C_STEP_WRITE_DMA;
+	step.data = (uint8_t*) data->msgOut;
+	step.len = data->lenOut;
+	job.address = data->address;
+	job.speed = data->speed;
+	job.steps = &step;
+	job.numSteps = 1;
 
+	return I2cRunJob(&job, xMaxBlockTime);
+}
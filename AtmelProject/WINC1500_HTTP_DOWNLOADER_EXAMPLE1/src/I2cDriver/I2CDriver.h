@@ -30,6 +30,20 @@ extern "C" {
 #define I2C_INIT_ATTEMPTS 3
 #define WAIT_I2C_LINE_MS 300
 
+#define I2C_USE_DMA_WRITES		1	///<Set to 1 to send long writes (e.g. OLED frames) through the DMAC instead of byte-per-interrupt
+#define I2C_DMA_MAX_TRANSFER	255	///<Maximum number of bytes one DMA transfer can send (SERCOM ADDR.LEN is 8 bits)
+
+#define I2C_BUS_IDLE_TIMEOUT	1000	///<Maximum number of polls to wait for the STOP of the previous job, and for each SERCOM sync, when the bus is re-clocked
+#define I2C_PROBE_ATTEMPTS		3		///<Number of address probes in a row a device must acknowledge at a speed to be run at that speed
+#define I2C_MAX_DEVICES			4		///<Maximum number of devices in the speed profile table
+
+///Devices on the sensor bus, probed at I2cInitializeDriver, with the fastest speed their datasheet allows
+#define I2C_BOARD_DEVICES { \
+	{0x3D, I2C_SPEED_400KHZ, I2C_SPEED_100KHZ},	/*SSD1306 OLED, SA0 = 1*/ \
+	{0x2E, I2C_SPEED_400KHZ, I2C_SPEED_100KHZ},	/*NeoTrellis Seesaw*/ \
+	{0x10, I2C_SPEED_400KHZ, I2C_SPEED_100KHZ},	/*VEML6030 light sensor, ADDR = GND*/ \
+}
+
 
 #define ERROR_NONE                                 0
 #define ERROR_INVALID_DATA                        -1
@@ -77,6 +91,24 @@ typedef enum eI2cBusState
 	I2C_BUS_MAX_STATES,	///<Maximum number of allowable states of a bus
 }eI2cBusState;
 
+///Speed profiles of the sensor bus
+typedef enum eI2cSpeed
+{
+	I2C_SPEED_AUTO = 0,		///<Use the speed the autoprobe found for the device (100 kHz for unknown devices)
+	I2C_SPEED_100KHZ,		///<Standard mode
+	I2C_SPEED_400KHZ,		///<Fast mode
+	I2C_SPEED_1MHZ,			///<Fast mode plus
+	I2C_SPEED_MAX_PROFILES,	///<Maximum number of speed profiles
+}eI2cSpeed;
+
+///Structure that holds the speed profile of one device
+typedef struct I2C_Device_Profile
+{
+	uint8_t address;	///<Address of the I2C device
+	uint8_t maxSpeed;	///<Fastest speed (eI2cSpeed) the device is rated for. The autoprobe starts here.
+	uint8_t speed;		///<Speed (eI2cSpeed) the device is run at
+}I2C_Device_Profile;
+
 ///Structure that describes an I2C data, determining address to use, data buffer to send, etc.
 typedef struct I2C_Data
 {
@@ -85,10 +117,45 @@ typedef struct I2C_Data
 	uint8_t	*msgIn;		///<Pointer to array buffer that we will get message to
 	uint16_t lenIn;			///<Length of message to read/write;
 	uint16_t lenOut;			///<Length of message to read/write;
+	uint8_t speed;			///<Speed profile (eI2cSpeed). I2C_SPEED_AUTO uses the speed found for the device.
 	
 }I2C_Data;
 
 
+///Type of one step of an I2C job
+typedef enum eI2cStepType
+{
+	I2C_STEP_WRITE = 0,		///<Write the step buffer, then send a STOP
+	I2C_STEP_WRITE_NO_STOP,	///<Write the step buffer without a STOP. The next step starts with a repeated START.
+	I2C_STEP_READ,			///<Read into the step buffer, then send a STOP
+	I2C_STEP_WRITE_DMA,		///<Same as I2C_STEP_WRITE, but the bytes are moved by the DMAC (falls back to I2C_STEP_WRITE)
+	I2C_STEP_MAX_TYPES,		///<Maximum number of step types
+}eI2cStepType;
+
+///Structure that describes one transfer of an I2C job
+typedef struct I2C_Step
+{
+	uint8_t type;		///<One of eI2cStepType
+	uint8_t *data;		///<Buffer to write from or read into. Must stay valid until the job is done.
+	uint16_t len;		///<Number of bytes to write or read
+}I2C_Step;
+
+///Structure that describes a chain of transfers to one device, run back to back on the bus. Memory is owned by the caller.
+typedef struct I2C_Job
+{
+	uint8_t address;					///<Address of the I2C device
+	const I2C_Step *steps;				///<Array of steps to run in order. The job stops at the first step that fails.
+	uint8_t numSteps;					///<Number of steps in the array
+	uint8_t speed;						///<Speed profile (eI2cSpeed). I2C_SPEED_AUTO uses the speed found for the device.
+	TaskHandle_t notifyTask;			///<Task to notify (xTaskNotifyGive) when the job is done. NULL for none.
+	void (*callback)(struct I2C_Job *job);	///<Function called from the I2C interrupt when the job is done. NULL for none.
+	void *context;						///<Free for the owner of the job, e.g. for the callback
+	volatile uint8_t done;				///<Set by the driver once the job has ended and its memory can be reused
+	volatile int32_t result;			///<Result of the job (ERROR_NONE on success). Valid once done is set.
+	uint8_t currentStep;				///<Used by the driver
+	struct I2C_Job *next;				///<Used by the driver
+}I2C_Job;
+
 ///Structure that describes an I2C bus data, determining the bus and the flags
 typedef struct I2C_Bus_State
 {
@@ -104,12 +171,12 @@ typedef struct I2C_Bus_State
 int32_t I2cReadDataWait(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime);
 int32_t I2cReadDataWait_NoStop(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime);
 int32_t I2cWriteDataWait(I2C_Data *data, const TickType_t xMaxBlockTime);
-int32_t I2cGetMutex(TickType_t waitTime);
-int32_t I2cFreeMutex(void);
-int32_t I2cReadData(I2C_Data *data);
-int32_t I2cWriteData(I2C_Data *data);
-int32_t I2cWriteData_No_Stop(I2C_Data *data);
+int32_t I2cWriteDataDmaWait(I2C_Data *data, const TickType_t xMaxBlockTime);
+int32_t I2cSubmitJob(I2C_Job *job);
+int32_t I2cWaitJob(I2C_Job *job, const TickType_t xMaxBlockTime);
+int32_t I2cRunJob(I2C_Job *job, const TickType_t xMaxBlockTime);
 int32_t I2cInitializeDriver(void);
+uint8_t I2cGetDeviceSpeed(uint8_t address);
 void I2cDriverRegisterSensorBusCallbacks(void);
 void I2cSensorsError(struct i2c_master_module *const module);
 void I2cSensorsRxComplete(struct i2c_master_module *const module);
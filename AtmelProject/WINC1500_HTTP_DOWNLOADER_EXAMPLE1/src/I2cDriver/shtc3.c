@@ -12,13 +12,10 @@
 ******************************************************************************/
 #include "shtc3.h"
 #include "stdint.h"
-#include "i2c_master.h"
-#include "i2c_master_interrupt.h"
 
-struct i2c_master_module i2cSensorBusInstance;
-static const uint16_t SHT3_wakeup_cmd = SHT3_SLEEP_COMMAND; //Why am I used here?
+static const uint8_t SHT3_wakeup_cmd[2] = {(SHT3_SLEEP_COMMAND >> 8) & 0xFF, SHT3_SLEEP_COMMAND & 0xFF}; ///<Command bytes, MSB first
 
-static int SHTC3_SendI2cCommand(uint8_t *buf, uint8_t size); //Why am I here? What am I?
+static int SHTC3_SendI2cCommand(const uint8_t *buf, uint8_t size); //Why am I here? What am I?
 /**************************************************************************//**
 * @fn		int SHTC3_Init(void)
 * @brief	Function to initialize the SHTC3 sensor
@@ -33,23 +30,23 @@ int SHTC3_Init(void)
     return SHTC3_SendI2cCommand(SHT3_wakeup_cmd, sizeof(SHT3_wakeup_cmd));
 }
 /**************************************************************************//**
-* @fn		static int SHTC3_SendI2cCommand(uint8_t *buf, uint8_t size)
+* @fn		static int SHTC3_SendI2cCommand(const uint8_t *buf, uint8_t size)
 * @brief	Static interface function use to send an I2C command
 * @param[in]	buf Pointer to a data buffer to send
 * @param[in]	size Ammount of bytes to send
 * @return		Returns SHT3_OK if initialized correctly
 * @note         
 *****************************************************************************/
-static int SHTC3_SendI2cCommand(uint8_t *buf, uint8_t size)
+static int SHTC3_SendI2cCommand(const uint8_t *buf, uint8_t size)
 {
-    //Write WAKE command to the device address
-    struct i2c_master_packet sensorPacketWrite;
-
-    //Prepare to write
-	sensorPacketWrite.address = SHT3_LOW_ADDRESS;   //Address to send to
-	sensorPacketWrite.data = (uint8_t*)SHT3_wakeup_cmd; //Requires a pointer to the data to send. Why dont we put a #define here?
-	sensorPacketWrite.data_length = sizeof(SHT3_wakeup_cmd); //Length to send.
-
-    return i2c_master_write_packet_job(&i2cSensorBusInstance, &sensorPacketWrite);
+    //Queue the command on the shared sensor bus instead of driving the SERCOM directly
+    I2C_Data data;
+	data.address = SHT3_LOW_ADDRESS;
+	data.msgOut = buf;
+	data.lenOut = size;
+	data.lenIn = 0;
+	data.speed = I2C_SPEED_AUTO;
+
+    return (ERROR_NONE == I2cWriteDataWait(&data, 100)) ? SHT3_OK : SHT3_COMM_ERROR;
 
 }
\ No newline at end of file
@@ -28,6 +28,9 @@
 #define MAXFONTS 5 // Do not change this line - except when _adding_ new fonts
 
 #define i2cTransactionSize 32
+#define OLED_RAM_WIDTH 0x80		///<Width of the SSD1306 GDRAM. Only LCDWIDTH columns of it are visible on the 64x48 panel.
+#define OLED_RAM_PAGES 8		///<Number of pages in the SSD1306 GDRAM
+#define OLED_SCREEN_PAGES (LCDHEIGHT / 8)	///<Number of pages visible on the 64x48 panel
 
 #ifndef INCLUDE_FONT_5x7
 #define INCLUDE_FONT_5x7 1			// Change this to 0 to exclude the 5x7 font
@@ -48,9 +51,16 @@
 * Variables
 ******************************************************************************/
 I2C_Data OLEDData; ///<Global variable to use for I2C communications with the Seesaw Device
+static uint8_t oledPageBuffer[1 + OLED_RAM_WIDTH]; ///<One I2C data transaction: the I2C_DATA control byte followed by a full page of pixels
+///Dirty column window of each page of screenmemory. A page is clean when its start is bigger than its end.
+///Starts all dirty, since the controller RAM holds random data at power up.
+static uint8_t dirtyColStart[OLED_SCREEN_PAGES] = {0, 0, 0, 0, 0, 0};
+static uint8_t dirtyColEnd[OLED_SCREEN_PAGES] = {LCDWIDTH - 1, LCDWIDTH - 1, LCDWIDTH - 1, LCDWIDTH - 1, LCDWIDTH - 1, LCDWIDTH - 1};
 /******************************************************************************
 * Forward Declarations
 ******************************************************************************/
+static void MicroOLEDmarkDirty(uint8_t page, uint8_t column);
+static void MicroOLEDbufferWrite(uint16_t index, uint8_t value);
 
 /******************************************************************************
 * @brief	MicroOLED screen buffer.
@@ -242,7 +252,7 @@ const unsigned char WAIT [] = {
 };
 // Add the font name as declared in the header file.
 // Exclude as many as possible to conserve FLASH memory.
-const unsigned int *fontsPointer[] = {
+const unsigned char *fontsPointer[] = {
 	#if INCLUDE_FONT_5x7
 	font5x7,
 	#else
@@ -413,30 +423,26 @@ int MicroOLEDdata(uint8_t c)
 *****************************************************************************/
 int MicroOLEDclear(uint8_t mode)
 {
-int error = NULL;
+int error = ERROR_NONE;
 	if (mode == ALL)
 	{
-		for (int i = 0; i < 8; i++)
+		for (int i = 0; i < OLED_RAM_PAGES; i++)
 		{
-			MicroOLEDsetPageAddress(i);
-			MicroOLEDsetColumnAddress(0);
-			uint8_t zeros[0x80];
-			memset(zeros, 0, 0x80);
-			for (int j = 0; j < 0x80; j++)
-			{
-				error= MicroOLEDdata(0);
-				if (ERROR_NONE != error){
-					return error;
-				}
-				
+			error = MicroOLEDpageWrite(i, 0, NULL, OLED_RAM_WIDTH);
+			if (ERROR_NONE != error){
+				return error;
 			}
-			
 		}
+		//The controller RAM no longer matches the screen buffer
+		MicroOLEDinvalidate();
 	}
 	else
 	{
-		memset(screenmemory, 0, sizeof(screenmemory)); // (64 x 48) / 8 = 384
-		MicroOLEDdisplay();
+		for (uint16_t i = 0; i < sizeof(screenmemory); i++) // (64 x 48) / 8 = 384
+		{
+			MicroOLEDbufferWrite(i, 0);
+		}
+		error = MicroOLEDdisplay();
 	}
 	return error;
 }
@@ -453,22 +459,106 @@ int error = NULL;
 *****************************************************************************/
 int MicroOLEDdisplay(void)
 {
-	uint8_t i, j;
-int error = NULL;
-	for (i = 0; i < 6; i++)
+	uint8_t i;
+int error = ERROR_NONE;
+	for (i = 0; i < OLED_SCREEN_PAGES; i++)
 	{
-		MicroOLEDsetPageAddress(i);
-		MicroOLEDsetColumnAddress(0);
-		for (j = 0; j < 0x40; j++)
+		if (dirtyColStart[i] > dirtyColEnd[i])
 		{
-			error= MicroOLEDdata(screenmemory[i * 0x40 + j]);
-			if (ERROR_NONE != error){
-				return error;
-			}
+			continue; //Nothing changed on this page
 		}
+		error = MicroOLEDpageWrite(i, dirtyColStart[i], &screenmemory[i * LCDWIDTH + dirtyColStart[i]], dirtyColEnd[i] - dirtyColStart[i] + 1);
+		if (ERROR_NONE != error){
+			return error; //Page stays dirty so the next call retries it
+		}
+		dirtyColStart[i] = LCDWIDTH;
+		dirtyColEnd[i] = 0;
 	}
 	return error;
 }
+
+/*****************************************************************************
+* @fn		void MicroOLEDinvalidate(void)
+* @brief	Marks the whole screen buffer as dirty
+* @details 	The next MicroOLEDdisplay() call sends every page, whether it changed or not.
+			Use it when the controller RAM may not match the screen buffer anymore.
+* @return
+* @note
+*****************************************************************************/
+void MicroOLEDinvalidate(void)
+{
+	for (uint8_t i = 0; i < OLED_SCREEN_PAGES; i++)
+	{
+		dirtyColStart[i] = 0;
+		dirtyColEnd[i] = LCDWIDTH - 1;
+	}
+}
+
+/*****************************************************************************
+* @fn		static void MicroOLEDmarkDirty(uint8_t page, uint8_t column)
+* @brief	Grows the dirty window of a page so it includes the given column
+* @details
+* @return
+* @note
+*****************************************************************************/
+static void MicroOLEDmarkDirty(uint8_t page, uint8_t column)
+{
+	if (column < dirtyColStart[page]) dirtyColStart[page] = column;
+	if (column > dirtyColEnd[page]) dirtyColEnd[page] = column;
+}
+
+/*****************************************************************************
+* @fn		static void MicroOLEDbufferWrite(uint16_t index, uint8_t value)
+* @brief	Writes one byte of the screen buffer
+* @details 	Only marks the byte dirty if its value changes, so redrawing the same content costs no I2C traffic.
+* @return
+* @note
+*****************************************************************************/
+static void MicroOLEDbufferWrite(uint16_t index, uint8_t value)
+{
+	if (screenmemory[index] != value)
+	{
+		screenmemory[index] = value;
+		MicroOLEDmarkDirty(index / LCDWIDTH, index % LCDWIDTH);
+	}
+}
+
+/*****************************************************************************
+* @fn		int MicroOLEDpageWrite(uint8_t page, uint8_t column, const uint8_t *data, uint8_t len)
+* @brief	Writes a run of bytes into one page of the SSD1306 GDRAM
+* @details 	Sets the page and column in one command transaction, then sends all the bytes in one data transaction
+			(through the DMA path of the I2C driver), instead of one transaction per byte.
+			Both transactions are steps of one job, so the I2C interrupt starts the data right after the address and
+			this thread waits for, and gets the result of, a single job.
+* @param[in]	page Page (group of 8 rows) to write
+* @param[in]	column First column to write
+* @param[in]	data Bytes to write. If NULL, the run is filled with zeros.
+* @param[in]	len Number of bytes to write. Must not be larger than OLED_RAM_WIDTH.
+* @return		Returns 0 if no errors.
+* @note
+*****************************************************************************/
+int MicroOLEDpageWrite(uint8_t page, uint8_t column, const uint8_t *data, uint8_t len)
+{
+	uint8_t cmds[4] = {I2C_COMMAND, 0xb0 | page, (0x10 | (column >> 4)) + 0x02, (0x0f & column)};
+	I2C_Step steps[2] = {
+		{I2C_STEP_WRITE, cmds, sizeof(cmds)},				//Page and column, then STOP
+		{I2C_STEP_WRITE_DMA, oledPageBuffer, len + 1},	//Data control byte and the bytes, then STOP
+	};
+	I2C_Job job = {.address = OLED_I2C_ADDRESS_SA0_1, .steps = steps, .numSteps = 2};
+	if (len == 0 || len > OLED_RAM_WIDTH){
+		return ERROR_INVALID_ARG;
+	}
+
+	oledPageBuffer[0] = I2C_DATA;
+	if (data == NULL){
+		memset(&oledPageBuffer[1], 0, len);
+	}else{
+		memcpy(&oledPageBuffer[1], data, len);
+	}
+
+	//The job stops at the first step that fails, so no data is written at a wrong address
+	return I2cRunJob(&job, 100);
+}
 /*****************************************************************************
 * @fn
 /** \brief Set SSD1306 page address.
@@ -584,17 +674,18 @@ void MicroOLEDpixel(uint8_t x, uint8_t y, uint8_t color, uint8_t mode)
 	if ((x < 0) || (x >= LCDWIDTH) || (y < 0) || (y >= LCDHEIGHT))
 	return;
 
+	uint16_t index = x + (y / 8) * LCDWIDTH;
 	if (mode == XOR)
 	{
 		if (color == WHITE)
-		screenmemory[x + (y / 8) * LCDWIDTH] ^= _BV((y % 8));
+		MicroOLEDbufferWrite(index, screenmemory[index] ^ _BV((y % 8)));
 	}
 	else
 	{
 		if (color == WHITE)
-		screenmemory[x + (y / 8) * LCDWIDTH] |= _BV((y % 8));
+		MicroOLEDbufferWrite(index, screenmemory[index] | _BV((y % 8)));
 		else
-		screenmemory[x + (y / 8) * LCDWIDTH] &= ~_BV((y % 8));
+		MicroOLEDbufferWrite(index, screenmemory[index] & ~_BV((y % 8)));
 	}
 }
 /*****************************************************************************
@@ -774,12 +865,45 @@ void MicroOLEDwrite(uint8_t c)
 
 void MicroOLEDdrawBitmap(uint8_t *bitArray)
 {
-	MicroOLEDclear(!ALL);
-	for (int i = 0; i < (LCDWIDTH * LCDHEIGHT / 8); i++)
-	screenmemory[i] = bitArray[i];
+	MicroOLEDloadBitmap(bitArray);
 	MicroOLEDdisplay();
 }
 
+/*****************************************************************************
+* @fn		void MicroOLEDloadBitmap(const uint8_t *bitArray)
+* @brief	Copies a full screen bitmap into the screen buffer without sending it
+* @details 	The bitmap covers the whole screen, so there is no need to clear the buffer first.
+			Only the bytes that differ from the current buffer are marked dirty.
+* @return
+* @note
+*****************************************************************************/
+void MicroOLEDloadBitmap(const uint8_t *bitArray)
+{
+	for (uint16_t i = 0; i < (LCDWIDTH * LCDHEIGHT / 8); i++)
+	{
+		MicroOLEDbufferWrite(i, bitArray[i]);
+	}
+}
+
+/*****************************************************************************
+* @fn		void MicroOLEDloadScreen(oledScreen_t screen)
+* @brief	Copies one of the game screens into the screen buffer without sending it
+* @details 	Used by the OLED render thread, which decides when to flush.
+* @return
+* @note
+*****************************************************************************/
+void MicroOLEDloadScreen(oledScreen_t screen)
+{
+	switch (screen)
+	{
+		case OLED_SCREEN_WAIT: MicroOLEDloadBitmap(WAIT); break;
+		case OLED_SCREEN_TURNS: MicroOLEDloadBitmap(Turns); break;
+		case OLED_SCREEN_WINNER: MicroOLEDloadBitmap(winner); break;
+		case OLED_SCREEN_LOSER: MicroOLEDloadBitmap(loser); break;
+		default: break;
+	}
+}
+
 void MicroOLEDdrawWinner(){
 	MicroOLEDdrawBitmap(winner);
 	
@@ -96,6 +96,15 @@ typedef enum CMD
 	CMD_SETDRAWMODE	  //18
 } commCommand_t;
 
+typedef enum oledScreen_t
+{
+	OLED_SCREEN_WAIT = 0,	///<Waiting for the other player
+	OLED_SCREEN_TURNS,		///<Our turn to play
+	OLED_SCREEN_WINNER,		///<Game won
+	OLED_SCREEN_LOSER,		///<Game lost
+	OLED_SCREEN_MAX			///<Number of screens
+} oledScreen_t;
+
 
 
 /******************************************************************************
@@ -104,13 +113,14 @@ typedef enum CMD
 	uint8_t mosipinmask, sckpinmask, sspinmask, dcpinmask;
 	uint8_t foreColor, drawMode, fontWidth, fontHeight, fontType, fontStartChar, fontTotalChar, cursorX, cursorY;
 	uint16_t fontMapWidth;
-	const unsigned int *fontsPointer[];
+	extern const unsigned char *fontsPointer[];
 
 	int InitializeOLEDdriver(void);
 
 	// RAW LCD functions
 	int MicroOLEDcommand(uint8_t c);
 	int MicroOLEDdata(uint8_t c);
+	int MicroOLEDpageWrite(uint8_t page, uint8_t column, const uint8_t *data, uint8_t len);
 	void MicroOLEDsetColumnAddress(uint8_t add);
 	void MicroOLEDsetPageAddress(uint8_t add);
 
@@ -119,6 +129,7 @@ typedef enum CMD
 	void MicroOLEDinvert(bool inv);
 	void MicroOLEDcontrast(uint8_t contrast);
 	int MicroOLEDdisplay(void);
+	void MicroOLEDinvalidate(void);
 	void MicroOLEDsetCursor(uint8_t x, uint8_t y);
 	void MicroOLEDpixel(uint8_t x, uint8_t y, uint8_t color, uint8_t mode);
 
@@ -130,6 +141,8 @@ typedef enum CMD
 
 	void MicroOLEDdrawChar(uint8_t x, uint8_t y, uint8_t c, uint8_t color, uint8_t mode);
 	void MicroOLEDdrawBitmap(uint8_t *bitArray);
+	void MicroOLEDloadBitmap(const uint8_t *bitArray);
+	void MicroOLEDloadScreen(oledScreen_t screen);
 	void MicroOLEDdrawWinner();
 	void MicroOLEDdrawLoser();
 	void MicroOLEDdrawTurns();
@@ -15,11 +15,21 @@
 
 #define NEO_TRELLIS_ADDR 0x2E
 
+#define SEESAW_USE_INT_PIN	0					///<Set to 1 once the Seesaw INT line is wired to SEESAW_INT_EIC_PIN. PA20 is not connected on this board, so the UI polls the keypad.
+#define SEESAW_INT_EIC_PIN	EXT1_IRQ_PIN		///<EIC pin the Seesaw INT line (active low, open drain) is wired to (PA20)
+#define SEESAW_INT_EIC_MUX	EXT1_IRQ_MUX		///<Pin mux of SEESAW_INT_EIC_PIN
+#define SEESAW_INT_EIC_LINE	EXT1_IRQ_INPUT		///<EIC channel of SEESAW_INT_EIC_PIN
+
 #define NEO_TRELLIS_NEOPIX_PIN 3
 
 #define NEO_TRELLIS_NUM_ROWS 4
 #define NEO_TRELLIS_NUM_COLS 4
 #define NEO_TRELLIS_NUM_KEYS (NEO_TRELLIS_NUM_ROWS * NEO_TRELLIS_NUM_COLS)
+#define NEO_TRELLIS_LED_BYTES (NEO_TRELLIS_NUM_KEYS * 3) ///<Size of the Neopixel buffer (GRB, 3 bytes per key)
+
+#define SEESAW_NEOPIXEL_HEADER_SIZE 4 ///<Bytes in front of the pixel data of a SEESAW_NEOPIXEL_BUF write (base, function, 16 bit offset)
+#define SEESAW_NEOPIXEL_MAX_DATA 24 ///<Maximum pixel bytes per SEESAW_NEOPIXEL_BUF write. The Seesaw I2C buffer is 32 bytes, header included.
+#define SEESAW_NEOPIXEL_MAX_CHUNKS ((NEO_TRELLIS_LED_BYTES + SEESAW_NEOPIXEL_MAX_DATA - 1) / SEESAW_NEOPIXEL_MAX_DATA) ///<Writes needed for the whole buffer
 
 #define NEO_TRELLIS_MAX_CALLBACKS 32
 
@@ -267,8 +277,11 @@ union keyState {
 };
 
 int InitializeSeesaw(void);
+void SeesawRegisterKeypadNotify(TaskHandle_t task);
+bool SeesawKeypadHasEvents(void);
 uint8_t SeesawGetKeypadCount(void);
 int32_t SeesawReadKeypad(uint8_t *buffer, uint8_t count);
 int32_t SeesawSetLed(uint8_t key, uint8_t red, uint8_t green, uint8_t blue);
+int32_t SeesawCommitLeds(void);
 int32_t SeesawOrderLedUpdate(void);
 #endif
\ No newline at end of file
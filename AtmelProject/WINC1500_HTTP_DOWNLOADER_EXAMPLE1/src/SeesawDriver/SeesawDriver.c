@@ -8,6 +8,7 @@
 
 ******************************************************************************/
 
+#include <string.h>
 #include "Seesaw.h"
 #include "I2cDriver/I2cDriver.h"
 #include "SerialConsole.h"
@@ -24,6 +25,12 @@
 * Variables
 ******************************************************************************/
 I2C_Data seesawData; ///<Global variable to use for I2C communications with the Seesaw Device
+static TaskHandle_t seesawKeypadTask = NULL; ///<Task notified when the Seesaw INT line signals new keypad events
+static uint8_t seesawLedShadow[NEO_TRELLIS_LED_BYTES]; ///<Copy of the Neopixel buffer in the Seesaw (GRB order). SeesawSetLed only writes here.
+static uint8_t seesawLedDirtyStart = 0; ///<First byte of seesawLedShadow that differs from the Seesaw. Clean when start > end.
+static uint8_t seesawLedDirtyEnd = NEO_TRELLIS_LED_BYTES - 1; ///<Last byte of seesawLedShadow that differs from the Seesaw. Starts all dirty.
+static uint8_t seesawLedTxBuffer[SEESAW_NEOPIXEL_MAX_CHUNKS][SEESAW_NEOPIXEL_HEADER_SIZE + SEESAW_NEOPIXEL_MAX_DATA]; ///<Buffer writes of one commit
+static uint8_t seesawLedShowBuffer[2] = {SEESAW_NEOPIXEL_BASE, SEESAW_NEOPIXEL_SHOW}; ///<Message to latch the Neopixel buffer to the LEDs
 /******************************************************************************
 * Forward Declarations
 ******************************************************************************/
@@ -41,6 +48,25 @@ const uint8_t msgKeypadGetCount[2] = {SEESAW_KEYPAD_BASE, SEESAW_KEYPAD_COUNT};
 
 static void SeesawTurnOnLedTest(void);
 static void SeesawInitializeKeypad(void);
+static void SeesawConfigureInterrupt(void);
+
+#if SEESAW_USE_INT_PIN
+/**************************************************************************//**
+* @fn		static void SeesawKeypadIntCallback(void)
+* @brief	EIC callback for the falling edge of the Seesaw INT line
+* @details 	The Seesaw pulls INT low when its keypad FIFO has events. Wakes the registered task so it can drain the FIFO.
+* @note
+*****************************************************************************/
+static void SeesawKeypadIntCallback(void)
+{
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+	if(seesawKeypadTask != NULL)
+	{
+		vTaskNotifyGiveFromISR(seesawKeypadTask, &xHigherPriorityTaskWoken);
+	}
+	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+#endif
 /******************************************************************************
 * Functions
 ******************************************************************************/
@@ -202,49 +228,100 @@ int32_t SeesawActivateKey(uint8_t key, uint8_t edge, bool enable)
 
 /**************************************************************************//**
 int32_t SeesawSetLed(uint8_t key, uint8_t red, uint8_t green, uint8_t blue)
-* @brief	Turns on a given LED with the given RGB colors.
+* @brief	Sets the color of a given LED in the shadow buffer.
 * @param[in] key  Key number (0 to 15)
 * @param[in] red Red color. 0 to 255.
-* @param[in] green Red color. 0 to 255.
-* @param[in] blue Red color. 0 to 255.
-                				
-* @return		Returns zero if no I2C errors occurred. Other number in case of error
-* @note         Note that the LEDs wont turn on until you send a "SeesawOrderLedUpdate" command.
+* @param[in] green Green color. 0 to 255.
+* @param[in] blue Blue color. 0 to 255.
+
+* @return		Returns ERROR_INVALID_ARG if the key does not exist, zero otherwise
+* @note         Does not touch the bus. The LEDs wont change until you call "SeesawCommitLeds" (or "SeesawOrderLedUpdate").
+	Setting a key to the color it already has costs nothing.
 	FOR ESE516 Board, please do not turn ALL the LEDs to maximum brightness (255,255,255)!
 *****************************************************************************/
 int32_t SeesawSetLed(uint8_t key, uint8_t red, uint8_t green, uint8_t blue)
 {
-	uint8_t write_buffer1[7] = {SEESAW_NEOPIXEL_BASE, SEESAW_NEOPIXEL_BUF, 0, 0, green,red, blue};
-	uint8_t orderBuffer[2] = {SEESAW_NEOPIXEL_BASE, SEESAW_NEOPIXEL_SHOW};
+	if(key >= NEO_TRELLIS_NUM_KEYS) return ERROR_INVALID_ARG;
+
+	uint8_t offset = 3 * key; //RGB LED
+	uint8_t grb[3] = {green, red, blue};
+	for(uint8_t i = 0; i < 3; i++, offset++)
+	{
+		if(seesawLedShadow[offset] == grb[i]) continue;
+		seesawLedShadow[offset] = grb[i];
+		if(seesawLedDirtyStart > seesawLedDirtyEnd){
+			seesawLedDirtyStart = offset;
+			seesawLedDirtyEnd = offset;
+		}else{
+			if(offset < seesawLedDirtyStart) seesawLedDirtyStart = offset;
+			if(offset > seesawLedDirtyEnd) seesawLedDirtyEnd = offset;
+		}
+	}
+	return ERROR_NONE;
+}
+
+/**************************************************************************//**
+int32_t SeesawCommitLeds(void)
+* @brief	Sends the changed part of the shadow buffer to the Seesaw and latches it to the LEDs.
+* @details 	Only the contiguous span between the first and last changed byte is written, split in writes of at most
+			SEESAW_NEOPIXEL_MAX_DATA bytes, followed by one SHOW. All of them go in a single I2C job, so a full
+			repaint of the 16 keys is 3 transactions instead of 17. Nothing is sent if no LED changed.
+* @return		Returns zero if no I2C errors occurred. Other number in case of error
+* @note         On error the span stays dirty and is sent again on the next commit.
+*****************************************************************************/
+int32_t SeesawCommitLeds(void)
+{
+	I2C_Step steps[SEESAW_NEOPIXEL_MAX_CHUNKS + 1];
+	I2C_Job job = {.address = NEO_TRELLIS_ADDR, .steps = steps, .numSteps = 0, .speed = I2C_SPEED_AUTO};
 
-	uint16_t offset = 3 * key; //RGB LED
-	write_buffer1[2] = (offset >> 8);
-	write_buffer1[3] = (offset);
+	if(seesawLedDirtyStart > seesawLedDirtyEnd) return ERROR_NONE;
 
-	seesawData.msgOut = &write_buffer1;
-	seesawData.lenOut = sizeof(write_buffer1);
-	int error = I2cWriteDataWait(&seesawData, 100);
-	return error;
+	uint8_t offset = seesawLedDirtyStart;
+	while(offset <= seesawLedDirtyEnd)
+	{
+		uint8_t len = seesawLedDirtyEnd - offset + 1;
+		if(len > SEESAW_NEOPIXEL_MAX_DATA) len = SEESAW_NEOPIXEL_MAX_DATA;
+
+		uint8_t *buffer = seesawLedTxBuffer[job.numSteps];
+		buffer[0] = SEESAW_NEOPIXEL_BASE;
+		buffer[1] = SEESAW_NEOPIXEL_BUF;
+		buffer[2] = 0;
+		buffer[3] = offset;
+		memcpy(&buffer[SEESAW_NEOPIXEL_HEADER_SIZE], &seesawLedShadow[offset], len);
+
+		steps[job.numSteps].type = I2C_STEP_WRITE;
+		steps[job.numSteps].data = buffer;
+		steps[job.numSteps].len = SEESAW_NEOPIXEL_HEADER_SIZE + len;
+		job.numSteps++;
+		offset += len;
+	}
+
+	steps[job.numSteps].type = I2C_STEP_WRITE;
+	steps[job.numSteps].data = seesawLedShowBuffer;
+	steps[job.numSteps].len = sizeof(seesawLedShowBuffer);
+	job.numSteps++;
 
+	int32_t error = I2cRunJob(&job, 100);
+	if(ERROR_NONE == error)
+	{
+		seesawLedDirtyStart = NEO_TRELLIS_LED_BYTES;
+		seesawLedDirtyEnd = 0;
+	}
+	return error;
 }
 
 
 /**************************************************************************//**
 int32_t SeesawOrderLedUpdate(void)
 * @brief	Orders the Seesaw driver to update the LEDs (turn on with new information given before).
-                				
+
 * @return		Returns zero if no I2C errors occurred. Other number in case of error
-* @note         Use "SeesawSetLed" to send LED Data. The data will not be use to update the display until this function has been called!
+* @note         Kept for older callers, same as "SeesawCommitLeds".
 
 *****************************************************************************/
 int32_t SeesawOrderLedUpdate(void)
 {
-	uint8_t orderBuffer[2] = {SEESAW_NEOPIXEL_BASE, SEESAW_NEOPIXEL_SHOW};
-
-	seesawData.msgOut = &orderBuffer;
-	seesawData.lenOut = sizeof(orderBuffer);
-	int error = I2cWriteDataWait(&seesawData, 100);
-	return error;
+	return SeesawCommitLeds();
 }
 
 
@@ -277,6 +354,54 @@ static void SeesawInitializeKeypad(void)
 			SerialConsoleWriteString("Could not initialize Keypad!/r/n");
 		}
 	}
+
+	SeesawConfigureInterrupt();
+}
+
+/*****************************************************************************************
+*  @brief     Routes the Seesaw INT line to an EIC channel that calls SeesawKeypadIntCallback on a falling edge
+****************************************************************************************/
+static void SeesawConfigureInterrupt(void)
+{
+#if SEESAW_USE_INT_PIN
+	struct extint_chan_conf config_extint_chan;
+	extint_chan_get_config_defaults(&config_extint_chan);
+	config_extint_chan.gpio_pin           = SEESAW_INT_EIC_PIN;
+	config_extint_chan.gpio_pin_mux       = SEESAW_INT_EIC_MUX;
+	config_extint_chan.gpio_pin_pull      = EXTINT_PULL_UP;
+	config_extint_chan.detection_criteria = EXTINT_DETECT_FALLING;
+	extint_chan_set_config(SEESAW_INT_EIC_LINE, &config_extint_chan);
+
+	extint_register_callback(SeesawKeypadIntCallback, SEESAW_INT_EIC_LINE, EXTINT_CALLBACK_TYPE_DETECT);
+	extint_chan_enable_callback(SEESAW_INT_EIC_LINE, EXTINT_CALLBACK_TYPE_DETECT);
+#endif
+}
+
+/**************************************************************************//**
+* @fn		void SeesawRegisterKeypadNotify(TaskHandle_t task)
+* @brief	Registers the task to notify (xTaskNotifyGive) when the keypad has new events
+* @param[in]	task Task to notify. NULL to stop notifications.
+* @note
+*****************************************************************************/
+void SeesawRegisterKeypadNotify(TaskHandle_t task)
+{
+	seesawKeypadTask = task;
+}
+
+/**************************************************************************//**
+* @fn		bool SeesawKeypadHasEvents(void)
+* @brief	Returns true while the Seesaw INT line is asserted, i.e. the keypad FIFO still has events
+* @details 	Used after draining the FIFO: events that arrive during the read keep INT low, so no new falling edge is seen.
+* @return	Returns true if the INT line is low. Always false if SEESAW_USE_INT_PIN is 0.
+* @note
+*****************************************************************************/
+bool SeesawKeypadHasEvents(void)
+{
+#if SEESAW_USE_INT_PIN
+	return !port_pin_get_input_level(SEESAW_INT_EIC_PIN);
+#else
+	return false;
+#endif
 }
 
 
@@ -29,19 +29,27 @@
 /******************************************************************************
 * Defines
 ******************************************************************************/
-#define RX_BUFFER_SIZE 256	///<Size of character buffer for RX, in bytes
-#define TX_BUFFER_SIZE 512	///<Size of character buffers for TX, in bytes
+#define RX_BUFFER_SIZE 256	///<Size of character buffer for RX, in bytes. Must be a power of two.
+#define TX_BUFFER_SIZE 512	///<Size of character buffers for TX, in bytes. Must be a power of two.
 
 char debugBuffer[128];
 
 /******************************************************************************
 * Structures and Enumerations
 ******************************************************************************/
-cbuf_handle_t cbufRx;	///<Circular buffer handler for receiving characters from the Serial Interface
-cbuf_handle_t cbufTx;	///<Circular buffer handler for transmitting characters from the Serial Interface
+static struct byte_ring rxRing;	///<Ring of characters received from the Serial Interface. Filled by the RX interrupt, read by the CLI task.
+static struct byte_ring txRing;	///<Ring of characters to transmit on the Serial Interface. Filled by the tasks, emptied by the TX interrupt.
 
 char latestRx;	///< Holds the latest character that was received
-char latestTx;	///< Holds the latest character to be transmitted.
+static volatile bool txBusy = false;	///<Set while a span of the TX ring is being sent
+static uint32_t txSpan = 0;				///<Number of bytes of the TX ring handed to the span being sent
+static TaskHandle_t rxWaitingTask = NULL;	///<Task reading with SerialConsoleWaitCharacter, notified by the RX interrupt
+
+#if SERIAL_CONSOLE_USE_DMA_TX
+static struct dma_resource usartDmaTxResource;		///<DMA channel used to stream the TX ring into the SERCOM DATA register
+COMPILER_ALIGNED(16) DmacDescriptor usartDmaTxDescriptor SECTION_DMAC_DESCRIPTOR; ///<Transfer descriptor for the UART TX DMA channel
+static bool usartDmaReady = false;					///<Set when the DMA channel was allocated at init. If false, spans are sent with a usart write job.
+#endif
 
 /******************************************************************************
 *  Callback Declaration
@@ -54,14 +62,20 @@ void usart_read_callback(struct usart_module *const usart_module);	//Callback fo
 ******************************************************************************/
 static void configure_usart(void);
 static void configure_usart_callbacks(void);
+static void SerialConsoleStartTx(void);
+#if SERIAL_CONSOLE_USE_DMA_TX
+static int32_t configure_usart_dma(void);
+static void usart_dma_write_callback(struct dma_resource *const resource);
+#endif
 
 /******************************************************************************
 * Global Local Variables
 ******************************************************************************/
 struct usart_module usart_instance;
-char rxCharacterBuffer[RX_BUFFER_SIZE]; ///<Buffer to store received characters
-char txCharacterBuffer[TX_BUFFER_SIZE]; ///<Buffer to store characters to be sent
+uint8_t rxCharacterBuffer[RX_BUFFER_SIZE]; ///<Buffer to store received characters
+uint8_t txCharacterBuffer[TX_BUFFER_SIZE]; ///<Buffer to store characters to be sent
 enum eDebugLogLevels currentDebugLevel = LOG_INFO_LVL; ///<Variable that holds the level of debug log messages to show. Defaults to showing all debug values
+enum eDebugLogLevels moduleDebugLevel[N_LOG_MODULES] = {LOG_INFO_LVL}; ///<Level of each module, on top of currentDebugLevel. Defaults to showing all debug values
 
 
 /******************************************************************************
@@ -81,13 +95,19 @@ enum eDebugLogLevels currentDebugLevel = LOG_INFO_LVL; ///<Variable that holds t
 void InitializeSerialConsole(void)
 {
 
-	//Initialize circular buffers for RX and TX
-	cbufRx = circular_buf_init((uint8_t*)rxCharacterBuffer, RX_BUFFER_SIZE);
-	cbufTx = circular_buf_init((uint8_t*)txCharacterBuffer, TX_BUFFER_SIZE);
+	//Initialize ring buffers for RX and TX
+	byte_ring_init(&rxRing, rxCharacterBuffer, RX_BUFFER_SIZE);
+	byte_ring_init(&txRing, txCharacterBuffer, TX_BUFFER_SIZE);
 
 	//Configure USART and Callbacks
 	configure_usart();
 	configure_usart_callbacks();
+#if SERIAL_CONSOLE_USE_DMA_TX
+	//Not fatal: without a channel, the TX ring is sent with usart write jobs instead
+	if(STATUS_OK != configure_usart_dma()){
+		usartDmaReady = false;
+	}
+#endif
 	
 	
 	usart_read_buffer_job(&usart_instance, (uint8_t*) &latestRx, 1);	//Kicks off constant reading of characters
@@ -108,26 +128,28 @@ void DeinitializeSerialConsole(void)
 /**************************************************************************//**
 * @fn			void SerialConsoleWriteString(char * string)
 * @brief		Writes a string to be written to the uart. Copies the string to a ring buffer that is used to hold the text send to the uart
-* @details		Uses the ringbuffer 'cbufTx', which in turn uses the array 'txCharacterBuffer'. Modified to be thread safe.
+* @details		Uses the ringbuffer 'txRing', which in turn uses the array 'txCharacterBuffer'. Modified to be thread safe.
+*				The tasks are the single producer of the ring, so they only lock each other out. The TX interrupt,
+*				the consumer, keeps running. If the UART is idle, the TX engine is started on the text just added.
+*				Otherwise the completion callback picks it up after the span on the wire. Characters that do not
+*				fit in the ring are dropped and counted (see SerialConsoleGetTxOverflow).
 * @note			Use to send a string of characters to the user via UART
 *****************************************************************************/
 void SerialConsoleWriteString(const char * string)
 {
-vTaskSuspendAll();
- 	if(string != NULL)
-	{
-		for (size_t iter = 0; iter < strlen(string); iter++)
-		{
-			circular_buf_put(cbufTx, string[iter]);
-		}
+	if(string == NULL) return;
 
-		if(usart_get_job_status(&usart_instance, USART_TRANSCEIVER_TX) == STATUS_OK)
-		{
-			circular_buf_get(cbufTx, (uint8_t*) &latestTx); //Perform only if the SERCOM TX is free (not busy)
-			usart_write_buffer_job(&usart_instance, (uint8_t*) &latestTx, 1);
-		}
+	vTaskSuspendAll();
+	byte_ring_put_n(&txRing, (const uint8_t*) string, strlen(string));
+
+	//No interrupt is pending while txBusy is false, but one could start a span between the test and the start
+	taskENTER_CRITICAL();
+	if(!txBusy)
+	{
+		SerialConsoleStartTx(); //Perform only if the SERCOM TX is free (not busy)
 	}
-xTaskResumeAll();
+	taskEXIT_CRITICAL();
+	xTaskResumeAll();
 }
 
 /**************************************************************************//**
@@ -135,18 +157,58 @@ xTaskResumeAll();
 * @brief		Reads a character from the RX ring buffer and stores it on the pointer given as an argument.
 *				Also, returns -1 if there is no characters on the buffer
 *				This buffer has values added to it when the UART receives ASCII characters from the terminal
-* @details		Uses the ringbuffer 'cbufTx', which in turn uses the array 'txCharacterBuffer'
+* @details		Uses the ringbuffer 'rxRing', which in turn uses the array 'rxCharacterBuffer'. The caller is the only
+*				reader of the ring and the RX interrupt the only writer, so no lock is needed.
 * @param[in]	Pointer to a character. This function will return the character from the RX buffer into this pointer
 * @return		Returns -1 if there are no characters in the buffer
-* @note			Use to receive characters from the RX buffer (FIFO)
+* @note			Use to receive characters from the RX buffer (FIFO). Call from one task only.
 *****************************************************************************/
 int SerialConsoleReadCharacter(uint8_t *rxChar)
 {
-	vTaskSuspendAll();
-	int a = circular_buf_get(cbufRx, (uint8_t*) rxChar);
-	xTaskResumeAll();
-	return a;
+	return byte_ring_get(&rxRing, rxChar);
+}
+
+/**************************************************************************//**
+* @fn			int SerialConsoleWaitCharacter(uint8_t *rxChar, TickType_t ticksToWait)
+* @brief		Same as SerialConsoleReadCharacter, but blocks until a character is received
+* @details		The RX interrupt notifies the calling task for every character it adds, so the task sleeps while the
+*				buffer is empty and wakes as soon as input comes in. A character that arrives between the empty
+*				read and the wait leaves a notification pending, so it is not missed. Characters already in the
+*				buffer are returned without waiting, so a burst is read in one go.
+* @param[out]	rxChar Pointer where the character is returned
+* @param[in]	ticksToWait Longest wait for a character, portMAX_DELAY to wait forever
+* @return		Returns -1 if no character came in within ticksToWait
+* @note			Call from one task only (the RX buffer has a single reader). Uses the task notification of the caller.
+*****************************************************************************/
+int SerialConsoleWaitCharacter(uint8_t *rxChar, TickType_t ticksToWait)
+{
+	rxWaitingTask = xTaskGetCurrentTaskHandle();
+
+	for(;;)
+	{
+		if(byte_ring_get(&rxRing, rxChar) == 0) return 0;
 
+		//A notification can also come from another driver the task uses, so the buffer is checked again
+		if(ulTaskNotifyTake(pdTRUE, ticksToWait) == 0) return byte_ring_get(&rxRing, rxChar);
+	}
+}
+
+/**************************************************************************//**
+* @fn			uint32_t SerialConsoleGetRxOverflow(void)
+* @brief		Returns the number of received characters dropped because the RX buffer was full
+*****************************************************************************/
+uint32_t SerialConsoleGetRxOverflow(void)
+{
+	return byte_ring_overflow(&rxRing);
+}
+
+/**************************************************************************//**
+* @fn			uint32_t SerialConsoleGetTxOverflow(void)
+* @brief		Returns the number of characters dropped because the TX buffer was full
+*****************************************************************************/
+uint32_t SerialConsoleGetTxOverflow(void)
+{
+	return byte_ring_overflow(&txRing);
 }
 
 
@@ -179,10 +241,37 @@ void setLogLevel(enum eDebugLogLevels debugLevel)
 currentDebugLevel = debugLevel;
 }
 
+/**************************************************************************//**
+* @fn			void setLogModuleLevel(enum eLogModules module, enum eDebugLogLevels debugLevel)
+* @brief		Sets the level of debug to print for one module. A message is printed if its level is at or above
+*				both the module level and the global level (setLogLevel).
+* @param[in]	module Module to set
+* @param[in]	debugLevel The debug level to be set for the module
+* @note			Messages below the build time level of the module (LOG_BUILD_LEVEL_*) are not in the firmware at all
+*****************************************************************************/
+void setLogModuleLevel(enum eLogModules module, enum eDebugLogLevels debugLevel)
+{
+	if(module >= N_LOG_MODULES || debugLevel >= N_DEBUG_LEVELS) return;
+	moduleDebugLevel[module] = debugLevel;
+}
+
+/**************************************************************************//**
+* @fn			enum eDebugLogLevels getLogModuleLevel(enum eLogModules module)
+* @brief		Gets the level of debug to print for one module
+* @return		Returns the level of the module, LOG_OFF_LVL if the module is not valid
+*****************************************************************************/
+enum eDebugLogLevels getLogModuleLevel(enum eLogModules module)
+{
+	if(module >= N_LOG_MODULES) return LOG_OFF_LVL;
+	return moduleDebugLevel[module];
+}
+
 
 /**************************************************************************//**
 * @fn			LogMessage (Students to fill out this)
-* @brief
+* @brief		Formats a message into 'debugBuffer' and writes it to the console, if its level is enabled
+* @details		'debugBuffer' is shared by all tasks, so the scheduler is held while it is used. For messages logged
+*				often, prefer LogDeferred (LogThread.h), which leaves the formatting to a low priority thread.
 * @note
 *****************************************************************************/
 void LogMessage(enum eDebugLogLevels level, const char *format, ...)
@@ -191,8 +280,10 @@ void LogMessage(enum eDebugLogLevels level, const char *format, ...)
 if(getLogLevel() <= level){
 	va_list ap;
 	va_start(ap, format);
+	vTaskSuspendAll();
 	vsnprintf(debugBuffer, 127, format, ap);
 	SerialConsoleWriteString(debugBuffer);
+	xTaskResumeAll();
 	va_end(ap);
 }
 };
@@ -249,6 +340,81 @@ static void configure_usart(void)
 }
 
 
+#if SERIAL_CONSOLE_USE_DMA_TX
+/**************************************************************************//**
+* @fn			static int32_t configure_usart_dma(void)
+* @brief		Allocates a DMA channel triggered by the SERCOM TX request of "EDBG_CDC_MODULE"
+* @details		The channel moves one byte of the TX ring into the SERCOM DATA register each time the UART can take
+*				one, so a span of text costs one interrupt instead of one per character.
+* @return		Returns STATUS_OK if the channel was allocated.
+* @note
+*****************************************************************************/
+static int32_t configure_usart_dma(void)
+{
+	struct dma_resource_config config;
+	dma_get_config_defaults(&config);
+	config.peripheral_trigger = SERCOM4_DMAC_ID_TX;
+	config.trigger_action = DMA_TRIGGER_ACTION_BEAT;
+
+	enum status_code errCodeAsf = dma_allocate(&usartDmaTxResource, &config);
+	if(STATUS_OK != errCodeAsf) goto exit;
+
+	struct dma_descriptor_config descriptor_config;
+	dma_descriptor_get_config_defaults(&descriptor_config);
+	descriptor_config.beat_size = DMA_BEAT_SIZE_BYTE;
+	descriptor_config.dst_increment_enable = false;
+	descriptor_config.block_transfer_count = 1;
+	descriptor_config.source_address = (uint32_t)txCharacterBuffer;
+	descriptor_config.destination_address = (uint32_t)(&usart_instance.hw->USART.DATA.reg);
+	dma_descriptor_create(&usartDmaTxDescriptor, &descriptor_config);
+
+	errCodeAsf = dma_add_descriptor(&usartDmaTxResource, &usartDmaTxDescriptor);
+	if(STATUS_OK != errCodeAsf) goto exit;
+
+	dma_register_callback(&usartDmaTxResource, usart_dma_write_callback, DMA_CALLBACK_TRANSFER_DONE);
+	dma_enable_callback(&usartDmaTxResource, DMA_CALLBACK_TRANSFER_DONE);
+	usartDmaReady = true;
+
+	exit:
+	return errCodeAsf;
+}
+#endif
+
+/**************************************************************************//**
+* @fn			static void SerialConsoleStartTx(void)
+* @brief		Sends the oldest contiguous span of the TX ring to the UART
+* @details		The span stays in the ring while it is on the wire and is removed by the completion callback, which
+*				then calls this function again for the next span. Uses the DMAC if the channel is available, a
+*				multi-byte usart write job otherwise.
+* @note			Called with the TX ring locked (critical section or TX completion interrupt)
+*****************************************************************************/
+static void SerialConsoleStartTx(void)
+{
+	uint8_t *data;
+	uint32_t len = byte_ring_peek_contiguous(&txRing, &data);
+	txBusy = false;
+	txSpan = 0;
+	if(len == 0) return;
+
+#if SERIAL_CONSOLE_USE_DMA_TX
+	if(usartDmaReady){
+		//DMA source address is the address AFTER the last beat
+		usartDmaTxDescriptor.SRCADDR.reg = (uint32_t)data + len;
+		usartDmaTxDescriptor.BTCNT.reg = len;
+		if(STATUS_OK == dma_start_transfer_job(&usartDmaTxResource)){
+			txSpan = len;
+			txBusy = true;
+		}
+		return;
+	}
+#endif
+
+	if(STATUS_OK == usart_write_buffer_job(&usart_instance, data, len)){
+		txSpan = len;
+		txBusy = true;
+	}
+}
+
 /**************************************************************************//**
 * @fn			static void configure_usart_callbacks(void)
 * @brief		Code to register callbacks
@@ -281,25 +447,46 @@ static void configure_usart_callbacks(void)
 void usart_read_callback(struct usart_module *const usart_module)
 {
 
-	circular_buf_put(cbufRx, (uint8_t) latestRx); //Add the latest read character into the RX circular Buffer
+	byte_ring_put(&rxRing, (uint8_t) latestRx); //Add the latest read character into the RX ring. Dropped and counted if full.
 	usart_read_buffer_job(&usart_instance, (uint8_t*) &latestRx, 1);	//Order the MCU to keep reading
+
+	//Wake the reader, if it sleeps in SerialConsoleWaitCharacter
+	if(rxWaitingTask != NULL)
+	{
+		BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+		vTaskNotifyGiveFromISR(rxWaitingTask, &xHigherPriorityTaskWoken);
+		portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+	}
 	
 }
 
 
 /**************************************************************************//**
 * @fn			void usart_write_callback(struct usart_module *const usart_module)
-* @brief		Callback called when the system finishes sending all the bytes requested from a UART read job
+* @brief		Callback called when the system finishes sending all the bytes requested from a UART write job
+* @details		Removes the span that was sent from the TX ring and starts the next one, if any.
 * @note
 *****************************************************************************/
 void usart_write_callback(struct usart_module *const usart_module)
 {
-	if(circular_buf_get(cbufTx, (uint8_t*) &latestTx) != -1) //Only continue if there are more characters to send
-	{
-		usart_write_buffer_job(&usart_instance, (uint8_t*) &latestTx, 1);
-	}
-	
+	byte_ring_skip(&txRing, txSpan);
+	SerialConsoleStartTx(); //Only continues if there are more characters to send
+}
+
+#if SERIAL_CONSOLE_USE_DMA_TX
+/**************************************************************************//**
+* @fn			static void usart_dma_write_callback(struct dma_resource *const resource)
+* @brief		Callback called when the DMA channel has moved the last byte of a span into the SERCOM
+* @details		The UART still shifts that byte out, but DATA is buffered, so the next span can start right away.
+* @param[in]	resource Pointer to the DMA resource that finished
+* @note
+*****************************************************************************/
+static void usart_dma_write_callback(struct dma_resource *const resource)
+{
+	byte_ring_skip(&txRing, txSpan);
+	SerialConsoleStartTx();
 }
+#endif
 
 
 
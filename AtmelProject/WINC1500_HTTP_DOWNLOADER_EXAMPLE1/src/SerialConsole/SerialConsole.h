@@ -32,12 +32,57 @@ extern "C" {
 ******************************************************************************/
 #include <asf.h>
 #include "string.h"
-#include "circular_buffer.h"
+#include "byte_ring.h"
 #include <stdarg.h>
 
 /******************************************************************************
 * Defines
 ******************************************************************************/
+#define SERIAL_CONSOLE_USE_DMA_TX	1	///<Set to 1 to feed the UART from the TX ring through the DMAC instead of one interrupt per byte
+
+/*
+ * Build time log thresholds, as eDebugLogLevels values. Messages of a module below its threshold are compiled out,
+ * arguments included. Override them from the project symbols, e.g. LOG_BUILD_LEVEL_WIFI=2 keeps WiFi warnings and up.
+ */
+#ifndef LOG_BUILD_LEVEL
+#define LOG_BUILD_LEVEL				0					///<Default threshold of all modules (LOG_INFO_LVL: nothing compiled out)
+#endif
+#ifndef LOG_BUILD_LEVEL_WIFI
+#define LOG_BUILD_LEVEL_WIFI		LOG_BUILD_LEVEL		///<Threshold of the WiFi, HTTP download and MQTT messages
+#endif
+#ifndef LOG_BUILD_LEVEL_I2C
+#define LOG_BUILD_LEVEL_I2C			LOG_BUILD_LEVEL		///<Threshold of the I2C driver messages
+#endif
+#ifndef LOG_BUILD_LEVEL_UI
+#define LOG_BUILD_LEVEL_UI			LOG_BUILD_LEVEL		///<Threshold of the UI and OLED messages
+#endif
+#ifndef LOG_BUILD_LEVEL_CONTROL
+#define LOG_BUILD_LEVEL_CONTROL		LOG_BUILD_LEVEL		///<Threshold of the control thread messages
+#endif
+#ifndef LOG_BUILD_LEVEL_CLI
+#define LOG_BUILD_LEVEL_CLI			LOG_BUILD_LEVEL		///<Threshold of the CLI messages
+#endif
+#ifndef LOG_BUILD_LEVEL_BOOT
+#define LOG_BUILD_LEVEL_BOOT		LOG_BUILD_LEVEL		///<Threshold of the start-up messages
+#endif
+
+/**
+ * True if a message of the module (WIFI, I2C, UI, CONTROL, CLI or BOOT) at the level is printed. Constant false
+ * when the level is below the build threshold of the module, so the compiler drops the message.
+ */
+#define LOG_ENABLED(module, level)	\
+	((level) >= LOG_BUILD_LEVEL_##module && LogModuleLevelEnabled(LOG_MODULE_##module, (level)))
+
+///Logs a message of a module. Same arguments as LogMessage after the module.
+#define LogModule(module, level, ...)	\
+	do { if(LOG_ENABLED(module, level)) LogMessage((level), __VA_ARGS__); } while(0)
+
+#define LogWifi(level, ...)		LogModule(WIFI, level, __VA_ARGS__)		///<Logs a WiFi, HTTP download or MQTT message
+#define LogI2c(level, ...)		LogModule(I2C, level, __VA_ARGS__)		///<Logs an I2C driver message
+#define LogUi(level, ...)		LogModule(UI, level, __VA_ARGS__)		///<Logs a UI or OLED message
+#define LogControl(level, ...)	LogModule(CONTROL, level, __VA_ARGS__)	///<Logs a control thread message
+#define LogCli(level, ...)		LogModule(CLI, level, __VA_ARGS__)		///<Logs a CLI message
+#define LogBoot(level, ...)		LogModule(BOOT, level, __VA_ARGS__)		///<Logs a start-up message
 
 
 /******************************************************************************
@@ -53,6 +98,20 @@ enum eDebugLogLevels {
 	N_DEBUG_LEVELS = 6	//Max number of log levels
 };
 
+///Modules with their own log level
+enum eLogModules {
+	LOG_MODULE_WIFI = 0,	//WiFi, HTTP download and MQTT
+	LOG_MODULE_I2C,			//I2C driver
+	LOG_MODULE_UI,			//UI and OLED
+	LOG_MODULE_CONTROL,		//Control thread
+	LOG_MODULE_CLI,			//Command line interface
+	LOG_MODULE_BOOT,		//Start-up
+	N_LOG_MODULES			//Number of modules
+};
+
+extern enum eDebugLogLevels currentDebugLevel;
+extern enum eDebugLogLevels moduleDebugLevel[N_LOG_MODULES];
+
 
 
 /******************************************************************************
@@ -62,12 +121,26 @@ void InitializeSerialConsole(void);
 void DeinitializeSerialConsole(void);
 void SerialConsoleWriteString(const char * string);
 int SerialConsoleReadCharacter(uint8_t *rxChar);
+int SerialConsoleWaitCharacter(uint8_t *rxChar, TickType_t ticksToWait);
+uint32_t SerialConsoleGetRxOverflow(void);
+uint32_t SerialConsoleGetTxOverflow(void);
 void LogMessage(enum eDebugLogLevels level, const char *format, ...);
 void setLogLevel(enum eDebugLogLevels debugLevel);
 enum eDebugLogLevels getLogLevel(void);
+void setLogModuleLevel(enum eLogModules module, enum eDebugLogLevels debugLevel);
+enum eDebugLogLevels getLogModuleLevel(enum eLogModules module);
 struct usart_module* GetUsartModule(void);
 void LogMessageDebug(const char *format, ...);
 
+/**************************************************************************//**
+* @fn			static inline bool LogModuleLevelEnabled(enum eLogModules module, enum eDebugLogLevels level)
+* @brief		Run time half of LOG_ENABLED: true if the level passes both the global and the module level
+*****************************************************************************/
+static inline bool LogModuleLevelEnabled(enum eLogModules module, enum eDebugLogLevels level)
+{
+	return level >= currentDebugLevel && level >= moduleDebugLevel[module];
+}
+
 /******************************************************************************
 * Local Functions
 ******************************************************************************/
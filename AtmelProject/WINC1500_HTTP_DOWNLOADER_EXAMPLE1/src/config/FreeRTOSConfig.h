@@ -55,7 +55,7 @@ void assert_triggered( const char * file, uint32_t line );
 #define configMAX_PRIORITIES                    ( 5 )
 #define configMINIMAL_STACK_SIZE                ( ( unsigned short ) 100)
 /* configTOTAL_HEAP_SIZE is not used when heap_3.c is used. */
-#define configTOTAL_HEAP_SIZE                   ( ( size_t ) ( 12000 ) )
+#define configTOTAL_HEAP_SIZE                   ( ( size_t ) ( 15300 ) ) /* 12000 plus the SD writer task stack and queues, the log task stack, and the OLED task stack, queues and semaphore */
 #define configMAX_TASK_NAME_LEN                 ( 8 )
 #define configUSE_TRACE_FACILITY                1
 #define configUSE_16_BIT_TICKS                  0
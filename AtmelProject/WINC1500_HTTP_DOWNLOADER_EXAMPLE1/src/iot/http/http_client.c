@@ -33,6 +33,7 @@
 
 #include "iot/http/http_client.h"
 #include <string.h>
+#include <strings.h>
 #include "driver/include/m2m_wifi.h"
 #include "iot/stream_writer.h"
 #include <stdio.h>
@@ -42,6 +43,16 @@
 
 #define MIN_SEND_BUFFER_SIZE 18 + HTTP_MAX_URI_LENGTH /* DELETE {URI} HTTP/1.1\r\n */
 
+/* Longest sleep while a send is in progress. The WINC interrupt normally wakes the task first. */
+#define HTTP_SEND_WAIT_MS 100
+
+/* Longest header line parsed when it wraps around the end of the receive buffer. */
+#define HTTP_HEADER_LINE_SIZE 64
+
+/* Values of read_length in chunked mode when no chunk data is expected. */
+#define HTTP_CHUNK_SIZE_LINE (-1) /* Waiting for the size line of the next chunk. */
+#define HTTP_CHUNK_TRAILER   (-2) /* Last chunk read. Waiting for the end of the trailer. */
+
 enum http_client_req_state {
 	STATE_INIT = 0,
 	STATE_TRY_SOCK_CONNECT,
@@ -115,12 +126,56 @@ int _http_client_handle_header(struct http_client_module *const module);
  */
 int _http_client_handle_entity(struct http_client_module *const module);
 /**
- * \brief Move remain part of the buffer to the start position in the buffer.
+ * \brief Drop parsed bytes from the front of the receive buffer. Nothing is moved.
+ *
+ * \param[in]  module          Module instance of HTTP.
+ * \param[in]  length          Number of bytes parsed.
+ */
+void _http_client_consume(struct http_client_module *const module, uint32_t length);
+/**
+ * \brief Keep the connection for the next request once a response is complete.
  *
  * \param[in]  module          Module instance of HTTP.
- * \param[in]  base            Current position of the buffer pointer.
+ *
+ * \return     0               Connection was closed.
+ * \return     1               Connection is kept open.
+ */
+int _http_client_keep_alive(struct http_client_module *const module);
+
+static int _http_client_reopen_stale(struct http_client_module *const module);
+
+/**
+ * \brief Position in the receive buffer of the byte offset bytes after the oldest one.
+ *
+ * The receive buffer is a ring. Parsed bytes are dropped by moving its head, never by moving the data.
+ */
+static inline uint32_t _http_client_ring_index(struct http_client_module *const module, uint32_t offset)
+{
+	uint32_t index = module->recv_head + offset;
+
+	if (index >= module->config.recv_buffer_size) {
+		index -= module->config.recv_buffer_size;
+	}
+	return index;
+}
+
+/**
+ * \brief Byte offset bytes after the oldest one in the receive buffer.
+ */
+static inline char _http_client_ring_at(struct http_client_module *const module, uint32_t offset)
+{
+	return module->config.recv_buffer[_http_client_ring_index(module, offset)];
+}
+
+/**
+ * \brief Number of received bytes that sit in one piece from the oldest one.
  */
-void _http_client_move_buffer(struct http_client_module *const module, char *base);
+static inline uint32_t _http_client_ring_contiguous(struct http_client_module *const module)
+{
+	uint32_t span = module->config.recv_buffer_size - module->recv_head;
+
+	return (module->recved_size < span) ? module->recved_size : span;
+}
 
 /**
  * \brief Timer callback entry of HTTP client.
@@ -143,6 +198,7 @@ void http_client_get_config_defaults(struct http_client_config *const config)
 	config->port = 80;
 	config->tls = 0;
 	config->timeout = 20000;
+	config->keep_alive_timeout = 0;
 	config->timer_inst = NULL;
 	config->recv_buffer = NULL;
 	config->recv_buffer_size = 256;
@@ -157,7 +213,7 @@ int http_client_init(struct http_client_module *const module, struct http_client
 		return -EINVAL;
 	}
 
-	if (config->recv_buffer_size == 0) {
+	if (config->recv_buffer_size == 0 || config->recv_buffer_size > HTTP_MAX_RECV_BUFFER_SIZE) {
 		return -EINVAL;
 	}
 
@@ -174,14 +230,18 @@ int http_client_init(struct http_client_module *const module, struct http_client
 
 	/* Allocate the buffer in the heap. */
 	if (module->config.recv_buffer == NULL) {
+#if HTTP_CLIENT_STATIC_RECV_BUFFER
+		return -EINVAL;
+#else
 		module->config.recv_buffer = malloc(config->recv_buffer_size);
 		if (module->config.recv_buffer == NULL) {
 			return -ENOMEM;
 		}
 		module->alloc_buffer = 1;
+#endif
 	}
 
-	if (config->timeout > 0) {
+	if (config->timeout > 0 || config->keep_alive_timeout > 0) {
 		/* Enable the timer. */
 		module->timer_id = sw_timer_register_callback(config->timer_inst, http_client_timer_callback, (void *)module, 0);
 
@@ -306,7 +366,9 @@ void http_client_socket_event_handler(SOCKET sock, uint8_t msg_type, void *msg_d
 			}
 			module->req.state = STATE_REQ_SEND_HEADER;
 			/* Start timer. */
-			sw_timer_enable_callback(module->config.timer_inst, module->timer_id, module->config.timeout);
+			if (module->config.timeout > 0) {
+				sw_timer_enable_callback(module->config.timer_inst, module->timer_id, module->config.timeout);
+			}
     		/* Start receive packet. */
     		_http_client_recv_packet(module);
 			/* Try to check the FSM. */
@@ -318,6 +380,9 @@ void http_client_socket_event_handler(SOCKET sock, uint8_t msg_type, void *msg_d
     	/* Start post processing. */
     	if (msg_recv->s16BufferSize > 0) {
     		_http_client_recved_packet(module, msg_recv->s16BufferSize);
+		} else if (_http_client_reopen_stale(module) == 0) {
+			/* Request goes out again on a new connection. */
+			break;
 		} else {
 			/* Socket was occurred errors. Close this session. */
 			_http_client_clear_conn(module, _hwerr_to_stderr(msg_recv->s16BufferSize));
@@ -329,7 +394,10 @@ void http_client_socket_event_handler(SOCKET sock, uint8_t msg_type, void *msg_d
 		send_ret = *(int16_t*)msg_data;
 		if (send_ret < 0) {
 			/* Send failed. */
-			_http_client_clear_conn(module, _hwerr_to_stderr(send_ret));
+			module->sending = 0;
+			if (_http_client_reopen_stale(module) != 0) {
+				_http_client_clear_conn(module, _hwerr_to_stderr(send_ret));
+			}
 		} else {
 			/* Try to check the FSM. */
     		_http_client_request(module);
@@ -376,7 +444,8 @@ void http_client_timer_callback(struct sw_timer_module *const module, int timer_
 		return;
 	}
 
-	_http_client_clear_conn(module_inst, -ETIME);
+	/* An idle connection that timed out is closed normally, a request that timed out is an error. */
+	_http_client_clear_conn(module_inst, module_inst->idle ? 0 : -ETIME);
 }
 
 static int _is_ip(const char *host)
@@ -399,11 +468,77 @@ static int _is_ip(const char *host)
 	return 1;
 }
 
-int http_client_send_request(struct http_client_module *const module, const char *url,
-	enum http_method method, struct http_entity *const entity, const char *ext_header)
+/**
+ * \brief Open the socket and start connecting to the host of the module.
+ *
+ * \param[in]  module          Module instance of HTTP.
+ *
+ * \return     0               Function succeeded
+ * \return     -ENOSPC         No socket left.
+ */
+static int _http_client_connect(struct http_client_module *const module)
 {
 	uint8_t flag = 0;
 	struct sockaddr_in addr_in;
+	SOCKET sock;
+
+	if (module->config.tls) {
+		flag |= SOCKET_FLAGS_SSL;
+	}
+	sock = socket(AF_INET, SOCK_STREAM, flag);
+	if (sock < 0) {
+		return -ENOSPC;
+	}
+
+	module->sock = sock;
+	module_ref_inst[module->sock] = module;
+	if (_is_ip(module->host)) {
+		addr_in.sin_family = AF_INET;
+		addr_in.sin_port = _htons(module->config.port);
+		addr_in.sin_addr.s_addr = nmi_inet_addr((char *)module->host);
+		connect(module->sock, (struct sockaddr *)&addr_in, sizeof(struct sockaddr_in));
+	} else {
+		gethostbyname((uint8*)module->host);
+	}
+	module->req.state = STATE_TRY_SOCK_CONNECT;
+
+	return 0;
+}
+
+/**
+ * \brief Send the request again on a new connection if the server dropped the reused one.
+ *
+ * A server may close an idle persistent connection just as the next request goes out.
+ * Requests without entity are sent again once. Anything else is reported to the application.
+ * A connection dropped while idle has no request to send again, its last one was answered.
+ *
+ * \param[in]  module          Module instance of HTTP.
+ *
+ * \return     0               Request is sent again.
+ * \return     otherwise       Connection must be cleared.
+ */
+static int _http_client_reopen_stale(struct http_client_module *const module)
+{
+	if (!module->reused || module->idle || module->recved_size != 0 || module->resp.response_code != 0
+			|| module->req.entity.read != NULL || module->req.state < STATE_SOCK_CONNECTED) {
+		return -1;
+	}
+
+	close(module->sock);
+	module_ref_inst[module->sock] = NULL;
+	module->reused = 0;
+	module->sending = 0;
+	module->permanent = 0;
+	module->resp.state = STATE_PARSE_HEADER;
+	/* Socket is closed already. */
+	module->req.state = STATE_INIT;
+
+	return _http_client_connect(module);
+}
+
+int http_client_send_request(struct http_client_module *const module, const char *url,
+	enum http_method method, struct http_entity *const entity, const char *ext_header)
+{
 	const char *uri = NULL;
 	int i = 0, j = 0, reconnect = 0;
 
@@ -421,7 +556,9 @@ int http_client_send_request(struct http_client_module *const module, const char
 	} else if (!strncmp(url, "https://", 8)) {
 		i = 8;
 	}
-	reconnect = strncmp(module->host, url + i, strlen(module->host));
+	j = strlen(module->host);
+	reconnect = strncmp(module->host, url + i, j) || (url[i + j] != '/' && url[i + j] != '\0');
+	j = 0;
 
 	for (; url[i] != '\0' && url[i] != '/'; i++) {
 		module->host[j++] = url[i];
@@ -438,6 +575,14 @@ int http_client_send_request(struct http_client_module *const module, const char
 		return -ENAMETOOLONG;
 	}
 
+	/* A persistent connection is only reused once the previous response was read to its end. */
+	if ((module->req.state == STATE_TRY_SOCK_CONNECT && reconnect)
+			|| (module->req.state == STATE_SOCK_CONNECTED
+				&& (reconnect || module->resp.state != STATE_PARSE_HEADER || module->recved_size != 0))) {
+		/* Request to another peer. Disconnect and try connect again. */
+		_http_client_clear_conn(module, 0);
+	}
+
 	if (module->req.ext_header != NULL) {
 		free(module->req.ext_header);
 	}
@@ -452,6 +597,7 @@ int http_client_send_request(struct http_client_module *const module, const char
 
 	module->sending = 0;
 	module->recved_size = 0;
+	module->recv_head = 0;
 	if (uri[0] == '/') {
 		strcpy(module->req.uri, uri);
 		} else {
@@ -471,39 +617,23 @@ int http_client_send_request(struct http_client_module *const module, const char
 	
 	switch (module->req.state) {
 	case STATE_TRY_SOCK_CONNECT:
-		if (!reconnect) {
-			break; /* Currently try to connect to the same server. */
-		}
+		break; /* Currently try to connect to the same server. */
 	case STATE_SOCK_CONNECTED:
-		if (!reconnect) {
-			module->req.state = STATE_REQ_SEND_HEADER;
-			/* Send request immediately. */
-			_http_client_request(module);
-			break;
-		} else {
-			/* Request to another peer. Disconnect and try connect again. */
-			_http_client_clear_conn(module, 0);
-		}
-	case STATE_INIT:
-		if (module->config.tls) {
-			flag |= SOCKET_FLAGS_SSL;
-		}
-		module->sock = socket(AF_INET, SOCK_STREAM, flag);
-		if (module->sock >= 0) {
-			module_ref_inst[module->sock] = module;
-			if (_is_ip(module->host)) {
-				addr_in.sin_family = AF_INET;
-				addr_in.sin_port = _htons(module->config.port);
-				addr_in.sin_addr.s_addr = nmi_inet_addr((char *)module->host);
-				connect(module->sock, (struct sockaddr *)&addr_in, sizeof(struct sockaddr_in));
-			} else {
-				gethostbyname((uint8*)module->host);
-			}
-			module->req.state = STATE_TRY_SOCK_CONNECT;
-		} else {
-			return -ENOSPC;
+		/* Persistent connection is idle. Reuse it and skip the DNS, TCP and TLS handshakes. */
+		module->idle = 0;
+		module->reused = 1;
+		module->req.state = STATE_REQ_SEND_HEADER;
+		if (module->config.timeout > 0) {
+			sw_timer_enable_callback(module->config.timer_inst, module->timer_id, module->config.timeout);
+		} else if (module->config.keep_alive_timeout > 0) {
+			sw_timer_disable_callback(module->config.timer_inst, module->timer_id);
 		}
+		/* Send request immediately. */
+		_http_client_request(module);
 		break;
+	case STATE_INIT:
+		module->reused = 0;
+		return _http_client_connect(module);
 	default:
 		/* STATE_TRY_REQ */
 		/* STATE_WAIT_RESP */
@@ -534,6 +664,11 @@ void _http_client_clear_conn(struct http_client_module *const module, int reason
 {
 	union http_client_data data;
 
+	/* Losing a connection that waits for no response is not an error for the application. */
+	if (module->idle) {
+		reason = 0;
+	}
+
 	if (module->req.entity.close) {
 		module->req.entity.close(module->req.entity.priv_data);
 	}
@@ -544,7 +679,14 @@ void _http_client_clear_conn(struct http_client_module *const module, int reason
 		close(module->sock);
 	}
 
+	if (module->timer_id >= 0 && (module->config.timeout > 0 || module->config.keep_alive_timeout > 0)) {
+		sw_timer_disable_callback(module->config.timer_inst, module->timer_id);
+	}
+
 	module_ref_inst[module->sock] = NULL;
+	if (module->req.ext_header != NULL) {
+		free(module->req.ext_header);
+	}
 	memset(&module->req, 0, sizeof(struct http_client_req));
 	memset(&module->resp, 0, sizeof(struct http_client_resp));
 	module->req.state = STATE_INIT;
@@ -552,6 +694,10 @@ void _http_client_clear_conn(struct http_client_module *const module, int reason
 
 	module->sending = 0;
 	module->permanent = 0;
+	module->idle = 0;
+	module->reused = 0;
+	module->recved_size = 0;
+	module->recv_head = 0;
 	data.disconnected.reason = reason;
 	if (module->cb) {
 		module->cb(module, HTTP_CLIENT_CALLBACK_DISCONNECTED, &data);
@@ -572,6 +718,13 @@ int _http_client_send_wait(void *_module, char *buffer, size_t buffer_len)
 	while (module->sending == 1 && module->req.state > STATE_SOCK_CONNECTED){
 		m2m_wifi_handle_events(NULL);
 		sw_timer_task(module->config.timer_inst);
+#ifdef __FREERTOS__
+		if (module->sending == 1) {
+			/* Sleep until the WINC interrupt or the next timer instead of spinning. */
+			uint32_t wait = sw_timer_next_deadline(module->config.timer_inst);
+			nm_bsp_wait_for_event((wait < HTTP_SEND_WAIT_MS) ? wait : HTTP_SEND_WAIT_MS);
+		}
+#endif
 	}
 
 	return 0;
@@ -767,6 +920,9 @@ void _http_client_request(struct http_client_module *const module)
 
 void _http_client_recv_packet(struct http_client_module *const module)
 {
+	uint32_t tail;
+	uint32_t space;
+
 	if (module == NULL) {
 		return;
 	}
@@ -777,15 +933,21 @@ void _http_client_recv_packet(struct http_client_module *const module)
 		return;
 	}
 	
+	/* Receive into the free part of the ring that follows the stored data. */
+	tail = _http_client_ring_index(module, module->recved_size);
+	if (tail < module->recv_head) {
+		space = module->recv_head - tail;
+	} else {
+		space = module->config.recv_buffer_size - tail;
+	}
+
 	/* Executing read until receiving operation is started. */
 	/*
 	while (recv(module->sock,
 		module->config.recv_buffer + module->recved_size,
 		module->config.recv_buffer_size - module->recved_size, 0) != 0);
 	*/
-	recv(module->sock,
-		module->config.recv_buffer + module->recved_size,
-		module->config.recv_buffer_size - module->recved_size, 0);
+	recv(module->sock, module->config.recv_buffer + tail, space, 0);
 }
 
 void _http_client_recved_packet(struct http_client_module *const module, int read_len)
@@ -810,68 +972,126 @@ int _http_client_handle_response(struct http_client_module *const module)
 	return 0;
 }
 
+/**
+ * \brief Find the end of the first line in the receive buffer.
+ *
+ * \param[in]  module          Module instance of HTTP.
+ *
+ * \return     Offset of the '\n' from the oldest byte, -1 if the line is not complete yet.
+ */
+static int _http_client_find_line(struct http_client_module *const module)
+{
+	uint32_t offset;
+
+	for (offset = 0; offset < module->recved_size; offset++) {
+		if (_http_client_ring_at(module, offset) == '\n') {
+			return (int)offset;
+		}
+	}
+	return -1;
+}
+
+/**
+ * \brief Checks the name of a header line. Header names are not case sensitive.
+ */
+static int _http_client_header_is(const char *line, int length, const char *name)
+{
+	int name_length = strlen(name);
+
+	return length >= name_length && !strncasecmp(line, name, name_length);
+}
+
 int _http_client_handle_header(struct http_client_module *const module)
 {
-	char *ptr_line_end, *ptr;
+	char *ptr;
+	int line_end, length, i;
 	union http_client_data data;
-	/* New line character only used in this function. So variable registered in the code region. */
-	static const char *new_line = "\r\n";
+	/* Copy of a line that wraps around the end of the buffer. Known headers fit in it. */
+	char line[HTTP_HEADER_LINE_SIZE];
 
 	//TODO : header filter
 
-	for (ptr = module->config.recv_buffer ; ; ) {
-		ptr_line_end = strstr(ptr, new_line);
-		if (ptr_line_end == NULL || ptr_line_end >= module->config.recv_buffer + module->recved_size) {
+	for (;;) {
+		line_end = _http_client_find_line(module);
+		if (line_end < 0) {
 			/* not enough buffer. */
-			_http_client_move_buffer(module, ptr);
 			return 0;
 		}
 
-		if (!strncmp(ptr, new_line, strlen(new_line))) {
-			/* Move remain data to forward part of buffer. */
-			_http_client_move_buffer(module, ptr + strlen(new_line));
+		length = line_end;
+		if (length > 0 && _http_client_ring_at(module, length - 1) == '\r') {
+			length--;
+		}
+
+		if (module->recv_head + line_end < module->config.recv_buffer_size) {
+			/* Parse in place. The line ends with '\n' inside the buffer. */
+			ptr = module->config.recv_buffer + module->recv_head;
+		} else {
+			if (length >= (int)sizeof(line)) {
+				length = sizeof(line) - 1;
+			}
+			for (i = 0; i < length; i++) {
+				line[i] = _http_client_ring_at(module, i);
+			}
+			line[length] = '\0';
+			ptr = line;
+		}
+
+		if (length == 0) {
+			_http_client_consume(module, line_end + 1);
 
 			/* Check validation first. */
+			module->resp.streamed = 0;
+			if (module->resp.content_length > (int)module->config.recv_buffer_size
+					|| module->recv_head + module->resp.content_length > module->config.recv_buffer_size) {
+				/* Entity does not fit in one piece in the receive buffer. */
+				module->resp.streamed = 1;
+			}
+			module->resp.read_length = 0;
+			if (module->resp.content_length < 0) {
+				module->resp.read_length = HTTP_CHUNK_SIZE_LINE;
+			}
+
 			if (module->cb && module->resp.response_code) {
 				/* Chunked transfer */
 				if (module->resp.content_length < 0) {
 					data.recv_response.response_code = module->resp.response_code;
 					data.recv_response.is_chunked = 1;
-					module->resp.read_length = 0;
+					data.recv_response.content_length = 0;
 					data.recv_response.content = NULL;
 					module->cb(module, HTTP_CLIENT_CALLBACK_RECV_RESPONSE, &data);
-				} else if (module->resp.content_length > (int)module->config.recv_buffer_size) {
-					/* Entity is bigger than receive buffer. Sending the buffer to user like chunked transfer. */
+				} else if (module->resp.streamed) {
+					/* Sending the buffer to user like chunked transfer. */
 					data.recv_response.response_code = module->resp.response_code;
+					data.recv_response.is_chunked = 0;
 					data.recv_response.content_length = module->resp.content_length;
 					data.recv_response.content = NULL;
-					module->resp.read_length = 0;
 					module->cb(module, HTTP_CLIENT_CALLBACK_RECV_RESPONSE, &data);
 				}
 			}
 
 			module->resp.state = STATE_PARSE_ENTITY;
 			return 1;
-		} else if (!strncmp(ptr, "Content-Length: ", strlen("Content-Length: "))) {
+		} else if (_http_client_header_is(ptr, length, "Content-Length: ")) {
 			module->resp.content_length = atoi(ptr + strlen("Content-Length: "));
-		} else if (!strncmp(ptr, "Transfer-Encoding: ", strlen("Transfer-Encoding: "))) {
+		} else if (_http_client_header_is(ptr, length, "Transfer-Encoding: ")) {
 			/* Currently does not support gzip or deflate encoding. If received this header, disconnect session immediately*/
 			char *type_ptr = ptr + strlen("Transfer-Encoding: ");
-			for (; ptr_line_end > type_ptr; type_ptr++) {
+			for (; ptr + length > type_ptr; type_ptr++) {
 				if (*type_ptr == ' ') {
 					continue;
 				} else if (*type_ptr == 'C' || *type_ptr == 'c') {
 					/* Chunked transfer */
-					module->req.content_length = -1;
+					module->resp.content_length = -1;
 				} else {
 					_http_client_clear_conn(module, -ENOTSUP);
 					return 0;
 				}
 				break;
 			}
-		} else if (!strncmp(ptr, "Connection: ", strlen("Connection: "))) {
+		} else if (_http_client_header_is(ptr, length, "Connection: ")) {
 			char *type_ptr = ptr + strlen("Connection: ");
-			for (; ptr_line_end > type_ptr; type_ptr++) {
+			for (; ptr + length > type_ptr; type_ptr++) {
 				if (*type_ptr == ' ') {
 					continue;
 				} else if (*type_ptr == 'K' || *type_ptr == 'k') {
@@ -881,7 +1101,7 @@ int _http_client_handle_header(struct http_client_module *const module)
 				}
 				break;
 			}
-		} else if (!strncmp(ptr, "HTTP/", 5)) {
+		} else if (length >= 12 && !strncmp(ptr, "HTTP/", 5)) {
 			module->resp.response_code = atoi(ptr + 9); /* HTTP/{Ver} {Code} {Desc} : HTTP/1.1 200 OK */
 			/* Initializing the variables */
 			module->resp.content_length = 0;
@@ -893,161 +1113,202 @@ int _http_client_handle_header(struct http_client_module *const module)
 			}
 		}
 
-		ptr = ptr_line_end + strlen(new_line);
+		_http_client_consume(module, line_end + 1);
 	}
 }
 
-static void _http_client_read_chuked_entity(struct http_client_module *const module)
+/**
+ * \brief Finish the response and keep the connection if the server allows it.
+ *
+ * \param[in]  module          Module instance of HTTP.
+ *
+ * \return     Number of bytes left to parse, 0 if the connection was closed.
+ */
+static int _http_client_entity_done(struct http_client_module *const module)
+{
+	module->resp.state = STATE_PARSE_HEADER;
+	module->resp.response_code = 0;
+
+	if (!_http_client_keep_alive(module)) {
+		/* This server was not supported keep alive. */
+		return 0;
+	}
+	return (int)module->recved_size;
+}
+
+static int _http_client_read_chuked_entity(struct http_client_module *const module)
 {
 	/* In chunked mode, read_length variable is means to remain data in the chunk. */
 	union http_client_data data;
-	int length = (int)module->recved_size;
-	int extension = 0;
-	char *buffer= module->config.recv_buffer;
+	int line_end, length, i, digits;
+	uint32_t span;
+	char ch;
 
-	do {
-		if (module->resp.read_length >= 0) {
+	while (module->recved_size > 0) {
+		if (module->resp.read_length > 0) {
+			/* Chunk data is passed on as it arrives, straight from the buffer. */
+			span = _http_client_ring_contiguous(module);
+			if (span > (uint32_t)module->resp.read_length) {
+				span = module->resp.read_length;
+			}
+			data.recv_chunked_data.length = span;
+			data.recv_chunked_data.data = module->config.recv_buffer + module->recv_head;
+			data.recv_chunked_data.is_complete = 0;
+			if (module->cb) {
+				module->cb(module, HTTP_CLIENT_CALLBACK_RECV_CHUNKED_DATA, &data);
+			}
+			_http_client_consume(module, span);
+			module->resp.read_length -= span;
 			if (module->resp.read_length == 0) {
-				/* Complete to receive the buffer. */
-				module->resp.state = STATE_PARSE_HEADER;
-				module->resp.response_code = 0;
-				data.recv_chunked_data.is_complete = 1;
-				data.recv_chunked_data.length = 0;
-				data.recv_chunked_data.data = NULL;
-				if (module->cb) {
-					module->cb(module, HTTP_CLIENT_CALLBACK_RECV_CHUNKED_DATA, &data);
-				}
-				if (module->permanent == 0) {
-					/* This server was not supported keep alive. */
-					_http_client_clear_conn(module, 0);
-					return;
-				}
-				_http_client_move_buffer(module, buffer + 2);
-			} else if (module->resp.read_length <= length) {
-				data.recv_chunked_data.length = module->resp.read_length;
-				data.recv_chunked_data.data = buffer;
-				data.recv_chunked_data.is_complete = 0;
+				/* The '\r\n' after the data is skipped as an empty size line. */
+				module->resp.read_length = HTTP_CHUNK_SIZE_LINE;
+			}
+			continue;
+		}
 
-				if (module->cb) {
-					module->cb(module, HTTP_CLIENT_CALLBACK_RECV_CHUNKED_DATA, &data);
-				}
-				/* Last two character in the chunk is '\r\n'. */
-				_http_client_move_buffer(module, buffer + module->resp.read_length + 2 /* sizeof newline character */);
-				length = (int)module->recved_size;
-				buffer = module->config.recv_buffer;
-				module->resp.read_length = -1;
+		line_end = _http_client_find_line(module);
+		if (line_end < 0) {
+			/* currently not received packet yet. */
+			return 0;
+		}
+		length = line_end;
+		if (length > 0 && _http_client_ring_at(module, length - 1) == '\r') {
+			length--;
+		}
+
+		if (module->resp.read_length == HTTP_CHUNK_TRAILER) {
+			_http_client_consume(module, line_end + 1);
+			if (length != 0) {
+				/* Trailer header. Not used. */
+				continue;
 			}
-		} else {
-			/* Read chunked length. */
-			module->resp.read_length = 0;
-			for (; length > 0; buffer++, length--) {
-				if (*buffer == '\n') {
-					buffer++;
-					length--;
-					break;
-				}
-				if (extension != 0) {
-					continue;
-				}
-				if (*buffer >= '0' && *buffer <= '9') {
-					module->resp.read_length = module->resp.read_length * 0x10 + *buffer - '0';
-				} else if (*buffer >= 'a' && *buffer <= 'f') {
-					module->resp.read_length = module->resp.read_length * 0x10 + *buffer - 'a';
-				} else if (*buffer >= 'A' && *buffer <= 'F') {
-					module->resp.read_length = module->resp.read_length * 0x10 + *buffer - 'A';
-				} else if (*buffer == ';') {
-					extension = 1;
-				}
+			/* Complete to receive the buffer. */
+			data.recv_chunked_data.is_complete = 1;
+			data.recv_chunked_data.length = 0;
+			data.recv_chunked_data.data = NULL;
+			if (module->cb) {
+				module->cb(module, HTTP_CLIENT_CALLBACK_RECV_CHUNKED_DATA, &data);
 			}
+			module->resp.read_length = 0;
+			return _http_client_entity_done(module);
+		}
+
+		if (length == 0) {
+			_http_client_consume(module, line_end + 1);
+			continue;
+		}
 
-			if (module->resp.read_length > (int)module->config.recv_buffer_size) {
+		/* Read chunked length. */
+		module->resp.read_length = 0;
+		for (i = 0, digits = 0; i < length; i++) {
+			ch = _http_client_ring_at(module, i);
+			if (ch >= '0' && ch <= '9') {
+				module->resp.read_length = module->resp.read_length * 0x10 + ch - '0';
+			} else if (ch >= 'a' && ch <= 'f') {
+				module->resp.read_length = module->resp.read_length * 0x10 + ch - 'a' + 10;
+			} else if (ch >= 'A' && ch <= 'F') {
+				module->resp.read_length = module->resp.read_length * 0x10 + ch - 'A' + 10;
+			} else {
+				/* Chunk extension (';') or white space. */
+				break;
+			}
+			if (++digits > 7) {
 				/* Chunked size is too big. */
 				/* Through exception. */
 				_http_client_clear_conn(module, -EOVERFLOW);
-				return;
+				return 0;
 			}
+		}
+		_http_client_consume(module, line_end + 1);
 
-			if (length  == 0) {
-				/* currently not received packet yet. */
-				module->resp.read_length = -1;
-				return;
-			}
+		if (digits == 0) {
+			_http_client_clear_conn(module, -EBADMSG);
+			return 0;
+		}
+		if (module->resp.read_length == 0) {
+			/* Last chunk. Trailer headers and an empty line follow. */
+			module->resp.read_length = HTTP_CHUNK_TRAILER;
 		}
-	} while(module->recved_size > 0);
+	}
+
+	return 0;
 }
 
 int _http_client_handle_entity(struct http_client_module *const module)
 {
 	union http_client_data data;
-	char *buffer = module->config.recv_buffer;
+	uint32_t span;
+
+	if (module->resp.content_length < 0) {
+		return _http_client_read_chuked_entity(module);
+	}
 
 	/* If data size is lesser than buffer size, read all buffer and retransmission it to application. */
-	if (module->resp.content_length >= 0 && module->resp.content_length <= (int)module->config.recv_buffer_size) {
+	if (!module->resp.streamed) {
 		if ((int)module->recved_size >= module->resp.content_length) {
 			if (module->cb && module->resp.response_code) {
 				data.recv_response.response_code = module->resp.response_code;
 				data.recv_response.is_chunked = 0;
 				data.recv_response.content_length = module->resp.content_length;
-				data.recv_response.content = buffer;
+				data.recv_response.content = module->config.recv_buffer + module->recv_head;
 				module->cb(module, HTTP_CLIENT_CALLBACK_RECV_RESPONSE, &data);
 			}
-			module->resp.state = STATE_PARSE_HEADER;
-			module->resp.response_code = 0;
-			
-			if (module->permanent == 0) {
-				/* This server was not supported keep alive. */
-				_http_client_clear_conn(module, 0);
-			} else {
-				_http_client_move_buffer(module, buffer + module->resp.content_length);
-				return module->recved_size;
-			}
+			_http_client_consume(module, module->resp.content_length);
+			return _http_client_entity_done(module);
 		}
 		/* else, buffer was not received enough size yet. */
-	} else {
-		if (module->resp.content_length >= 0) {
-			data.recv_chunked_data.length = module->recved_size;
-			data.recv_chunked_data.data = buffer;
-			module->resp.read_length += (int)module->recved_size;
-			if (module->resp.content_length <= module->resp.read_length) {
-				/* Complete to receive the buffer. */
-				module->resp.state = STATE_PARSE_HEADER;
-				module->resp.response_code = 0;
-				data.recv_chunked_data.is_complete = 1;
-			} else {
-				data.recv_chunked_data.is_complete = 0;
-			}
+		return 0;
+	}
 
-			if (module->cb) {
-				module->cb(module, HTTP_CLIENT_CALLBACK_RECV_CHUNKED_DATA, &data);
-			}
-			
-			if (data.recv_chunked_data.is_complete == 1) {
-				if (module->permanent == 0) {
-					/* This server was not supported keep alive. */
-					printf("1\r\n");
-					_http_client_clear_conn(module, 0);
-					return 0;
-				}
-			}
-			_http_client_move_buffer(module, buffer + module->recved_size);
-		} else {
-			_http_client_read_chuked_entity(module);
+	while (module->recved_size > 0 && module->resp.read_length < module->resp.content_length) {
+		/* Pass on what sits in one piece in the buffer, at most up to the end of the entity. */
+		span = _http_client_ring_contiguous(module);
+		if (span > (uint32_t)(module->resp.content_length - module->resp.read_length)) {
+			span = module->resp.content_length - module->resp.read_length;
+		}
+		data.recv_chunked_data.length = span;
+		data.recv_chunked_data.data = module->config.recv_buffer + module->recv_head;
+		module->resp.read_length += (int)span;
+		data.recv_chunked_data.is_complete = (module->resp.content_length <= module->resp.read_length);
+
+		if (module->cb) {
+			module->cb(module, HTTP_CLIENT_CALLBACK_RECV_CHUNKED_DATA, &data);
 		}
+		_http_client_consume(module, span);
+	}
+
+	if (module->resp.read_length >= module->resp.content_length) {
+		/* Complete to receive the buffer. */
+		return _http_client_entity_done(module);
 	}
 
 	return 0;
 }
 
-void _http_client_move_buffer(struct http_client_module *const module, char *base)
+int _http_client_keep_alive(struct http_client_module *const module)
 {
-	char *buffer = module->config.recv_buffer;
-	int remain = (int)module->recved_size - (int)base + (int)buffer;
+	if (module->permanent == 0) {
+		_http_client_clear_conn(module, 0);
+		return 0;
+	}
 
-	if (remain > 0) {
-		memmove(buffer, base, remain);
-		module->recved_size = remain;
-	} else {
-		module->recved_size = 0;
+	/* Close the connection ourselves before the server gives up on it. */
+	module->idle = 1;
+	if (module->config.keep_alive_timeout > 0) {
+		sw_timer_enable_callback(module->config.timer_inst, module->timer_id, module->config.keep_alive_timeout);
 	}
+	return 1;
 }
 
+void _http_client_consume(struct http_client_module *const module, uint32_t length)
+{
+	if (length >= module->recved_size) {
+		/* Buffer is empty. Start over at its beginning, so the next entity is more likely to fit in one piece. */
+		module->recved_size = 0;
+		module->recv_head = 0;
+		return;
+	}
+
+	module->recv_head = _http_client_ring_index(module, length);
+	module->recved_size -= length;
+}
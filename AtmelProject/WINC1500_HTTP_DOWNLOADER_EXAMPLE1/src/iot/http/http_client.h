@@ -63,6 +63,13 @@ extern "C" {
 #define HTTP_PROTO_NAME               "HTTP/1.1"
 /** Max size of URI. */
 #define HTTP_MAX_URI_LENGTH           64
+/** Max size of the receive buffer. The WINC socket never passes more than one MTU at once. */
+#define HTTP_MAX_RECV_BUFFER_SIZE     1400
+
+/** Set to 1 to leave out the heap allocation of the receive buffer. config.recv_buffer must then be given. */
+#ifndef HTTP_CLIENT_STATIC_RECV_BUFFER
+#define HTTP_CLIENT_STATIC_RECV_BUFFER 0
+#endif
 
 /**
  * \brief A type of HTTP method.
@@ -149,7 +156,8 @@ struct http_client_data_recv_response {
 	uint32_t content_length;
 	/**
 	 * Content buffer.
-	 * If this value is equal to zero, it means This data is too big compared with the receive buffer.
+	 * If this value is equal to zero, it means This data is too big compared with the receive buffer,
+	 * or does not sit in one piece in it.
 	 * In this situation, Data will be transmitted through HTTP_CLIENT_CALLBACK_RECV_CHUNKED_DATA callback.
 	 */
 	char *content;
@@ -245,12 +253,20 @@ struct http_client_config {
 	 */
 	uint16_t timeout;
 	/**
-	 * Rx buffer.
+	 * Time an idle persistent connection is kept open for the next request.
+	 * Unit is milliseconds. Keep it below the keep-alive timeout of the server.
+	 * Default value is 0. (Kept open until the server closes it)
+	 */
+	uint16_t keep_alive_timeout;
+	/**
+	 * Rx buffer. Used as a ring: parsed bytes are never moved.
+	 * If NULL, the buffer is allocated in the heap, unless HTTP_CLIENT_STATIC_RECV_BUFFER is set.
 	 * Default value is NULL.
 	 */
 	char *recv_buffer;
 	/**
-	 * Maximum size of the receive buffer.
+	 * Maximum size of the receive buffer, at most HTTP_MAX_RECV_BUFFER_SIZE.
+	 * Entities up to this size are passed in one piece when they do not wrap around its end.
 	 * Default value is 256.
 	 */
 	uint32_t recv_buffer_size;
@@ -307,6 +323,8 @@ struct http_client_resp {
 	int read_length;
 	/** Response code of this response. */
 	uint16_t response_code;
+	/** A flag that the entity is passed in pieces through HTTP_CLIENT_CALLBACK_RECV_CHUNKED_DATA. */
+	uint8_t streamed;
 };
 
 /**
@@ -324,9 +342,15 @@ struct http_client_module {
 	uint8_t permanent       : 1;
 	/** A flag for the receive buffer located in the heap. */
 	uint8_t alloc_buffer    : 1;
+	/** A flag that the connection is idle and waits for the next request. */
+	uint8_t idle            : 1;
+	/** A flag that the current request was sent on a connection used before. */
+	uint8_t reused          : 1;
 
 	/** Size that received. */
 	uint32_t recved_size;
+	/** Position of the oldest received byte in the receive buffer. */
+	uint32_t recv_head;
 
 	/** SW Timer ID for the request time out. */
 	int timer_id;
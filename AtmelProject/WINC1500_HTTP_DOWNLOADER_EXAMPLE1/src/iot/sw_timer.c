@@ -33,8 +33,22 @@
 
 #include "sw_timer.h"
 
-/** Tick count of timer. */
-static uint32_t sw_timer_tick = 0;
+/** Tick count of timer. Increased in the interrupt. */
+static volatile uint32_t sw_timer_tick = 0;
+
+/**
+ * \brief Make expire_time the next deadline of the module if it comes first.
+ *
+ * The deadline may be earlier than the real one (a timer was disabled since). sw_timer_task then scans
+ * the handlers once and sets it right.
+ */
+static inline void sw_timer_update_deadline(struct sw_timer_module *const module_inst, uint32_t expire_time)
+{
+	if (!module_inst->deadline_valid || (int)(expire_time - module_inst->deadline) < 0) {
+		module_inst->deadline = expire_time;
+		module_inst->deadline_valid = 1;
+	}
+}
 
 /**
  * \brief TCC callback of SW timer.
@@ -88,6 +102,7 @@ void sw_timer_init(struct sw_timer_module *const module_inst, struct sw_timer_co
 	Assert(config->tcc_callback_channel < TCC_NUM_CHANNELS);
 
 	module_inst->accuracy = config->accuracy;
+	module_inst->deadline_valid = 0;
 #if (SAMD21)
 	/* Start the TCC module. */
 	tcc_module = &module_inst->tcc_inst;
@@ -197,6 +212,7 @@ void sw_timer_enable_callback(struct sw_timer_module *const module_inst, int tim
 
 	handler->callback_enable = 1;
 	handler->expire_time = sw_timer_tick + (delay / module_inst->accuracy);
+	sw_timer_update_deadline(module_inst, handler->expire_time);
 }
 
 void sw_timer_disable_callback(struct sw_timer_module *const module_inst, int timer_id)
@@ -218,6 +234,11 @@ void sw_timer_task(struct sw_timer_module *const module_inst)
 
 	Assert(module_inst);
 
+	/* Nothing is due before the next deadline. Called in tight loops, so this is the common case. */
+	if (!module_inst->deadline_valid || (int)(module_inst->deadline - sw_timer_tick) >= 0) {
+		return;
+	}
+
 	for (index = 0; index < CONF_SW_TIMER_COUNT; index++) {
 		if (module_inst->handler[index].used && module_inst->handler[index].callback_enable) {
 			handler = &module_inst->handler[index];
@@ -238,4 +259,31 @@ void sw_timer_task(struct sw_timer_module *const module_inst)
 			}
 		}
 	}
+
+	/* Find the next deadline among the timers still enabled. */
+	module_inst->deadline_valid = 0;
+	for (index = 0; index < CONF_SW_TIMER_COUNT; index++) {
+		handler = &module_inst->handler[index];
+		if (handler->used && handler->callback_enable) {
+			sw_timer_update_deadline(module_inst, handler->expire_time);
+		}
+	}
+}
+
+uint32_t sw_timer_next_deadline(struct sw_timer_module *const module_inst)
+{
+	int ticks;
+
+	Assert(module_inst);
+
+	if (!module_inst->deadline_valid) {
+		return SW_TIMER_NO_DEADLINE;
+	}
+
+	/* A timer fires once the tick count went past its expire time. */
+	ticks = (int)(module_inst->deadline - sw_timer_tick) + 1;
+	if (ticks <= 0) {
+		return 0;
+	}
+	return (uint32_t)ticks * module_inst->accuracy;
 }
@@ -44,6 +44,9 @@ extern "C" {
 
 struct sw_timer_module;
 
+/** Returned by \ref sw_timer_next_deadline when no timer is enabled. */
+#define SW_TIMER_NO_DEADLINE               0xFFFFFFFF
+
 /**
  * Callback Function type of time out event in the timer.
  *
@@ -101,6 +104,10 @@ struct sw_timer_module {
 #endif
 	/** Accuracy of timer. */
 	uint32_t accuracy;
+	/** Earliest expire time of the enabled timers. Never later than the real one. */
+	uint32_t deadline;
+	/** A flag that deadline is set. If not, no timer is enabled. */
+	uint8_t deadline_valid;
 };
 
 /**
@@ -183,6 +190,18 @@ void sw_timer_disable_callback(struct sw_timer_module *const module_inst, int ti
  */
 void sw_timer_task(struct sw_timer_module *const module_inst);
 
+/**
+ * \brief Time left until the next timer expires.
+ *
+ * Lets the caller block until then instead of calling \ref sw_timer_task in a loop.
+ * The value can be earlier than the real expiry, never later.
+ *
+ * \param[in]  module_inst     Pointer of timer.
+ *
+ * \return Time left in milliseconds, 0 if a timer is due, SW_TIMER_NO_DEADLINE if no timer is enabled.
+ */
+uint32_t sw_timer_next_deadline(struct sw_timer_module *const module_inst);
+
 #ifdef __cplusplus
 }
 #endif
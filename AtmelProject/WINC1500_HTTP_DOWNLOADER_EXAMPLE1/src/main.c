@@ -30,6 +30,9 @@
 #include "FreeRTOS_Threads/WifiHandlerThread/WifiHandler.h"
 #include "FreeRTOS_Threads/UiHandlerThread/UiHandlerThread.h"
 #include "FreeRTOS_Threads/ControlThread/ControlThread.h"
+#include "FreeRTOS_Threads/OLEDThread/OLEDThread.h"
+#include "FreeRTOS_Threads/SdWriterThread/SdWriterThread.h"
+#include "FreeRTOS_Threads/LogThread/LogThread.h"
 
 /******************************************************************************
 * Defines and Types
@@ -56,6 +59,9 @@ static TaskHandle_t wifiTaskHandle    = NULL; //!< Wifi task handle
 static TaskHandle_t uiTaskHandle    = NULL; //!< UI task handle
 static TaskHandle_t controlTaskHandle    = NULL; //!< Control task handle
 static TaskHandle_t lightTaskHandle    = NULL; //!< Control task handle
+static TaskHandle_t oledTaskHandle    = NULL; //!< OLED render task handle
+static TaskHandle_t sdWriterTaskHandle    = NULL; //!< SD writer task handle
+static TaskHandle_t logTaskHandle    = NULL; //!< Log task handle
 
 char bufferPrint[64]; //Buffer for daemon task
 
@@ -74,6 +80,11 @@ int main(void)
 	/* Initialize the UART console. */
 	InitializeSerialConsole();
 
+	//Queues other threads post to, created before any thread runs
+	if (OledThreadInit() != pdPASS) {
+		SerialConsoleWriteString("ERR: OLED queues could not be initialized!\r\n");
+	}
+
 	//Initialize trace capabilities
 	 vTraceEnable(TRC_START);
     // Start FreeRTOS scheduler
@@ -177,6 +188,24 @@ static void StartTasks(void)
 	}
 	snprintf(bufferPrint, 64, "Heap after starting Light Task: %d\r\n", xPortGetFreeHeapSize());
 	SerialConsoleWriteString(bufferPrint);
+
+	if(xTaskCreate(vOledRenderTask, "OLED Task", OLED_TASK_SIZE, NULL, OLED_TASK_PRIORITY, &oledTaskHandle) != pdPASS) {
+		SerialConsoleWriteString("ERR: OLED task could not be initialized!\r\n");
+	}
+	snprintf(bufferPrint, 64, "Heap after starting OLED Task: %d\r\n", xPortGetFreeHeapSize());
+	SerialConsoleWriteString(bufferPrint);
+
+	if(xTaskCreate(vSdWriterTask, "SD Task", SD_WRITER_TASK_SIZE, NULL, SD_WRITER_TASK_PRIORITY, &sdWriterTaskHandle) != pdPASS) {
+		SerialConsoleWriteString("ERR: SD writer task could not be initialized!\r\n");
+	}
+	snprintf(bufferPrint, 64, "Heap after starting SD Writer Task: %d\r\n", xPortGetFreeHeapSize());
+	SerialConsoleWriteString(bufferPrint);
+
+	if(xTaskCreate(vLogTask, "Log Task", LOG_TASK_SIZE, NULL, LOG_TASK_PRIORITY, &logTaskHandle) != pdPASS) {
+		SerialConsoleWriteString("ERR: Log task could not be initialized!\r\n");
+	}
+	snprintf(bufferPrint, 64, "Heap after starting Log Task: %d\r\n", xPortGetFreeHeapSize());
+	SerialConsoleWriteString(bufferPrint);
 }
 
 static void configure_console(void)
@@ -0,0 +1,620 @@
+/**************************************************************************//**
+* @file      fake_i2c_bus.c
+* @brief     Simulated sensor bus for the host tests of the I2C driver
+* @details   See fake_i2c_bus.h. Implements the ASF I2C master and DMA calls the driver makes, the part of the ASF SERCOM
+			 interrupt handler it relies on, and the FreeRTOS task calls, for one thread. There is at most one transfer on
+			 the bus, so the pending events are its end, the DMAC interrupt and the SERCOM interrupt.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "host_test.h"
+#include "fake_i2c_bus.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define NONE			0		///<No event pending. Every event is at least one latency after time 0.
+#define RISE_CYCLES		((FAKE_BUS_GCLK_HZ / 1000) * 215 / 1000000)	///<SCL rise time of the default config, in GCLK cycles
+#define BUSSTATE_IDLE	SERCOM_I2CM_STATUS_BUSSTATE(1)
+#define BUSSTATE_OWNER	SERCOM_I2CM_STATUS_BUSSTATE(2)
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+Sercom fakeSercom0;
+uint64_t fakeBusNowNs;
+struct fake_bus_stats fakeBusStats;
+bool fakeDmaAllocateFails;
+bool fakeDmaStartFails;
+
+///Packet of the step on the bus, filled in by the driver. The DMAC reads RAM by 32-bit address, which a 64-bit host
+///cannot follow, so the DMA writes take their bytes from here (after checking the descriptor points at them).
+extern struct i2c_master_packet sensorPacketWrite;
+
+static struct fake_i2c_device *devices[FAKE_BUS_MAX_DEVICES];
+static struct i2c_master_module *busModule;	///<Module given to i2c_master_init
+static uint8_t intEnabled;					///<SERCOM interrupts enabled through INTENSET and INTENCLR
+static uint64_t busFreeNs;					///<End of the last STOP on the wire
+static uint32_t lastBaud;					///<BAUD of the last transfer
+static bool anyTransfer;					///<Set once a transfer ended, so the next one measures a gap
+
+static struct dma_resource *dmaResource;
+static DmacDescriptor *dmaDescriptor;
+static bool dmaRunning;
+
+///Transfer on the bus
+static struct {
+	bool active;		///<Started, and its end not handled yet
+	bool read;
+	bool dma;
+	bool nackAddress;
+	bool nackData;
+	uint8_t address;
+	uint8_t *data;
+	uint16_t len;
+	struct fake_i2c_device *device;
+	uint64_t startNs;
+} xfer;
+
+static uint64_t endAtNs;		///<End of the last byte of the transfer
+static uint64_t dmaIsrAtNs;		///<DMAC interrupt
+static uint64_t sercomIsrAtNs;	///<SERCOM interrupt
+static bool endPending;			///<MB or SB set and not handled
+
+static int threadTask;			///<Handle of the test thread, the only task
+static uint32_t notifyValue;
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///Length of one SCL clock at the BAUD register value, for a standard or fast mode master
+static uint64_t bit_ns(void)
+{
+	uint32_t baud = fakeSercom0.I2CM.BAUD.reg & 0xFF;
+	return (uint64_t)(2 * baud + 10 + RISE_CYCLES) * 1000000000ull / FAKE_BUS_GCLK_HZ;
+}
+
+static struct fake_i2c_device *find_device(uint8_t address)
+{
+	for(int i = 0; i < FAKE_BUS_MAX_DEVICES; i++)
+	{
+		if(devices[i] != NULL && devices[i]->address == address) return devices[i];
+	}
+	return NULL;
+}
+
+///Picks up the INTENSET and INTENCLR writes made since the last call, and raises the SERCOM interrupt if its flag is
+///set and it is now enabled
+static void sync_registers(void)
+{
+	SercomI2cm *hw = &fakeSercom0.I2CM;
+
+	intEnabled |= hw->INTENSET.reg;
+	hw->INTENSET.reg = 0;
+	intEnabled &= ~hw->INTENCLR.reg;
+	hw->INTENCLR.reg = 0;
+
+	if(endPending && (intEnabled & hw->INTFLAG.reg) && sercomIsrAtNs == NONE)
+	{
+		sercomIsrAtNs = fakeBusNowNs + FAKE_BUS_ISR_LATENCY_NS;
+	}
+}
+
+///Puts STOP on the wire and releases the bus
+static void bus_stop(void)
+{
+	busFreeNs = fakeBusNowNs + bit_ns();
+	fakeSercom0.I2CM.STATUS.reg = (fakeSercom0.I2CM.STATUS.reg & ~SERCOM_I2CM_STATUS_BUSSTATE_Msk) | BUSSTATE_IDLE;
+}
+
+///Sends START (or repeated START) and the address. The transfer starts once the STOP of the last one is on the wire.
+static enum status_code start_transfer(uint8_t address, bool read, uint8_t *data, uint16_t len, bool dma)
+{
+	if(xfer.active) return STATUS_BUSY;
+
+	uint64_t bit = bit_ns();
+	uint64_t start = (fakeBusNowNs > busFreeNs) ? fakeBusNowNs : busFreeNs;
+	struct fake_i2c_device *device = find_device(address);
+
+	memset(&xfer, 0, sizeof(xfer));
+	xfer.active = true;
+	xfer.read = read;
+	xfer.dma = dma;
+	xfer.address = address;
+	xfer.data = data;
+	xfer.len = len;
+	xfer.device = device;
+	xfer.startNs = start;
+	xfer.nackAddress = (device == NULL || 1000000000ull / bit > device->maxHz);
+
+	uint32_t bytes = xfer.nackAddress ? 1 : 1 + len;
+	endAtNs = start + bit * (1 + 9 * bytes);
+	if(device != NULL && device->hangNs != 0)
+	{
+		endAtNs = start + device->hangNs;
+		device->hangNs = 0;
+	}
+	else if(dma && !xfer.nackAddress)
+	{
+		//The DMAC moves the last byte into DATA once the one before it is out
+		dmaIsrAtNs = start + bit * (1 + 9 * len) + FAKE_BUS_ISR_LATENCY_NS;
+	}
+
+	if(anyTransfer)
+	{
+		uint64_t gap = start - fakeBusStats.lastEndNs;
+		fakeBusStats.gapNs += gap;
+		fakeBusStats.gaps++;
+		if(gap > fakeBusStats.maxGapNs) fakeBusStats.maxGapNs = gap;
+		if(fakeSercom0.I2CM.BAUD.reg != lastBaud) fakeBusStats.reclocks++;
+	}
+	if(fakeBusStats.transfers == 0) fakeBusStats.firstStartNs = start;
+	lastBaud = fakeSercom0.I2CM.BAUD.reg;
+	fakeBusStats.transfers++;
+	fakeBusStats.bytes += bytes;
+	if(dma) fakeBusStats.dmaTransfers++;
+
+	fakeSercom0.I2CM.STATUS.reg = BUSSTATE_OWNER;
+	fakeSercom0.I2CM.INTFLAG.reg = 0;
+	fakeSercom0.I2CM.ADDR.reg = SERCOM_I2CM_ADDR_ADDR((address << 1) | (read ? 1 : 0));
+	return STATUS_OK;
+}
+
+///Last byte is out: the device takes or gives its data, and MB (write, or address NACK) or SB (read) is set
+static void transfer_end(void)
+{
+	struct fake_i2c_device *device = xfer.device;
+
+	endAtNs = NONE;
+	fakeBusStats.busyNs += fakeBusNowNs - xfer.startNs;
+	fakeBusStats.lastEndNs = fakeBusNowNs;
+	anyTransfer = true;
+
+	if(!xfer.nackAddress)
+	{
+		if(xfer.read)
+		{
+			for(uint16_t i = 0; i < xfer.len; i++) xfer.data[i] = (uint8_t)(device->readBase + i);
+			device->reads++;
+		}
+		else
+		{
+			CHECK(xfer.len <= sizeof(device->lastWrite));
+			if(xfer.len != 0) memcpy(device->lastWrite, xfer.data, xfer.len);
+			device->lastWriteLen = xfer.len;
+			device->writes++;
+			xfer.nackData = device->nackLastByte;
+			device->nackLastByte = false;
+		}
+	}
+
+	if(xfer.nackAddress || xfer.nackData) fakeSercom0.I2CM.STATUS.reg |= SERCOM_I2CM_STATUS_RXNACK;
+	fakeSercom0.I2CM.INTFLAG.reg = (xfer.read && !xfer.nackAddress) ? SERCOM_I2CM_INTFLAG_SB : SERCOM_I2CM_INTFLAG_MB;
+	endPending = true;
+	sync_registers();
+}
+
+///The part of the ASF SERCOM handler that ends a transfer. A NACK of the last byte written is not seen by ASF.
+static void sercom_isr(void)
+{
+	struct i2c_master_module *module = busModule;
+	enum i2c_master_callback callback;
+
+	sercomIsrAtNs = NONE;
+	if(!endPending || !(intEnabled & fakeSercom0.I2CM.INTFLAG.reg)) return;	//Disabled since it was raised
+	CHECK_EQ(host_critical_nesting, 0);
+
+	fakeBusStats.sercomIsrs++;
+	endPending = false;
+	xfer.active = false;
+	fakeSercom0.I2CM.INTFLAG.reg = 0;
+	intEnabled &= ~(SERCOM_I2CM_INTENCLR_MB | SERCOM_I2CM_INTENCLR_SB);
+
+	if(module->status == STATUS_BUSY && xfer.nackAddress) module->status = STATUS_ERR_BAD_ADDRESS;
+
+	if(module->status == STATUS_BUSY)
+	{
+		module->status = STATUS_OK;
+		module->buffer_remaining = 0;
+		if(module->send_stop) bus_stop();
+		callback = xfer.read ? I2C_MASTER_CALLBACK_READ_COMPLETE : I2C_MASTER_CALLBACK_WRITE_COMPLETE;
+	}
+	else if(module->status != STATUS_OK)
+	{
+		module->buffer_length = 0;
+		module->buffer_remaining = 0;
+		bus_stop();
+		callback = I2C_MASTER_CALLBACK_ERROR;
+	}
+	else
+	{
+		return;
+	}
+
+	if((module->registered_callback & module->enabled_callback) & (1 << callback))
+	{
+		module->callbacks[callback](module);
+	}
+	CHECK_EQ(host_critical_nesting, 0);
+	sync_registers();
+}
+
+static void dma_isr(void)
+{
+	dmaIsrAtNs = NONE;
+	dmaRunning = false;
+	fakeBusStats.dmaIsrs++;
+	if((dmaResource->callback_enable & (1 << DMA_CALLBACK_TRANSFER_DONE)) && dmaResource->callback[DMA_CALLBACK_TRANSFER_DONE] != NULL)
+	{
+		dmaResource->callback[DMA_CALLBACK_TRANSFER_DONE](dmaResource);
+	}
+	CHECK_EQ(host_critical_nesting, 0);
+	sync_registers();
+}
+
+///Runs the next event if it is due by limitNs. Returns false if there is none.
+static bool bus_step(uint64_t limitNs)
+{
+	uint64_t next = UINT64_MAX;
+
+	if(endAtNs != NONE && endAtNs < next) next = endAtNs;
+	if(dmaIsrAtNs != NONE && dmaIsrAtNs < next) next = dmaIsrAtNs;
+	if(sercomIsrAtNs != NONE && sercomIsrAtNs < next) next = sercomIsrAtNs;
+	if(next == UINT64_MAX || next > limitNs) return false;
+
+	fakeBusNowNs = next;
+	if(next == endAtNs) transfer_end();
+	else if(next == dmaIsrAtNs) dma_isr();
+	else sercom_isr();
+	return true;
+}
+
+/******************************************************************************
+* Functions
+******************************************************************************/
+void fake_bus_reset(void)
+{
+	memset(&fakeSercom0, 0, sizeof(fakeSercom0));
+	memset(devices, 0, sizeof(devices));
+	memset(&xfer, 0, sizeof(xfer));
+	fakeBusNowNs = 0;
+	busModule = NULL;
+	intEnabled = 0;
+	busFreeNs = 0;
+	endAtNs = dmaIsrAtNs = sercomIsrAtNs = NONE;
+	endPending = false;
+	dmaResource = NULL;
+	dmaDescriptor = NULL;
+	dmaRunning = false;
+	fakeDmaAllocateFails = false;
+	fakeDmaStartFails = false;
+	notifyValue = 0;
+	fake_bus_reset_stats();
+}
+
+void fake_bus_add_device(struct fake_i2c_device *device)
+{
+	for(int i = 0; i < FAKE_BUS_MAX_DEVICES; i++)
+	{
+		if(devices[i] == NULL)
+		{
+			devices[i] = device;
+			return;
+		}
+	}
+	CHECK(!"too many devices");
+}
+
+void fake_bus_reset_stats(void)
+{
+	memset(&fakeBusStats, 0, sizeof(fakeBusStats));
+	anyTransfer = false;
+	lastBaud = fakeSercom0.I2CM.BAUD.reg;
+}
+
+///Runs the bus until untilNs, as if the test thread slept
+void fake_bus_run(uint64_t untilNs)
+{
+	while(bus_step(untilNs));
+	if(fakeBusNowNs < untilNs) fakeBusNowNs = untilNs;
+}
+
+uint32_t fake_bus_scl_hz(void)
+{
+	return (uint32_t)(1000000000ull / bit_ns());
+}
+
+///True if nothing is on the bus and no interrupt is pending
+bool fake_bus_idle(void)
+{
+	return !xfer.active && endAtNs == NONE && dmaIsrAtNs == NONE && sercomIsrAtNs == NONE;
+}
+
+/******************************************************************************
+* ASF I2C master
+******************************************************************************/
+void i2c_master_get_config_defaults(struct i2c_master_config *const config)
+{
+	memset(config, 0, sizeof(*config));
+	config->baud_rate = 100;	//kHz, as I2C_MASTER_BAUD_RATE_100KHZ
+	config->buffer_timeout = 65535;
+	config->unknown_bus_state_timeout = 65535;
+	config->sda_scl_rise_time_ns = 215;
+}
+
+enum status_code i2c_master_init(struct i2c_master_module *const module, Sercom *const hw, const struct i2c_master_config *const config)
+{
+	int32_t hz = config->baud_rate * 1000;
+
+	memset(module, 0, sizeof(*module));
+	module->hw = hw;
+	module->buffer_timeout = config->buffer_timeout;
+	module->status = STATUS_OK;
+	busModule = module;
+	hw->I2CM.BAUD.reg = SERCOM_I2CM_BAUD_BAUD((FAKE_BUS_GCLK_HZ - hz * (10 + RISE_CYCLES) + 2 * hz - 1) / (2 * hz));
+	lastBaud = hw->I2CM.BAUD.reg;
+	return STATUS_OK;
+}
+
+void i2c_master_reset(struct i2c_master_module *const module)
+{
+}
+
+void i2c_master_enable(const struct i2c_master_module *const module)
+{
+	module->hw->I2CM.CTRLA.reg |= SERCOM_I2CM_CTRLA_ENABLE;
+	module->hw->I2CM.STATUS.reg = BUSSTATE_IDLE;
+}
+
+void i2c_master_register_callback(struct i2c_master_module *const module, i2c_master_callback_t callback, enum i2c_master_callback callback_type)
+{
+	module->callbacks[callback_type] = callback;
+	module->registered_callback |= (1 << callback_type);
+}
+
+void i2c_master_enable_callback(struct i2c_master_module *const module, enum i2c_master_callback callback_type)
+{
+	module->enabled_callback |= (1 << callback_type);
+}
+
+///Blocking write, polled by ASF with the interrupts off. Only the autoprobe uses it, before any job is queued.
+enum status_code i2c_master_write_packet_wait(struct i2c_master_module *const module, struct i2c_master_packet *const packet)
+{
+	CHECK(fake_bus_idle());
+	enum status_code status = start_transfer(packet->address, false, packet->data, packet->data_length, false);
+	if(status != STATUS_OK) return status;
+
+	fakeBusNowNs = endAtNs;
+	transfer_end();
+	endPending = false;
+	xfer.active = false;
+	fakeSercom0.I2CM.INTFLAG.reg = 0;
+	bus_stop();
+
+	if(xfer.nackAddress) return STATUS_ERR_BAD_ADDRESS;
+	if(xfer.nackData) return STATUS_ERR_OVERFLOW;
+	return STATUS_OK;
+}
+
+static enum status_code start_job(struct i2c_master_module *const module, struct i2c_master_packet *const packet, bool read, bool stop)
+{
+	if(module->buffer_remaining > 0) return STATUS_BUSY;
+
+	module->send_stop = stop;
+	module->send_nack = read;
+	module->buffer = packet->data;
+	module->buffer_length = packet->data_length;
+	module->buffer_remaining = packet->data_length;
+	module->transfer_direction = read ? I2C_TRANSFER_READ : I2C_TRANSFER_WRITE;
+	module->status = STATUS_BUSY;
+	module->hw->I2CM.INTENSET.reg = SERCOM_I2CM_INTENSET_MB | SERCOM_I2CM_INTENSET_SB;
+	sync_registers();
+	return start_transfer(packet->address, read, packet->data, packet->data_length, false);
+}
+
+enum status_code i2c_master_write_packet_job(struct i2c_master_module *const module, struct i2c_master_packet *const packet)
+{
+	return start_job(module, packet, false, true);
+}
+
+enum status_code i2c_master_write_packet_job_no_stop(struct i2c_master_module *const module, struct i2c_master_packet *const packet)
+{
+	return start_job(module, packet, false, false);
+}
+
+enum status_code i2c_master_read_packet_job(struct i2c_master_module *const module, struct i2c_master_packet *const packet)
+{
+	return start_job(module, packet, true, true);
+}
+
+void i2c_master_cancel_job(struct i2c_master_module *const module)
+{
+	module->buffer_remaining = 0;
+	module->buffer_length = 0;
+	module->status = STATUS_ABORTED;
+}
+
+///STOP while a transfer is on the wire cuts it short; its end never comes
+void i2c_master_send_stop(struct i2c_master_module *const module)
+{
+	sync_registers();
+	if(xfer.active)
+	{
+		if(endAtNs != NONE)
+		{
+			fakeBusStats.busyNs += fakeBusNowNs - xfer.startNs;
+			fakeBusStats.lastEndNs = fakeBusNowNs;
+			anyTransfer = true;
+		}
+		endAtNs = NONE;
+		endPending = false;
+		sercomIsrAtNs = NONE;
+		xfer.active = false;
+		fakeSercom0.I2CM.INTFLAG.reg = 0;
+	}
+	bus_stop();
+}
+
+void i2c_master_dma_set_transfer(struct i2c_master_module *const module, uint16_t addr, uint8_t length, enum i2c_transfer_direction direction)
+{
+	CHECK(dmaRunning);
+	CHECK_EQ(direction, I2C_TRANSFER_WRITE);
+	CHECK_EQ(length, sensorPacketWrite.data_length);
+	CHECK_EQ(dmaDescriptor->BTCNT.reg, length);
+	CHECK_EQ(dmaDescriptor->SRCADDR.reg, (uint32_t)(uintptr_t)(sensorPacketWrite.data + length));
+
+	sync_registers();
+	CHECK(start_transfer(addr, false, sensorPacketWrite.data, length, true) == STATUS_OK);
+	module->hw->I2CM.ADDR.reg |= SERCOM_I2CM_ADDR_LENEN | SERCOM_I2CM_ADDR_LEN(length);
+}
+
+uint32_t system_gclk_chan_get_hz(const uint8_t channel)
+{
+	return FAKE_BUS_GCLK_HZ;
+}
+
+/******************************************************************************
+* ASF DMA
+******************************************************************************/
+void dma_get_config_defaults(struct dma_resource_config *config)
+{
+	memset(config, 0, sizeof(*config));
+}
+
+enum status_code dma_allocate(struct dma_resource *resource, struct dma_resource_config *config)
+{
+	if(fakeDmaAllocateFails) return STATUS_ERR_NOT_FOUND;
+	CHECK_EQ(config->peripheral_trigger, SERCOM0_DMAC_ID_TX);
+	memset(resource, 0, sizeof(*resource));
+	dmaResource = resource;
+	return STATUS_OK;
+}
+
+void dma_descriptor_get_config_defaults(struct dma_descriptor_config *config)
+{
+	memset(config, 0, sizeof(*config));
+	config->descriptor_valid = true;
+	config->src_increment_enable = true;
+	config->dst_increment_enable = true;
+}
+
+void dma_descriptor_create(DmacDescriptor *descriptor, struct dma_descriptor_config *config)
+{
+	CHECK(config->src_increment_enable && !config->dst_increment_enable);
+	CHECK_EQ(config->destination_address, (uint32_t)(uintptr_t)&fakeSercom0.I2CM.DATA.reg);
+	descriptor->BTCNT.reg = config->block_transfer_count;
+	descriptor->SRCADDR.reg = config->source_address;
+	descriptor->DSTADDR.reg = config->destination_address;
+	descriptor->DESCADDR.reg = config->next_descriptor_address;
+}
+
+enum status_code dma_add_descriptor(struct dma_resource *resource, DmacDescriptor *descriptor)
+{
+	resource->descriptor = descriptor;
+	dmaDescriptor = descriptor;
+	return STATUS_OK;
+}
+
+void dma_register_callback(struct dma_resource *resource, dma_callback_t callback, enum dma_callback_type type)
+{
+	resource->callback[type] = callback;
+}
+
+void dma_enable_callback(struct dma_resource *resource, enum dma_callback_type type)
+{
+	resource->callback_enable |= (1 << type);
+}
+
+enum status_code dma_start_transfer_job(struct dma_resource *resource)
+{
+	if(fakeDmaStartFails) return STATUS_BUSY;
+	CHECK(!dmaRunning);
+	dmaRunning = true;
+	return STATUS_OK;
+}
+
+void dma_abort_job(struct dma_resource *resource)
+{
+	dmaRunning = false;
+	dmaIsrAtNs = NONE;
+}
+
+/******************************************************************************
+* FreeRTOS, for the one test thread
+******************************************************************************/
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+	return &threadTask;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+	return (TickType_t)(fakeBusNowNs / FAKE_BUS_NS_PER_TICK);
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+	fake_bus_run(fakeBusNowNs + xTicksToDelay * FAKE_BUS_NS_PER_TICK);
+}
+
+void vTaskSetTimeOutState(TimeOut_t *const pxTimeOut)
+{
+	pxTimeOut->xTimeOnEntering = xTaskGetTickCount();
+}
+
+BaseType_t xTaskCheckForTimeOut(TimeOut_t *const pxTimeOut, TickType_t *const pxTicksToWait)
+{
+	TickType_t now = xTaskGetTickCount();
+	TickType_t elapsed = now - pxTimeOut->xTimeOnEntering;
+
+	if(*pxTicksToWait == portMAX_DELAY) return pdFALSE;
+	if(elapsed >= *pxTicksToWait)
+	{
+		*pxTicksToWait = 0;
+		return pdTRUE;
+	}
+	*pxTicksToWait -= elapsed;
+	pxTimeOut->xTimeOnEntering = now;
+	return pdFALSE;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+	CHECK(xTaskToNotify == &threadTask);
+	notifyValue++;
+	return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken)
+{
+	CHECK(xTaskToNotify == &threadTask);
+	notifyValue++;
+	*pxHigherPriorityTaskWoken = pdTRUE;
+}
+
+///Sleeps: the bus runs until the thread is notified or the ticks have passed
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+	uint64_t deadline = (xTicksToWait == portMAX_DELAY) ? UINT64_MAX : fakeBusNowNs + xTicksToWait * FAKE_BUS_NS_PER_TICK;
+
+	CHECK_EQ(host_critical_nesting, 0);
+	while(notifyValue == 0 && bus_step(deadline));
+	if(notifyValue == 0)
+	{
+		CHECK(deadline != UINT64_MAX);	//Nothing left on the bus to wake the thread
+		fakeBusNowNs = deadline;
+		return 0;
+	}
+
+	uint32_t value = notifyValue;
+	notifyValue = xClearCountOnExit ? 0 : value - 1;
+	return value;
+}
@@ -0,0 +1,79 @@
+/**************************************************************************//**
+* @file      fake_i2c_bus.h
+* @brief     Simulated sensor bus for the host tests of the I2C driver
+* @details   Runs I2CDriver.c unchanged on a model of SERCOM0, the DMAC and the devices on the bus, on a simulated clock in
+			 nanoseconds. A transfer takes START, 9 clocks per byte (address included) and, when it ends the transaction,
+			 STOP, at the SCL frequency the BAUD register gives. The SERCOM and DMAC interrupts run FAKE_BUS_ISR_LATENCY_NS
+			 after their event, through a model of the ASF SERCOM handler, and only while enabled in INTENSET. Time only
+			 moves while the test thread sleeps in ulTaskNotifyTake or calls fake_bus_run.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdbool.h>
+#include "I2cDriver/I2cDriver.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define FAKE_BUS_GCLK_HZ		48000000	///<SERCOM0 core clock
+#define FAKE_BUS_ISR_LATENCY_NS	2000		///<From an event to the first line of its handler, FreeRTOS masking included
+#define FAKE_BUS_NS_PER_TICK	(1000000000ull / configTICK_RATE_HZ)
+#define FAKE_BUS_MAX_DEVICES	4
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///Device on the simulated bus
+struct fake_i2c_device
+{
+	uint8_t address;		///<7-bit address
+	uint32_t maxHz;			///<Fastest SCL the device acknowledges at. Its address is NACKed above it.
+	bool nackLastByte;		///<NACK the last byte of the next write, then clear
+	uint64_t hangNs;		///<If not 0, the next transfer holds the bus that long (clock stretching), then clear
+	uint8_t readBase;		///<A read returns readBase, readBase + 1, ...
+	uint8_t lastWrite[256];	///<Data of the last write
+	uint16_t lastWriteLen;
+	uint32_t writes, reads;	///<Transfers the device acknowledged
+};
+
+///Traffic on the bus since the last fake_bus_reset_stats
+struct fake_bus_stats
+{
+	uint32_t transfers;			///<START (or repeated START) to the end of the last byte
+	uint32_t bytes;				///<Address bytes plus data bytes
+	uint32_t dmaTransfers;		///<Writes fed by the DMAC
+	uint32_t sercomIsrs;		///<SERCOM interrupts taken
+	uint32_t dmaIsrs;			///<DMAC interrupts taken
+	uint32_t reclocks;			///<Transfers that start at another SCL frequency than the one before
+	uint64_t busyNs;			///<Time with a transfer on the wire
+	uint64_t gapNs;				///<Sum of the idle times from the end of a transfer to the START of the next
+	uint64_t maxGapNs;			///<Longest of those
+	uint32_t gaps;				///<Number of those
+	uint64_t firstStartNs;		///<START of the first transfer
+	uint64_t lastEndNs;			///<End of the last transfer
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+extern uint64_t fakeBusNowNs;			///<Simulated time
+extern struct fake_bus_stats fakeBusStats;
+extern bool fakeDmaAllocateFails;		///<dma_allocate fails, so the driver has no DMA channel
+extern bool fakeDmaStartFails;			///<dma_start_transfer_job fails until cleared
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+void fake_bus_reset(void);
+void fake_bus_add_device(struct fake_i2c_device *device);
+void fake_bus_reset_stats(void);
+void fake_bus_run(uint64_t untilNs);
+uint32_t fake_bus_scl_hz(void);
+bool fake_bus_idle(void);
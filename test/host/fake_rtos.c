@@ -0,0 +1,344 @@
+/**************************************************************************//**
+* @file      fake_rtos.c
+* @brief     Simulated FreeRTOS tick for the host tests of the firmware threads
+* @details   See fake_rtos.h. One mutex and condition variable hand the CPU back and forth between the test and the
+			 task, so the two never run at the same time and every write of one is seen by the other.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <pthread.h>
+#include <string.h>
+#include "host_test.h"
+#include "fake_rtos.h"
+#include "queue.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+///True if tick a is not later than tick b, across the wrap of the tick count
+#define TICK_NOT_AFTER(a, b)	((TickType_t)((b) - (a)) < portMAX_DELAY / 2)
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+uint32_t fakeRtosWakeups;
+int fakeRtosSchedulerSuspended;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t turn = PTHREAD_COND_INITIALIZER;
+static pthread_t thread;
+
+static bool taskRunning;		///<The task has the CPU. Cleared when it blocks.
+static bool waitNotify;			///<The blocked task wakes up on a notification
+static bool waitTimed;			///<The blocked task wakes up at wakeTick
+static QueueHandle_t waitQueue;	///<The blocked task wakes up once this queue holds an item
+static TickType_t wakeTick;
+static TickType_t tick;
+static uint32_t notifyValue;
+static bool notifyPending;		///<A notification came since the task last took or waited for one
+static int taskHandle;			///<Handle of the one task
+
+static void (*taskFunction)(void *);
+static void *taskParameters;
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///Gives the CPU back to the test until fake_rtos_run_until wakes the task. Called with the lock held.
+static void task_block(bool onNotify, bool timed, TickType_t until)
+{
+	waitNotify = onNotify;
+	waitTimed = timed;
+	wakeTick = until;
+	taskRunning = false;
+	pthread_cond_broadcast(&turn);
+	while(!taskRunning) pthread_cond_wait(&turn, &lock);
+	fakeRtosWakeups++;
+}
+
+static void *task_thread(void *arg)
+{
+	pthread_mutex_lock(&lock);
+	while(!taskRunning) pthread_cond_wait(&turn, &lock);
+	pthread_mutex_unlock(&lock);
+
+	taskFunction(taskParameters);
+
+	fprintf(stderr, "task returned\n");	//A FreeRTOS task must never return
+	exit(1);
+}
+
+/******************************************************************************
+* Functions
+******************************************************************************/
+
+///Starts the task at startTick and runs it until it blocks for the first time
+void fake_rtos_start(void (*task)(void *), void *parameters, TickType_t startTick)
+{
+	taskFunction = task;
+	taskParameters = parameters;
+	tick = startTick;
+	notifyValue = 0;
+	notifyPending = false;
+	fakeRtosWakeups = 0;
+	CHECK(pthread_create(&thread, NULL, task_thread, NULL) == 0);
+
+	pthread_mutex_lock(&lock);
+	taskRunning = true;
+	pthread_cond_broadcast(&turn);
+	while(taskRunning) pthread_cond_wait(&turn, &lock);
+	pthread_mutex_unlock(&lock);
+}
+
+///Moves the clock to untilTick, waking the task each time its wait ends or it was notified, and returns with the
+///task blocked
+void fake_rtos_run_until(TickType_t untilTick)
+{
+	pthread_mutex_lock(&lock);
+	CHECK(TICK_NOT_AFTER(tick, untilTick));
+	for(;;)
+	{
+		if((waitNotify && notifyPending) || (waitQueue != NULL && uxQueueMessagesWaiting(waitQueue) > 0))
+		{
+			//Woken at once, no time passes
+		}
+		else if(waitTimed && TICK_NOT_AFTER(wakeTick, untilTick))
+		{
+			if(TICK_NOT_AFTER(tick, wakeTick)) tick = wakeTick;
+		}
+		else
+		{
+			break;
+		}
+		taskRunning = true;
+		pthread_cond_broadcast(&turn);
+		while(taskRunning) pthread_cond_wait(&turn, &lock);
+	}
+	tick = untilTick;
+	pthread_mutex_unlock(&lock);
+}
+
+void fake_rtos_run_for(TickType_t ticks)
+{
+	fake_rtos_run_until(fake_rtos_tick() + ticks);
+}
+
+///Notification from an interrupt. The task sees it on the next fake_rtos_run_until, at the current tick.
+void fake_rtos_notify(void)
+{
+	xTaskNotify(&taskHandle, 0, eIncrement);
+}
+
+///True when called from the task, for the models that only take time when the task uses them
+bool fake_rtos_in_task(void)
+{
+	return pthread_equal(pthread_self(), thread) != 0;
+}
+
+TickType_t fake_rtos_tick(void)
+{
+	pthread_mutex_lock(&lock);
+	TickType_t now = tick;
+	pthread_mutex_unlock(&lock);
+	return now;
+}
+
+/******************************************************************************
+* FreeRTOS
+******************************************************************************/
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+	return &taskHandle;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+	return fake_rtos_tick();
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+	pthread_mutex_lock(&lock);
+	task_block(false, true, tick + xTicksToDelay);
+	pthread_mutex_unlock(&lock);
+}
+
+///There is no other task to hold off, so suspending the scheduler only counts its nesting
+void vTaskSuspendAll(void)
+{
+	fakeRtosSchedulerSuspended++;
+}
+
+BaseType_t xTaskResumeAll(void)
+{
+	CHECK(fakeRtosSchedulerSuspended > 0);
+	fakeRtosSchedulerSuspended--;
+	return pdFALSE;
+}
+
+///Only the task suspending itself, which never wakes up again
+void vTaskSuspend(TaskHandle_t xTaskToSuspend)
+{
+	CHECK(xTaskToSuspend == NULL);
+	pthread_mutex_lock(&lock);
+	task_block(false, false, 0);
+	CHECK(false);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+	pthread_mutex_lock(&lock);
+	CHECK_EQ(host_critical_nesting, 0);
+	if(notifyValue == 0 && xTicksToWait != 0)
+	{
+		notifyPending = false;
+		task_block(true, xTicksToWait != portMAX_DELAY, tick + xTicksToWait);
+	}
+	uint32_t value = notifyValue;
+	if(value != 0) notifyValue = xClearCountOnExit ? 0 : value - 1;
+	notifyPending = false;
+	pthread_mutex_unlock(&lock);
+	return value;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction)
+{
+	CHECK(xTaskToNotify == &taskHandle);
+	pthread_mutex_lock(&lock);
+	switch(eAction)
+	{
+		case eSetBits: notifyValue |= ulValue; break;
+		case eIncrement: notifyValue++; break;
+		case eSetValueWithOverwrite: notifyValue = ulValue; break;
+		default: CHECK(false);
+	}
+	notifyPending = true;
+	pthread_mutex_unlock(&lock);
+	return pdPASS;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClearOnExit, uint32_t *pulNotificationValue,
+	TickType_t xTicksToWait)
+{
+	pthread_mutex_lock(&lock);
+	CHECK_EQ(host_critical_nesting, 0);
+	if(!notifyPending)
+	{
+		notifyValue &= ~ulBitsToClearOnEntry;
+		if(xTicksToWait != 0) task_block(true, xTicksToWait != portMAX_DELAY, tick + xTicksToWait);
+	}
+	BaseType_t notified = notifyPending ? pdTRUE : pdFALSE;
+	if(pulNotificationValue != NULL) *pulNotificationValue = notifyValue;
+	if(notified) notifyValue &= ~ulBitsToClearOnExit;
+	notifyPending = false;
+	pthread_mutex_unlock(&lock);
+	return notified;
+}
+
+void vTaskSetTimeOutState(TimeOut_t *const pxTimeOut)
+{
+	pxTimeOut->xTimeOnEntering = xTaskGetTickCount();
+}
+
+BaseType_t xTaskCheckForTimeOut(TimeOut_t *const pxTimeOut, TickType_t *const pxTicksToWait)
+{
+	TickType_t now = xTaskGetTickCount();
+	TickType_t elapsed = now - pxTimeOut->xTimeOnEntering;
+
+	if(*pxTicksToWait == portMAX_DELAY) return pdFALSE;
+	if(elapsed >= *pxTicksToWait)
+	{
+		*pxTicksToWait = 0;
+		return pdTRUE;
+	}
+	*pxTicksToWait -= elapsed;
+	pxTimeOut->xTimeOnEntering = now;
+	return pdFALSE;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+	return xTaskNotify(xTaskToNotify, 0, eIncrement);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken)
+{
+	xTaskNotify(xTaskToNotify, 0, eIncrement);
+	*pxHigherPriorityTaskWoken = pdTRUE;
+}
+
+/******************************************************************************
+* FreeRTOS queues
+******************************************************************************/
+///Queue of fixed size items. Only the task or the test touches it at a time, so it needs no lock of its own.
+///Sends never block. A receive on an empty queue blocks the task until an item comes or the wait ends; called from
+///the test, it runs the task a tick at a time for as long.
+struct fake_queue
+{
+	UBaseType_t length;
+	UBaseType_t itemSize;
+	UBaseType_t count;
+	UBaseType_t head;		///<Index of the oldest item
+	uint8_t items[];
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize)
+{
+	QueueHandle_t queue = calloc(1, sizeof(*queue) + uxQueueLength * uxItemSize);
+	CHECK(queue != NULL);
+	queue->length = uxQueueLength;
+	queue->itemSize = uxItemSize;
+	return queue;
+}
+
+///Never blocks: a full queue fails at once, as if the wait timed out
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+	if(xQueue->count == xQueue->length) return errQUEUE_FULL;
+	UBaseType_t slot = (xQueue->head + xQueue->count) % xQueue->length;
+	memcpy(&xQueue->items[slot * xQueue->itemSize], pvItemToQueue, xQueue->itemSize);
+	xQueue->count++;
+	return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait)
+{
+	if(xQueue->count == 0 && xTicksToWait != 0)
+	{
+		if(fake_rtos_in_task())
+		{
+			pthread_mutex_lock(&lock);
+			CHECK_EQ(host_critical_nesting, 0);
+			waitQueue = xQueue;
+			task_block(false, xTicksToWait != portMAX_DELAY, tick + xTicksToWait);
+			waitQueue = NULL;
+			pthread_mutex_unlock(&lock);
+		}
+		else
+		{
+			TickType_t deadline = fake_rtos_tick() + xTicksToWait;
+			fake_rtos_run_for(0);
+			while(xQueue->count == 0 && (xTicksToWait == portMAX_DELAY || fake_rtos_tick() != deadline))
+			{
+				fake_rtos_run_for(1);
+			}
+		}
+	}
+	if(xQueue->count == 0) return errQUEUE_EMPTY;
+	memcpy(pvBuffer, &xQueue->items[xQueue->head * xQueue->itemSize], xQueue->itemSize);
+	xQueue->head = (xQueue->head + 1) % xQueue->length;
+	xQueue->count--;
+	return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue)
+{
+	return xQueue->count;
+}
@@ -0,0 +1,39 @@
+/**************************************************************************//**
+* @file      fake_rtos.h
+* @brief     Simulated FreeRTOS tick for the host tests of the firmware threads
+* @details   Runs one task function on its own pthread, in lock step with the test: the test only runs while the task
+			 is blocked (ulTaskNotifyTake or vTaskDelay), and the task only runs when fake_rtos_run_until wakes it, at
+			 the tick its wait ends or at once if it was notified. The tick only moves forward in fake_rtos_run_until,
+			 so a test can stop the clock anywhere, inject an event and see exactly when the task reacts to it.
+			 Also implements the task notifications (counts and bits), the time outs, the scheduler suspension and the
+			 queues. A queue receive blocks the task like a notification wait; called from the test, it runs the task
+			 until the item comes.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdbool.h>
+#include "FreeRTOS.h"
+#include "task.h"
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+extern uint32_t fakeRtosWakeups;	///<Times the task came back from a blocking call
+extern int fakeRtosSchedulerSuspended;	///<Nesting of vTaskSuspendAll
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+void fake_rtos_start(void (*task)(void *), void *parameters, TickType_t startTick);
+void fake_rtos_run_until(TickType_t tick);
+void fake_rtos_run_for(TickType_t ticks);
+void fake_rtos_notify(void);
+TickType_t fake_rtos_tick(void);
+bool fake_rtos_in_task(void);
@@ -0,0 +1,273 @@
+/**************************************************************************//**
+* @file      fake_uart.c
+* @brief     Simulated console UART for the host tests of the Serial Console and the CLI
+* @details   See fake_uart.h. Implements the ASF usart and DMA calls the Serial Console makes. There is at most one
+			 span on the line, so the only pending event is its next byte.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "host_test.h"
+#include "fake_uart.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define NONE			UINT64_MAX
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+struct host_usart_sercom fakeSercom4;
+uint64_t fakeUartNowNs;
+uint64_t fakeUartLineFreeNs;
+bool fakeUartDmaAllocateFails;
+struct fake_uart_stats fakeUartStats;
+uint8_t fakeUartWire[FAKE_UART_WIRE_SIZE];
+uint32_t fakeUartWireLen;
+
+extern uint8_t txCharacterBuffer[];		///<TX ring storage of SerialConsole.c, which the DMAC reads
+
+static struct usart_module *usart;		///<Module given to usart_init
+static uint8_t *rxData;					///<Where the read job stores the next character, NULL if none
+static struct dma_resource *dma;		///<Channel given to dma_allocate
+
+static bool txActive;					///<A job or a DMA span is being sent
+static bool txDma;
+static const uint8_t *txData;
+static uint32_t txLen, txSent;
+static uint64_t nextByteNs = NONE;		///<The next byte of the span is on the line then
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+static void start_span(const uint8_t *data, uint32_t len, bool viaDma)
+{
+	CHECK(!txActive);
+	CHECK(len > 0);
+	//A span never runs past the end of the ring
+	CHECK(data >= txCharacterBuffer && data + len <= txCharacterBuffer + FAKE_UART_TX_RING_SIZE);
+	txActive = true;
+	txDma = viaDma;
+	txData = data;
+	txLen = len;
+	txSent = 0;
+	nextByteNs = ((fakeUartLineFreeNs > fakeUartNowNs) ? fakeUartLineFreeNs : fakeUartNowNs) + FAKE_UART_BYTE_NS;
+	fakeUartStats.starts++;
+}
+
+/******************************************************************************
+* USART
+******************************************************************************/
+void usart_get_config_defaults(struct usart_config *const config)
+{
+	memset(config, 0, sizeof(*config));
+}
+
+enum status_code usart_init(struct usart_module *const module, struct host_usart_sercom *const hw,
+	const struct usart_config *const config)
+{
+	CHECK(hw == &fakeSercom4);
+	CHECK_EQ(config->baudrate, 115200);
+	memset(module, 0, sizeof(*module));
+	module->hw = hw;
+	usart = module;
+	return STATUS_OK;
+}
+
+void usart_enable(const struct usart_module *const module)
+{
+}
+
+void usart_disable(const struct usart_module *const module)
+{
+}
+
+void usart_register_callback(struct usart_module *const module, usart_callback_t callback_func,
+	enum usart_callback callback_type)
+{
+	module->callback[callback_type] = callback_func;
+}
+
+void usart_enable_callback(struct usart_module *const module, enum usart_callback callback_type)
+{
+	module->callback_enable_mask |= 1u << callback_type;
+}
+
+enum status_code usart_write_buffer_job(struct usart_module *const module, uint8_t *tx_data, uint16_t length)
+{
+	CHECK(module == usart);
+	if(txActive) return STATUS_BUSY;
+	start_span(tx_data, length, false);
+	return STATUS_OK;
+}
+
+enum status_code usart_read_buffer_job(struct usart_module *const module, uint8_t *rx_data, uint16_t length)
+{
+	CHECK(module == usart);
+	CHECK_EQ(length, 1);
+	rxData = rx_data;
+	return STATUS_OK;
+}
+
+/******************************************************************************
+* DMA
+******************************************************************************/
+void dma_get_config_defaults(struct dma_resource_config *config)
+{
+	memset(config, 0, sizeof(*config));
+}
+
+enum status_code dma_allocate(struct dma_resource *resource, struct dma_resource_config *config)
+{
+	if(fakeUartDmaAllocateFails) return STATUS_ERR_NOT_FOUND;
+	CHECK_EQ(config->peripheral_trigger, SERCOM4_DMAC_ID_TX);
+	CHECK_EQ(config->trigger_action, DMA_TRIGGER_ACTION_BEAT);
+	memset(resource, 0, sizeof(*resource));
+	dma = resource;
+	return STATUS_OK;
+}
+
+void dma_descriptor_get_config_defaults(struct dma_descriptor_config *config)
+{
+	memset(config, 0, sizeof(*config));
+	config->descriptor_valid = true;
+	config->src_increment_enable = true;
+	config->dst_increment_enable = true;
+}
+
+void dma_descriptor_create(DmacDescriptor *descriptor, struct dma_descriptor_config *config)
+{
+	CHECK(config->src_increment_enable && !config->dst_increment_enable);
+	CHECK_EQ(config->beat_size, DMA_BEAT_SIZE_BYTE);
+	CHECK_EQ(config->destination_address, (uint32_t)(uintptr_t)&fakeSercom4.USART.DATA.reg);
+	descriptor->BTCNT.reg = config->block_transfer_count;
+	descriptor->SRCADDR.reg = config->source_address;
+	descriptor->DSTADDR.reg = config->destination_address;
+	descriptor->DESCADDR.reg = config->next_descriptor_address;
+}
+
+enum status_code dma_add_descriptor(struct dma_resource *resource, DmacDescriptor *descriptor)
+{
+	resource->descriptor = descriptor;
+	return STATUS_OK;
+}
+
+void dma_register_callback(struct dma_resource *resource, dma_callback_t callback, enum dma_callback_type type)
+{
+	resource->callback[type] = callback;
+}
+
+void dma_enable_callback(struct dma_resource *resource, enum dma_callback_type type)
+{
+	resource->callback_enable |= 1u << type;
+}
+
+///The DMAC reads RAM by 32-bit address, which a 64-bit host cannot follow. The span is found from its offset in the
+///TX ring, the only memory the channel is given.
+enum status_code dma_start_transfer_job(struct dma_resource *resource)
+{
+	CHECK(resource == dma);
+	if(txActive) return STATUS_BUSY;
+	DmacDescriptor *descriptor = resource->descriptor;
+	uint32_t len = descriptor->BTCNT.reg;
+	uint32_t offset = descriptor->SRCADDR.reg - (uint32_t)(uintptr_t)txCharacterBuffer - len;
+	CHECK(offset < FAKE_UART_TX_RING_SIZE);
+	start_span(txCharacterBuffer + offset, len, true);
+	return STATUS_OK;
+}
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
+
+///Forgets the channel and clears the line and the counts, before the test calls InitializeSerialConsole. Time goes on.
+void fake_uart_reset(bool useDma)
+{
+	CHECK(!txActive);
+	fakeUartDmaAllocateFails = !useDma;
+	dma = NULL;
+	fakeUartWireLen = 0;
+	memset(&fakeUartStats, 0, sizeof(fakeUartStats));
+}
+
+///True if the console got its DMA channel
+bool fake_uart_dma_allocated(void)
+{
+	return dma != NULL;
+}
+
+///True if a read job waits for the next character
+bool fake_uart_reading(void)
+{
+	return rxData != NULL;
+}
+
+///True if a span is on the line
+bool fake_uart_tx_active(void)
+{
+	return txActive;
+}
+
+///Runs the line until ns from now. The interrupts of the spans that end are taken on the way.
+void fake_uart_run(uint64_t ns)
+{
+	uint64_t end = fakeUartNowNs + ns;
+
+	while(txActive && nextByteNs <= end)
+	{
+		fakeUartNowNs = nextByteNs;
+		CHECK(fakeUartWireLen < FAKE_UART_WIRE_SIZE);
+		fakeUartWire[fakeUartWireLen++] = txData[txSent++];
+		fakeUartLineFreeNs = fakeUartNowNs;
+		if(!txDma) fakeUartStats.interrupts++;	//Data register empty, the next byte is written by the CPU
+		if(txSent < txLen)
+		{
+			nextByteNs += FAKE_UART_BYTE_NS;
+			continue;
+		}
+
+		//Span is out: transfer done of the channel, or transmit complete of the job
+		txActive = false;
+		nextByteNs = NONE;
+		fakeUartStats.interrupts++;
+		if(txDma)
+		{
+			CHECK(dma->callback_enable & (1u << DMA_CALLBACK_TRANSFER_DONE));
+			dma->callback[DMA_CALLBACK_TRANSFER_DONE](dma);
+		}
+		else
+		{
+			CHECK(usart->callback_enable_mask & (1u << USART_CALLBACK_BUFFER_TRANSMITTED));
+			usart->callback[USART_CALLBACK_BUFFER_TRANSMITTED](usart);
+		}
+	}
+	fakeUartNowNs = end;
+}
+
+///Runs the line until every byte written is out
+void fake_uart_drain(void)
+{
+	while(txActive)
+	{
+		fake_uart_run(FAKE_UART_BYTE_NS);
+	}
+}
+
+///A character comes in now: the read job stores it and its callback runs, as in the RX interrupt
+void fake_uart_receive(uint8_t rxChar)
+{
+	CHECK(rxData != NULL);
+	CHECK(usart->callback_enable_mask & (1u << USART_CALLBACK_BUFFER_RECEIVED));
+	uint8_t *data = rxData;
+	rxData = NULL;
+	*data = rxChar;
+	fakeUartStats.received++;
+	usart->callback[USART_CALLBACK_BUFFER_RECEIVED](usart);
+}
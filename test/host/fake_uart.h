@@ -0,0 +1,60 @@
+/**************************************************************************//**
+* @file      fake_uart.h
+* @brief     Simulated console UART for the host tests of the Serial Console and the CLI
+* @details   Runs SerialConsole.c unchanged on a model of SERCOM4 at 115200 8N1, which puts one byte on the line
+			 every 10 bit times, and of the DMA channel that feeds it, on a simulated clock in nanoseconds. The model
+			 counts the interrupts the way the SAMD21 takes them: a DMA span costs the one of its transfer done, a
+			 usart write job one per byte (data register empty) and one at its end (transmit complete). A received
+			 character is handed to the read job and its callback at once, as the RX interrupt does. Time only moves
+			 in fake_uart_run.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdbool.h>
+#include "SerialConsole.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define FAKE_UART_BYTE_NS		86806ull			///<10 bits at 115200 baud
+#define FAKE_UART_TX_RING_SIZE	512					///<TX_BUFFER_SIZE of SerialConsole.c
+#define FAKE_UART_WIRE_SIZE		(256 * 1024)		///<Most bytes one test sends
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///Traffic on the line since the last fake_uart_reset
+struct fake_uart_stats
+{
+	uint32_t interrupts;	///<TX interrupts taken
+	uint32_t starts;		///<DMA spans and usart write jobs started
+	uint32_t received;		///<Characters handed to the read job
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+extern uint64_t fakeUartNowNs;				///<Simulated time
+extern uint64_t fakeUartLineFreeNs;			///<The last byte sent was out then
+extern bool fakeUartDmaAllocateFails;		///<dma_allocate fails, so the console sends with usart write jobs
+extern struct fake_uart_stats fakeUartStats;
+extern uint8_t fakeUartWire[FAKE_UART_WIRE_SIZE];	///<Bytes on the TX line
+extern uint32_t fakeUartWireLen;
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+void fake_uart_reset(bool useDma);
+bool fake_uart_dma_allocated(void);
+bool fake_uart_reading(void);
+bool fake_uart_tx_active(void);
+void fake_uart_run(uint64_t ns);
+void fake_uart_drain(void);
+void fake_uart_receive(uint8_t rxChar);
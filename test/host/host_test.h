@@ -0,0 +1,42 @@
+/**************************************************************************//**
+* @file      host_test.h
+* @brief     Minimal checks shared by the host tests
+* @details   A failed check prints where it failed and exits, so the Makefile stops at the first broken test.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+///Fails the test if cond is false
+#define CHECK(cond)	\
+	do { if(!(cond)) { fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); exit(1); } } while(0)
+
+///Fails the test if a and b differ. Both are compared and printed as long long.
+#define CHECK_EQ(a, b)	\
+	do { long long a_ = (long long)(a), b_ = (long long)(b); \
+		if(a_ != b_) { fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, a_, b_); exit(1); } } while(0)
+
+/******************************************************************************
+* Functions
+******************************************************************************/
+///Small xorshift generator, so every run of a test sees the same sequence
+static inline uint32_t test_rand(void)
+{
+	static uint32_t state = 0x2545F491;
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
@@ -0,0 +1,132 @@
+/**************************************************************************//**
+* @file      mock_i2c.c
+* @brief     Mock of the I2C driver for the host tests of the device drivers
+* @details   See mock_i2c.h. The legacy *Wait calls are built on jobs the same way as in I2CDriver.c, so a test counts
+			 the transfers the firmware would put on the bus.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "host_test.h"
+#include "mock_i2c.h"
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+struct mock_i2c_stats mockI2cStats;
+uint32_t mockI2cFailTransfer;
+
+static mock_i2c_device_fn mockDevice;
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///Runs one step of a job on the mock bus
+static int32_t mock_i2c_transfer(uint8_t address, const I2C_Step *step)
+{
+	bool read = (step->type == I2C_STEP_READ);
+
+	mockI2cStats.transfers++;
+	mockI2cStats.bytes += 1 + step->len;
+	if(read) mockI2cStats.reads++;
+
+	if(mockI2cFailTransfer != 0 && mockI2cStats.transfers == mockI2cFailTransfer)
+	{
+		mockI2cFailTransfer = 0;
+		return ERROR_IO;
+	}
+	if(step->len != 0 && step->data == NULL) return ERROR_INVALID_ARG;
+	return (mockDevice != NULL) ? mockDevice(address, read, step->data, step->len) : ERROR_NONE;
+}
+
+///Builds and runs a job of up to two steps, like the *Wait calls of the driver
+static int32_t mock_i2c_run(const I2C_Data *data, uint8_t firstType, bool withRead)
+{
+	I2C_Step steps[2] = {
+		{firstType, (uint8_t *)data->msgOut, data->lenOut},
+		{I2C_STEP_READ, data->msgIn, data->lenIn},
+	};
+	I2C_Job job = {.address = data->address, .speed = data->speed, .steps = steps, .numSteps = withRead ? 2 : 1};
+
+	return I2cRunJob(&job, portMAX_DELAY);
+}
+
+/******************************************************************************
+* Functions
+******************************************************************************/
+
+void mock_i2c_reset(mock_i2c_device_fn device)
+{
+	memset(&mockI2cStats, 0, sizeof(mockI2cStats));
+	mockI2cFailTransfer = 0;
+	mockDevice = device;
+}
+
+int32_t I2cSubmitJob(I2C_Job *job)
+{
+	if(job == NULL || job->steps == NULL || job->numSteps == 0) return ERROR_INVALID_ARG;
+
+	mockI2cStats.jobs++;
+	job->next = NULL;
+	job->result = ERROR_NONE;
+	for(job->currentStep = 0; job->currentStep < job->numSteps; job->currentStep++)
+	{
+		job->result = mock_i2c_transfer(job->address, &job->steps[job->currentStep]);
+		if(ERROR_NONE != job->result) break;
+	}
+	job->done = true;
+	if(job->callback != NULL) job->callback(job);
+	return ERROR_NONE;
+}
+
+int32_t I2cWaitJob(I2C_Job *job, const TickType_t xMaxBlockTime)
+{
+	CHECK(job->done);
+	return job->result;
+}
+
+int32_t I2cRunJob(I2C_Job *job, const TickType_t xMaxBlockTime)
+{
+	job->notifyTask = NULL;
+	job->callback = NULL;
+
+	int32_t error = I2cSubmitJob(job);
+	if(ERROR_NONE != error) return error;
+	return I2cWaitJob(job, xMaxBlockTime);
+}
+
+int32_t I2cWriteDataWait(I2C_Data *data, const TickType_t xMaxBlockTime)
+{
+	if(data == NULL || data->msgOut == NULL) return ERROR_INVALID_ARG;
+	return mock_i2c_run(data, I2C_STEP_WRITE, false);
+}
+
+int32_t I2cWriteDataDmaWait(I2C_Data *data, const TickType_t xMaxBlockTime)
+{
+	if(data == NULL || data->msgOut == NULL || data->lenOut == 0) return ERROR_INVALID_ARG;
+	return mock_i2c_run(data, I2C_STEP_WRITE_DMA, false);
+}
+
+int32_t I2cReadDataWait(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime)
+{
+	if(data == NULL || data->msgOut == NULL || data->msgIn == NULL) return ERROR_INVALID_ARG;
+	return mock_i2c_run(data, I2C_STEP_WRITE, true);
+}
+
+int32_t I2cReadDataWait_NoStop(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime)
+{
+	if(data == NULL || data->msgOut == NULL || data->msgIn == NULL) return ERROR_INVALID_ARG;
+	return mock_i2c_run(data, I2C_STEP_WRITE_NO_STOP, true);
+}
+
+uint8_t I2cGetDeviceSpeed(uint8_t address)
+{
+	return I2C_SPEED_100KHZ;
+}
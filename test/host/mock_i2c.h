@@ -0,0 +1,45 @@
+/**************************************************************************//**
+* @file      mock_i2c.h
+* @brief     Mock of the I2C driver for the host tests of the device drivers
+* @details   Implements the API of I2cDriver.h without a bus. Every job runs at once on the calling thread: each step is
+			 handed to the device model the test installs, and counted. A transfer is one START (or repeated START),
+			 the address byte and the data bytes, so the byte counts are the bytes on the wire, ACKs left out.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdbool.h>
+#include "I2cDriver/I2cDriver.h"
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///Traffic seen by the mock bus since the last mock_i2c_reset
+struct mock_i2c_stats
+{
+	uint32_t jobs;			///<Jobs run, including the ones the *Wait calls build
+	uint32_t transfers;		///<START (or repeated START) to STOP (or next repeated START)
+	uint32_t bytes;			///<Address bytes plus data bytes
+	uint32_t reads;			///<Transfers that read from the device
+};
+
+///Device model. Gets every transfer to its address: read is false for a write. Returns ERROR_NONE if the device
+///acknowledged, or an error code, which ends the job with that code.
+typedef int32_t (*mock_i2c_device_fn)(uint8_t address, bool read, uint8_t *data, uint16_t len);
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+extern struct mock_i2c_stats mockI2cStats;
+extern uint32_t mockI2cFailTransfer;	///<1-based number of the transfer to fail with ERROR_IO, 0 for none. Cleared when hit.
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+void mock_i2c_reset(mock_i2c_device_fn device);
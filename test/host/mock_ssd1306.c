@@ -0,0 +1,106 @@
+/**************************************************************************//**
+* @file      mock_ssd1306.c
+* @brief     Model of the SSD1306 OLED controller for the host tests of the OLED driver
+* @details   See mock_ssd1306.h. Only what the driver uses is modelled: the first byte of a transfer is the control
+			 byte (commands or data, Co = 0), the commands with one argument byte are skipped with their argument,
+			 and the column wraps inside the page as in page addressing mode.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "mock_ssd1306.h"
+#include "OLED_Driver/OLED_driver.h"
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+uint8_t ssd1306Ram[SSD1306_RAM_PAGES][SSD1306_RAM_WIDTH];
+uint32_t ssd1306Commands;
+
+static uint8_t ramPage, ramColumn;
+static bool argumentPending;	///<The last command byte takes an argument, which may come in the next transfer
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///True for the commands the driver sends that take one argument byte
+static bool ssd1306_has_argument(uint8_t command)
+{
+	switch(command)
+	{
+		case SETCONTRAST: case SETDISPLAYCLOCKDIV: case SETMULTIPLEX: case SETDISPLAYOFFSET:
+		case CHARGEPUMP: case SETCOMPINS: case SETPRECHARGE: case SETVCOMDESELECT: case MEMORYMODE:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static void ssd1306_command(uint8_t command)
+{
+	ssd1306Commands++;
+	if(argumentPending)
+	{
+		argumentPending = false;
+	}
+	else if(command <= 0x0f)
+	{
+		ramColumn = (ramColumn & 0xf0) | command;
+	}
+	else if(command <= 0x1f)
+	{
+		ramColumn = (ramColumn & 0x0f) | (uint8_t)((command & 0x0f) << 4);
+	}
+	else if((command & 0xf8) == 0xb0)
+	{
+		ramPage = command & 0x07;
+	}
+	else
+	{
+		argumentPending = ssd1306_has_argument(command);
+	}
+}
+
+/******************************************************************************
+* Functions
+******************************************************************************/
+
+void ssd1306_reset(void)
+{
+	memset(ssd1306Ram, 0xa5, sizeof(ssd1306Ram));
+	ssd1306Commands = 0;
+	ramPage = 0;
+	ramColumn = 0;
+	argumentPending = false;
+}
+
+int32_t ssd1306_device(uint8_t address, bool read, uint8_t *data, uint16_t len)
+{
+	if(address != OLED_I2C_ADDRESS_SA0_1) return ERROR_IO;	//No ACK
+	if(read || len == 0) return ERROR_INVALID_DATA;
+
+	for(uint16_t i = 1; i < len; i++)
+	{
+		if(data[0] == I2C_COMMAND)
+		{
+			ssd1306_command(data[i]);
+		}
+		else if(data[0] == I2C_DATA)
+		{
+			ssd1306Ram[ramPage][ramColumn] = data[i];
+			ramColumn = (ramColumn + 1) % SSD1306_RAM_WIDTH;
+		}
+		else
+		{
+			return ERROR_INVALID_DATA;
+		}
+	}
+	return ERROR_NONE;
+}
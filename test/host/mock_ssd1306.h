@@ -0,0 +1,36 @@
+/**************************************************************************//**
+* @file      mock_ssd1306.h
+* @brief     Model of the SSD1306 OLED controller for the host tests of the OLED driver
+* @details   Plugs into mock_i2c as the device at the OLED address. It decodes the command stream (page and column
+			 address, in page addressing mode) and writes the data bytes into a model of the GDRAM, so a test can
+			 check what the panel shows.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "mock_i2c.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define SSD1306_RAM_PAGES		8		///<Pages of the GDRAM
+#define SSD1306_RAM_WIDTH		128		///<Columns of the GDRAM
+#define SSD1306_PANEL_COLUMN	32		///<First GDRAM column shown by the 64x48 panel
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+extern uint8_t ssd1306Ram[SSD1306_RAM_PAGES][SSD1306_RAM_WIDTH];	///<Model of the GDRAM, filled with 0xA5 by ssd1306_reset
+extern uint32_t ssd1306Commands;	///<Command bytes received, arguments included
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+void ssd1306_reset(void);
+int32_t ssd1306_device(uint8_t address, bool read, uint8_t *data, uint16_t len);
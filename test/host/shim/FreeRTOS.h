@@ -0,0 +1,40 @@
+/**************************************************************************//**
+* @file      FreeRTOS.h
+* @brief     Host stand-in for the FreeRTOS header
+* @details   Only the types and macros the modules under test use. See task.h for the critical sections.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define pdFALSE					((BaseType_t)0)
+#define pdTRUE					((BaseType_t)1)
+#define pdFAIL					pdFALSE
+#define pdPASS					pdTRUE
+#define portMAX_DELAY			((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ		1000	///<Same tick as the firmware, so ticks are milliseconds
+#define pdMS_TO_TICKS(ms)		((TickType_t)(((TickType_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define portTICK_PERIOD_MS		((TickType_t)1000 / configTICK_RATE_HZ)
+#define configASSERT(expr)		do { if(!(expr)) abort(); } while(0)
+#define configCOMMAND_INT_MAX_OUTPUT_SIZE	32	///<As in config/FreeRTOSConfig.h, for FreeRTOS_CLI.c
+#define pvPortMalloc(size)		malloc(size)
+#define vPortFree(pointer)		free(pointer)
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
@@ -0,0 +1,16 @@
+/**************************************************************************//**
+* @file      I2cDriver.h
+* @brief     Host stand-in for the name I2CDriver.c includes its header by
+* @details   I2CDriver.c includes "I2cDriver.h" from its own directory, where the file is I2CDriver.h. A case sensitive
+			 file system does not find it, so this header includes the real one.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "I2cDriver/I2CDriver.h"
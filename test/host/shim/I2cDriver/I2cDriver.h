@@ -0,0 +1,16 @@
+/**************************************************************************//**
+* @file      I2cDriver.h
+* @brief     Host stand-in for the path of the I2C driver header
+* @details   The firmware includes "I2cDriver/I2cDriver.h" and the Windows build finds I2cDriver/I2CDriver.h. A case sensitive
+			 file system does not, so this header includes the real one.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "I2cDriver/I2CDriver.h"
@@ -0,0 +1,16 @@
+/**************************************************************************//**
+* @file      OLED_driver.h
+* @brief     Host stand-in for the path of the OLED driver header
+* @details   OLEDThread.h includes "OLED_driver/OLED_driver.h", the directory is OLED_Driver/. This header includes the
+			 real one on a case sensitive file system.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "OLED_Driver/OLED_driver.h"
@@ -0,0 +1,16 @@
+/**************************************************************************//**
+* @file      fontlargeletter31x48.h
+* @brief     Host stand-in for the path of an OLED font
+* @details   OLED_driver.c includes its fonts from "OLED_driver/util/", the directory is OLED_Driver/util/. This header
+			 includes the real font on a case sensitive file system.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "OLED_Driver/util/fontlargeletter31x48.h"
@@ -0,0 +1,49 @@
+/**************************************************************************//**
+* @file      asf.h
+* @brief     Host stand-in for the ASF umbrella header
+* @details   The iot modules (sw_timer, stream_writer, http_client) include asf.h only for the integer types and
+			 Assert. This header gives them those on a host, with SAMD21 set to 0 so the TCC code of sw_timer is
+			 left out. The tests advance the sw_timer tick themselves. Like the firmware one, it also brings in the
+			 FreeRTOS task and queue API, for the threads that only get it through asf.h, crc32_t, the FatFs,
+			 SD/MMC, EXTINT and board parts the WiFi thread uses, the USART, DMA and stdio parts the Serial
+			 Console uses, and system_reset for the CLI thread.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "crc32.h"
+#include "ff.h"
+#include "sd_mmc.h"
+#include "extint.h"
+#include "usart.h"
+#include "dma.h"
+#include "stdio_serial.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define SAMD21				0	///<No TCC on the host
+#define TCC_INST_NUM		3	///<Only checked by the sw_timer_init asserts
+#define TCC_NUM_CHANNELS	4	///<Only checked by the sw_timer_init asserts
+
+#define Assert(expr)		assert(expr)
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+void system_reset(void);	///<Implemented by the tests that link the CLI thread
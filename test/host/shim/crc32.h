@@ -0,0 +1,28 @@
+/**************************************************************************//**
+* @file      crc32.h
+* @brief     Host stand-in for the ASF CRC-32 service header
+* @details   The download modules need the crc32_t type from it, and the SD writer crc32_recalculate. The tests
+			 that check a CRC32 compute it with their own reference, and implement crc32_recalculate with it.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include "status_codes.h"
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+typedef uint32_t crc32_t;	///<CRC32 as the ASF service keeps it
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+enum status_code crc32_recalculate(const void *data, size_t length, crc32_t *crc);
@@ -0,0 +1,88 @@
+/**************************************************************************//**
+* @file      dma.h
+* @brief     Host stand-in for the ASF DMA driver header
+* @details   Only the part the I2C driver and the Serial Console use. The calls are implemented by fake_i2c_bus.c and
+			 fake_uart.c, which run the transfer on their simulated bus or line. The DMAC addresses are 32 bits, as on
+			 the SAMD21.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "status_codes.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define COMPILER_ALIGNED(a)			__attribute__((__aligned__(a)))
+#define SECTION_DMAC_DESCRIPTOR
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+enum dma_callback_type {
+	DMA_CALLBACK_TRANSFER_ERROR,
+	DMA_CALLBACK_TRANSFER_DONE,
+	DMA_CALLBACK_CHANNEL_SUSPEND,
+	DMA_CALLBACK_N,
+};
+
+enum dma_beat_size { DMA_BEAT_SIZE_BYTE = 0, DMA_BEAT_SIZE_HWORD, DMA_BEAT_SIZE_WORD };
+enum dma_transfer_trigger_action { DMA_TRIGGER_ACTION_BLOCK = 0, DMA_TRIGGER_ACTION_BEAT = 2, DMA_TRIGGER_ACTION_TRANSACTION = 3 };
+
+///Transfer descriptor, in the layout of the DMAC descriptor SRAM
+typedef struct {
+	struct { uint16_t reg; } BTCTRL;
+	struct { uint16_t reg; } BTCNT;
+	struct { uint32_t reg; } SRCADDR;
+	struct { uint32_t reg; } DSTADDR;
+	struct { uint32_t reg; } DESCADDR;
+} DmacDescriptor;
+
+struct dma_resource;
+typedef void (*dma_callback_t)(struct dma_resource *const resource);
+
+struct dma_resource {
+	uint8_t channel_id;
+	dma_callback_t callback[DMA_CALLBACK_N];
+	uint8_t callback_enable;
+	volatile enum status_code job_status;
+	uint32_t transfered_size;
+	DmacDescriptor *descriptor;
+};
+
+struct dma_resource_config {
+	uint8_t peripheral_trigger;
+	enum dma_transfer_trigger_action trigger_action;
+};
+
+struct dma_descriptor_config {
+	bool descriptor_valid;
+	enum dma_beat_size beat_size;
+	bool src_increment_enable;
+	bool dst_increment_enable;
+	uint16_t block_transfer_count;
+	uint32_t source_address;
+	uint32_t destination_address;
+	uint32_t next_descriptor_address;
+};
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+void dma_get_config_defaults(struct dma_resource_config *config);
+enum status_code dma_allocate(struct dma_resource *resource, struct dma_resource_config *config);
+void dma_descriptor_get_config_defaults(struct dma_descriptor_config *config);
+void dma_descriptor_create(DmacDescriptor *descriptor, struct dma_descriptor_config *config);
+enum status_code dma_add_descriptor(struct dma_resource *resource, DmacDescriptor *descriptor);
+void dma_register_callback(struct dma_resource *resource, dma_callback_t callback, enum dma_callback_type type);
+void dma_enable_callback(struct dma_resource *resource, enum dma_callback_type type);
+enum status_code dma_start_transfer_job(struct dma_resource *resource);
+void dma_abort_job(struct dma_resource *resource);
@@ -0,0 +1,54 @@
+/**************************************************************************//**
+* @file      extint.h
+* @brief     Host stand-in for the ASF EXTINT and PORT drivers and the SAMW25 Xplained Pro board pins
+* @details   Only the part the WiFi thread uses for the button and the LED. The calls are implemented by the tests.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "status_codes.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define LED_0_PIN			23		///<PIN_PA23
+#define LED_0_ACTIVE		false
+#define LED_0_INACTIVE		!LED_0_ACTIVE
+#define BUTTON_0_EIC_PIN	55		///<PIN_PB23A_EIC_EXTINT7
+#define BUTTON_0_EIC_MUX	0
+#define BUTTON_0_EIC_LINE	7
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+enum extint_pull { EXTINT_PULL_UP = 0, EXTINT_PULL_DOWN, EXTINT_PULL_NONE };
+enum extint_detect { EXTINT_DETECT_NONE = 0, EXTINT_DETECT_RISING, EXTINT_DETECT_FALLING, EXTINT_DETECT_BOTH };
+enum extint_callback_type { EXTINT_CALLBACK_TYPE_DETECT = 0 };
+
+struct extint_chan_conf {
+	uint32_t gpio_pin;
+	uint32_t gpio_pin_mux;
+	enum extint_pull gpio_pin_pull;
+	bool wake_if_sleeping;
+	bool filter_input_signal;
+	enum extint_detect detection_criteria;
+};
+
+typedef void (*extint_callback_t)(void);
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+void extint_chan_get_config_defaults(struct extint_chan_conf *const config);
+void extint_chan_set_config(const uint8_t channel, const struct extint_chan_conf *const config);
+enum status_code extint_register_callback(const extint_callback_t callback, const uint8_t channel, const enum extint_callback_type type);
+enum status_code extint_chan_enable_callback(const uint8_t channel, const enum extint_callback_type type);
+void port_pin_set_output_level(const uint8_t gpio_pin, const bool level);
@@ -0,0 +1,89 @@
+/**************************************************************************//**
+* @file      ff.h
+* @brief     Host stand-in for the FatFs R0.09 header
+* @details   Only the part the download modules use, with the result codes and mode flags of FatFs. The calls are
+			 implemented by the tests, on whatever model of the card each test needs. FIL keeps the file pointer
+			 and size, which f_size and f_tell read as in FatFs. A test that links FatFs itself defines HOST_FATFS
+			 and gets its header instead.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+#ifdef HOST_FATFS
+#include "fatfs-r0.09/src/ff.h"
+#else
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdint.h>
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define FA_READ				0x01
+#define FA_OPEN_EXISTING	0x00
+#define FA_WRITE			0x02
+#define FA_CREATE_NEW		0x04
+#define FA_CREATE_ALWAYS	0x08
+#define FA_OPEN_ALWAYS		0x10
+
+#define f_tell(fp)			((fp)->fptr)
+#define f_size(fp)			((fp)->fsize)
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+typedef unsigned int UINT;
+typedef unsigned char BYTE;
+typedef uint32_t DWORD;		///<32 bits, as on the SAMD21
+
+typedef enum {
+	FR_OK = 0,
+	FR_DISK_ERR,
+	FR_INT_ERR,
+	FR_NOT_READY,
+	FR_NO_FILE,
+	FR_NO_PATH,
+	FR_INVALID_NAME,
+	FR_DENIED,
+	FR_EXIST,
+	FR_INVALID_OBJECT,
+	FR_WRITE_PROTECTED,
+	FR_INVALID_DRIVE,
+	FR_NOT_ENABLED,
+	FR_NO_FILESYSTEM,
+	FR_MKFS_ABORTED,
+	FR_TIMEOUT,
+	FR_LOCKED,
+	FR_NOT_ENOUGH_CORE,
+	FR_TOO_MANY_OPEN_FILES,
+	FR_INVALID_PARAMETER
+} FRESULT;
+
+typedef struct {
+	BYTE fs_type;
+} FATFS;
+
+typedef struct {
+	DWORD fptr;			///<Read/write pointer
+	DWORD fsize;		///<File size
+	int handle;			///<File of the card model, for the test
+} FIL;
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+FRESULT f_mount(BYTE vol, FATFS *fs);
+FRESULT f_open(FIL *fp, const char *path, BYTE mode);
+FRESULT f_close(FIL *fp);
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br);
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw);
+FRESULT f_sync(FIL *fp);
+FRESULT f_truncate(FIL *fp);
+FRESULT f_unlink(const char *path);
+
+#endif
@@ -0,0 +1,10 @@
+/**************************************************************************//**
+* @file      gfx_mono.h
+* @brief     Host stand-in for the ASF monochrome graphics header
+* @details   UiHandlerThread.c includes it but draws through the OLED driver, so nothing is needed from it.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
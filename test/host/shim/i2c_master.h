@@ -0,0 +1,141 @@
+/**************************************************************************//**
+* @file      i2c_master.h
+* @brief     Host stand-in for the ASF I2C master header
+* @details   The SERCOM registers, driver module and calls the I2C driver uses, with the ASF names and bit positions.
+			 The calls are implemented by fake_i2c_bus.c, which runs them on a simulated bus. The device driver tests
+			 link mock_i2c.c instead and only pass the module around by pointer.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <asf.h>
+#include "status_codes.h"
+#include "dma.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define SERCOM_I2CM_CTRLA_ENABLE			(0x1ul << 1)
+#define SERCOM_I2CM_CTRLA_SPEED_Msk			(0x3ul << 24)
+#define SERCOM_I2CM_CTRLA_SPEED(value)		(SERCOM_I2CM_CTRLA_SPEED_Msk & ((value) << 24))
+#define SERCOM_I2CM_CTRLB_ACKACT			(0x1ul << 18)
+#define SERCOM_I2CM_CTRLB_CMD(value)		((0x3ul << 16) & ((value) << 16))
+#define SERCOM_I2CM_BAUD_BAUD(value)		(0xFFul & (value))
+#define SERCOM_I2CM_INTENCLR_MB				(0x1ul << 0)
+#define SERCOM_I2CM_INTENCLR_SB				(0x1ul << 1)
+#define SERCOM_I2CM_INTENSET_MB				(0x1ul << 0)
+#define SERCOM_I2CM_INTENSET_SB				(0x1ul << 1)
+#define SERCOM_I2CM_INTFLAG_MB				(0x1ul << 0)
+#define SERCOM_I2CM_INTFLAG_SB				(0x1ul << 1)
+#define SERCOM_I2CM_STATUS_RXNACK			(0x1ul << 2)
+#define SERCOM_I2CM_STATUS_BUSSTATE_Msk		(0x3ul << 4)
+#define SERCOM_I2CM_STATUS_BUSSTATE(value)	(SERCOM_I2CM_STATUS_BUSSTATE_Msk & ((value) << 4))
+#define SERCOM_I2CM_ADDR_ADDR(value)		(0x7FFul & (value))
+#define SERCOM_I2CM_ADDR_LENEN				(0x1ul << 13)
+#define SERCOM_I2CM_ADDR_LEN(value)			((0xFFul << 16) & ((value) << 16))
+
+#define SERCOM0						(&fakeSercom0)	///<The simulated SERCOM of the sensor bus
+#define SERCOM0_GCLK_ID_CORE		20
+#define SERCOM0_DMAC_ID_TX			2
+#define PINMUX_PA08C_SERCOM0_PAD0	0x00080002ul
+#define PINMUX_PA09C_SERCOM0_PAD1	0x00090002ul
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///I2C master registers. Writes to INTENSET and INTENCLR are picked up by the fake bus, as the hardware would.
+typedef struct {
+	struct { uint32_t reg; } CTRLA;
+	struct { uint32_t reg; } CTRLB;
+	struct { uint32_t reg; } BAUD;
+	struct { uint8_t reg; } INTENCLR;
+	struct { uint8_t reg; } INTENSET;
+	struct { uint8_t reg; } INTFLAG;
+	struct { uint16_t reg; } STATUS;
+	struct { uint32_t reg; } SYNCBUSY;
+	struct { uint32_t reg; } ADDR;
+	struct { uint8_t reg; } DATA;
+} SercomI2cm;
+
+typedef union {
+	SercomI2cm I2CM;
+} Sercom;
+
+enum i2c_transfer_direction {
+	I2C_TRANSFER_WRITE = 0,
+	I2C_TRANSFER_READ = 1,
+};
+
+enum i2c_master_callback {
+	I2C_MASTER_CALLBACK_WRITE_COMPLETE = 0,
+	I2C_MASTER_CALLBACK_READ_COMPLETE,
+	I2C_MASTER_CALLBACK_ERROR,
+	_I2C_MASTER_CALLBACK_N,
+};
+
+struct i2c_master_module;
+typedef void (*i2c_master_callback_t)(struct i2c_master_module *const module);
+
+struct i2c_master_module {
+	Sercom *hw;
+	volatile bool locked;
+	uint16_t unknown_bus_state_timeout;
+	uint16_t buffer_timeout;
+	bool send_stop;
+	bool send_nack;
+	volatile i2c_master_callback_t callbacks[_I2C_MASTER_CALLBACK_N];
+	volatile uint8_t registered_callback;
+	volatile uint8_t enabled_callback;
+	volatile uint16_t buffer_length;
+	volatile uint16_t buffer_remaining;
+	volatile uint8_t *buffer;
+	volatile enum i2c_transfer_direction transfer_direction;
+	volatile enum status_code status;
+};
+
+struct i2c_master_packet {
+	uint16_t address;
+	uint16_t data_length;
+	uint8_t *data;
+	bool ten_bit_address;
+	bool high_speed;
+	uint8_t hs_master_code;
+};
+
+struct i2c_master_config {
+	uint32_t baud_rate;
+	uint32_t pinmux_pad0;
+	uint32_t pinmux_pad1;
+	uint16_t buffer_timeout;
+	uint16_t unknown_bus_state_timeout;
+	uint16_t sda_scl_rise_time_ns;
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+extern Sercom fakeSercom0;
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+void i2c_master_get_config_defaults(struct i2c_master_config *const config);
+enum status_code i2c_master_init(struct i2c_master_module *const module, Sercom *const hw, const struct i2c_master_config *const config);
+void i2c_master_reset(struct i2c_master_module *const module);
+void i2c_master_enable(const struct i2c_master_module *const module);
+void i2c_master_register_callback(struct i2c_master_module *const module, i2c_master_callback_t callback, enum i2c_master_callback callback_type);
+void i2c_master_enable_callback(struct i2c_master_module *const module, enum i2c_master_callback callback_type);
+enum status_code i2c_master_write_packet_wait(struct i2c_master_module *const module, struct i2c_master_packet *const packet);
+enum status_code i2c_master_write_packet_job(struct i2c_master_module *const module, struct i2c_master_packet *const packet);
+enum status_code i2c_master_write_packet_job_no_stop(struct i2c_master_module *const module, struct i2c_master_packet *const packet);
+enum status_code i2c_master_read_packet_job(struct i2c_master_module *const module, struct i2c_master_packet *const packet);
+void i2c_master_cancel_job(struct i2c_master_module *const module);
+void i2c_master_send_stop(struct i2c_master_module *const module);
+void i2c_master_dma_set_transfer(struct i2c_master_module *const module, uint16_t addr, uint8_t length, enum i2c_transfer_direction direction);
+uint32_t system_gclk_chan_get_hz(const uint8_t channel);
@@ -0,0 +1,15 @@
+/**************************************************************************//**
+* @file      i2c_master_interrupt.h
+* @brief     Host stand-in for the ASF I2C master interrupt header
+* @details   Everything the I2C driver header needs is in i2c_master.h.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "i2c_master.h"
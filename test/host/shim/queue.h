@@ -0,0 +1,34 @@
+/**************************************************************************//**
+* @file      queue.h
+* @brief     Host stand-in for the FreeRTOS queue header
+* @details   The queue calls the threads use. They are implemented by the fake a test links (see fake_rtos.c).
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "FreeRTOS.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define errQUEUE_EMPTY		((BaseType_t)0)
+#define errQUEUE_FULL		((BaseType_t)0)
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+typedef struct fake_queue *QueueHandle_t;
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize);
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait);
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue);
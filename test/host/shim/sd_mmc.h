@@ -0,0 +1,37 @@
+/**************************************************************************//**
+* @file      sd_mmc.h
+* @brief     Host stand-in for the ASF SD/MMC stack and memory control access headers
+* @details   Only the part the WiFi thread uses to bring up the card. The calls are implemented by the tests.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdint.h>
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define LUN_ID_SD_MMC_0_MEM		0	///<Drive number of the card, as in conf_access.h
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+typedef enum
+{
+	CTRL_GOOD		= 0,
+	CTRL_FAIL		= 1,
+	CTRL_NO_PRESENT	= 2,
+	CTRL_BUSY		= 3
+} Ctrl_status;
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+void sd_mmc_init(void);
+Ctrl_status sd_mmc_test_unit_ready(uint8_t slot);
@@ -0,0 +1,20 @@
+/**************************************************************************//**
+* @file      semphr.h
+* @brief     Host stand-in for the FreeRTOS semaphore header
+* @details   Only the handle type, for the headers that declare semaphores.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "FreeRTOS.h"
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+typedef void *SemaphoreHandle_t;
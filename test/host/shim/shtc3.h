@@ -0,0 +1,11 @@
+/**************************************************************************//**
+* @file      shtc3.h
+* @brief     Host stand-in for the SHTC3 header
+* @details   The control thread includes "shtc3.h" but uses nothing from it. The real header defines
+			 SHT3_LOW_ADDRESS twice with two values, which the host build stops on, so this one is empty.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
@@ -0,0 +1,15 @@
+/**************************************************************************//**
+* @file      status_codes.h
+* @brief     Host stand-in for the ASF status codes header
+* @details   The ASF header is plain C, so this one includes it.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "ASF/sam0/utils/status_codes.h"
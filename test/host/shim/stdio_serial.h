@@ -0,0 +1,15 @@
+/**************************************************************************//**
+* @file      stdio_serial.h
+* @brief     Host stand-in for the ASF stdio over UART service
+* @details   The threads include it but only print through SerialConsole, which the tests stub.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdio.h>
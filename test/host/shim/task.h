@@ -0,0 +1,77 @@
+/**************************************************************************//**
+* @file      task.h
+* @brief     Host stand-in for the FreeRTOS task header
+* @details   The tests run the modules on one thread, so a critical section only counts its nesting. A test
+			 defines host_critical_nesting and checks that it is back to 0 after every call. A test that runs a
+			 module on several threads builds with HOST_CRITICAL_MUTEX instead, and holds a mutex of its own from
+			 host_critical_enter to host_critical_exit, as masking interrupts keeps out every other task on the
+			 SAMD21. The task calls are
+			 declared here and implemented by the test, or by the fake it links, in the way that test needs.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "FreeRTOS.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+extern int host_critical_nesting;	///<Depth of the critical sections entered. Defined by the test.
+
+#ifdef HOST_CRITICAL_MUTEX
+void host_critical_enter(void);
+void host_critical_exit(void);
+#define taskENTER_CRITICAL()	host_critical_enter()
+#define taskEXIT_CRITICAL()		host_critical_exit()
+#else
+#define taskENTER_CRITICAL()	(host_critical_nesting++)
+#define taskEXIT_CRITICAL()		(host_critical_nesting--)
+#endif
+#define taskENTER_CRITICAL_FROM_ISR()		(host_critical_nesting++, (UBaseType_t)0)
+#define taskEXIT_CRITICAL_FROM_ISR(status)	((void)(status), host_critical_nesting--)
+#define portYIELD_FROM_ISR(woken)			((void)(woken))
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+typedef void *TaskHandle_t;
+
+///What xTaskNotify does to the notification value
+typedef enum
+{
+	eNoAction = 0,
+	eSetBits,
+	eIncrement,
+	eSetValueWithOverwrite,
+	eSetValueWithoutOverwrite
+} eNotifyAction;
+
+///Time out state of vTaskSetTimeOutState and xTaskCheckForTimeOut
+typedef struct
+{
+	TickType_t xTimeOnEntering;
+} TimeOut_t;
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(const TickType_t xTicksToDelay);
+void vTaskSuspend(TaskHandle_t xTaskToSuspend);
+void vTaskSuspendAll(void);
+BaseType_t xTaskResumeAll(void);
+void vTaskSetTimeOutState(TimeOut_t *const pxTimeOut);
+BaseType_t xTaskCheckForTimeOut(TimeOut_t *const pxTimeOut, TickType_t *const pxTicksToWait);
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify);
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken);
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+BaseType_t xTaskNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction);
+BaseType_t xTaskNotifyWait(uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClearOnExit, uint32_t *pulNotificationValue,
+	TickType_t xTicksToWait);
@@ -0,0 +1,80 @@
+/**************************************************************************//**
+* @file      usart.h
+* @brief     Host stand-in for the ASF SERCOM USART driver and its interrupt job API
+* @details   Only the part the Serial Console uses, with the EDBG virtual COM port of the SAMW25 Xplained Pro on
+			 SERCOM4. The SERCOM is a struct with the USART DATA register only, so its address can be given to the
+			 DMAC. The calls are implemented by fake_uart.c.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+#pragma once
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "status_codes.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define EDBG_CDC_MODULE					(&fakeSercom4)
+#define EDBG_CDC_SERCOM_MUX_SETTING		0
+#define EDBG_CDC_SERCOM_PINMUX_PAD0		0
+#define EDBG_CDC_SERCOM_PINMUX_PAD1		0
+#define EDBG_CDC_SERCOM_PINMUX_PAD2		0
+#define EDBG_CDC_SERCOM_PINMUX_PAD3		0
+#define SERCOM4_DMAC_ID_TX				10		///<DMAC trigger of the SERCOM4 data register empty flag
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///SERCOM in USART mode. Not named Sercom, so a test can have the I2C one as well.
+struct host_usart_sercom {
+	struct {
+		struct { uint16_t reg; } DATA;
+	} USART;
+};
+
+extern struct host_usart_sercom fakeSercom4;	///<Defined by fake_uart.c
+
+enum usart_callback {
+	USART_CALLBACK_BUFFER_TRANSMITTED = 0,
+	USART_CALLBACK_BUFFER_RECEIVED,
+	USART_CALLBACK_N
+};
+
+struct usart_config {
+	uint32_t baudrate;
+	uint32_t mux_setting;
+	uint32_t pinmux_pad0;
+	uint32_t pinmux_pad1;
+	uint32_t pinmux_pad2;
+	uint32_t pinmux_pad3;
+};
+
+struct usart_module;
+typedef void (*usart_callback_t)(struct usart_module *const module);
+
+struct usart_module {
+	struct host_usart_sercom *hw;
+	usart_callback_t callback[USART_CALLBACK_N];
+	uint8_t callback_enable_mask;
+};
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+void usart_get_config_defaults(struct usart_config *const config);
+enum status_code usart_init(struct usart_module *const module, struct host_usart_sercom *const hw,
+	const struct usart_config *const config);
+void usart_enable(const struct usart_module *const module);
+void usart_disable(const struct usart_module *const module);
+void usart_register_callback(struct usart_module *const module, usart_callback_t callback_func,
+	enum usart_callback callback_type);
+void usart_enable_callback(struct usart_module *const module, enum usart_callback callback_type);
+enum status_code usart_write_buffer_job(struct usart_module *const module, uint8_t *tx_data, uint16_t length);
+enum status_code usart_read_buffer_job(struct usart_module *const module, uint8_t *rx_data, uint16_t length);
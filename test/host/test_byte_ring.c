@@ -0,0 +1,240 @@
+/**************************************************************************//**
+* @file      test_byte_ring.c
+* @brief     Host test of the single-producer/single-consumer byte ring of the Serial Console
+* @details   Checks the edge cases of every call on one thread (full, empty, overflow count, wrap of the
+			 storage and of the free-running counters), then runs a producer thread against a consumer
+			 thread that uses all three ways of reading, and checks that every byte comes out once, in order.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "host_test.h"
+#include "SerialConsole/byte_ring.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define STRESS_BYTES	2000000		///<Bytes sent from the producer thread to the consumer thread
+#define STRESS_SIZE		64			///<Storage of the stress ring, small so it is full and empty often
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+static struct byte_ring stressRing;
+static uint8_t stressStorage[STRESS_SIZE];
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+static void test_init(void)
+{
+	struct byte_ring ring;
+	uint8_t storage[16];
+
+	CHECK(!byte_ring_init(NULL, storage, sizeof(storage)));
+	CHECK(!byte_ring_init(&ring, NULL, sizeof(storage)));
+	CHECK(!byte_ring_init(&ring, storage, 0));
+	CHECK(!byte_ring_init(&ring, storage, 12));
+	CHECK(byte_ring_init(&ring, storage, 1));
+	CHECK(byte_ring_init(&ring, storage, sizeof(storage)));
+
+	CHECK_EQ(byte_ring_capacity(&ring), 16);
+	CHECK_EQ(byte_ring_count(&ring), 0);
+	CHECK_EQ(byte_ring_space(&ring), 16);
+	CHECK(byte_ring_empty(&ring));
+	CHECK(!byte_ring_full(&ring));
+	CHECK_EQ(byte_ring_overflow(&ring), 0);
+}
+
+static void test_single_bytes(void)
+{
+	struct byte_ring ring;
+	uint8_t storage[8];
+	uint8_t data = 0;
+
+	byte_ring_init(&ring, storage, sizeof(storage));
+	CHECK_EQ(byte_ring_get(&ring, &data), -1);
+
+	for(int i = 0; i < 8; i++)
+	{
+		CHECK_EQ(byte_ring_put(&ring, (uint8_t)i), 0);
+	}
+	CHECK(byte_ring_full(&ring));
+	CHECK_EQ(byte_ring_put(&ring, 99), -1);
+	CHECK_EQ(byte_ring_put(&ring, 99), -1);
+	CHECK_EQ(byte_ring_overflow(&ring), 2);
+
+	//Go around the storage several times, one byte at a time
+	for(int i = 0; i < 100; i++)
+	{
+		CHECK_EQ(byte_ring_get(&ring, &data), 0);
+		CHECK_EQ(data, (uint8_t)i);
+		CHECK_EQ(byte_ring_put(&ring, (uint8_t)(i + 8)), 0);
+		CHECK_EQ(byte_ring_count(&ring), 8);
+	}
+
+	byte_ring_reset(&ring);
+	CHECK(byte_ring_empty(&ring));
+	CHECK_EQ(byte_ring_overflow(&ring), 0);
+}
+
+static void test_blocks(void)
+{
+	struct byte_ring ring;
+	uint8_t storage[16];
+	uint8_t in[32], out[32];
+	uint8_t *piece;
+
+	for(int i = 0; i < 32; i++) in[i] = (uint8_t)(i + 1);
+	byte_ring_init(&ring, storage, sizeof(storage));
+
+	//Partial put: what does not fit is dropped and counted
+	CHECK_EQ(byte_ring_put_n(&ring, in, 20), 16);
+	CHECK_EQ(byte_ring_overflow(&ring), 4);
+	CHECK_EQ(byte_ring_put_n(&ring, in, 1), 0);
+	CHECK_EQ(byte_ring_overflow(&ring), 5);
+	CHECK_EQ(byte_ring_put_n(&ring, in, 0), 0);
+
+	CHECK_EQ(byte_ring_get_n(&ring, out, 10), 10);
+	CHECK(memcmp(out, in, 10) == 0);
+
+	//This put wraps around the end of the storage
+	CHECK_EQ(byte_ring_put_n(&ring, in + 16, 10), 10);
+	CHECK(byte_ring_full(&ring));
+
+	//Peek stops at the end of the storage, the rest comes on the next peek
+	CHECK_EQ(byte_ring_peek_contiguous(&ring, &piece), 6);
+	CHECK(memcmp(piece, in + 10, 6) == 0);
+	byte_ring_skip(&ring, 6);
+	CHECK_EQ(byte_ring_peek_contiguous(&ring, &piece), 10);
+	CHECK(piece == storage);
+	CHECK(memcmp(piece, in + 16, 10) == 0);
+	byte_ring_skip(&ring, 4);
+
+	//Get more than there is: only what there is comes out, across the wrap if needed
+	CHECK_EQ(byte_ring_get_n(&ring, out, 32), 6);
+	CHECK(memcmp(out, in + 20, 6) == 0);
+	CHECK(byte_ring_empty(&ring));
+	CHECK_EQ(byte_ring_get_n(&ring, out, 32), 0);
+	CHECK_EQ(byte_ring_peek_contiguous(&ring, &piece), 0);
+}
+
+static void test_counter_wrap(void)
+{
+	struct byte_ring ring;
+	uint8_t storage[16];
+	uint8_t in[16], out[16];
+
+	for(int i = 0; i < 16; i++) in[i] = (uint8_t)(0xA0 + i);
+	byte_ring_init(&ring, storage, sizeof(storage));
+
+	//The counters are free running: start them just before they wrap around 2^32
+	ring.head = ring.tail = 0xFFFFFFF8u;
+	for(int round = 0; round < 4; round++)
+	{
+		CHECK_EQ(byte_ring_put_n(&ring, in, 16), 16);
+		CHECK(byte_ring_full(&ring));
+		CHECK_EQ(byte_ring_count(&ring), 16);
+		CHECK_EQ(byte_ring_put(&ring, 0), -1);
+		CHECK_EQ(byte_ring_get_n(&ring, out, 16), 16);
+		CHECK(memcmp(out, in, 16) == 0);
+		CHECK(byte_ring_empty(&ring));
+	}
+	CHECK(ring.head < 0xFFFFFFF8u);	//Really wrapped
+	CHECK_EQ(byte_ring_overflow(&ring), 4);
+}
+
+///Producer of the stress test: blocks of 1 to 13 bytes of a running counter, never more than fits
+static void *stress_producer(void *arg)
+{
+	uint8_t block[13];
+	uint32_t sent = 0;
+
+	while(sent < STRESS_BYTES)
+	{
+		uint32_t len = test_rand() % sizeof(block) + 1;
+		if(len > STRESS_BYTES - sent) len = STRESS_BYTES - sent;
+		if(len > byte_ring_space(&stressRing)) len = byte_ring_space(&stressRing);
+		for(uint32_t i = 0; i < len; i++) block[i] = (uint8_t)(sent + i);
+
+		uint32_t put = 0;
+		if(len == 1)
+		{
+			put = (byte_ring_put(&stressRing, block[0]) == 0) ? 1 : 0;
+		}
+		else if(len > 1)
+		{
+			put = byte_ring_put_n(&stressRing, block, len);
+		}
+		if(put == 0)
+		{
+			sched_yield();	//Ring full: let the consumer run, there may be only one CPU
+			continue;
+		}
+		CHECK_EQ(put, len);
+		sent += put;
+	}
+	return NULL;
+}
+
+///Consumer of the stress test, on the main thread: takes turns at get_n, peek and skip, and get
+static void test_stress(void)
+{
+	pthread_t producer;
+	uint8_t block[17];
+	uint8_t *piece;
+	uint32_t received = 0;
+
+	byte_ring_init(&stressRing, stressStorage, sizeof(stressStorage));
+	stressRing.head = stressRing.tail = 0xFFFFFF00u;	//The counters wrap during the run too
+	CHECK_EQ(pthread_create(&producer, NULL, stress_producer, NULL), 0);
+
+	while(received < STRESS_BYTES)
+	{
+		uint32_t len;
+		switch(received % 3)
+		{
+			case 0:
+				len = byte_ring_get_n(&stressRing, block, sizeof(block));
+				for(uint32_t i = 0; i < len; i++) CHECK_EQ(block[i], (uint8_t)(received + i));
+				break;
+			case 1:
+				len = byte_ring_peek_contiguous(&stressRing, &piece);
+				for(uint32_t i = 0; i < len; i++) CHECK_EQ(piece[i], (uint8_t)(received + i));
+				byte_ring_skip(&stressRing, len);
+				break;
+			default:
+				len = (byte_ring_get(&stressRing, block) == 0) ? 1 : 0;
+				if(len) CHECK_EQ(block[0], (uint8_t)received);
+				break;
+		}
+		if(len == 0) sched_yield();
+		received += len;
+	}
+
+	CHECK_EQ(pthread_join(producer, NULL), 0);
+	CHECK(byte_ring_empty(&stressRing));
+	CHECK_EQ(byte_ring_overflow(&stressRing), 0);	//The producer only put what fit
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	test_init();
+	test_single_bytes();
+	test_blocks();
+	test_counter_wrap();
+	test_stress();
+	printf("byte ring: OK\n");
+	return 0;
+}
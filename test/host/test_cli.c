@@ -0,0 +1,311 @@
+/**************************************************************************//**
+* @file      test_cli.c
+* @brief     Host test of the CLI thread replaying a scripted session through the console UART
+* @details   Runs vCommandConsoleTask on fake_rtos.c, with the Serial Console on fake_uart.c. Each character goes
+			 through the RX interrupt, then the CLI thread runs at once, as it has the highest priority. The session
+			 is typed at human speed and pasted at line speed, and the line must carry the echo and the reply of
+			 every command. Measures the round trip from the Enter key to the last byte of the reply, and the wakeups
+			 of the thread: one per character, one for a burst received while it could not run, none while idle.
+			 Line editing, a notification that is not from the UART and a line longer than the input buffer must
+			 not upset the session.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#define _GNU_SOURCE		///<For memmem
+#include <string.h>
+#include "host_test.h"
+#include "fake_rtos.h"
+#include "fake_uart.h"
+#include "FreeRTOS_Threads/CliThread/CliThread.h"
+#include "FreeRTOS_Threads/WifiHandlerThread/WifiHandler.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define NS_PER_TICK		(1000000000ull / configTICK_RATE_HZ)
+#define TYPED_NS		(120 * 1000000ull)	///<From one key to the next when typed
+#define PASTED_NS		FAKE_UART_BYTE_NS	///<From one character to the next when pasted
+#define IDLE_TICKS		10000
+#define WELCOME			"FreeRTOS CLI.\r\nType Help to view a list of registered commands.\r\n"
+#define NOT_RECOGNISED	"Command not recognised.  Enter 'help' to view a l"	///<Cut to the CLI output buffer
+#define INCORRECT		"Incorrect command parameter(s).  Enter \"help\" to "	///<Cut to the CLI output buffer
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///Command of the session, and its reply. A NULL reply is checked by the test.
+struct cli_command
+{
+	const char *line;
+	const char *reply;
+};
+
+///Round trips of a session
+struct session_stats
+{
+	uint64_t roundTripNs;	///<Sum, from the Enter key to the end of the reply
+	uint64_t replyBytes;	///<Sum of the bytes sent for those, "\r\n" included
+	uint32_t commands;
+	uint32_t wakeups;
+	uint32_t characters;
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+int host_critical_nesting = 0;
+char cOutputBuffer[configCOMMAND_INT_MAX_OUTPUT_SIZE];	///<Output buffer of FreeRTOS_CLI.c, which the firmware provides
+
+static uint32_t wireChecked;	///<Bytes of the line already compared
+static uint32_t downloads;		///<Calls of the "fw" command
+
+static const struct cli_command session[] = {
+	{"help", NULL},
+	{"log wifi 2", "wifi: level 2\r\n"},
+	{"led 1 2 3 4", "Students to fill out!"},
+	{"cls", "\x1b[2J"},
+	{"fw", ""},
+	{"led 1", INCORRECT},
+	{"stats", NOT_RECOGNISED},
+	{"log all 0", "all: level 0\r\n"},
+};
+
+/******************************************************************************
+* Firmware stubs
+******************************************************************************/
+void WifiHandlerSetState(uint8_t state)
+{
+	CHECK_EQ(state, WIFI_DOWNLOAD_INIT);
+	downloads++;
+}
+
+void system_reset(void)
+{
+	CHECK(false);
+}
+
+uint8_t SeesawGetKeypadCount(void)
+{
+	CHECK(false);
+	return 0;
+}
+
+int32_t SeesawReadKeypad(uint8_t *buffer, uint8_t count)
+{
+	CHECK(false);
+	return -1;
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///Runs the line ns on, and the tick with it
+static void run(uint64_t ns)
+{
+	fake_uart_run(ns);
+	fake_rtos_run_until((TickType_t)(fakeUartNowNs / NS_PER_TICK));
+}
+
+///A character comes in. The CLI thread has the highest priority, so it runs as soon as the RX interrupt returns.
+static void receive(uint8_t rxChar)
+{
+	fake_uart_receive(rxChar);
+	fake_rtos_run_for(0);
+}
+
+///The line must carry text and nothing else since the last check
+static void check_printed(const char *text)
+{
+	fake_uart_drain();
+	CHECK_EQ(fakeUartWireLen - wireChecked, strlen(text));
+	CHECK(memcmp(fakeUartWire + wireChecked, text, strlen(text)) == 0);
+	wireChecked = fakeUartWireLen;
+}
+
+///Types a command, gapNs from one character to the next, and checks what comes back
+static void run_command(const struct cli_command *command, uint64_t gapNs, struct session_stats *stats)
+{
+	uint32_t wakeupsBefore = fakeRtosWakeups, len = strlen(command->line);
+
+	for(uint32_t i = 0; i < len; i++)
+	{
+		run(gapNs);
+		uint64_t rxNs = fakeUartNowNs;
+		receive(command->line[i]);
+		if(gapNs >= 2 * FAKE_UART_BYTE_NS)
+		{
+			//The line is idle, so the echo is out one character time later
+			run(FAKE_UART_BYTE_NS);
+			CHECK_EQ(fakeUartLineFreeNs, rxNs + FAKE_UART_BYTE_NS);
+			CHECK_EQ(fakeUartWire[fakeUartWireLen - 1], command->line[i]);
+		}
+	}
+	run(gapNs);
+	uint64_t enterNs = fakeUartNowNs;
+	uint32_t replyStart = fakeUartWireLen;
+	receive('\r');
+	fake_uart_drain();
+	stats->roundTripNs += fakeUartLineFreeNs - enterNs;
+	stats->replyBytes += fakeUartWireLen - replyStart;
+	stats->commands++;
+	stats->characters += len + 1;
+	stats->wakeups += fakeRtosWakeups - wakeupsBefore;
+	CHECK_EQ(fakeRtosWakeups - wakeupsBefore, len + 1);
+
+	//The echo, the line separator and the reply, in that order
+	CHECK(fakeUartWireLen - wireChecked >= len + 2);
+	CHECK(memcmp(fakeUartWire + wireChecked, command->line, len) == 0);
+	CHECK(memcmp(fakeUartWire + wireChecked + len, "\r\n", 2) == 0);
+	wireChecked += len + 2;
+	if(command->reply != NULL)
+	{
+		check_printed(command->reply);
+	}
+	else
+	{
+		//Help lists the commands, one help string at a time
+		static const char *const helps[] = {"help:", "fw:", "cls:", "reset:", "led [keynum]", "getbutton:", "log [module]"};
+		for(uint32_t i = 0; i < sizeof(helps) / sizeof(helps[0]); i++)
+		{
+			CHECK(memmem(fakeUartWire + wireChecked, fakeUartWireLen - wireChecked, helps[i], strlen(helps[i])) != NULL);
+		}
+		wireChecked = fakeUartWireLen;
+	}
+	CHECK_EQ(fakeRtosSchedulerSuspended, 0);
+	CHECK_EQ(host_critical_nesting, 0);
+}
+
+static struct session_stats run_session(uint64_t gapNs)
+{
+	struct session_stats stats = {0};
+
+	for(uint32_t i = 0; i < sizeof(session) / sizeof(session[0]); i++)
+	{
+		run_command(&session[i], gapNs, &stats);
+	}
+	CHECK_EQ(getLogModuleLevel(LOG_MODULE_WIFI), LOG_WARNING_LVL);
+	CHECK_EQ(downloads, 1);
+	downloads = 0;
+	setLogModuleLevel(LOG_MODULE_WIFI, LOG_INFO_LVL);
+	return stats;
+}
+
+static void test_idle(void)
+{
+	//Blocked on the UART, the thread never wakes without input
+	uint32_t wakeupsBefore = fakeRtosWakeups;
+	run((uint64_t)IDLE_TICKS * NS_PER_TICK);
+	CHECK_EQ(fakeRtosWakeups, wakeupsBefore);
+	check_printed("");
+}
+
+static uint32_t test_burst(void)
+{
+	//A line received while the thread could not run (another task holding the scheduler) is read in one wakeup
+	const char *line = "log ui 3\r";
+	uint32_t wakeupsBefore = fakeRtosWakeups;
+
+	for(const char *c = line; *c != '\0'; c++)
+	{
+		fake_uart_run(PASTED_NS);
+		fake_uart_receive(*c);
+	}
+	run(0);
+	CHECK_EQ(fakeRtosWakeups, wakeupsBefore + 1);
+	check_printed("log ui 3\r\nui: level 3\r\n");
+	CHECK_EQ(getLogModuleLevel(LOG_MODULE_UI), LOG_ERROR_LVL);
+	setLogModuleLevel(LOG_MODULE_UI, LOG_INFO_LVL);
+	CHECK_EQ(SerialConsoleGetRxOverflow(), 0);
+	return strlen(line);
+}
+
+static void test_foreign_notification(void)
+{
+	//Another driver notifying the thread wakes it, and it goes back to waiting for the UART
+	uint32_t wakeupsBefore = fakeRtosWakeups;
+	fake_rtos_notify();
+	fake_rtos_run_for(0);
+	CHECK_EQ(fakeRtosWakeups, wakeupsBefore + 1);
+	check_printed("");
+
+	struct session_stats stats = {0};
+	run_command(&(struct cli_command){"log cli 1", "cli: level 1\r\n"}, TYPED_NS, &stats);
+	setLogModuleLevel(LOG_MODULE_CLI, LOG_INFO_LVL);
+}
+
+static void test_line_editing(void)
+{
+	struct session_stats stats = {0};
+
+	//Backspace erases the last character on the terminal and in the input
+	const char *typed = "log wifx\b";
+	for(const char *c = typed; *c != '\0'; c++)
+	{
+		run(TYPED_NS);
+		receive(*c);
+	}
+	check_printed("log wifx\b \b");
+	run_command(&(struct cli_command){"i 1", "wifi: level 1\r\n"}, TYPED_NS, &stats);
+	CHECK_EQ(getLogModuleLevel(LOG_MODULE_WIFI), LOG_DEBUG_LVL);
+
+	//Up arrow brings back the last command
+	setLogModuleLevel(LOG_MODULE_WIFI, LOG_INFO_LVL);
+	const char *upArrow = "\x1b[A\r";
+	for(const char *c = upArrow; *c != '\0'; c++)
+	{
+		run(TYPED_NS);
+		receive(*c);
+	}
+	check_printed("\x1b[2K\r>log wifi 1\r\nwifi: level 1\r\n");
+	CHECK_EQ(getLogModuleLevel(LOG_MODULE_WIFI), LOG_DEBUG_LVL);
+	setLogModuleLevel(LOG_MODULE_WIFI, LOG_INFO_LVL);
+}
+
+static void test_long_line(void)
+{
+	//The input keeps what fits with its terminator, and the command is cut there: four parameters for "log"
+	struct session_stats stats = {0};
+	run_command(&(struct cli_command){"log wifi 4 and more", INCORRECT}, PASTED_NS, &stats);
+	CHECK_EQ(getLogModuleLevel(LOG_MODULE_WIFI), LOG_INFO_LVL);
+	run_command(&(struct cli_command){"log wifi 4", "wifi: level 4\r\n"}, TYPED_NS, &stats);
+	setLogModuleLevel(LOG_MODULE_WIFI, LOG_INFO_LVL);
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	fake_uart_reset(true);
+	InitializeSerialConsole();
+	fake_rtos_start(vCommandConsoleTask, NULL, 0);
+	CHECK_EQ(fakeRtosWakeups, 0);
+	check_printed(WELCOME);
+
+	test_idle();
+	struct session_stats typed = run_session(TYPED_NS);
+	struct session_stats pasted = run_session(PASTED_NS);
+	uint32_t burst = test_burst();
+	test_foreign_notification();
+	test_line_editing();
+	test_long_line();
+	test_idle();
+
+	//Nothing waits for the thread: the reply follows the Enter key on the line at once
+	CHECK_EQ(typed.roundTripNs, typed.replyBytes * FAKE_UART_BYTE_NS);
+	CHECK(pasted.roundTripNs <= (pasted.replyBytes + pasted.commands) * FAKE_UART_BYTE_NS);
+	CHECK_EQ(typed.wakeups, typed.characters);
+	CHECK_EQ(pasted.wakeups, pasted.characters);
+
+	printf("cli: OK (Enter to end of reply: %.2f ms typed, %.2f ms pasted, for %u bytes on average; "
+		"a wakeup per character, 1 for a burst of %u, none in %u s idle)\n",
+		typed.roundTripNs / 1e6 / typed.commands, pasted.roundTripNs / 1e6 / pasted.commands,
+		(unsigned)(typed.replyBytes / typed.commands), (unsigned)burst, (unsigned)(IDLE_TICKS / configTICK_RATE_HZ));
+	return 0;
+}
@@ -0,0 +1,224 @@
+/**************************************************************************//**
+* @file      test_control_trace.c
+* @brief     Host event-trace test of the control thread state machine
+* @details   Runs vControlHandlerTask on fake_rtos.c and plays a game through its producers: game statuses and packets
+			 from the WiFi thread, and the end of the player's move from the UI. After each event the test checks the
+			 calls the thread made (screens, moves ordered to the UI, moves posted to MQTT), the state it ended in and
+			 how many times it woke up. The thread must wake once per event and never while idle, and data that
+			 arrives before the state that wants it must wait in its queue and be used when that state is reached.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "host_test.h"
+#include "fake_rtos.h"
+#include "FreeRTOS_Threads/ControlThread/ControlThread.h"
+#include "FreeRTOS_Threads/UiHandlerThread/UiHandlerThread.h"
+#include "FreeRTOS_Threads/OLEDThread/OLEDThread.h"
+#include "SerialConsole.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define TRACE_SIZE		256
+#define IDLE_TICKS		10000
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+int host_critical_nesting = 0;
+enum eDebugLogLevels currentDebugLevel = LOG_ERROR_LVL;
+enum eDebugLogLevels moduleDebugLevel[N_LOG_MODULES];
+
+extern controlStateMachine_state controlState;
+
+static char trace[TRACE_SIZE];		///<Calls of the thread since the last event, space separated
+static bool playDone;
+static struct GameDataPacket moveOut;
+static uint8_t shownMove;			///<First move of the last packet ordered to the UI
+static uint8_t postedMove;			///<First move of the last packet posted to MQTT
+static uint32_t events;				///<Events posted to the thread
+
+static const char *const screenNames[OLED_SCREEN_MAX] = {"wait", "turns", "winner", "loser"};
+static const char *const stateNames[CONTROL_STATE_MAX_STATES] = {"WAIT_FOR_STATUS", "WAIT_FOR_GAME", "PLAYING_MOVE",
+	"END_GAME"};
+
+/******************************************************************************
+* Firmware stubs
+******************************************************************************/
+static void trace_add(const char *what)
+{
+	CHECK(strlen(trace) + strlen(what) + 2 < TRACE_SIZE);
+	if(trace[0] != '\0') strcat(trace, " ");
+	strcat(trace, what);
+}
+
+int OledPostScreen(oledScreen_t screen)
+{
+	CHECK(screen < OLED_SCREEN_MAX);
+	trace_add(screenNames[screen]);
+	return pdTRUE;
+}
+
+void UiOrderShowMoves(struct GameDataPacket *packetIn)
+{
+	trace_add("show");
+	shownMove = packetIn->game[0];
+	playDone = false;
+}
+
+bool UiPlayIsDone(void)
+{
+	return playDone;
+}
+
+struct GameDataPacket *UiGetGamePacketOut(void)
+{
+	return &moveOut;
+}
+
+int WifiAddGameDataToQueue(struct GameDataPacket *game)
+{
+	trace_add("post");
+	postedMove = game->game[0];
+	return pdTRUE;
+}
+
+void LogMessage(enum eDebugLogLevels level, const char *format, ...)
+{
+}
+
+void SerialConsoleWriteString(const char *string)
+{
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///Runs the thread for one tick after an event and checks what it did
+static void expect(const char *calls, controlStateMachine_state state, uint32_t wakeups)
+{
+	uint32_t wakeupsBefore = fakeRtosWakeups;
+
+	fake_rtos_run_for(1);
+	if(strcmp(trace, calls) != 0)
+	{
+		fprintf(stderr, "trace \"%s\", expected \"%s\"\n", trace, calls);
+		CHECK(false);
+	}
+	if(controlState != state)
+	{
+		fprintf(stderr, "state %s, expected %s\n", stateNames[controlState], stateNames[state]);
+		CHECK(false);
+	}
+	CHECK_EQ(fakeRtosWakeups - wakeupsBefore, wakeups);
+	trace[0] = '\0';
+}
+
+static void send_status(uint8_t status)
+{
+	events++;
+	CHECK_EQ(ControlAddStatusDataToQueue(&status), pdTRUE);
+}
+
+static void send_game(uint8_t firstMove)
+{
+	struct GameDataPacket packet;
+	events++;
+	memset(packet.game, 0xff, sizeof(packet.game));
+	packet.game[0] = firstMove;
+	CHECK_EQ(ControlAddGameData(&packet), pdTRUE);
+}
+
+static void play_done(uint8_t firstMove)
+{
+	events++;
+	moveOut.game[0] = firstMove;
+	playDone = true;
+	ControlNotifyPlayDone();
+}
+
+static void test_idle(void)
+{
+	//Nothing to do: the thread never wakes up
+	uint32_t wakeupsBefore = fakeRtosWakeups;
+	fake_rtos_run_for(IDLE_TICKS);
+	CHECK_EQ(fakeRtosWakeups, wakeupsBefore);
+	expect("", CONTROL_WAIT_FOR_STATUS, 0);
+}
+
+static void test_game(void)
+{
+	uint32_t gameWakeups = fakeRtosWakeups, gameEvents = events;
+
+	//The opponent plays, then it is our turn
+	send_status(P2_turn);
+	expect("wait", CONTROL_WAIT_FOR_STATUS, 1);
+	send_status(P1_turn);
+	expect("wait", CONTROL_WAIT_FOR_GAME, 1);
+	send_game(3);
+	expect("turns show", CONTROL_PLAYING_MOVE, 1);
+	CHECK_EQ(shownMove, 3);
+
+	//A status while the player moves wakes the thread, which leaves it queued for later
+	send_status(P2_turn);
+	expect("", CONTROL_PLAYING_MOVE, 1);
+
+	//The move goes out, then the queued status is used in the same wake up
+	play_done(4);
+	expect("post wait", CONTROL_WAIT_FOR_STATUS, 1);
+	CHECK_EQ(postedMove, 4);
+
+	//The packet comes before the status that lets us use it: it waits in its queue
+	send_game(5);
+	expect("", CONTROL_WAIT_FOR_STATUS, 1);
+	send_status(P1_turn);
+	expect("wait turns show", CONTROL_PLAYING_MOVE, 1);
+	CHECK_EQ(shownMove, 5);
+
+	//Several events before the thread runs: one wake up for all of them
+	play_done(6);
+	send_status(P2_turn);
+	send_status(P1_turn);
+	send_game(7);
+	expect("post wait wait turns show", CONTROL_PLAYING_MOVE, 1);
+	CHECK_EQ(postedMove, 6);
+	CHECK_EQ(shownMove, 7);
+
+	play_done(8);
+	expect("post", CONTROL_WAIT_FOR_STATUS, 1);
+	send_status(P1_Lose);
+	expect("loser", CONTROL_END_GAME, 1);
+
+	//The game is over: later events still wake it, and change nothing
+	send_status(P1_turn);
+	send_game(9);
+	expect("", CONTROL_END_GAME, 1);
+
+	printf("game: %u wake ups for %u events\n", (unsigned)(fakeRtosWakeups - gameWakeups), (unsigned)(events - gameEvents));
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	for(int i = 0; i < N_LOG_MODULES; i++) moduleDebugLevel[i] = LOG_ERROR_LVL;
+
+	fake_rtos_start(vControlHandlerTask, NULL, 0);
+	CHECK_EQ(controlState, CONTROL_WAIT_FOR_STATUS);
+	CHECK_EQ(fakeRtosWakeups, 0);
+
+	test_idle();
+	test_game();
+
+	printf("control trace: OK\n");
+	return 0;
+}
@@ -0,0 +1,239 @@
+/**************************************************************************//**
+* @file      test_download_manifest.c
+* @brief     Host test of the image manifest parser and the size and CRC32 check of the downloaded image
+* @details   Feeds DownloadManifestParse well formed, truncated and corrupted manifests, each copied into a heap
+			 block of its exact size so AddressSanitizer reports any read past its end. Then downloads random images
+			 in random packets, computing the size and CRC32 the SD writer would report, and checks that
+			 DownloadManifestMatches passes the intact images, resumed ones included, and refuses truncated,
+			 extended and corrupted ones.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "host_test.h"
+#include "FreeRTOS_Threads/WifiHandlerThread/DownloadManifest.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define IMAGE_MAX_SIZE		65536
+#define PACKET_MAX_SIZE		1460	///<Largest TCP payload the WINC1500 hands to the HTTP client
+#define IMAGE_ROUNDS		200
+#define FUZZ_RUNS			100000
+#define FUZZ_MAX_LEN		32		///<MAIN_MANIFEST_MAX_SIZE, the longest manifest the WiFi thread keeps
+#define FUZZ_CHARS			"0123456789abcdefABCDEFxX \r\n\t-"
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+int host_critical_nesting = 0;
+
+static uint8_t image[IMAGE_MAX_SIZE + 1];
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///Reference CRC32 of IEEE 802.3, carried on from crc like crc32_recalculate does
+static crc32_t reference_crc(crc32_t crc, const uint8_t *data, uint32_t length)
+{
+	crc = ~crc;
+	for(uint32_t i = 0; i < length; i++)
+	{
+		crc ^= data[i];
+		for(int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320UL : 0);
+	}
+	return ~crc;
+}
+
+///Parses the first length characters of text from a heap block of exactly that size
+static bool parse(const char *text, uint32_t length, struct DownloadManifest *manifest)
+{
+	char *copy = malloc(length ? length : 1);
+	CHECK(copy != NULL);
+	memcpy(copy, text, length);
+	bool ok = DownloadManifestParse(copy, length, manifest);
+	free(copy);
+	return ok;
+}
+
+static void expect_manifest(const char *text, uint32_t size, crc32_t crc)
+{
+	struct DownloadManifest manifest = {0};
+	if(!parse(text, (uint32_t)strlen(text), &manifest))
+	{
+		fprintf(stderr, "\"%s\" refused\n", text);
+		CHECK(false);
+	}
+	CHECK_EQ(manifest.size, size);
+	CHECK_EQ(manifest.crc, crc);
+}
+
+static void expect_refused(const char *text)
+{
+	struct DownloadManifest manifest = {.size = 1, .crc = 2};
+	if(parse(text, (uint32_t)strlen(text), &manifest))
+	{
+		fprintf(stderr, "\"%s\" accepted\n", text);
+		CHECK(false);
+	}
+	CHECK_EQ(manifest.size, 1);
+	CHECK_EQ(manifest.crc, 2);
+}
+
+static void test_well_formed(void)
+{
+	expect_manifest("1234 0123abcd", 1234, 0x0123ABCD);
+	expect_manifest("1234 0123ABCD", 1234, 0x0123ABCD);
+	expect_manifest("  1234   deadBEEF", 1234, 0xDEADBEEF);
+	expect_manifest("1 00000000\n", 1, 0);
+	expect_manifest("999999999 ffffffff\r\n", 999999999, 0xFFFFFFFF);
+	expect_manifest("0001234 0123abcd \r\n", 1234, 0x0123ABCD);
+}
+
+static void test_truncated(void)
+{
+	//Every manifest cut before the last digit of the CRC32 is refused, every one cut after it is taken
+	const char text[] = "123456 89abcdef\r\n";
+	const uint32_t complete = sizeof("123456 89abcdef") - 1;
+	struct DownloadManifest manifest;
+
+	for(uint32_t length = 0; length < sizeof(text) - 1; length++)
+	{
+		bool ok = parse(text, length, &manifest);
+		CHECK_EQ(ok, length >= complete);
+		if(ok)
+		{
+			CHECK_EQ(manifest.size, 123456);
+			CHECK_EQ(manifest.crc, 0x89ABCDEF);
+		}
+	}
+}
+
+static void test_corrupted(void)
+{
+	expect_refused("");
+	expect_refused("   ");
+	expect_refused("1234");
+	expect_refused("1234 ");
+	expect_refused("0 0123abcd");							//Empty image
+	expect_refused("1234567890 0123abcd");					//Size does not fit
+	expect_refused("1234 0123abcd0");						//CRC32 too long
+	expect_refused("1234 0123abgd");
+	expect_refused("1234 0x0123abcd");
+	expect_refused("12a4 0123abcd");
+	expect_refused("-1234 0123abcd");
+	expect_refused("1234\t0123abcd");
+	expect_refused("1234 0123abcd x");
+	expect_refused("1234 0123abcd\n5678 89abcdef");			//Two manifests run together
+	expect_refused("<html><body>404</body></html>");		//Error page served in its place
+
+	//A NUL does not end the manifest early
+	struct DownloadManifest manifest;
+	CHECK(!parse("1234 0123abcd\0garbage", sizeof("1234 0123abcd\0garbage") - 1, &manifest));
+	CHECK(!parse("1234 0123\0bcd", sizeof("1234 0123\0bcd") - 1, &manifest));
+}
+
+static void test_random_bytes(void)
+{
+	//Random text made of the characters of a manifest is never read past its end, and what is taken holds a
+	//size and a CRC32 that read back the same once printed the way the server does
+	char text[FUZZ_MAX_LEN];
+	struct DownloadManifest manifest, again;
+	uint32_t accepted = 0;
+
+	for(int run = 0; run < FUZZ_RUNS; run++)
+	{
+		uint32_t length = test_rand() % (FUZZ_MAX_LEN + 1);
+		for(uint32_t i = 0; i < length; i++) text[i] = FUZZ_CHARS[test_rand() % (sizeof(FUZZ_CHARS) - 1)];
+		if(!parse(text, length, &manifest)) continue;
+
+		char printed[FUZZ_MAX_LEN];
+		accepted++;
+		CHECK(length >= sizeof("1 01234567") - 1);
+		CHECK(manifest.size != 0);
+		snprintf(printed, sizeof(printed), "%lu %08lx", (unsigned long)manifest.size, (unsigned long)manifest.crc);
+		CHECK(parse(printed, (uint32_t)strlen(printed), &again));
+		CHECK_EQ(again.size, manifest.size);
+		CHECK_EQ(again.crc, manifest.crc);
+	}
+	printf("random text: %u of %u taken as a manifest\n", (unsigned)accepted, (unsigned)FUZZ_RUNS);
+}
+
+///Downloads the first length bytes of image in random packets, from offset, as the SD writer sees them
+static crc32_t download(uint32_t offset, uint32_t length, crc32_t crc)
+{
+	for(uint32_t pos = offset; pos < length; )
+	{
+		uint32_t packet = 1 + test_rand() % PACKET_MAX_SIZE;
+		if(packet > length - pos) packet = length - pos;
+		crc = reference_crc(crc, &image[pos], packet);
+		pos += packet;
+	}
+	return crc;
+}
+
+static void test_images(void)
+{
+	const uint8_t check[] = "123456789";
+	CHECK_EQ(reference_crc(0, check, 9), 0xCBF43926);
+
+	for(int round = 0; round < IMAGE_ROUNDS; round++)
+	{
+		uint32_t size = 1 + test_rand() % IMAGE_MAX_SIZE;
+		for(uint32_t i = 0; i <= size; i++) image[i] = (uint8_t)test_rand();
+
+		//The manifest the server would publish for this image
+		char text[32];
+		struct DownloadManifest manifest;
+		snprintf(text, sizeof(text), "%lu %08lX\n", (unsigned long)size, (unsigned long)reference_crc(0, image, size));
+		CHECK(parse(text, (uint32_t)strlen(text), &manifest));
+		CHECK_EQ(manifest.size, size);
+
+		//Intact, in one go and resumed after a drop
+		CHECK(DownloadManifestMatches(&manifest, size, download(0, size, 0)));
+		uint32_t drop = test_rand() % size;
+		CHECK(DownloadManifestMatches(&manifest, size, download(drop, size, download(0, drop, 0))));
+
+		//Cut short or one byte too long
+		CHECK(!DownloadManifestMatches(&manifest, drop, download(0, drop, 0)));
+		CHECK(!DownloadManifestMatches(&manifest, size + 1, download(0, size + 1, 0)));
+
+		//The right size, one bit flipped
+		uint32_t at = test_rand() % size;
+		uint8_t mask = (uint8_t)(1 << (test_rand() % 8));
+		image[at] ^= mask;
+		CHECK(!DownloadManifestMatches(&manifest, size, download(0, size, 0)));
+		image[at] ^= mask;
+
+		//The right size, a packet lost and the next one stored in its place
+		if(size >= 2 * PACKET_MAX_SIZE)
+		{
+			crc32_t crc = download(0, PACKET_MAX_SIZE, 0);
+			crc = reference_crc(crc, &image[2 * PACKET_MAX_SIZE], PACKET_MAX_SIZE);
+			crc = download(2 * PACKET_MAX_SIZE, size, crc);
+			CHECK(!DownloadManifestMatches(&manifest, size - PACKET_MAX_SIZE, crc));
+			CHECK(!DownloadManifestMatches(&manifest, size, crc));
+		}
+	}
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	test_well_formed();
+	test_truncated();
+	test_corrupted();
+	test_random_bytes();
+	test_images();
+
+	printf("download manifest: OK\n");
+	return 0;
+}
@@ -0,0 +1,242 @@
+/**************************************************************************//**
+* @file      test_game_codec.c
+* @brief     Host test of the game and status MQTT payload codec
+* @details   Round trips random games and statuses through the encoder and decoder, checks that short output
+			 buffers are refused without being overrun, and feeds the decoders mutated and random payloads. Every
+			 payload is copied into a heap block of its exact size, so AddressSanitizer reports any read past
+			 its end.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "host_test.h"
+#include "FreeRTOS_Threads/WifiHandlerThread/GameCodec.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define ROUND_TRIPS		20000	///<Random games encoded and decoded
+#define FUZZ_RUNS		200000	///<Mutated or random payloads given to the decoders
+#define FUZZ_MAX_LEN	(GAME_CODEC_MAX_GAME_LEN * 2)	///<Longest fuzzed payload
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///Fills a game with a random number of random moves, the rest with 0xFF like the UI does
+static void random_game(struct GameDataPacket *game)
+{
+	uint32_t moves = test_rand() % (GAME_SIZE + 1);
+	memset(game->game, 0xFF, sizeof(game->game));
+	for(uint32_t i = 0; i < moves; i++)
+	{
+		game->game[i] = (uint8_t)(test_rand() % 0xFF);	//0xFF would end the game early
+	}
+}
+
+///Decodes a copy of payload that ends exactly at len
+static bool decode_exact(const char *payload, size_t len, struct GameDataPacket *game)
+{
+	char *copy = malloc(len ? len : 1);
+	CHECK(copy != NULL);
+	memcpy(copy, payload, len);
+	bool ok = GameCodecDecodeGame(copy, len, game);
+	free(copy);
+	return ok;
+}
+
+static void test_game_round_trip(void)
+{
+	struct GameDataPacket in, out;
+	char buffer[GAME_CODEC_MAX_GAME_LEN + 1];
+
+	for(int run = 0; run < ROUND_TRIPS; run++)
+	{
+		random_game(&in);
+		size_t len = GameCodecEncodeGame(&in, buffer, sizeof(buffer));
+		CHECK(len != 0);
+		CHECK_EQ(strlen(buffer), len);
+		CHECK(len <= GAME_CODEC_MAX_GAME_LEN);
+		CHECK(decode_exact(buffer, len, &out));
+		CHECK(memcmp(in.game, out.game, GAME_SIZE) == 0);
+
+		//Every buffer too small for the payload and its NUL is refused, and nothing is written past it
+		for(size_t size = 0; size <= len; size++)
+		{
+			char *small = malloc(size ? size : 1);
+			CHECK(small != NULL);
+			CHECK_EQ(GameCodecEncodeGame(&in, small, size), 0);
+			free(small);
+		}
+	}
+
+	//Longest game: every move 3 digits. GAME_CODEC_MAX_GAME_LEN is a bound, it counts a comma after the last move too.
+	memset(in.game, 254, sizeof(in.game));
+	size_t len = GameCodecEncodeGame(&in, buffer, sizeof(buffer));
+	CHECK(len != 0 && len <= GAME_CODEC_MAX_GAME_LEN);
+}
+
+static void test_game_decode_cases(void)
+{
+	struct GameDataPacket game;
+	static const char *const good[] = {
+		"{\"game\":[]}",
+		"{\"game\":[ ]}",
+		"  {\"game\":[1,2,3]}",
+		"{\"game\":[ 0 , 255 ,\t7\r\n] }",
+		"{\"game\":[1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22]}",	//Moves past GAME_SIZE are ignored
+	};
+	static const char *const bad[] = {
+		"",
+		"{\"game\":[",
+		"{\"game\":[1,2",
+		"{\"game\":[1,]}",
+		"{\"game\":[,1]}",
+		"{\"game\":[256]}",
+		"{\"game\":[1 2]}",
+		"{\"game\":[-1]}",
+		"{\"game\":[1]",
+		"{\"gam\":[1]}",
+		"status:1",
+	};
+
+	for(size_t i = 0; i < sizeof(good) / sizeof(good[0]); i++)
+	{
+		CHECK(decode_exact(good[i], strlen(good[i]), &game));
+	}
+	for(size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+	{
+		CHECK(!decode_exact(bad[i], strlen(bad[i]), &game));
+	}
+
+	CHECK(decode_exact(good[3], strlen(good[3]), &game));
+	CHECK_EQ(game.game[0], 0);
+	CHECK_EQ(game.game[1], 255);
+	CHECK_EQ(game.game[2], 7);
+	CHECK_EQ(game.game[3], 0xFF);
+
+	CHECK(decode_exact(good[4], strlen(good[4]), &game));
+	CHECK_EQ(game.game[GAME_SIZE - 1], GAME_SIZE);
+
+	//The length is what counts, not a NUL
+	CHECK(!decode_exact("{\"game\":[1]}", 11, &game));
+}
+
+static void test_status(void)
+{
+	char buffer[GAME_CODEC_MAX_STATUS_LEN + 1];
+	uint8_t status;
+
+	for(int value = 0; value <= 0xFF; value++)
+	{
+		size_t len = GameCodecEncodeStatus((uint8_t)value, buffer, sizeof(buffer));
+		CHECK(len != 0 && len <= GAME_CODEC_MAX_STATUS_LEN);
+		CHECK_EQ(GameCodecEncodeStatus((uint8_t)value, buffer, len), 0);
+
+		char *copy = malloc(len);
+		CHECK(copy != NULL);
+		memcpy(copy, buffer, len);
+		CHECK(GameCodecDecodeStatus(copy, len, &status));
+		CHECK_EQ(status, value);
+		free(copy);
+	}
+
+	CHECK(GameCodecDecodeStatus("status: 3\r\n", 11, &status));
+	CHECK_EQ(status, 3);
+	CHECK(!GameCodecDecodeStatus("status:", 7, &status));
+	CHECK(!GameCodecDecodeStatus("status:300", 10, &status));
+	CHECK(!GameCodecDecodeStatus("stat", 4, &status));
+}
+
+///Decoding must never read past len. Whatever decodes must encode and decode back to the same game.
+static void fuzz_one(const char *payload, size_t len)
+{
+	struct GameDataPacket game, again;
+	char buffer[GAME_CODEC_MAX_GAME_LEN + 1];
+	uint8_t status;
+
+	if(decode_exact(payload, len, &game))
+	{
+		size_t encoded = GameCodecEncodeGame(&game, buffer, sizeof(buffer));
+		CHECK(encoded != 0);
+		CHECK(decode_exact(buffer, encoded, &again));
+		CHECK(memcmp(game.game, again.game, GAME_SIZE) == 0);
+	}
+
+	char *copy = malloc(len ? len : 1);
+	CHECK(copy != NULL);
+	memcpy(copy, payload, len);
+	(void)GameCodecDecodeStatus(copy, len, &status);
+	free(copy);
+}
+
+static void test_fuzz(void)
+{
+	static const char alphabet[] = "{}[]\",: \t\r\n0123456789gamestus-";
+	struct GameDataPacket game;
+	char payload[FUZZ_MAX_LEN];
+	size_t len;
+
+	for(int run = 0; run < FUZZ_RUNS; run++)
+	{
+		if(run & 1)
+		{
+			//Random text made of the characters the decoders care about
+			len = test_rand() % FUZZ_MAX_LEN;
+			for(size_t i = 0; i < len; i++)
+			{
+				payload[i] = alphabet[test_rand() % (sizeof(alphabet) - 1)];
+			}
+		}
+		else
+		{
+			//A valid payload with a few bytes changed, inserted, removed or cut off
+			random_game(&game);
+			len = GameCodecEncodeGame(&game, payload, sizeof(payload));
+			for(uint32_t edits = test_rand() % 4 + 1; edits > 0 && len > 0; edits--)
+			{
+				size_t at = test_rand() % len;
+				switch(test_rand() % 4)
+				{
+					case 0:
+						payload[at] = (char)test_rand();
+						break;
+					case 1:
+						if(len < sizeof(payload))
+						{
+							memmove(&payload[at + 1], &payload[at], len - at);
+							payload[at] = alphabet[test_rand() % (sizeof(alphabet) - 1)];
+							len++;
+						}
+						break;
+					case 2:
+						memmove(&payload[at], &payload[at + 1], len - at - 1);
+						len--;
+						break;
+					default:
+						len = at;
+						break;
+				}
+			}
+		}
+		fuzz_one(payload, len);
+	}
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	test_game_round_trip();
+	test_game_decode_cases();
+	test_status();
+	test_fuzz();
+	printf("game codec: OK\n");
+	return 0;
+}
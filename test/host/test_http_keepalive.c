@@ -0,0 +1,520 @@
+/**************************************************************************//**
+* @file      test_http_keepalive.c
+* @brief     Host test of the persistent connection of the HTTP client
+* @details   Runs http_client.c against a stand-in for the WINC1500 and an HTTP/1.1 server on a simulated
+			 clock. Every name lookup, TCP connect and TLS handshake takes the time it takes on the board, and a
+			 response comes in segments at the rate of the link. sw_timer.c is built into this file, so its tick
+			 follows that clock and the idle timeout of the client runs as it does in the firmware. Fetches the
+			 manifest, the image and a few deltas one after the other and counts the handshakes, with a server
+			 that keeps the connection and with one that closes it after each response. Then checks the idle
+			 timeout, a server that drops the idle connection first, the request that crosses such a drop, a
+			 request to another host and one made while a response is still coming in.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+//The HTTP client is the only user of the timers here
+#define CONF_SW_TIMER_H_INCLUDED
+#define CONF_SW_TIMER_COUNT		1
+
+#include <string.h>
+#include "host_test.h"
+#include "iot/sw_timer.c"
+#include "iot/http/http_client.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define SERVER_HOST			"www.seas.upenn.edu"			///<Host of the firmware files
+#define OTHER_HOST			"www.seas.upenn.edu.example"	///<Starts with SERVER_HOST, but is another peer
+#define FILE_DIR			"/~wujizh/"
+#define SERVER_IP			0x0100000A
+
+#define TICK_MS				10		///<Accuracy of the software timers
+#define DNS_MS				60		///<Name lookup
+#define TCP_MS				40		///<TCP handshake, one round trip
+#define TLS_MS				1200	///<TLS handshake of the WINC1500, with the check of the certificate chain
+#define RTT_MS				40		///<From the request to the first byte of its response
+#define BYTES_PER_MS		100		///<Rate of a response, 100 kB/s
+#define SEGMENT_SIZE		1400	///<Most the WINC hands over in one receive
+#define KEEP_ALIVE_MS		4000	///<Idle timeout of the client, MAIN_HTTP_KEEP_ALIVE_MS
+#define RECV_BUFFER_SIZE	1400	///<Receive buffer of the client, MAIN_BUFFER_MAX_SIZE
+#define FETCHES				6		///<Manifest, image and deltas
+#define NEVER				UINT32_MAX
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+static struct sw_timer_module timer;
+static struct http_client_module client;
+static char recvBuffer[RECV_BUFFER_SIZE];
+static uint32_t now;						///<Simulated time in ms
+
+static bool serverKeepsAlive = true;		///<Answers with Connection: keep-alive, else with close
+static uint32_t serverIdleMs;				///<Server drops a connection idle for that long, 0 for never
+static bool serverDropsNext;				///<Server drops the connection as the next request comes in
+static uint32_t bodyLength;					///<Body of the next response
+static uint32_t handshakes, lookups, requests, closes;
+
+static SOCKET linkSock = -1;				///<Socket of the connection, -1 if closed by the client
+static SOCKET nextSock;
+static bool linkUp;							///<Server end of the connection is open
+static char lookupHost[HOSTNAME_MAX_SIZE];
+static uint32_t lookupDue = NEVER, connectDue = NEVER, abortDue = NEVER;
+static uint32_t idleSince;					///<Last response of the connection went out then
+static char request[512];
+static size_t requestLen;
+static char header[128];
+static uint32_t headerLen, responseLen, responseFed, responseDue = NEVER;
+static uint8 *recvPtr;						///<Where the client asked recv to write
+static uint16 recvRoom;						///<How much it asked for, 0 if no receive is posted
+static sint16 sendPending;					///<Bytes of the send in flight, 0 if none
+
+static uint32_t gotBytes;					///<Body bytes of the current response seen through the callback
+static bool gotComplete;
+static int gotCode;
+static int disconnects, lastReason;
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+static uint8_t body_byte(uint32_t i)
+{
+	return (uint8_t)(i * 7 + i / 251);
+}
+
+static void serve_request(void)
+{
+	CHECK(strncmp(request, "GET " FILE_DIR, strlen("GET " FILE_DIR)) == 0);
+	CHECK(strstr(request, "\r\nConnection: Keep-Alive\r\n") != NULL);
+	requestLen = 0;
+	requests++;
+
+	//The connection is gone by the time the request gets there
+	if(serverDropsNext)
+	{
+		serverDropsNext = false;
+		linkUp = false;
+		abortDue = now + RTT_MS / 2;
+		return;
+	}
+
+	CHECK_EQ(responseFed, responseLen);		//One request at a time
+	headerLen = (uint32_t)snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Length: %u\r\nConnection: %s\r\n\r\n",
+		bodyLength, serverKeepsAlive ? "keep-alive" : "close");
+	responseLen = headerLen + bodyLength;
+	responseFed = 0;
+	responseDue = now + RTT_MS;
+}
+
+/******************************************************************************
+* WINC stubs
+******************************************************************************/
+SOCKET socket(uint16 u16Domain, uint8 u8Type, uint8 u8Flags)
+{
+	CHECK(u8Flags & SOCKET_FLAGS_SSL);
+	CHECK(linkSock < 0);	//One connection at a time
+	linkSock = nextSock;
+	nextSock = (nextSock + 1) % TCP_SOCK_MAX;
+	return linkSock;
+}
+
+sint8 gethostbyname(uint8 *pcHostName)
+{
+	lookups++;
+	strcpy(lookupHost, (char *)pcHostName);
+	lookupDue = now + DNS_MS;
+	return 0;
+}
+
+sint8 connect(SOCKET sock, struct sockaddr *pstrAddr, uint8 u8AddrLen)
+{
+	CHECK_EQ(sock, linkSock);
+	CHECK_EQ(((struct sockaddr_in *)pstrAddr)->sin_addr.s_addr, SERVER_IP);
+	handshakes++;
+	connectDue = now + TCP_MS + TLS_MS;
+	return 0;
+}
+
+sint16 recv(SOCKET sock, void *pvRecvBuf, uint16 u16BufLen, uint32 u32Timeoutmsec)
+{
+	if(sock != linkSock)
+	{
+		return SOCK_ERR_INVALID_ARG;
+	}
+	CHECK(recvRoom == 0);
+	recvPtr = pvRecvBuf;
+	recvRoom = u16BufLen;
+	return 0;
+}
+
+sint16 send(SOCKET sock, void *pvSendBuffer, uint16 u16SendLength, uint16 u16Flags)
+{
+	CHECK_EQ(sock, linkSock);
+	CHECK_EQ(sendPending, 0);
+	sendPending = (sint16)u16SendLength;
+	if(!linkUp)
+	{
+		return 0;	//Lost, the WINC only finds out from the reset of the server
+	}
+
+	CHECK(requestLen + u16SendLength < sizeof(request));
+	memcpy(request + requestLen, pvSendBuffer, u16SendLength);
+	requestLen += u16SendLength;
+	request[requestLen] = '\0';
+	if(strstr(request, "\r\n\r\n") != NULL)
+	{
+		serve_request();
+	}
+	return 0;
+}
+
+sint8 close(SOCKET sock)
+{
+	CHECK_EQ(sock, linkSock);
+	closes++;
+	linkSock = -1;
+	linkUp = false;
+	recvRoom = 0;
+	connectDue = abortDue = responseDue = NEVER;
+	requestLen = responseLen = responseFed = 0;
+	return 0;
+}
+
+uint32 nmi_inet_addr(char *pcIpAddr)
+{
+	return SERVER_IP;
+}
+
+///Completes the send in flight, like the WINC does from its event handler
+sint8 m2m_wifi_handle_events(void *arg)
+{
+	if(sendPending != 0)
+	{
+		int16_t sent = sendPending;
+		sendPending = 0;
+		http_client_socket_event_handler(linkSock, SOCKET_MSG_SEND, &sent);
+	}
+	return 0;
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+static void check_body(const char *data, uint32_t offset, uint32_t length)
+{
+	for(uint32_t i = 0; i < length; i++)
+	{
+		CHECK_EQ((uint8_t)data[i], body_byte(offset + i));
+	}
+}
+
+static void client_callback(struct http_client_module *module, int type, union http_client_data *data)
+{
+	switch(type)
+	{
+		case HTTP_CLIENT_CALLBACK_RECV_RESPONSE:
+			CHECK(!gotComplete);
+			CHECK(!data->recv_response.is_chunked);
+			CHECK_EQ(data->recv_response.content_length, bodyLength);
+			gotCode = data->recv_response.response_code;
+			if(data->recv_response.content != NULL)
+			{
+				check_body(data->recv_response.content, 0, data->recv_response.content_length);
+				gotBytes = data->recv_response.content_length;
+				gotComplete = true;
+			}
+			else if(data->recv_response.content_length == 0)
+			{
+				gotComplete = true;
+			}
+			break;
+
+		case HTTP_CLIENT_CALLBACK_RECV_CHUNKED_DATA:
+			CHECK(!gotComplete);
+			check_body(data->recv_chunked_data.data, gotBytes, data->recv_chunked_data.length);
+			gotBytes += data->recv_chunked_data.length;
+			gotComplete = data->recv_chunked_data.is_complete;
+			break;
+
+		case HTTP_CLIENT_CALLBACK_DISCONNECTED:
+			disconnects++;
+			lastReason = data->disconnected.reason;
+			break;
+
+		default:
+			break;
+	}
+}
+
+static void recv_event(sint16 size)
+{
+	tstrSocketRecvMsg msg = { .pu8Buffer = recvPtr, .s16BufferSize = size };
+	recvRoom = 0;
+	http_client_socket_event_handler(linkSock, SOCKET_MSG_RECV, &msg);
+}
+
+///Hands the client the next event that is due. Returns false if there is none.
+static bool deliver_event(void)
+{
+	if(lookupDue <= now)
+	{
+		lookupDue = NEVER;
+		http_client_socket_resolve_handler((uint8_t *)lookupHost, SERVER_IP);
+		return true;
+	}
+	if(connectDue <= now)
+	{
+		tstrSocketConnectMsg msg = { .sock = linkSock, .s8Error = 0 };
+		connectDue = NEVER;
+		linkUp = true;
+		idleSince = now;
+		http_client_socket_event_handler(linkSock, SOCKET_MSG_CONNECT, &msg);
+		return true;
+	}
+	if(abortDue <= now && recvRoom != 0)
+	{
+		abortDue = NEVER;
+		recv_event(SOCK_ERR_CONN_ABORTED);
+		return true;
+	}
+	if(linkUp && responseFed < responseLen && responseDue <= now && recvRoom != 0)
+	{
+		uint32_t len = responseLen - responseFed;
+		if(len > SEGMENT_SIZE) len = SEGMENT_SIZE;
+		if(len > recvRoom) len = recvRoom;
+		for(uint32_t i = 0; i < len; i++, responseFed++)
+		{
+			recvPtr[i] = (responseFed < headerLen) ? header[responseFed] : body_byte(responseFed - headerLen);
+		}
+		responseDue = now + len / BYTES_PER_MS;
+		idleSince = now;
+		recv_event((sint16)len);
+		return true;
+	}
+	if(linkUp && serverIdleMs != 0 && requestLen == 0 && responseFed == responseLen && now - idleSince >= serverIdleMs)
+	{
+		linkUp = false;
+		abortDue = now;
+		return true;
+	}
+	return false;
+}
+
+///Moves the clock on by ms, with the software timers, and delivers the events that come due
+static void run_for(uint32_t ms)
+{
+	uint32_t end = now + ms;
+
+	while(deliver_event());
+	while(now < end)
+	{
+		now++;
+		sw_timer_tick = now / TICK_MS;
+		sw_timer_task(&timer);
+		while(deliver_event());
+	}
+}
+
+///Asks for the file and runs until its response is in. Returns how long that took.
+static uint32_t fetch(const char *file, uint32_t length)
+{
+	char url[128];
+	uint32_t start = now;
+
+	snprintf(url, sizeof(url), "https://%s" FILE_DIR "%s", (strchr(file, ':') != NULL) ? OTHER_HOST : SERVER_HOST,
+		(strchr(file, ':') != NULL) ? strchr(file, ':') + 1 : file);
+	bodyLength = length;
+	gotBytes = 0;
+	gotComplete = false;
+	gotCode = 0;
+	CHECK_EQ(http_client_send_request(&client, url, HTTP_METHOD_GET, NULL, NULL), 0);
+	while(!gotComplete)
+	{
+		CHECK(now - start < 20000);
+		run_for(1);
+	}
+	CHECK_EQ(gotCode, 200);
+	CHECK_EQ(gotBytes, length);
+	return now - start;
+}
+
+///Fetches the manifest, the image and the deltas one after the other. Returns how long that took.
+static uint32_t fetch_all(void)
+{
+	static const char *const files[FETCHES] = { "IoT.crc", "IoT.bin", "IoT.d1", "IoT.d2", "IoT.d3", "IoT.d4" };
+	static const uint32_t lengths[FETCHES] = { 18, 48 * 1024, 2048, 1024, 4096, 0 };
+	uint32_t total = 0;
+
+	for(int i = 0; i < FETCHES; i++)
+	{
+		total += fetch(files[i], lengths[i]);
+	}
+	return total;
+}
+
+static uint32_t test_keep_alive(void)
+{
+	uint32_t before = handshakes;
+
+	//Only the first fetch pays the lookup and the handshakes, and nothing goes wrong on the way
+	uint32_t total = fetch_all();
+	CHECK_EQ(handshakes, before + 1);
+	CHECK_EQ(lookups, 1);
+	CHECK_EQ(requests, FETCHES);
+	CHECK_EQ(closes, 0);
+	CHECK_EQ(disconnects, 0);
+	CHECK(linkSock >= 0);
+	return total;
+}
+
+static void test_idle_timeout(void)
+{
+	//The idle connection is closed by the client once its timeout is over, and that is no error
+	run_for(KEEP_ALIVE_MS - 2 * TICK_MS);
+	CHECK_EQ(closes, 0);
+	CHECK_EQ(disconnects, 0);
+	run_for(4 * TICK_MS);
+	CHECK_EQ(closes, 1);
+	CHECK_EQ(disconnects, 1);
+	CHECK_EQ(lastReason, 0);
+	CHECK(linkSock < 0);
+}
+
+static uint32_t test_no_keep_alive(void)
+{
+	uint32_t before = handshakes, closesBefore = closes;
+
+	//A server that closes after each response costs a lookup and the handshakes every time
+	serverKeepsAlive = false;
+	uint32_t total = fetch_all();
+	serverKeepsAlive = true;
+	CHECK_EQ(handshakes, before + FETCHES);
+	CHECK_EQ(closes, closesBefore + FETCHES);
+	CHECK_EQ(lastReason, 0);
+	CHECK(linkSock < 0);
+	return total;
+}
+
+static void test_server_idle_close(void)
+{
+	uint32_t before = handshakes;
+
+	//The server gives up on the idle connection before the client does, after a reused request
+	serverIdleMs = KEEP_ALIVE_MS / 2;
+	fetch("IoT.crc", 18);
+	fetch("IoT.d1", 2048);
+	CHECK_EQ(handshakes, before + 1);
+	uint32_t requestsBefore = requests, disconnectsBefore = disconnects;
+	run_for(serverIdleMs + 2 * TICK_MS);
+	serverIdleMs = 0;
+
+	//The client closes its end and reports it as a normal close. Nothing is asked for again.
+	CHECK_EQ(requests, requestsBefore);
+	CHECK_EQ(disconnects, disconnectsBefore + 1);
+	CHECK_EQ(lastReason, 0);
+	CHECK(linkSock < 0);
+	run_for(KEEP_ALIVE_MS);
+	CHECK_EQ(requests, requestsBefore);
+	CHECK_EQ(handshakes, before + 1);
+}
+
+static void test_stale_request(void)
+{
+	uint32_t before = handshakes;
+
+	fetch("IoT.crc", 18);
+	CHECK_EQ(handshakes, before + 1);
+
+	//The server drops the connection just as the next request gets there. The request goes out again on a
+	//new connection, and the application only sees its response.
+	uint32_t requestsBefore = requests, disconnectsBefore = disconnects;
+	serverDropsNext = true;
+	fetch("IoT.d2", 1024);
+	CHECK_EQ(handshakes, before + 2);
+	CHECK_EQ(requests, requestsBefore + 2);
+	CHECK_EQ(disconnects, disconnectsBefore);
+	CHECK(linkSock >= 0);
+}
+
+static void test_other_host(void)
+{
+	uint32_t before = handshakes, lookupsBefore = lookups;
+
+	//A host that only starts with the one of the open connection is another peer
+	fetch("other:IoT.crc", 18);
+	CHECK_EQ(handshakes, before + 1);
+	CHECK_EQ(lookups, lookupsBefore + 1);
+	CHECK(strcmp(lookupHost, OTHER_HOST) == 0);
+	CHECK_EQ(lastReason, 0);
+
+	fetch("IoT.crc", 18);
+	CHECK_EQ(handshakes, before + 2);
+	CHECK(strcmp(lookupHost, SERVER_HOST) == 0);
+	fetch("IoT.d1", 2048);
+	CHECK_EQ(handshakes, before + 2);
+}
+
+static void test_cut_response(void)
+{
+	uint32_t before = handshakes;
+
+	//A request made while the image is still coming in cannot share its connection
+	bodyLength = 48 * 1024;
+	gotBytes = 0;
+	gotComplete = false;
+	CHECK_EQ(http_client_send_request(&client, "https://" SERVER_HOST FILE_DIR "IoT.bin", HTTP_METHOD_GET, NULL, NULL), 0);
+	run_for(RTT_MS + 100);
+	CHECK(gotBytes > 0 && !gotComplete);
+
+	fetch("IoT.crc", 18);
+	CHECK_EQ(handshakes, before + 1);
+	CHECK_EQ(lastReason, 0);
+	fetch("IoT.d1", 2048);
+	CHECK_EQ(handshakes, before + 1);
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	struct sw_timer_config timerConfig;
+	struct http_client_config config;
+
+	sw_timer_get_config_defaults(&timerConfig);
+	timerConfig.accuracy = TICK_MS;
+	sw_timer_init(&timer, &timerConfig);
+
+	//Configured as by the downloader
+	http_client_get_config_defaults(&config);
+	config.recv_buffer = recvBuffer;
+	config.recv_buffer_size = RECV_BUFFER_SIZE;
+	config.timer_inst = &timer;
+	config.port = 443;
+	config.tls = 1;
+	config.keep_alive_timeout = KEEP_ALIVE_MS;
+	CHECK_EQ(http_client_init(&client, &config), 0);
+	CHECK_EQ(http_client_register_callback(&client, client_callback), 0);
+
+	uint32_t kept = test_keep_alive();
+	test_idle_timeout();
+	uint32_t reopened = test_no_keep_alive();
+	//Each fetch after the first saves exactly its lookup and handshakes
+	CHECK_EQ(reopened - kept, (FETCHES - 1) * (DNS_MS + TCP_MS + TLS_MS));
+
+	test_server_idle_close();
+	test_stale_request();
+	test_other_host();
+	test_cut_response();
+
+	printf("http keep-alive: OK (%d fetches in %u ms on one connection, %u ms with a connection each)\n", FETCHES,
+		kept, reopened);
+	return 0;
+}
@@ -0,0 +1,327 @@
+/**************************************************************************//**
+* @file      test_http_parser.c
+* @brief     Host test of the response parser of the HTTP client and its ring receive buffer
+* @details   Drives http_client.c through stubs of the WINC socket calls: the request goes out, then a stream
+			 of back to back responses is handed to the client in pieces of various sizes, exactly where it
+			 asked recv to write. Bodies with a Content-Length that fit in the buffer, that do not fit and that
+			 are empty, and chunked bodies with extensions and trailers are all checked against what the
+			 callback received, for receive buffers from 64 to 1400 bytes. The buffer is a heap block of its
+			 exact size, so AddressSanitizer reports any access past it.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "host_test.h"
+#include "iot/http/http_client.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define TEST_SOCK			1		///<Socket number handed out by the socket stub
+#define MAX_RESPONSES		16		///<Most responses in one stream
+#define MAX_BODY			4096	///<Largest body of a response
+#define MAX_STREAM			(MAX_RESPONSES * (MAX_BODY + 512))	///<Largest stream of responses
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///One response, as sent by the server or as seen through the callback
+struct test_response
+{
+	int code;				///<Status code
+	size_t len;				///<Number of bytes in body
+	bool complete;			///<Whole body received
+	char body[MAX_BODY];	///<Body, without the chunk framing
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+static char stream[MAX_STREAM];			///<Bytes the server sends
+static size_t streamLen;
+static struct test_response expected[MAX_RESPONSES];
+static int expectedCount;
+static struct test_response got[MAX_RESPONSES];
+static int gotCount;
+static int disconnects;					///<Disconnects reported while the stream is fed
+
+static char *recvPtr;					///<Where the client asked recv to write
+static uint16 recvRoom;					///<How much it asked for, 0 once the data was delivered
+static sint16 sendPending;				///<Bytes of the send in flight, 0 if none
+
+/******************************************************************************
+* WINC stubs
+******************************************************************************/
+SOCKET socket(uint16 u16Domain, uint8 u8Type, uint8 u8Flags)
+{
+	return TEST_SOCK;
+}
+
+sint8 connect(SOCKET sock, struct sockaddr *pstrAddr, uint8 u8AddrLen)
+{
+	return 0;
+}
+
+sint16 recv(SOCKET sock, void *pvRecvBuf, uint16 u16BufLen, uint32 u32Timeoutmsec)
+{
+	recvPtr = pvRecvBuf;
+	recvRoom = u16BufLen;
+	return 0;
+}
+
+sint16 send(SOCKET sock, void *pvSendBuffer, uint16 u16SendLength, uint16 u16Flags)
+{
+	sendPending = u16SendLength;
+	return 0;
+}
+
+sint8 close(SOCKET sock)
+{
+	return 0;
+}
+
+sint8 gethostbyname(uint8 *pcHostName)
+{
+	return 0;
+}
+
+uint32 nmi_inet_addr(char *pcIpAddr)
+{
+	return 0x0100000A;
+}
+
+///Completes the send in flight, like the WINC does from its event handler
+sint8 m2m_wifi_handle_events(void *arg)
+{
+	if(sendPending != 0)
+	{
+		int16_t sent = sendPending;
+		sendPending = 0;
+		http_client_socket_event_handler(TEST_SOCK, SOCKET_MSG_SEND, &sent);
+	}
+	return 0;
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+static void client_callback(struct http_client_module *module, int type, union http_client_data *data)
+{
+	struct test_response *resp;
+
+	switch(type)
+	{
+		case HTTP_CLIENT_CALLBACK_RECV_RESPONSE:
+			CHECK(gotCount < MAX_RESPONSES);
+			CHECK(gotCount == 0 || got[gotCount - 1].complete);
+			resp = &got[gotCount++];
+			resp->code = data->recv_response.response_code;
+			resp->len = 0;
+			resp->complete = false;
+			if(data->recv_response.content != NULL)
+			{
+				//Whole body in one piece, straight from the receive buffer
+				CHECK(!data->recv_response.is_chunked);
+				CHECK(data->recv_response.content_length <= MAX_BODY);
+				memcpy(resp->body, data->recv_response.content, data->recv_response.content_length);
+				resp->len = data->recv_response.content_length;
+				resp->complete = true;
+			}
+			else if(!data->recv_response.is_chunked && data->recv_response.content_length == 0)
+			{
+				resp->complete = true;
+			}
+			break;
+
+		case HTTP_CLIENT_CALLBACK_RECV_CHUNKED_DATA:
+			CHECK(gotCount > 0);
+			resp = &got[gotCount - 1];
+			CHECK(!resp->complete);
+			CHECK(resp->len + data->recv_chunked_data.length <= MAX_BODY);
+			if(data->recv_chunked_data.length != 0)
+			{
+				memcpy(resp->body + resp->len, data->recv_chunked_data.data, data->recv_chunked_data.length);
+				resp->len += data->recv_chunked_data.length;
+			}
+			resp->complete = data->recv_chunked_data.is_complete;
+			break;
+
+		case HTTP_CLIENT_CALLBACK_DISCONNECTED:
+			disconnects++;
+			break;
+
+		default:
+			break;
+	}
+}
+
+static void stream_add(const char *text)
+{
+	size_t len = strlen(text);
+	CHECK(streamLen + len <= MAX_STREAM);
+	memcpy(stream + streamLen, text, len);
+	streamLen += len;
+}
+
+static void stream_add_bytes(const char *data, size_t len)
+{
+	CHECK(streamLen + len <= MAX_STREAM);
+	memcpy(stream + streamLen, data, len);
+	streamLen += len;
+}
+
+///Adds the expected response and returns it, with a body of len pseudo random printable bytes
+static struct test_response *expect_response(int code, size_t len)
+{
+	CHECK(expectedCount < MAX_RESPONSES);
+	CHECK(len <= MAX_BODY);
+	struct test_response *resp = &expected[expectedCount++];
+	resp->code = code;
+	resp->len = len;
+	for(size_t i = 0; i < len; i++)
+	{
+		resp->body[i] = (char)(' ' + test_rand() % 95);
+	}
+	return resp;
+}
+
+///Response with a Content-Length. lowerCase sends the header names in lower case.
+static void add_sized_response(int code, size_t len, bool lowerCase)
+{
+	char header[128];
+	struct test_response *resp = expect_response(code, len);
+
+	snprintf(header, sizeof(header), "HTTP/1.1 %d X\r\n%s: %zu\r\n%s: keep-alive\r\n\r\n", code,
+			lowerCase ? "content-length" : "Content-Length", len, lowerCase ? "connection" : "Connection");
+	stream_add(header);
+	stream_add_bytes(resp->body, len);
+}
+
+///Chunked response cut in chunks of random sizes, hex digits in both cases, some with an extension
+static void add_chunked_response(int code, size_t len, bool trailer)
+{
+	char line[64];
+	struct test_response *resp = expect_response(code, len);
+	size_t sent = 0;
+
+	snprintf(line, sizeof(line), "HTTP/1.1 %d X\r\nTransfer-Encoding: chunked\r\n\r\n", code);
+	stream_add(line);
+	while(sent < len)
+	{
+		size_t chunk = test_rand() % 1500 + 1;
+		if(chunk > len - sent) chunk = len - sent;
+		snprintf(line, sizeof(line), (test_rand() & 1) ? "%zx" : "%zX", chunk);
+		stream_add(line);
+		stream_add((test_rand() & 1) ? ";name=value\r\n" : "\r\n");
+		stream_add_bytes(resp->body + sent, chunk);
+		stream_add("\r\n");
+		sent += chunk;
+	}
+	stream_add("0\r\n");
+	if(trailer) stream_add("X-Checksum: 1a2b3c4d\r\n");
+	stream_add("\r\n");
+}
+
+///Sends the request, feeds the stream in pieces of piece bytes (0: random sizes) and checks the responses
+static void run(uint32_t bufferSize, uint32_t piece)
+{
+	struct sw_timer_module timer;
+	struct sw_timer_config timerConfig;
+	struct http_client_module client;
+	struct http_client_config config;
+	char *buffer = malloc(bufferSize);
+	size_t fed = 0;
+
+	CHECK(buffer != NULL);
+	memset(&timer, 0, sizeof(timer));	//sw_timer_init leaves the handlers alone, the firmware's instance is static
+	sw_timer_get_config_defaults(&timerConfig);
+	sw_timer_init(&timer, &timerConfig);
+
+	http_client_get_config_defaults(&config);
+	config.timer_inst = &timer;
+	config.recv_buffer = buffer;
+	config.recv_buffer_size = bufferSize;
+	config.keep_alive_timeout = 4000;
+	CHECK_EQ(http_client_init(&client, &config), 0);
+	CHECK_EQ(http_client_register_callback(&client, client_callback), 0);
+
+	gotCount = 0;
+	disconnects = 0;
+	recvRoom = 0;
+	CHECK_EQ(http_client_send_request(&client, "http://10.0.0.1/file.bin", HTTP_METHOD_GET, NULL, NULL), 0);
+	tstrSocketConnectMsg connectMsg = { .sock = TEST_SOCK, .s8Error = 0 };
+	http_client_socket_event_handler(TEST_SOCK, SOCKET_MSG_CONNECT, &connectMsg);
+
+	while(fed < streamLen)
+	{
+		CHECK(recvRoom != 0);	//The client must always be receiving while a response is incomplete
+		uint32_t len = piece ? piece : test_rand() % 1400 + 1;
+		if(len > recvRoom) len = recvRoom;
+		if(len > streamLen - fed) len = streamLen - fed;
+
+		memcpy(recvPtr, stream + fed, len);
+		fed += len;
+		recvRoom = 0;
+		tstrSocketRecvMsg recvMsg = { .pu8Buffer = (uint8 *)recvPtr, .s16BufferSize = (sint16)len };
+		http_client_socket_event_handler(TEST_SOCK, SOCKET_MSG_RECV, &recvMsg);
+	}
+
+	if(disconnects != 0 || gotCount != expectedCount)
+	{
+		fprintf(stderr, "buffer %u, piece %u: %d responses, %d disconnects\n", bufferSize, piece, gotCount, disconnects);
+	}
+	CHECK_EQ(disconnects, 0);
+	CHECK_EQ(gotCount, expectedCount);
+	for(int i = 0; i < expectedCount; i++)
+	{
+		CHECK(got[i].complete);
+		CHECK_EQ(got[i].code, expected[i].code);
+		CHECK_EQ(got[i].len, expected[i].len);
+		CHECK(memcmp(got[i].body, expected[i].body, expected[i].len) == 0);
+	}
+
+	http_client_close(&client);
+	http_client_deinit(&client);
+	free(buffer);
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	static const uint32_t bufferSizes[] = { 64, 97, 128, 256, 512, 1024, 1400 };
+	static const uint32_t pieces[] = { 1, 7, 64, 100, 1400, 0 };
+
+	//Back to back responses on one kept alive connection, in every combination of buffer and piece size
+	for(int round = 0; round < 4; round++)
+	{
+		streamLen = 0;
+		expectedCount = 0;
+		add_sized_response(200, 30, false);		//Fits in every buffer (the manifest)
+		add_sized_response(204, 0, round & 1);	//Empty body
+		add_chunked_response(200, 1026, round & 1);
+		add_sized_response(206, 2500, round & 2);	//Larger than every buffer, passed on like chunked data
+		add_chunked_response(200, 3000, false);
+		add_sized_response(404, 9, false);
+		add_chunked_response(200, 0, true);			//Only the last chunk
+		add_sized_response(200, test_rand() % MAX_BODY, round & 2);
+
+		for(size_t b = 0; b < sizeof(bufferSizes) / sizeof(bufferSizes[0]); b++)
+		{
+			for(size_t p = 0; p < sizeof(pieces) / sizeof(pieces[0]); p++)
+			{
+				run(bufferSizes[b], pieces[p]);
+			}
+		}
+	}
+
+	printf("http parser: OK\n");
+	return 0;
+}
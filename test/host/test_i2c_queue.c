@@ -0,0 +1,342 @@
+/**************************************************************************//**
+* @file      test_i2c_queue.c
+* @brief     Host test of the I2C job queue on a simulated bus
+* @details   Runs I2CDriver.c on fake_i2c_bus.c with the OLED, the Seesaw and the light sensor on the bus. A batch of OLED
+			 page writes, keypad reads and a light read is queued at once: the jobs must end in order, and the bus must
+			 never sit idle for longer than one interrupt latency and a STOP between two transfers. Reports the gaps and
+			 the latency of each job. Also covers re-clocking between devices, the fallback when the DMA channel cannot
+			 start, a NACK of the last DMA byte, a missing device and a device that holds the bus past the timeout.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "host_test.h"
+#include "fake_i2c_bus.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define OLED_ADDRESS		0x3D
+#define SEESAW_ADDRESS		0x2E
+#define LIGHT_ADDRESS		0x10
+#define OLED_PAGES			6
+#define OLED_PAGE_BYTES		(1 + 128)	///<Control byte and one page of the SSD1306 RAM
+#define KEYPAD_EVENTS		4
+#define BATCH_JOBS			(OLED_PAGES + 3)
+#define MAX_GAP_NS(hz)		(FAKE_BUS_ISR_LATENCY_NS + 1000000000ull / (hz))	///<Interrupt latency, then the STOP
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+int host_critical_nesting = 0;
+
+static struct fake_i2c_device oled, seesaw, light;
+
+///A job and the buffers of its steps
+struct test_job
+{
+	I2C_Job job;
+	I2C_Step steps[2];
+	uint8_t out[OLED_PAGE_BYTES];
+	uint8_t in[KEYPAD_EVENTS];
+	uint64_t submitNs;
+	uint64_t doneNs;
+};
+
+static struct test_job jobs[BATCH_JOBS];
+static int doneOrder[BATCH_JOBS];
+static int doneCount;
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+static void job_done(I2C_Job *job)
+{
+	struct test_job *owner = job->context;
+
+	CHECK(doneCount < BATCH_JOBS);
+	owner->doneNs = fakeBusNowNs;
+	doneOrder[doneCount++] = (int)(owner - jobs);
+}
+
+///Clears the bus, puts the three devices on it and initializes the driver, which probes them
+static void setup(uint32_t seesawMaxHz)
+{
+	fake_bus_reset();
+	memset(&oled, 0, sizeof(oled));
+	memset(&seesaw, 0, sizeof(seesaw));
+	memset(&light, 0, sizeof(light));
+	oled.address = OLED_ADDRESS;
+	oled.maxHz = 1000000;
+	seesaw.address = SEESAW_ADDRESS;
+	seesaw.maxHz = seesawMaxHz;
+	seesaw.readBase = 0x40;
+	light.address = LIGHT_ADDRESS;
+	light.maxHz = 400000;
+	light.readBase = 0x10;
+	fake_bus_add_device(&oled);
+	fake_bus_add_device(&seesaw);
+	fake_bus_add_device(&light);
+
+	CHECK_EQ(I2cInitializeDriver(), ERROR_NONE);
+	CHECK(fake_bus_idle());
+	memset(jobs, 0, sizeof(jobs));
+	doneCount = 0;
+	fake_bus_reset_stats();
+}
+
+///Page address commands, then the page through the DMAC, as MicroOLEDdisplay sends it
+static I2C_Job *oled_page_job(struct test_job *t, uint8_t page)
+{
+	static const uint8_t commands[] = {0x00, 0xB0, 0x10, 0x00};
+
+	t->steps[0].type = I2C_STEP_WRITE;
+	t->steps[0].data = (uint8_t *)commands;
+	t->steps[0].len = sizeof(commands);
+	t->out[0] = 0x40;
+	for(int i = 1; i < OLED_PAGE_BYTES; i++) t->out[i] = (uint8_t)(page * 31 + i);
+	t->steps[1].type = I2C_STEP_WRITE_DMA;
+	t->steps[1].data = t->out;
+	t->steps[1].len = OLED_PAGE_BYTES;
+	t->job.address = OLED_ADDRESS;
+	t->job.steps = t->steps;
+	t->job.numSteps = 2;
+	t->job.context = t;
+	return &t->job;
+}
+
+///Seesaw keypad FIFO read: module and function register, then the events
+static I2C_Job *keypad_job(struct test_job *t)
+{
+	t->out[0] = 0x10;
+	t->out[1] = 0x10;
+	t->steps[0].type = I2C_STEP_WRITE;
+	t->steps[0].data = t->out;
+	t->steps[0].len = 2;
+	t->steps[1].type = I2C_STEP_READ;
+	t->steps[1].data = t->in;
+	t->steps[1].len = KEYPAD_EVENTS;
+	t->job.address = SEESAW_ADDRESS;
+	t->job.steps = t->steps;
+	t->job.numSteps = 2;
+	t->job.context = t;
+	return &t->job;
+}
+
+///VEML6030 ALS register read, with a repeated START
+static I2C_Job *light_job(struct test_job *t)
+{
+	t->out[0] = 0x04;
+	t->steps[0].type = I2C_STEP_WRITE_NO_STOP;
+	t->steps[0].data = t->out;
+	t->steps[0].len = 1;
+	t->steps[1].type = I2C_STEP_READ;
+	t->steps[1].data = t->in;
+	t->steps[1].len = 2;
+	t->job.address = LIGHT_ADDRESS;
+	t->job.steps = t->steps;
+	t->job.numSteps = 2;
+	t->job.context = t;
+	return &t->job;
+}
+
+static void submit(struct test_job *t)
+{
+	t->job.callback = job_done;
+	t->submitNs = fakeBusNowNs;
+	CHECK_EQ(I2cSubmitJob(&t->job), ERROR_NONE);
+	CHECK_EQ(host_critical_nesting, 0);
+}
+
+static void run_until_idle(void)
+{
+	while(!fake_bus_idle()) fake_bus_run(fakeBusNowNs + FAKE_BUS_NS_PER_TICK);
+}
+
+static void test_autoprobe(void)
+{
+	setup(400000);
+	CHECK_EQ(I2cGetDeviceSpeed(OLED_ADDRESS), I2C_SPEED_400KHZ);	//Answers at 1 MHz, rated for 400 kHz
+	CHECK_EQ(I2cGetDeviceSpeed(SEESAW_ADDRESS), I2C_SPEED_400KHZ);
+	CHECK_EQ(I2cGetDeviceSpeed(LIGHT_ADDRESS), I2C_SPEED_400KHZ);
+
+	setup(100000);
+	CHECK_EQ(I2cGetDeviceSpeed(SEESAW_ADDRESS), I2C_SPEED_100KHZ);
+	CHECK_EQ(I2cGetDeviceSpeed(0x50), I2C_SPEED_100KHZ);
+}
+
+static void test_batch(void)
+{
+	setup(400000);
+
+	for(int page = 0; page < OLED_PAGES; page++) oled_page_job(&jobs[page], page);
+	keypad_job(&jobs[OLED_PAGES]);
+	light_job(&jobs[OLED_PAGES + 1]);
+	keypad_job(&jobs[OLED_PAGES + 2]);
+	for(int i = 0; i < BATCH_JOBS; i++) submit(&jobs[i]);
+	run_until_idle();
+
+	//In order, all good, and the data went through
+	CHECK_EQ(doneCount, BATCH_JOBS);
+	for(int i = 0; i < BATCH_JOBS; i++)
+	{
+		CHECK_EQ(doneOrder[i], i);
+		CHECK(jobs[i].job.done);
+		CHECK_EQ(jobs[i].job.result, ERROR_NONE);
+	}
+	CHECK_EQ(oled.lastWriteLen, OLED_PAGE_BYTES);
+	CHECK(memcmp(oled.lastWrite, jobs[OLED_PAGES - 1].out, OLED_PAGE_BYTES) == 0);
+	for(int i = 0; i < KEYPAD_EVENTS; i++) CHECK_EQ(jobs[OLED_PAGES + 2].in[i], 0x40 + i);
+	CHECK_EQ(jobs[OLED_PAGES + 1].in[1], 0x11);
+
+	//One SERCOM interrupt per transfer, plus one DMAC interrupt per page. No gap longer than the hand-off in the interrupt.
+	const uint32_t transfers = 2 * BATCH_JOBS;
+	CHECK_EQ(fakeBusStats.transfers, transfers);
+	CHECK_EQ(fakeBusStats.dmaTransfers, OLED_PAGES);
+	CHECK_EQ(fakeBusStats.sercomIsrs, transfers);
+	CHECK_EQ(fakeBusStats.dmaIsrs, OLED_PAGES);
+	CHECK_EQ(fakeBusStats.reclocks, 0);
+	CHECK_EQ(fakeBusStats.gaps, transfers - 1);
+	CHECK(fakeBusStats.maxGapNs <= MAX_GAP_NS(400000));
+
+	uint64_t span = fakeBusStats.lastEndNs - fakeBusStats.firstStartNs;
+	CHECK_EQ(span, fakeBusStats.busyNs + fakeBusStats.gapNs);
+	printf("batch: %u jobs, %u transfers in %llu us, bus busy %.1f%%, gaps mean %llu ns max %llu ns\n",
+		(unsigned)BATCH_JOBS, (unsigned)transfers, (unsigned long long)(span / 1000), 100.0 * fakeBusStats.busyNs / span,
+		(unsigned long long)(fakeBusStats.gapNs / fakeBusStats.gaps), (unsigned long long)fakeBusStats.maxGapNs);
+
+	printf("latency (us):");
+	for(int i = 0; i < BATCH_JOBS; i++)
+	{
+		CHECK(jobs[i].doneNs > jobs[i].submitNs);
+		if(i > 0) CHECK(jobs[i].doneNs > jobs[i - 1].doneNs);
+		printf(" %llu", (unsigned long long)((jobs[i].doneNs - jobs[i].submitNs) / 1000));
+	}
+	printf("\n");
+	CHECK(jobs[BATCH_JOBS - 1].doneNs <= fakeBusStats.lastEndNs + FAKE_BUS_ISR_LATENCY_NS);
+}
+
+static void test_reclock(void)
+{
+	//Seesaw only answers at 100 kHz: the bus is re-clocked each time the queue goes from one speed to the other
+	setup(100000);
+	oled_page_job(&jobs[0], 0);
+	oled_page_job(&jobs[1], 1);
+	keypad_job(&jobs[2]);
+	oled_page_job(&jobs[3], 2);
+	keypad_job(&jobs[4]);
+	keypad_job(&jobs[5]);
+	for(int i = 0; i < 6; i++) submit(&jobs[i]);
+	run_until_idle();
+
+	CHECK_EQ(doneCount, 6);
+	for(int i = 0; i < 6; i++) CHECK_EQ(jobs[i].job.result, ERROR_NONE);
+	CHECK_EQ(fakeBusStats.reclocks, 3);
+	CHECK(fakeBusStats.maxGapNs <= MAX_GAP_NS(100000));
+}
+
+static void test_dma_fallback(void)
+{
+	//The channel cannot start: the page goes out as an interrupt driven write
+	setup(400000);
+	fakeDmaStartFails = true;
+	CHECK_EQ(I2cRunJob(oled_page_job(&jobs[0], 3), 10), ERROR_NONE);
+	CHECK_EQ(fakeBusStats.dmaTransfers, 0);
+	CHECK_EQ(fakeBusStats.dmaIsrs, 0);
+	CHECK(memcmp(oled.lastWrite, jobs[0].out, OLED_PAGE_BYTES) == 0);
+
+	//Back to DMA once it can
+	fakeDmaStartFails = false;
+	CHECK_EQ(I2cRunJob(oled_page_job(&jobs[1], 4), 10), ERROR_NONE);
+	CHECK_EQ(fakeBusStats.dmaTransfers, 1);
+
+	//No channel at all
+	fake_bus_reset();
+	fakeDmaAllocateFails = true;
+	fake_bus_add_device(&oled);
+	CHECK_EQ(I2cInitializeDriver(), ERROR_NONE);
+	CHECK_EQ(I2cRunJob(oled_page_job(&jobs[2], 5), 10), ERROR_NONE);
+	CHECK_EQ(fakeBusStats.dmaTransfers, 0);
+	CHECK(memcmp(oled.lastWrite, jobs[2].out, OLED_PAGE_BYTES) == 0);
+}
+
+static void test_nack(void)
+{
+	setup(400000);
+
+	//Last byte of a DMA write NACKed: ASF does not see it, the driver does
+	oled_page_job(&jobs[0], 0);
+	I2C_Data page = {.address = OLED_ADDRESS, .msgOut = jobs[0].out, .lenOut = OLED_PAGE_BYTES};
+	oled.nackLastByte = true;
+	CHECK_EQ(I2cWriteDataDmaWait(&page, 10), ERROR_ABORTED);
+	CHECK_EQ(fakeBusStats.dmaTransfers, 1);
+	CHECK_EQ(I2cRunJob(oled_page_job(&jobs[1], 1), 10), ERROR_NONE);
+
+	//No device at the address: the job fails and the one behind it still runs
+	jobs[2].out[0] = 0;
+	jobs[2].steps[0] = (I2C_Step){.type = I2C_STEP_WRITE, .data = jobs[2].out, .len = 1};
+	jobs[2].job = (I2C_Job){.address = 0x50, .steps = jobs[2].steps, .numSteps = 1, .context = &jobs[2]};
+	keypad_job(&jobs[3]);
+	submit(&jobs[2]);
+	submit(&jobs[3]);
+	run_until_idle();
+	CHECK_EQ(jobs[2].job.result, ERROR_ABORTED);
+	CHECK_EQ(jobs[3].job.result, ERROR_NONE);
+	CHECK_EQ(jobs[3].in[0], 0x40);
+}
+
+static void test_timeout(void)
+{
+	setup(400000);
+
+	//The light sensor holds the bus: the job times out, the keypad read queued behind it runs after the STOP
+	uint64_t start = fakeBusNowNs;
+	light.hangNs = 50000000;
+	keypad_job(&jobs[1]);
+	light_job(&jobs[0]);
+	jobs[0].job.notifyTask = xTaskGetCurrentTaskHandle();
+	CHECK_EQ(I2cSubmitJob(&jobs[0].job), ERROR_NONE);
+	submit(&jobs[1]);
+	CHECK_EQ(I2cWaitJob(&jobs[0].job, 10), ERROR_TIMEOUT);
+	CHECK_EQ(host_critical_nesting, 0);
+	CHECK_EQ(fakeBusNowNs - start, 10 * FAKE_BUS_NS_PER_TICK);
+	run_until_idle();
+	CHECK_EQ(doneCount, 1);
+	CHECK_EQ(jobs[1].job.result, ERROR_NONE);
+	CHECK_EQ(jobs[1].in[3], 0x43);
+	CHECK(jobs[1].doneNs - start < 11 * FAKE_BUS_NS_PER_TICK);	//Right after the STOP, not when the light sensor lets go
+
+	//Same for a DMA write: the channel is stopped too, and the next page goes through the DMAC again
+	oled.hangNs = 50000000;
+	CHECK_EQ(I2cRunJob(oled_page_job(&jobs[2], 0), 10), ERROR_TIMEOUT);
+	CHECK_EQ(I2cRunJob(oled_page_job(&jobs[3], 1), 10), ERROR_NONE);
+	CHECK(memcmp(oled.lastWrite, jobs[3].out, OLED_PAGE_BYTES) == 0);
+	CHECK(fake_bus_idle());
+
+	//A wake up posted to the thread while it waited is given back
+	xTaskNotifyGive(xTaskGetCurrentTaskHandle());
+	CHECK_EQ(I2cRunJob(keypad_job(&jobs[4]), 10), ERROR_NONE);
+	CHECK_EQ(ulTaskNotifyTake(pdTRUE, 0), 1);
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	test_autoprobe();
+	test_batch();
+	test_reclock();
+	test_dma_fallback();
+	test_nack();
+	test_timeout();
+
+	printf("i2c queue: OK\n");
+	return 0;
+}
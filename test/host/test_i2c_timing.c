@@ -0,0 +1,196 @@
+/**************************************************************************//**
+* @file      test_i2c_timing.c
+* @brief     Host model of the sensor bus timing at each I2C speed profile
+* @details   Runs I2CDriver.c on fake_i2c_bus.c and times the two workloads that load the bus most: a full OLED frame
+			 (six page jobs, each page address commands then 129 bytes through the DMAC) and a keypad poll (count read,
+			 then a FIFO read of four events, as SeesawGetKeypadCount and SeesawReadKeypad do). The simulated times must
+			 match the bit count of the transfers plus the interrupt hand-off between them. Reports the projected frame
+			 rate, pixel throughput and keypad poll time at 100 kHz, 400 kHz and 1 MHz.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "host_test.h"
+#include "fake_i2c_bus.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define OLED_ADDRESS		0x3D
+#define SEESAW_ADDRESS		0x2E
+#define OLED_PAGES			6
+#define OLED_COMMAND_BYTES	4
+#define OLED_PAGE_BYTES		(1 + 128)	///<Control byte and one page of the SSD1306 RAM
+#define PIXEL_BYTES			(OLED_PAGES * 128)
+#define KEYPAD_EVENTS		4
+
+#define TRANSFER_BITS(len)	(1 + 9 * (1 + (len)))	///<START, address and data, with their ACKs
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+int host_critical_nesting = 0;
+
+static struct fake_i2c_device oled, seesaw;
+
+static const uint32_t profileHz[I2C_SPEED_MAX_PROFILES] = {0, 100000, 400000, 1000000};
+static const char *const profileNames[I2C_SPEED_MAX_PROFILES] = {"auto", "100 kHz", "400 kHz", "1 MHz"};
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///Devices that answer at every profile, so each workload can be timed at each one
+static void setup(void)
+{
+	fake_bus_reset();
+	memset(&oled, 0, sizeof(oled));
+	memset(&seesaw, 0, sizeof(seesaw));
+	oled.address = OLED_ADDRESS;
+	oled.maxHz = 1000000;
+	seesaw.address = SEESAW_ADDRESS;
+	seesaw.maxHz = 1000000;
+	seesaw.readBase = 0x20;
+	fake_bus_add_device(&oled);
+	fake_bus_add_device(&seesaw);
+	CHECK_EQ(I2cInitializeDriver(), ERROR_NONE);
+	fake_bus_reset_stats();
+}
+
+///Time of a chain of transfers queued at once: each one on the wire, then between two of them the interrupt and the
+///STOP, and the interrupt that ends the last one
+static uint64_t model_ns(const uint16_t *lens, int transfers, uint32_t hz)
+{
+	uint64_t bit = 1000000000ull / hz;
+	uint64_t ns = 0;
+
+	for(int i = 0; i < transfers; i++) ns += TRANSFER_BITS(lens[i]) * bit;
+	return ns + (transfers - 1) * (FAKE_BUS_ISR_LATENCY_NS + bit) + FAKE_BUS_ISR_LATENCY_NS;
+}
+
+///Sends a full frame as six queued page jobs. Returns the time from the first submit to the end of the last job.
+static uint64_t time_frame(uint8_t speed)
+{
+	static const uint8_t commands[OLED_COMMAND_BYTES] = {0x00, 0xB0, 0x10, 0x00};
+	static uint8_t pages[OLED_PAGES][OLED_PAGE_BYTES];
+	static I2C_Step steps[OLED_PAGES][2];
+	static I2C_Job jobs[OLED_PAGES];
+
+	vTaskDelay(1);
+	uint64_t start = fakeBusNowNs;
+	for(int page = 0; page < OLED_PAGES; page++)
+	{
+		pages[page][0] = 0x40;
+		for(int i = 1; i < OLED_PAGE_BYTES; i++) pages[page][i] = (uint8_t)test_rand();
+		steps[page][0] = (I2C_Step){.type = I2C_STEP_WRITE, .data = (uint8_t *)commands, .len = OLED_COMMAND_BYTES};
+		steps[page][1] = (I2C_Step){.type = I2C_STEP_WRITE_DMA, .data = pages[page], .len = OLED_PAGE_BYTES};
+		jobs[page] = (I2C_Job){.address = OLED_ADDRESS, .steps = steps[page], .numSteps = 2, .speed = speed};
+		if(page == OLED_PAGES - 1) jobs[page].notifyTask = xTaskGetCurrentTaskHandle();
+		CHECK_EQ(I2cSubmitJob(&jobs[page]), ERROR_NONE);
+	}
+	//The thread waits for the last page only, as MicroOLEDdisplay does
+	CHECK_EQ(I2cWaitJob(&jobs[OLED_PAGES - 1], 100), ERROR_NONE);
+	for(int page = 0; page < OLED_PAGES; page++) CHECK_EQ(jobs[page].result, ERROR_NONE);
+	CHECK(memcmp(oled.lastWrite, pages[OLED_PAGES - 1], OLED_PAGE_BYTES) == 0);
+	return fakeBusNowNs - start;
+}
+
+///Reads the keypad event count, then the events. Returns the bus time of the two blocking reads.
+static uint64_t time_keypad_poll(uint8_t speed)
+{
+	uint8_t countCmd[] = {0x10, 0x04}, fifoCmd[] = {0x10, 0x10};
+	uint8_t count = 0, events[KEYPAD_EVENTS];
+	I2C_Data data = {.address = SEESAW_ADDRESS, .speed = speed};
+
+	vTaskDelay(1);
+	uint64_t start = fakeBusNowNs;
+	data.msgOut = countCmd;
+	data.lenOut = sizeof(countCmd);
+	data.msgIn = &count;
+	data.lenIn = 1;
+	CHECK_EQ(I2cReadDataWait(&data, 0, 100), ERROR_NONE);
+	uint64_t countNs = fakeBusNowNs - start;
+
+	vTaskDelay(1);
+	start = fakeBusNowNs;
+	data.msgOut = fifoCmd;
+	data.lenOut = sizeof(fifoCmd);
+	data.msgIn = events;
+	data.lenIn = KEYPAD_EVENTS;
+	CHECK_EQ(I2cReadDataWait(&data, 0, 100), ERROR_NONE);
+	uint64_t fifoNs = fakeBusNowNs - start;
+	CHECK_EQ(events[KEYPAD_EVENTS - 1], 0x20 + KEYPAD_EVENTS - 1);
+
+	//The thread sleeps between the reads, so each one starts on an idle bus
+	const uint16_t countLens[] = {sizeof(countCmd), 1}, fifoLens[] = {sizeof(fifoCmd), KEYPAD_EVENTS};
+	CHECK_EQ(countNs, model_ns(countLens, 2, profileHz[speed]));
+	CHECK_EQ(fifoNs, model_ns(fifoLens, 2, profileHz[speed]));
+	return countNs + fifoNs;
+}
+
+static void test_profiles(void)
+{
+	uint64_t frameNs[I2C_SPEED_MAX_PROFILES], pollNs[I2C_SPEED_MAX_PROFILES];
+	uint16_t frameLens[2 * OLED_PAGES];
+
+	for(int i = 0; i < OLED_PAGES; i++)
+	{
+		frameLens[2 * i] = OLED_COMMAND_BYTES;
+		frameLens[2 * i + 1] = OLED_PAGE_BYTES;
+	}
+
+	for(uint8_t speed = I2C_SPEED_100KHZ; speed < I2C_SPEED_MAX_PROFILES; speed++)
+	{
+		setup();
+
+		//Only the first page can re-clock the bus, which is not counted
+		frameNs[speed] = time_frame(speed);
+		CHECK_EQ(fake_bus_scl_hz(), profileHz[speed]);
+		CHECK_EQ(fakeBusStats.reclocks, 0);
+		CHECK_EQ(fakeBusStats.dmaTransfers, OLED_PAGES);
+		CHECK_EQ(frameNs[speed], model_ns(frameLens, 2 * OLED_PAGES, profileHz[speed]));
+
+		pollNs[speed] = time_keypad_poll(speed);
+		CHECK_EQ(fakeBusStats.reclocks, 0);
+
+		printf("%-7s: frame %6llu us (%3llu fps max, %5llu pixel B/s), keypad poll %4llu us (%5llu polls/s max)\n",
+			profileNames[speed], (unsigned long long)(frameNs[speed] / 1000), (unsigned long long)(1000000000ull / frameNs[speed]),
+			(unsigned long long)(PIXEL_BYTES * 1000000000ull / frameNs[speed]), (unsigned long long)(pollNs[speed] / 1000),
+			(unsigned long long)(1000000000ull / pollNs[speed]));
+	}
+
+	//The bits dominate: each step up in clock is close to the clock ratio for the frame, less for the short keypad reads
+	CHECK(frameNs[I2C_SPEED_100KHZ] > 39 * frameNs[I2C_SPEED_400KHZ] / 10);
+	CHECK(frameNs[I2C_SPEED_400KHZ] > 24 * frameNs[I2C_SPEED_1MHZ] / 10);
+	CHECK(pollNs[I2C_SPEED_100KHZ] > 3 * pollNs[I2C_SPEED_400KHZ]);
+	CHECK(pollNs[I2C_SPEED_400KHZ] > 2 * pollNs[I2C_SPEED_1MHZ]);
+}
+
+static void test_mixed_speeds(void)
+{
+	//OLED at 400 kHz and keypad at 100 kHz: one re-clock each way per poll, and no extra time on the wire
+	setup();
+	fake_bus_reset_stats();
+	time_frame(I2C_SPEED_400KHZ);
+	time_keypad_poll(I2C_SPEED_100KHZ);
+	time_frame(I2C_SPEED_400KHZ);
+	CHECK_EQ(fakeBusStats.reclocks, 2);
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	test_profiles();
+	test_mixed_speeds();
+
+	printf("i2c timing: OK\n");
+	return 0;
+}
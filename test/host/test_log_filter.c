@@ -0,0 +1,261 @@
+/**************************************************************************//**
+* @file      test_log_filter.c
+* @brief     Host test of the build time and run time log filters and of the "log" CLI command
+* @details   Built with the UI messages below LOG_ERROR_LVL compiled out. Their arguments call a function that is
+			 defined nowhere, so the test only links if every such call site left no code, and LOG_ENABLED must be
+			 a constant false for them at compile time. The other messages are filtered at run time by the global
+			 and the module levels, set directly and through the handler of the "log" command, and the text on
+			 fake_uart.c must be that of the messages that pass, with the arguments of the others never evaluated.
+			 Reports the cost of a message compiled out, filtered at run time and printed.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#define LOG_BUILD_LEVEL_UI	LOG_ERROR_LVL	///<UI messages below errors are compiled out in this file
+#include <string.h>
+#include <time.h>
+#include "host_test.h"
+#include "fake_rtos.h"
+#include "fake_uart.h"
+#include "FreeRTOS_Threads/CliThread/CliThread.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define COST_ROUNDS		1000000
+#define PRINT_ROUNDS	2000		///<Printed messages timed, each one drained from the line before the next
+
+///Makes each message read the levels again, as a call site between two others does on the SAMD21
+#define LEVELS_CHANGE()	__asm__ volatile("" ::: "memory")
+
+_Static_assert(!LOG_ENABLED(UI, LOG_WARNING_LVL), "UI warnings are below the build level of this file");
+_Static_assert(!LOG_ENABLED(UI, LOG_INFO_LVL), "UI messages are below the build level of this file");
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+int host_critical_nesting = 0;
+char cOutputBuffer[configCOMMAND_INT_MAX_OUTPUT_SIZE];	///<Output buffer of FreeRTOS_CLI.c, which the firmware provides
+
+static uint32_t evaluated;		///<Arguments of log messages evaluated
+static uint32_t wireChecked;	///<Bytes of the line already compared
+
+/******************************************************************************
+* Firmware stubs
+******************************************************************************/
+int not_compiled_out(void);		///<Defined nowhere: the link fails if a message below the build level is kept
+
+void WifiHandlerSetState(uint8_t state)
+{
+	CHECK(false);
+}
+
+void system_reset(void)
+{
+	CHECK(false);
+}
+
+uint8_t SeesawGetKeypadCount(void)
+{
+	CHECK(false);
+	return 0;
+}
+
+int32_t SeesawReadKeypad(uint8_t *buffer, uint8_t count)
+{
+	CHECK(false);
+	return -1;
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+static int arg(int value)
+{
+	evaluated++;
+	return value;
+}
+
+static double seconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+///The line must carry text and nothing else since the last check
+static void check_printed(const char *text)
+{
+	fake_uart_drain();
+	CHECK_EQ(fakeUartWireLen - wireChecked, strlen(text));
+	CHECK(memcmp(fakeUartWire + wireChecked, text, strlen(text)) == 0);
+	wireChecked = fakeUartWireLen;
+}
+
+///Runs one "log" command through its handler and checks the reply
+static void cli_log(const char *command, const char *reply)
+{
+	char output[MAX_OUTPUT_LENGTH_CLI];
+
+	memset(output, 0, sizeof(output));
+	CHECK_EQ(CLI_SetLogLevel((int8_t *)output, sizeof(output), (const int8_t *)command), pdFALSE);
+	CHECK(strcmp(output, reply) == 0);
+}
+
+static void test_build_level(void)
+{
+	//Compiled out whatever the run time levels, with the arguments
+	LogUi(LOG_INFO_LVL, "ui info %d\r\n", not_compiled_out());
+	LogUi(LOG_WARNING_LVL, "ui warning %d\r\n", not_compiled_out());
+	LogModule(UI, LOG_DEBUG_LVL, "ui debug %d\r\n", not_compiled_out());
+	check_printed("");
+
+	//At the build level and above, the run time levels decide
+	LogUi(LOG_ERROR_LVL, "ui error %d\r\n", arg(1));
+	LogUi(LOG_FATAL_LVL, "ui fatal %d\r\n", arg(2));
+	check_printed("ui error 1\r\nui fatal 2\r\n");
+	CHECK_EQ(evaluated, 2);
+
+	//The other modules keep the default build level, which compiles nothing out
+	CHECK(LOG_ENABLED(WIFI, LOG_INFO_LVL));
+	LogWifi(LOG_INFO_LVL, "wifi info\r\n");
+	LogBoot(LOG_DEBUG_LVL, "boot debug\r\n");
+	check_printed("wifi info\r\nboot debug\r\n");
+}
+
+static void test_run_time_levels(void)
+{
+	evaluated = 0;
+
+	//A module level only filters its own module. The arguments of a filtered message are not evaluated.
+	setLogModuleLevel(LOG_MODULE_WIFI, LOG_ERROR_LVL);
+	CHECK_EQ(getLogModuleLevel(LOG_MODULE_WIFI), LOG_ERROR_LVL);
+	LogWifi(LOG_WARNING_LVL, "wifi warning %d\r\n", arg(1));
+	LogWifi(LOG_ERROR_LVL, "wifi error %d\r\n", arg(2));
+	LogI2c(LOG_INFO_LVL, "i2c info %d\r\n", arg(3));
+	check_printed("wifi error 2\r\ni2c info 3\r\n");
+	CHECK_EQ(evaluated, 2);
+
+	//The global level filters every module, on top of their own level
+	setLogLevel(LOG_FATAL_LVL);
+	LogI2c(LOG_ERROR_LVL, "i2c error %d\r\n", arg(4));
+	LogControl(LOG_FATAL_LVL, "control fatal %d\r\n", arg(5));
+	LogWifi(LOG_FATAL_LVL, "wifi fatal %d\r\n", arg(6));
+	check_printed("control fatal 5\r\nwifi fatal 6\r\n");
+	CHECK_EQ(evaluated, 4);
+	setLogLevel(LOG_INFO_LVL);
+
+	//Off is above every message level
+	setLogModuleLevel(LOG_MODULE_CLI, LOG_OFF_LVL);
+	LogCli(LOG_FATAL_LVL, "cli fatal %d\r\n", arg(7));
+	check_printed("");
+	CHECK_EQ(evaluated, 4);
+
+	//Invalid modules and levels are ignored
+	setLogModuleLevel(N_LOG_MODULES, LOG_DEBUG_LVL);
+	setLogModuleLevel(LOG_MODULE_WIFI, N_DEBUG_LEVELS);
+	CHECK_EQ(getLogModuleLevel(LOG_MODULE_WIFI), LOG_ERROR_LVL);
+	CHECK_EQ(getLogModuleLevel(N_LOG_MODULES), LOG_OFF_LVL);
+	for(int module = 0; module < N_LOG_MODULES; module++)
+	{
+		setLogModuleLevel((enum eLogModules)module, LOG_INFO_LVL);
+	}
+}
+
+static void test_cli_command(void)
+{
+	cli_log("log wifi 3", "wifi: level 3\r\n");
+	CHECK_EQ(getLogModuleLevel(LOG_MODULE_WIFI), LOG_ERROR_LVL);
+	LogWifi(LOG_WARNING_LVL, "wifi warning\r\n");
+	LogWifi(LOG_ERROR_LVL, "wifi error\r\n");
+	check_printed("wifi error\r\n");
+
+	cli_log("log i2c  2", "i2c: level 2\r\n");
+	CHECK_EQ(getLogModuleLevel(LOG_MODULE_I2C), LOG_WARNING_LVL);
+	cli_log("log boot 5", "boot: level 5\r\n");
+	CHECK_EQ(getLogModuleLevel(LOG_MODULE_BOOT), LOG_OFF_LVL);
+	cli_log("log all 4", "all: level 4\r\n");
+	CHECK_EQ(getLogLevel(), LOG_FATAL_LVL);
+	cli_log("log all 0", "all: level 0\r\n");
+	CHECK_EQ(getLogLevel(), LOG_INFO_LVL);
+
+	//The run time level cannot bring back a message compiled out
+	cli_log("log ui 0", "ui: level 0\r\n");
+	LogUi(LOG_WARNING_LVL, "ui warning %d\r\n", not_compiled_out());
+	LogUi(LOG_ERROR_LVL, "ui error\r\n");
+	check_printed("ui error\r\n");
+
+	//Bad levels and modules change nothing
+	cli_log("log wifi 6", "Level must be 0 to 5\r\n");
+	cli_log("log wifi 12", "Level must be 0 to 5\r\n");
+	cli_log("log wifi", "Level must be 0 to 5\r\n");
+	cli_log("log wif 1", "Unknown module\r\n");
+	cli_log("log wifis 1", "Unknown module\r\n");
+	CHECK_EQ(getLogModuleLevel(LOG_MODULE_WIFI), LOG_ERROR_LVL);
+	CHECK_EQ(getLogLevel(), LOG_INFO_LVL);
+	check_printed("");
+}
+
+static void test_cost(void)
+{
+	double start;
+
+	evaluated = 0;
+	setLogModuleLevel(LOG_MODULE_WIFI, LOG_ERROR_LVL);
+	start = seconds();
+	for(uint32_t i = 0; i < COST_ROUNDS; i++)
+	{
+		LogUi(LOG_WARNING_LVL, "received[%u], file size[%u]\r\n", not_compiled_out(), 5000);
+		LEVELS_CHANGE();
+	}
+	double compiledOut = seconds() - start;
+
+	start = seconds();
+	for(uint32_t i = 0; i < COST_ROUNDS; i++)
+	{
+		LogWifi(LOG_WARNING_LVL, "received[%u], file size[%u]\r\n", arg(i), 5000);
+		LEVELS_CHANGE();
+	}
+	double filtered = seconds() - start;
+	check_printed("");
+	CHECK_EQ(evaluated, 0);
+
+	//Printed messages go through the TX ring, which is drained outside the timed part
+	double printed = 0;
+	for(uint32_t i = 0; i < PRINT_ROUNDS; i++)
+	{
+		start = seconds();
+		LogWifi(LOG_ERROR_LVL, "received[%u], file size[%u]\r\n", arg(i % 10), 5000);
+		printed += seconds() - start;
+		fake_uart_drain();
+	}
+	CHECK_EQ(evaluated, PRINT_ROUNDS);
+	CHECK_EQ(fakeUartWireLen - wireChecked, PRINT_ROUNDS * strlen("received[0], file size[5000]\r\n"));
+	CHECK_EQ(SerialConsoleGetTxOverflow(), 0);
+
+	printf("per message: %.1f ns compiled out, %.1f ns filtered at run time, %.0f ns printed\n",
+		compiledOut * 1e9 / COST_ROUNDS, filtered * 1e9 / COST_ROUNDS, printed * 1e9 / PRINT_ROUNDS);
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	fake_uart_reset(true);
+	InitializeSerialConsole();
+
+	test_build_level();
+	test_run_time_levels();
+	test_cli_command();
+	test_cost();
+
+	CHECK_EQ(fakeRtosSchedulerSuspended, 0);
+	CHECK_EQ(host_critical_nesting, 0);
+	printf("log filter: OK\n");
+	return 0;
+}
@@ -0,0 +1,307 @@
+/**************************************************************************//**
+* @file      test_log_thread.c
+* @brief     Host test of the deferred log ring with several producer threads and the log thread on its own
+* @details   Runs vLogTask on a pthread and posts with LogDeferred from several other pthreads at once. The
+			 critical section of LogDeferredPost holds a mutex, and the task notification is a counting semaphore
+			 on a condition variable, so the ring sees the same interleavings as tasks preempting each other on the
+			 SAMD21. Every printed line must come from a message that was posted, each producer's messages must
+			 come out in the order it posted them, and the printed and dropped messages must add up to the posted
+			 ones, with every drop reported. The log thread must never sleep with a message in the ring. Also
+			 reports the cost of a post against formatting the message in the caller.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include "host_test.h"
+#include "FreeRTOS_Threads/LogThread/LogThread.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define PRODUCERS			4
+#define PRODUCER_MESSAGES	50000		///<Messages each producer posts
+#define SLOW_LINE_EVERY		1024		///<The console stalls the log thread on one line in this many
+#define IDLE_TIMEOUT_S		10			///<Longest wait for the log thread to go back to sleep
+#define COST_ROUNDS			200000
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+int host_critical_nesting = 0;
+
+static pthread_mutex_t criticalMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t notifyMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notifyCond = PTHREAD_COND_INITIALIZER;
+static uint32_t notifyCount;			///<Notification value of the log thread
+static bool logSleeping;				///<The log thread waits in ulTaskNotifyTake
+static uint32_t notifyGives, logWakeups;
+static int logTask;						///<Its address is the handle of the log thread
+
+static enum eDebugLogLevels logLevel = LOG_INFO_LVL;
+static bool consoleSlow;
+
+//Only touched by the log thread, and read by the test once it sleeps
+static uint32_t nextMessage[PRODUCERS];	///<Lowest message number each producer may print next
+static uint32_t printedLines, reportedDrops, otherLines;
+static char lastLine[LOG_LINE_SIZE];
+
+/******************************************************************************
+* FreeRTOS and firmware stubs
+******************************************************************************/
+void host_critical_enter(void)
+{
+	pthread_mutex_lock(&criticalMutex);
+	host_critical_nesting++;
+}
+
+void host_critical_exit(void)
+{
+	host_critical_nesting--;
+	pthread_mutex_unlock(&criticalMutex);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+	return &logTask;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+	CHECK(xTaskToNotify == &logTask);
+	pthread_mutex_lock(&notifyMutex);
+	notifyCount++;
+	notifyGives++;
+	pthread_cond_broadcast(&notifyCond);
+	pthread_mutex_unlock(&notifyMutex);
+	return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+	uint32_t count;
+
+	CHECK_EQ(xClearCountOnExit, pdTRUE);
+	CHECK_EQ(xTicksToWait, portMAX_DELAY);
+	pthread_mutex_lock(&notifyMutex);
+	logSleeping = true;
+	pthread_cond_broadcast(&notifyCond);
+	while(notifyCount == 0) pthread_cond_wait(&notifyCond, &notifyMutex);
+	logSleeping = false;
+	count = notifyCount;
+	notifyCount = 0;
+	logWakeups++;
+	pthread_mutex_unlock(&notifyMutex);
+	return count;
+}
+
+enum eDebugLogLevels getLogLevel(void)
+{
+	return logLevel;
+}
+
+void SerialConsoleWriteString(const char *string)
+{
+	unsigned producer, message;
+	unsigned long dropped;
+
+	CHECK(strlen(string) < LOG_LINE_SIZE);
+	strcpy(lastLine, string);
+	if(sscanf(string, "producer %u message %u\r\n", &producer, &message) == 2)
+	{
+		//In order for each producer. A gap is a dropped message.
+		CHECK(producer < PRODUCERS);
+		CHECK(message >= nextMessage[producer]);
+		CHECK(message < PRODUCER_MESSAGES);
+		nextMessage[producer] = message + 1;
+		printedLines++;
+	}
+	else if(sscanf(string, "[%lu log messages dropped]\r\n", &dropped) == 1)
+	{
+		CHECK(dropped != 0);
+		reportedDrops += (uint32_t)dropped;
+	}
+	else
+	{
+		otherLines++;
+	}
+
+	if(consoleSlow && (printedLines % SLOW_LINE_EVERY) == 0)
+	{
+		struct timespec stall = {.tv_sec = 0, .tv_nsec = 200000};
+		nanosleep(&stall, NULL);
+	}
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///Waits until the log thread sleeps with no notification pending, which it must only do with the ring empty
+static void wait_log_idle(void)
+{
+	struct timespec deadline;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += IDLE_TIMEOUT_S;
+	pthread_mutex_lock(&notifyMutex);
+	while(!logSleeping || notifyCount != 0)
+	{
+		if(pthread_cond_timedwait(&notifyCond, &notifyMutex, &deadline) == ETIMEDOUT)
+		{
+			fprintf(stderr, "log thread still busy after %d s\n", IDLE_TIMEOUT_S);
+			CHECK(false);
+		}
+	}
+	pthread_mutex_unlock(&notifyMutex);
+}
+
+static void *log_thread(void *arg)
+{
+	vLogTask(NULL);
+	return NULL;
+}
+
+static void *producer_thread(void *arg)
+{
+	uint32_t producer = (uint32_t)(uintptr_t)arg;
+
+	for(uint32_t message = 0; message < PRODUCER_MESSAGES; message++)
+	{
+		//uint32_t is unsigned int on the host, hence %u where the firmware would use %lu
+		LogDeferred(LOG_INFO_LVL, "producer %u message %u\r\n", producer, message);
+		if((message & 0xff) == producer) sched_yield();
+	}
+	return NULL;
+}
+
+static double seconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void test_before_start(void)
+{
+	//Messages posted before the log thread runs wait in the ring, without a notification. Those that do not fit
+	//are dropped, and reported once the ring has been printed.
+	for(uint32_t message = 0; message < LOG_QUEUE_DEPTH + 5; message++)
+	{
+		LogDeferred(LOG_INFO_LVL, "producer %u message %u\r\n", 0, message);
+	}
+	CHECK_EQ(LogDeferredDropped(), 5);
+	CHECK_EQ(notifyGives, 0);
+	CHECK_EQ(host_critical_nesting, 0);
+
+	pthread_t thread;
+	CHECK_EQ(pthread_create(&thread, NULL, log_thread, NULL), 0);
+	CHECK_EQ(pthread_detach(thread), 0);
+	wait_log_idle();
+
+	CHECK_EQ(printedLines, LOG_QUEUE_DEPTH);
+	CHECK_EQ(nextMessage[0], LOG_QUEUE_DEPTH);
+	CHECK_EQ(reportedDrops, 5);
+	CHECK(strcmp(lastLine, "[5 log messages dropped]\r\n") == 0);
+	CHECK_EQ(logWakeups, 0);
+	nextMessage[0] = 0;
+}
+
+static void test_levels(void)
+{
+	//Messages below the log level are not queued, and do not wake the log thread
+	uint32_t printedBefore = printedLines, givesBefore = notifyGives;
+
+	logLevel = LOG_WARNING_LVL;
+	LogDeferred(LOG_DEBUG_LVL, "debug %u\r\n", 1);
+	CHECK_EQ(notifyGives, givesBefore);
+	LogDeferred(LOG_ERROR_LVL, "error without arguments\r\n");
+	wait_log_idle();
+	logLevel = LOG_INFO_LVL;
+
+	CHECK_EQ(notifyGives, givesBefore + 1);
+	CHECK_EQ(printedLines, printedBefore);
+	CHECK_EQ(otherLines, 1);
+	CHECK(strcmp(lastLine, "error without arguments\r\n") == 0);
+}
+
+static void test_producers(void)
+{
+	pthread_t threads[PRODUCERS];
+	uint32_t printedBefore = printedLines, droppedBefore = LogDeferredDropped(), reportedBefore = reportedDrops;
+	uint32_t givesBefore = notifyGives, wakeupsBefore = logWakeups;
+
+	consoleSlow = true;
+	for(uintptr_t producer = 0; producer < PRODUCERS; producer++)
+	{
+		CHECK_EQ(pthread_create(&threads[producer], NULL, producer_thread, (void *)producer), 0);
+	}
+	for(int producer = 0; producer < PRODUCERS; producer++) CHECK_EQ(pthread_join(threads[producer], NULL), 0);
+	wait_log_idle();
+	consoleSlow = false;
+
+	//Nothing lost without being counted, nothing counted without being reported
+	uint32_t printed = printedLines - printedBefore, dropped = LogDeferredDropped() - droppedBefore;
+	CHECK_EQ(printed + dropped, PRODUCERS * PRODUCER_MESSAGES);
+	CHECK_EQ(reportedDrops - reportedBefore, dropped);
+	CHECK_EQ(host_critical_nesting, 0);
+	CHECK(printed >= LOG_QUEUE_DEPTH);
+
+	//Only a post to an empty ring wakes the log thread
+	uint32_t gives = notifyGives - givesBefore, wakeups = logWakeups - wakeupsBefore;
+	CHECK(wakeups <= gives);
+	CHECK(gives <= printed);
+
+	printf("%d producers, %u messages: %u printed, %u dropped, %u notifications, %u wake ups\n", PRODUCERS,
+		(unsigned)(PRODUCERS * PRODUCER_MESSAGES), (unsigned)printed, (unsigned)dropped, (unsigned)gives, (unsigned)wakeups);
+}
+
+static void test_cost(void)
+{
+	//A post copies five words, formatting in the caller runs snprintf. Messages below the level are the cheapest
+	//way to post without filling the ring.
+	char line[LOG_LINE_SIZE];
+	double start;
+
+	logLevel = LOG_ERROR_LVL;
+	start = seconds();
+	for(uint32_t i = 0; i < COST_ROUNDS; i++) LogDeferred(LOG_INFO_LVL, "received[%u], file size[%u]\r\n", i, 5000);
+	double filtered = seconds() - start;
+	logLevel = LOG_INFO_LVL;
+
+	uint32_t printedBefore = printedLines + otherLines, droppedBefore = LogDeferredDropped();
+	start = seconds();
+	for(uint32_t i = 0; i < COST_ROUNDS; i++) LogDeferred(LOG_INFO_LVL, "received[%u], file size[%u]\r\n", i, 5000);
+	double posted = seconds() - start;
+	wait_log_idle();
+	CHECK_EQ(printedLines + otherLines - printedBefore + LogDeferredDropped() - droppedBefore, COST_ROUNDS);
+
+	start = seconds();
+	for(uint32_t i = 0; i < COST_ROUNDS; i++) snprintf(line, sizeof(line), "received[%u], file size[%u]\r\n", i, 5000);
+	double formatted = seconds() - start;
+
+	printf("per message: %.0f ns filtered out, %.0f ns posted, %.0f ns formatted in the caller\n",
+		filtered * 1e9 / COST_ROUNDS, posted * 1e9 / COST_ROUNDS, formatted * 1e9 / COST_ROUNDS);
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	test_before_start();
+	test_levels();
+	test_producers();
+	test_cost();
+
+	printf("log thread: OK\n");
+	return 0;
+}
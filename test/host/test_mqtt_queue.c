@@ -0,0 +1,206 @@
+/**************************************************************************//**
+* @file      test_mqtt_queue.c
+* @brief     Host test of the ring of MQTT messages waiting to be published
+* @details   Checks the edge cases (empty, full, payload too long, retry of the head), then runs a long random
+			 sequence of pushes, publishes and failed publishes against a plain FIFO model, long enough for the
+			 8-bit indexes to wrap many times. The counters of MqttQueueGetStats are checked all along.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "host_test.h"
+#include "FreeRTOS_Threads/WifiHandlerThread/MqttPublishQueue.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define TEST_STEPS		100000	///<Random operations
+#define TOPIC_GAME		"ese516/game"
+#define TOPIC_STATUS	"ese516/status"
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///A message as the model keeps it
+struct model_message
+{
+	const char *topic;
+	uint8_t qos;
+	uint8_t len;
+	char payload[MQTT_QUEUE_PAYLOAD_SIZE];
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+int host_critical_nesting = 0;
+
+static struct model_message model[MQTT_QUEUE_SIZE];	///<FIFO the queue must match
+static uint32_t modelHead, modelCount;
+static struct MqttPublishStats modelStats;
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///Checks the queue against the model: count, head message and counters
+static void check_model(void)
+{
+	struct MqttPublishStats stats;
+
+	CHECK_EQ(host_critical_nesting, 0);
+	CHECK_EQ(MqttQueueCount(), modelCount);
+
+	struct MqttQueuedMessage *msg = MqttQueuePeek();
+	if(modelCount == 0)
+	{
+		CHECK(msg == NULL);
+	}
+	else
+	{
+		struct model_message *expected = &model[modelHead % MQTT_QUEUE_SIZE];
+		CHECK(msg != NULL);
+		CHECK(msg->topic == expected->topic);
+		CHECK_EQ(msg->qos, expected->qos);
+		CHECK_EQ(msg->len, expected->len);
+		CHECK(memcmp(msg->payload, expected->payload, expected->len) == 0);
+		CHECK_EQ(msg->payload[msg->len], 0);
+	}
+
+	MqttQueueGetStats(&stats);
+	CHECK_EQ(host_critical_nesting, 0);
+	CHECK_EQ(stats.queued, modelStats.queued);
+	CHECK_EQ(stats.published, modelStats.published);
+	CHECK_EQ(stats.dropped, modelStats.dropped);
+	CHECK_EQ(stats.retries, modelStats.retries);
+	CHECK_EQ(stats.highWater, modelStats.highWater);
+	CHECK_EQ(stats.queued - stats.published, modelCount);
+}
+
+///Pushes a message of len random bytes on the queue and the model
+static void push(const char *topic, uint8_t len, uint8_t qos)
+{
+	char payload[MQTT_QUEUE_PAYLOAD_SIZE];
+
+	for(uint8_t i = 0; i < len; i++)
+	{
+		payload[i] = (char)('a' + test_rand() % 26);
+	}
+
+	bool queued = MqttQueuePush(topic, payload, len, qos);
+	if(modelCount < MQTT_QUEUE_SIZE)
+	{
+		CHECK(queued);
+		struct model_message *m = &model[(modelHead + modelCount) % MQTT_QUEUE_SIZE];
+		m->topic = topic;
+		m->qos = qos;
+		m->len = len;
+		memcpy(m->payload, payload, len);
+		modelCount++;
+		modelStats.queued++;
+		if(modelCount > modelStats.highWater) modelStats.highWater = modelCount;
+	}
+	else
+	{
+		CHECK(!queued);
+		modelStats.dropped++;
+	}
+	check_model();
+}
+
+static void pop(void)
+{
+	MqttQueuePop();
+	if(modelCount != 0)
+	{
+		modelHead++;
+		modelCount--;
+		modelStats.published++;
+	}
+	check_model();
+}
+
+static void retry(void)
+{
+	MqttQueueRetry();
+	modelStats.retries++;
+	check_model();
+}
+
+static void test_edges(void)
+{
+	char payload[MQTT_QUEUE_PAYLOAD_SIZE + 1];
+	memset(payload, 'x', sizeof(payload));
+
+	check_model();
+	CHECK(MqttQueuePeek() == NULL);
+	pop();	//Popping an empty ring does nothing
+
+	//Refused without being counted as dropped
+	CHECK(!MqttQueuePush(NULL, payload, 1, 1));
+	CHECK(!MqttQueuePush(TOPIC_GAME, NULL, 1, 1));
+	CHECK(!MqttQueuePush(TOPIC_GAME, payload, MQTT_QUEUE_PAYLOAD_SIZE, 1));
+	check_model();
+
+	//Longest payload and empty payload
+	push(TOPIC_GAME, MQTT_QUEUE_PAYLOAD_SIZE - 1, 1);
+	push(TOPIC_STATUS, 0, 0);
+
+	//Fill up, then one too many
+	while(modelCount < MQTT_QUEUE_SIZE)
+	{
+		push(TOPIC_GAME, 10, 1);
+	}
+	push(TOPIC_GAME, 10, 1);
+	CHECK_EQ(modelStats.dropped, 1);
+	CHECK_EQ(modelStats.highWater, MQTT_QUEUE_SIZE);
+
+	//A failed publish keeps the message at the head
+	struct MqttQueuedMessage *head = MqttQueuePeek();
+	retry();
+	retry();
+	CHECK(MqttQueuePeek() == head);
+
+	while(modelCount != 0)
+	{
+		pop();
+	}
+}
+
+static void test_random(void)
+{
+	for(int step = 0; step < TEST_STEPS; step++)
+	{
+		switch(test_rand() % 5)
+		{
+			case 0:
+			case 1:
+				push((test_rand() & 1) ? TOPIC_GAME : TOPIC_STATUS, test_rand() % MQTT_QUEUE_PAYLOAD_SIZE, test_rand() % 2);
+				break;
+			case 2:
+			case 3:
+				pop();
+				break;
+			default:
+				retry();
+				break;
+		}
+	}
+	CHECK(modelStats.published > 256 * 4);	//The 8-bit indexes wrapped several times
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	test_edges();
+	test_random();
+	printf("mqtt queue: OK\n");
+	return 0;
+}
@@ -0,0 +1,386 @@
+/**************************************************************************//**
+* @file      test_mqtt_wait.c
+* @brief     Host test of the MQTT platform layer waits for WINC events, on a simulated clock
+* @details   Runs WINC1500_read, WINC1500_write and ConnectNetwork of MCHP_ATWx.c in a task on fake_rtos.c, against
+			 stubs of the WINC socket calls and an m2m_wifi_handle_events that hands out the callbacks the test has
+			 queued. nm_bsp_wait_for_event sleeps on the task notification as in nm_bsp_samd21.c, and the test
+			 plays the WINC interrupt with fake_rtos_notify. Checks that a wait ends at the tick of the interrupt
+			 that brings its callback and sleeps in between, that a missed edge costs at most one poll period, that
+			 an interrupt during m2m_wifi_handle_events is not lost, and that every wait gives up on time when the
+			 callback never comes. Reports the wake ups of each wait against the calls of a busy loop.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "host_test.h"
+#include "fake_rtos.h"
+#include "MQTTClient/Wrapper/mqtt.h"
+#include "MQTTClient/Platforms/MCHP_ATWx.h"
+#include "bsp/include/nm_bsp.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define TEST_SOCK			2
+#define TEST_HOST			"broker.test"
+#define TEST_IP				0x0100000A
+
+//Limits of MCHP_ATWx.c
+#define EVENT_POLL_MS		100
+#define DNS_TIMEOUT_MS		10000
+#define CONNECT_TIMEOUT_MS	15000
+#define IO_MARGIN_MS		2000
+
+#define READ_TIMEOUT_MS		1000
+#define EVENT_DELAY_MS		37		///<Time from the start of a wait to the callback
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///What the task does on its next run
+enum mqtt_op
+{
+	OP_READ,
+	OP_WRITE,
+	OP_CONNECT
+};
+
+///Callback the WINC has ready for the next m2m_wifi_handle_events
+enum winc_event
+{
+	EVENT_NONE,
+	EVENT_DNS,
+	EVENT_CONNECT,
+	EVENT_SEND,
+	EVENT_RECV
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+int host_critical_nesting = 0;
+struct mqtt_client_pool mqttClientPool[MQTT_MAX_CLIENTS];
+
+static struct mqtt_module module;		///<MQTT instance that owns the broker socket
+
+static enum mqtt_op op;
+static int opLength;
+static int opTimeout;
+static unsigned char opBuffer[64];
+static int opResult;
+static bool opDone;
+static TickType_t opTick;
+
+static enum winc_event pendingEvent;
+static sint16 recvResult;				///<Size or error the pending EVENT_RECV reports
+static const unsigned char *recvData;
+static uint8 *recvBuffer;				///<Buffer given to recv
+static uint16 recvRoom;
+static uint32 recvTimeout;
+static bool interruptInHandler;			///<The WINC interrupt fires again while m2m_wifi_handle_events runs
+static uint32_t handleCalls, recvCalls, closeCalls;
+
+/******************************************************************************
+* WINC stubs
+******************************************************************************/
+SOCKET socket(uint16 u16Domain, uint8 u8Type, uint8 u8Flags)
+{
+	return TEST_SOCK;
+}
+
+sint8 connect(SOCKET sock, struct sockaddr *pstrAddr, uint8 u8AddrLen)
+{
+	CHECK_EQ(sock, TEST_SOCK);
+	CHECK_EQ(((struct sockaddr_in *)pstrAddr)->sin_addr.s_addr, TEST_IP);
+	return SOCK_ERR_NO_ERROR;
+}
+
+sint16 recv(SOCKET sock, void *pvRecvBuf, uint16 u16BufLen, uint32 u32Timeoutmsec)
+{
+	CHECK_EQ(sock, TEST_SOCK);
+	recvBuffer = pvRecvBuf;
+	recvRoom = u16BufLen;
+	recvTimeout = u32Timeoutmsec;
+	recvCalls++;
+	return SOCK_ERR_NO_ERROR;
+}
+
+sint16 send(SOCKET sock, void *pvSendBuffer, uint16 u16SendLength, uint16 u16Flags)
+{
+	CHECK_EQ(sock, TEST_SOCK);
+	return SOCK_ERR_NO_ERROR;
+}
+
+sint8 close(SOCKET sock)
+{
+	closeCalls++;
+	return SOCK_ERR_NO_ERROR;
+}
+
+sint8 gethostbyname(uint8 *pcHostName)
+{
+	CHECK(strcmp((const char *)pcHostName, TEST_HOST) == 0);
+	return SOCK_ERR_NO_ERROR;
+}
+
+///Hands out the pending callback, like the WINC driver does from its event handler
+sint8 m2m_wifi_handle_events(void *arg)
+{
+	enum winc_event event = pendingEvent;
+
+	handleCalls++;
+	pendingEvent = EVENT_NONE;
+	switch(event)
+	{
+		case EVENT_DNS:
+			dnsResolveCallback((uint8_t *)TEST_HOST, TEST_IP);
+			break;
+		case EVENT_CONNECT:
+			tcpClientSocketEventHandler(TEST_SOCK, SOCKET_MSG_CONNECT, NULL);
+			break;
+		case EVENT_SEND:
+			tcpClientSocketEventHandler(TEST_SOCK, SOCKET_MSG_SEND, NULL);
+			break;
+		case EVENT_RECV:
+		{
+			tstrSocketRecvMsg msg = {.pu8Buffer = recvBuffer, .s16BufferSize = recvResult, .u16RemainingSize = 0};
+			if(recvResult > 0)
+			{
+				CHECK(recvResult <= recvRoom);
+				memcpy(recvBuffer, recvData, recvResult);
+			}
+			tcpClientSocketEventHandler(TEST_SOCK, SOCKET_MSG_RECV, &msg);
+			break;
+		}
+		default:
+			break;
+	}
+
+	//The next event comes in after the driver has read the interrupt status: only the interrupt tells of it
+	if(interruptInHandler)
+	{
+		interruptInHandler = false;
+		pendingEvent = EVENT_RECV;
+		fake_rtos_notify();
+	}
+	return 0;
+}
+
+///Same as nm_bsp_samd21.c, on the fake task
+void nm_bsp_wait_for_event(uint32 u32TimeoutMsec)
+{
+	ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(u32TimeoutMsec));
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///Runs the operation the test asked for, then waits for the next one
+static void mqtt_task(void *pvParameters)
+{
+	for(;;)
+	{
+		xTaskNotifyWait(0, UINT32_MAX, NULL, portMAX_DELAY);
+		switch(op)
+		{
+			case OP_READ:
+				opResult = module.network.mqttread(&module.network, opBuffer, opLength, opTimeout);
+				break;
+			case OP_WRITE:
+				opResult = module.network.mqttwrite(&module.network, opBuffer, opLength, opTimeout);
+				break;
+			case OP_CONNECT:
+				opResult = ConnectNetwork(&module.network, TEST_HOST, 1883, 0);
+				break;
+		}
+		opTick = xTaskGetTickCount();
+		opDone = true;
+	}
+}
+
+///Starts an operation and runs the task until it sleeps. Returns the wake ups so far.
+static uint32_t start(enum mqtt_op what, int length, int timeout)
+{
+	op = what;
+	opLength = length;
+	opTimeout = timeout;
+	opDone = false;
+	handleCalls = 0;
+	fake_rtos_notify();
+	fake_rtos_run_for(0);
+	return fakeRtosWakeups;
+}
+
+///Queues a callback and, unless the edge is missed, fires the WINC interrupt
+static void winc_event(enum winc_event event, bool interrupt)
+{
+	pendingEvent = event;
+	if(interrupt) fake_rtos_notify();
+}
+
+static void expect_done(int result, TickType_t tick)
+{
+	CHECK(opDone);
+	CHECK_EQ(opResult, result);
+	CHECK_EQ(opTick, tick);
+}
+
+static void test_read(void)
+{
+	static const unsigned char packet[] = {0x30, 0x0b, 0x00, 0x04, 't', 'e', 's', 't', 'd', 'a', 't', 'a', 0x55};
+
+	//The task sleeps until the interrupt, and returns at its tick
+	TickType_t begin = fake_rtos_tick();
+	uint32_t wakeups = start(OP_READ, 4, READ_TIMEOUT_MS);
+	CHECK_EQ(recvTimeout, READ_TIMEOUT_MS);
+	fake_rtos_run_for(EVENT_DELAY_MS);
+	CHECK(!opDone);
+	CHECK_EQ(handleCalls, 1);
+	CHECK_EQ(fakeRtosWakeups, wakeups);
+
+	recvData = packet;
+	recvResult = sizeof(packet);
+	winc_event(EVENT_RECV, true);
+	fake_rtos_run_for(0);
+	expect_done(4, begin + EVENT_DELAY_MS);
+	CHECK(memcmp(opBuffer, packet, 4) == 0);
+	CHECK_EQ(handleCalls, 2);
+	printf("read: %u wake up, %u event handler calls in %u ms (a busy loop: one per pass)\n",
+		(unsigned)(fakeRtosWakeups - wakeups), (unsigned)handleCalls, EVENT_DELAY_MS);
+
+	//The rest of the packet comes from the FIFO, without a recv or a wait
+	uint32_t recvBefore = recvCalls;
+	start(OP_READ, sizeof(packet) - 4, READ_TIMEOUT_MS);
+	expect_done(sizeof(packet) - 4, begin + EVENT_DELAY_MS);
+	CHECK(memcmp(opBuffer, packet + 4, sizeof(packet) - 4) == 0);
+	CHECK_EQ(recvCalls, recvBefore);
+	CHECK_EQ(handleCalls, 0);
+}
+
+static void test_missed_edge(void)
+{
+	//The callback is ready but the interrupt never came: picked up at the end of the poll period
+	TickType_t begin = fake_rtos_tick();
+	start(OP_READ, 1, READ_TIMEOUT_MS);
+	fake_rtos_run_for(EVENT_DELAY_MS);
+	static const unsigned char byte = 0xA5;
+	recvData = &byte;
+	recvResult = 1;
+	winc_event(EVENT_RECV, false);
+	fake_rtos_run_for(EVENT_POLL_MS);
+	expect_done(1, begin + EVENT_POLL_MS);
+	CHECK_EQ(opBuffer[0], 0xA5);
+}
+
+static void test_interrupt_in_handler(void)
+{
+	//The interrupt of the callback fires while m2m_wifi_handle_events runs, after the driver looked for events.
+	//The notification is kept, so the task goes around again at once instead of sleeping through it.
+	static const unsigned char bytes[2] = {1, 2};
+	TickType_t begin = fake_rtos_tick();
+
+	recvData = bytes;
+	recvResult = sizeof(bytes);
+	interruptInHandler = true;
+	start(OP_READ, 2, READ_TIMEOUT_MS);
+	expect_done(2, begin);
+	CHECK_EQ(handleCalls, 2);
+}
+
+static void test_read_timeouts(void)
+{
+	//The WINC reports its own receive timeout: the error goes up to the MQTT client
+	TickType_t begin = fake_rtos_tick();
+	start(OP_READ, 2, READ_TIMEOUT_MS);
+	fake_rtos_run_for(READ_TIMEOUT_MS);
+	recvResult = SOCK_ERR_TIMEOUT;
+	winc_event(EVENT_RECV, true);
+	fake_rtos_run_for(0);
+	expect_done(SOCK_ERR_TIMEOUT, begin + READ_TIMEOUT_MS);
+
+	//The socket is gone and no callback ever comes: the wait gives up after the margin, waking once per poll
+	begin = fake_rtos_tick();
+	uint32_t wakeups = start(OP_READ, 2, READ_TIMEOUT_MS);
+	fake_rtos_run_for(READ_TIMEOUT_MS + IO_MARGIN_MS - 1);
+	CHECK(!opDone);
+	fake_rtos_run_for(1);
+	expect_done(-1, begin + READ_TIMEOUT_MS + IO_MARGIN_MS);
+	CHECK_EQ(fakeRtosWakeups - wakeups, (READ_TIMEOUT_MS + IO_MARGIN_MS) / EVENT_POLL_MS);
+}
+
+static void test_write(void)
+{
+	TickType_t begin = fake_rtos_tick();
+	start(OP_WRITE, 12, READ_TIMEOUT_MS);
+	fake_rtos_run_for(EVENT_DELAY_MS);
+	winc_event(EVENT_SEND, true);
+	fake_rtos_run_for(0);
+	expect_done(12, begin + EVENT_DELAY_MS);
+
+	begin = fake_rtos_tick();
+	start(OP_WRITE, 12, READ_TIMEOUT_MS);
+	fake_rtos_run_for(READ_TIMEOUT_MS + IO_MARGIN_MS);
+	expect_done(-1, begin + READ_TIMEOUT_MS + IO_MARGIN_MS);
+}
+
+static void test_connect(void)
+{
+	//The broker name never resolves
+	TickType_t begin = fake_rtos_tick();
+	start(OP_CONNECT, 0, 0);
+	fake_rtos_run_for(DNS_TIMEOUT_MS);
+	expect_done(SOCK_ERR_TIMEOUT, begin + DNS_TIMEOUT_MS);
+
+	//It resolves, then the socket never connects: closed, so the next attempt opens a new one
+	uint32_t closeBefore = closeCalls;
+	begin = fake_rtos_tick();
+	start(OP_CONNECT, 0, 0);
+	winc_event(EVENT_DNS, true);
+	fake_rtos_run_for(0);
+	CHECK(!opDone);
+	CHECK_EQ(module.network.socket, TEST_SOCK);
+	fake_rtos_run_for(CONNECT_TIMEOUT_MS);
+	expect_done(SOCK_ERR_TIMEOUT, begin + CONNECT_TIMEOUT_MS);
+	CHECK_EQ(closeCalls, closeBefore + 1);
+	CHECK_EQ(module.network.socket, -1);
+
+	//Both answer
+	begin = fake_rtos_tick();
+	start(OP_CONNECT, 0, 0);
+	fake_rtos_run_for(EVENT_DELAY_MS);
+	winc_event(EVENT_DNS, true);
+	fake_rtos_run_for(EVENT_DELAY_MS);
+	winc_event(EVENT_CONNECT, true);
+	fake_rtos_run_for(0);
+	expect_done(SOCK_ERR_NO_ERROR, begin + 2 * EVENT_DELAY_MS);
+	CHECK_EQ(module.network.hostIP, TEST_IP);
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	NetworkInit(&module.network);
+	module.network.socket = TEST_SOCK;
+	mqttClientPool[0].mqtt_instance = &module;
+
+	fake_rtos_start(mqtt_task, NULL, 0);
+
+	test_read();
+	test_missed_edge();
+	test_interrupt_in_handler();
+	test_read_timeouts();
+	test_write();
+	module.network.socket = -1;
+	test_connect();
+
+	printf("mqtt wait: OK\n");
+	return 0;
+}
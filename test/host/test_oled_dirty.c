@@ -0,0 +1,185 @@
+/**************************************************************************//**
+* @file      test_oled_dirty.c
+* @brief     Host test of the dirty column tracking of the OLED screen buffer
+* @details   Runs the OLED driver on the mock I2C bus with a model of the SSD1306. Every redraw must send, for each
+			 page, exactly the columns from the first to the last byte that changed, and leave the panel showing the
+			 new screen. The expected bytes are worked out from the bitmaps themselves. Reports the bytes on the wire
+			 for each change between the wait, turns, winner and loser screens, and for a character and a pixel
+			 drawn over a screen.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "host_test.h"
+#include "mock_i2c.h"
+#include "mock_ssd1306.h"
+#include "OLED_Driver/OLED_driver.h"
+#include "OLED_Driver/util/font5x7.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define SCREEN_PAGES		(LCDHEIGHT / 8)
+#define SCREEN_BYTES		(LCDWIDTH * SCREEN_PAGES)
+#define PAGE_WRITE_BYTES(len)	((1 + 4) + (1 + 1 + (len)))	///<Address and page/column commands, then address, control byte and data
+#define FULL_FRAME_BYTES	(SCREEN_PAGES * PAGE_WRITE_BYTES(LCDWIDTH))
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+extern const unsigned char winner[], loser[], Turns[], WAIT[];	///<Game screens of OLED_driver.c
+
+static const unsigned char *const screens[OLED_SCREEN_MAX] = {
+	[OLED_SCREEN_WAIT] = WAIT, [OLED_SCREEN_TURNS] = Turns, [OLED_SCREEN_WINNER] = winner, [OLED_SCREEN_LOSER] = loser,
+};
+static const char *const screenNames[OLED_SCREEN_MAX] = {"wait", "turns", "winner", "loser"};
+
+static uint8_t shown[SCREEN_BYTES];	///<What the panel shows after the last redraw
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///Stub of the console, the driver only prints its init result
+void SerialConsoleWriteString(const char *string)
+{
+}
+
+///Bytes on the wire to go from the shown screen to the next one: one page write per page that changed,
+///from its first to its last changed column
+static uint32_t expected_bytes(const uint8_t *next, uint32_t *pages)
+{
+	uint32_t bytes = 0;
+
+	*pages = 0;
+	for(int page = 0; page < SCREEN_PAGES; page++)
+	{
+		int first = -1, last = -1;
+		for(int column = 0; column < LCDWIDTH; column++)
+		{
+			if(shown[page * LCDWIDTH + column] != next[page * LCDWIDTH + column])
+			{
+				if(first < 0) first = column;
+				last = column;
+			}
+		}
+		if(first >= 0)
+		{
+			bytes += PAGE_WRITE_BYTES(last - first + 1);
+			(*pages)++;
+		}
+	}
+	return bytes;
+}
+
+///Checks that the panel area of the controller RAM shows the bitmap
+static void check_panel(const uint8_t *bitmap)
+{
+	for(int page = 0; page < SCREEN_PAGES; page++)
+	{
+		CHECK(memcmp(&ssd1306Ram[page][SSD1306_PANEL_COLUMN], &bitmap[page * LCDWIDTH], LCDWIDTH) == 0);
+	}
+}
+
+///Flushes the buffer, which must now hold next, and checks the traffic against the model. Returns the bytes sent.
+static uint32_t redraw(const uint8_t *next)
+{
+	uint32_t pages;
+	uint32_t bytes = expected_bytes(next, &pages);
+
+	mock_i2c_reset(ssd1306_device);
+	CHECK_EQ(MicroOLEDdisplay(), ERROR_NONE);
+	CHECK_EQ(mockI2cStats.jobs, pages);
+	CHECK_EQ(mockI2cStats.transfers, 2 * pages);
+	CHECK_EQ(mockI2cStats.bytes, bytes);
+	check_panel(next);
+	memcpy(shown, next, sizeof(shown));
+	return bytes;
+}
+
+static void test_init(void)
+{
+	mock_i2c_reset(ssd1306_device);
+	ssd1306_reset();
+	CHECK_EQ(InitializeOLEDdriver(), ERROR_NONE);
+
+	memset(shown, 0, sizeof(shown));
+	check_panel(shown);
+}
+
+static void test_screens(void)
+{
+	//Every change from one game screen to another, then the same screen again
+	for(int from = 0; from < OLED_SCREEN_MAX; from++)
+	{
+		MicroOLEDloadScreen(from);
+		redraw(screens[from]);
+
+		printf("%-7s ->", screenNames[from]);
+		for(int to = 0; to < OLED_SCREEN_MAX; to++)
+		{
+			MicroOLEDloadScreen(from);
+			redraw(screens[from]);
+
+			MicroOLEDloadScreen(to);
+			uint32_t bytes = redraw(screens[to]);
+			if(to == from) CHECK_EQ(bytes, 0);
+			CHECK(bytes <= FULL_FRAME_BYTES);
+			printf(" %s %u B,", screenNames[to], (unsigned)bytes);
+		}
+		printf(" full frame %u B\n", (unsigned)FULL_FRAME_BYTES);
+	}
+}
+
+static void test_overlay(void)
+{
+	uint8_t next[SCREEN_BYTES];
+	const uint8_t x = 40, page = 2;
+	const uint8_t c = '7';
+
+	MicroOLEDloadScreen(OLED_SCREEN_TURNS);
+	redraw(Turns);
+
+	//A turn counter drawn over the screen: the 5 glyph columns and the blank margin column, in one page
+	memcpy(next, Turns, sizeof(next));
+	for(int i = 0; i < 6; i++)
+	{
+		next[page * LCDWIDTH + x + i] = (i < 5) ? font5x7[FONTHEADERSIZE + c * 5 + i] : 0;
+	}
+	MicroOLEDsetFontType(0);
+	MicroOLEDdrawChar(x, page * 8, c, WHITE, NORM);
+	uint32_t bytes = redraw(next);
+	CHECK(bytes <= PAGE_WRITE_BYTES(6));
+	printf("turns + char: %u B\n", (unsigned)bytes);
+
+	//Drawing it again changes nothing
+	MicroOLEDdrawChar(x, page * 8, c, WHITE, NORM);
+	CHECK_EQ(redraw(next), 0);
+
+	//One pixel flipped in the last page
+	next[5 * LCDWIDTH + LCDWIDTH - 1] ^= 0x80;
+	MicroOLEDpixel(LCDWIDTH - 1, LCDHEIGHT - 1, WHITE, XOR);
+	CHECK_EQ(redraw(next), PAGE_WRITE_BYTES(1));
+
+	//Back to the plain screen: only the windows drawn over are sent
+	MicroOLEDloadScreen(OLED_SCREEN_TURNS);
+	redraw(Turns);
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	test_init();
+	test_screens();
+	test_overlay();
+
+	printf("oled dirty: OK\n");
+	return 0;
+}
@@ -0,0 +1,176 @@
+/**************************************************************************//**
+* @file      test_oled_flush.c
+* @brief     Host test of the page-per-write flush of the OLED screen buffer
+* @details   Runs the OLED driver on the mock I2C bus with a model of the SSD1306, and counts the transfers and bytes
+			 of a full frame. The same frame is also sent the way MicroOLEDdisplay used to (page and column commands,
+			 then one MicroOLEDdata transaction per byte) so the two can be compared, and both must leave the same
+			 pixels in the controller. Also checks MicroOLEDclear(ALL) and that a failed page is sent again.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "host_test.h"
+#include "mock_i2c.h"
+#include "mock_ssd1306.h"
+#include "OLED_Driver/OLED_driver.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define SCREEN_PAGES		(LCDHEIGHT / 8)
+#define SCREEN_BYTES		(LCDWIDTH * SCREEN_PAGES)
+#define PAGE_WRITE_BYTES(len)	((1 + 4) + (1 + 1 + (len)))	///<Address and page/column commands, then address, control byte and data
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+static uint8_t frame[SCREEN_BYTES];
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///Stub of the console, the driver only prints its init result
+void SerialConsoleWriteString(const char *string)
+{
+}
+
+///Checks that the panel area of the controller RAM shows the bitmap
+static void check_panel(const uint8_t *bitmap)
+{
+	for(int page = 0; page < SCREEN_PAGES; page++)
+	{
+		CHECK(memcmp(&ssd1306Ram[page][SSD1306_PANEL_COLUMN], &bitmap[page * LCDWIDTH], LCDWIDTH) == 0);
+	}
+}
+
+///Sends the screen buffer the way MicroOLEDdisplay did before the page writes: one transaction per byte
+static void legacy_display(const uint8_t *bitmap)
+{
+	for(int page = 0; page < SCREEN_PAGES; page++)
+	{
+		MicroOLEDsetPageAddress(page);
+		MicroOLEDsetColumnAddress(0);
+		for(int column = 0; column < LCDWIDTH; column++)
+		{
+			CHECK_EQ(MicroOLEDdata(bitmap[page * LCDWIDTH + column]), ERROR_NONE);
+		}
+	}
+}
+
+static void test_init(void)
+{
+	mock_i2c_reset(ssd1306_device);
+	ssd1306_reset();
+
+	CHECK_EQ(InitializeOLEDdriver(), ERROR_NONE);
+
+	//The whole buffer starts dirty, so the blank screen is sent in full
+	memset(frame, 0, sizeof(frame));
+	check_panel(frame);
+	CHECK_EQ(mockI2cStats.reads, 0);
+}
+
+static void test_full_frame(void)
+{
+	for(int i = 0; i < SCREEN_BYTES; i++)
+	{
+		frame[i] = (uint8_t)(test_rand() | 1);	//Never 0, so every byte differs from the blank screen
+	}
+
+	mock_i2c_reset(ssd1306_device);
+	MicroOLEDloadBitmap(frame);
+	CHECK_EQ(mockI2cStats.transfers, 0);	//Loading only touches the buffer
+	CHECK_EQ(MicroOLEDdisplay(), ERROR_NONE);
+	check_panel(frame);
+
+	struct mock_i2c_stats flush = mockI2cStats;
+	CHECK_EQ(flush.jobs, SCREEN_PAGES);
+	CHECK_EQ(flush.transfers, 2 * SCREEN_PAGES);
+	CHECK_EQ(flush.bytes, SCREEN_PAGES * PAGE_WRITE_BYTES(LCDWIDTH));
+
+	//Nothing changed, nothing sent
+	mock_i2c_reset(ssd1306_device);
+	CHECK_EQ(MicroOLEDdisplay(), ERROR_NONE);
+	CHECK_EQ(mockI2cStats.transfers, 0);
+
+	//Same frame through the old per-byte path
+	ssd1306_reset();
+	mock_i2c_reset(ssd1306_device);
+	legacy_display(frame);
+	check_panel(frame);
+
+	struct mock_i2c_stats legacy = mockI2cStats;
+	CHECK_EQ(legacy.transfers, SCREEN_PAGES * (3 + LCDWIDTH));
+	CHECK_EQ(legacy.bytes, 3 * legacy.transfers);
+
+	//A forced redraw sends the same full frame
+	ssd1306_reset();
+	mock_i2c_reset(ssd1306_device);
+	MicroOLEDinvalidate();
+	CHECK_EQ(MicroOLEDdisplay(), ERROR_NONE);
+	check_panel(frame);
+	CHECK_EQ(mockI2cStats.transfers, flush.transfers);
+	CHECK_EQ(mockI2cStats.bytes, flush.bytes);
+
+	printf("full frame: %u transfers, %u bytes (per byte: %u transfers, %u bytes)\n",
+		(unsigned)flush.transfers, (unsigned)flush.bytes, (unsigned)legacy.transfers, (unsigned)legacy.bytes);
+}
+
+static void test_clear_all(void)
+{
+	mock_i2c_reset(ssd1306_device);
+	CHECK_EQ(MicroOLEDclear(ALL), ERROR_NONE);
+
+	//The whole controller RAM is cleared, the hidden columns and pages too
+	for(int page = 0; page < SSD1306_RAM_PAGES; page++)
+	{
+		for(int column = 0; column < SSD1306_RAM_WIDTH; column++)
+		{
+			CHECK_EQ(ssd1306Ram[page][column], 0);
+		}
+	}
+	CHECK_EQ(mockI2cStats.transfers, 2 * SSD1306_RAM_PAGES);
+	CHECK_EQ(mockI2cStats.bytes, SSD1306_RAM_PAGES * PAGE_WRITE_BYTES(SSD1306_RAM_WIDTH));
+
+	//The buffer still holds the frame, and no longer matches the controller, so all of it is sent again
+	mock_i2c_reset(ssd1306_device);
+	CHECK_EQ(MicroOLEDdisplay(), ERROR_NONE);
+	check_panel(frame);
+	CHECK_EQ(mockI2cStats.transfers, 2 * SCREEN_PAGES);
+}
+
+static void test_failed_page(void)
+{
+	//Fail the data of page 3: pages 0 to 2 are sent, 3 to 5 stay dirty
+	ssd1306_reset();
+	mock_i2c_reset(ssd1306_device);
+	MicroOLEDinvalidate();
+	mockI2cFailTransfer = 2 * 3 + 2;
+	CHECK_EQ(MicroOLEDdisplay(), ERROR_IO);
+	CHECK_EQ(mockI2cStats.jobs, 4);
+
+	mock_i2c_reset(ssd1306_device);
+	CHECK_EQ(MicroOLEDdisplay(), ERROR_NONE);
+	CHECK_EQ(mockI2cStats.jobs, SCREEN_PAGES - 3);
+	check_panel(frame);
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	test_init();
+	test_full_frame();
+	test_clear_all();
+	test_failed_page();
+
+	printf("oled flush: OK\n");
+	return 0;
+}
@@ -0,0 +1,396 @@
+/**************************************************************************//**
+* @file      test_sd_writer.c
+* @brief     Host test of the SD writer thread on FatFs and a disk image, with its download throughput
+* @details   Runs vSdWriterTask on fake_rtos.c with FatFs R0.09 linked in, on a card that is a FAT image in a
+			 temporary file. Each sector the writer thread writes costs SECTOR_WRITE_MS of the fake tick, and the test
+			 is the WiFi thread: it receives a 512 byte chunk every RECV_MS and appends it. Checks that the file on
+			 the card is the one received, that the checkpoints carry the size and CRC32 of what is on the card, and
+			 that receiving overlaps writing, so a download takes about as long as the slower of the two instead of
+			 their sum. Then checks a card slower than the network, a card that stalls, a write error, a full card
+			 and a resume from a checkpoint.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include <unistd.h>
+#include "host_test.h"
+#include "fake_rtos.h"
+#include "fatfs-r0.09/src/diskio.h"
+#include "FreeRTOS_Threads/SdWriterThread/SdWriterThread.h"
+#include "SerialConsole.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define SECTOR_SIZE			512
+#define DISK_SECTORS		4096		///<2 MB card
+#define CHUNK_SIZE			512			///<MAIN_BUFFER_MAX_SIZE, what the HTTP client hands over at a time
+#define RECV_MS				2			///<Time to receive one chunk: 256 kB/s
+#define SECTOR_WRITE_MS		1			///<Time to write one sector: 512 kB/s
+#define IMAGE_SIZE			(160 * 1024 + 300)	///<Not a whole number of buffers
+#define FILE_PATH			"0:IoT.bin"
+#define MAX_CHECKPOINTS		32
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+int host_critical_nesting = 0;
+enum eDebugLogLevels currentDebugLevel = LOG_INFO_LVL;
+enum eDebugLogLevels moduleDebugLevel[N_LOG_MODULES];
+
+static FILE *disk;						///<The card
+static uint32_t sectorWriteMs = SECTOR_WRITE_MS;
+static uint32_t sectorsWritten;			///<By the writer thread
+static uint32_t stallMs;				///<Set, the next write of the writer thread takes this long
+static int32_t sectorsUntilError = -1;	///<Writes of the writer thread that succeed before the card fails. -1 for never.
+
+static uint8_t image[IMAGE_SIZE];
+static FATFS fs;
+
+static uint32_t checkpointBytes[MAX_CHECKPOINTS];
+static crc32_t checkpointCrc[MAX_CHECKPOINTS];
+static uint32_t checkpoints;
+
+static uint32_t pipelinedRate, serialRate;	///<Download throughput in kB/s, with and without the writer thread
+
+/******************************************************************************
+* Disk and firmware stubs
+******************************************************************************/
+///Reference CRC32 of IEEE 802.3, carried on from crc like crc32_recalculate does
+static crc32_t reference_crc(crc32_t crc, const uint8_t *data, uint32_t length)
+{
+	crc = ~crc;
+	for(uint32_t i = 0; i < length; i++)
+	{
+		crc ^= data[i];
+		for(int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320UL : 0);
+	}
+	return ~crc;
+}
+
+enum status_code crc32_recalculate(const void *data, size_t length, crc32_t *crc)
+{
+	*crc = reference_crc(*crc, data, length);
+	return STATUS_OK;
+}
+
+DSTATUS disk_initialize(BYTE drv)
+{
+	return (drv == 0) ? 0 : STA_NOINIT;
+}
+
+DSTATUS disk_status(BYTE drv)
+{
+	return (drv == 0) ? 0 : STA_NOINIT;
+}
+
+DRESULT disk_read(BYTE drv, BYTE *buff, DWORD sector, BYTE count)
+{
+	CHECK(sector + count <= DISK_SECTORS);
+	CHECK(fseek(disk, (long)sector * SECTOR_SIZE, SEEK_SET) == 0);
+	CHECK_EQ(fread(buff, SECTOR_SIZE, count, disk), count);
+	return RES_OK;
+}
+
+///Only the writes of the writer thread take time: the ones of the producer open and close files, between downloads
+DRESULT disk_write(BYTE drv, const BYTE *buff, DWORD sector, BYTE count)
+{
+	CHECK(sector + count <= DISK_SECTORS);
+	if(fake_rtos_in_task())
+	{
+		if(sectorsUntilError >= 0 && (sectorsUntilError -= count) < 0) return RES_ERROR;
+		vTaskDelay(stallMs ? stallMs : count * sectorWriteMs);
+		stallMs = 0;
+		sectorsWritten += count;
+	}
+	CHECK(fseek(disk, (long)sector * SECTOR_SIZE, SEEK_SET) == 0);
+	CHECK_EQ(fwrite(buff, SECTOR_SIZE, count, disk), count);
+	return RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE drv, BYTE ctrl, void *buff)
+{
+	switch(ctrl)
+	{
+		case CTRL_SYNC: CHECK(fflush(disk) == 0); return RES_OK;
+		case GET_SECTOR_COUNT: *(DWORD *)buff = DISK_SECTORS; return RES_OK;
+		case GET_SECTOR_SIZE: *(WORD *)buff = SECTOR_SIZE; return RES_OK;
+		case GET_BLOCK_SIZE: *(DWORD *)buff = 1; return RES_OK;
+		default: return RES_PARERR;
+	}
+}
+
+DWORD get_fattime(void)
+{
+	return ((DWORD)(2021 - 1980) << 25) | ((DWORD)5 << 21) | ((DWORD)14 << 16);
+}
+
+void SerialConsoleWriteString(const char *string)
+{
+}
+
+///Formats the message, so a format that does not match its arguments shows up in the sanitizers
+void LogMessage(enum eDebugLogLevels level, const char *format, ...)
+{
+	char line[256];
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+}
+
+void LogDeferredPost(enum eDebugLogLevels level, const char *format, const uint32_t *args)
+{
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///Checkpoint hook, as the download journal gets it
+static void checkpoint(uint32_t bytes, crc32_t crc)
+{
+	CHECK(checkpoints < MAX_CHECKPOINTS);
+	checkpointBytes[checkpoints] = bytes;
+	checkpointCrc[checkpoints] = crc;
+	checkpoints++;
+}
+
+///Receives image[from, to) a chunk every RECV_MS and appends it, like the HTTP callback. Returns false once an
+///append failed.
+static bool receive(uint32_t from, uint32_t to)
+{
+	for(uint32_t pos = from; pos < to; pos += CHUNK_SIZE)
+	{
+		uint32_t length = (to - pos < CHUNK_SIZE) ? to - pos : CHUNK_SIZE;
+		fake_rtos_run_for(RECV_MS);
+		if(!SdWriterAppend(&image[pos], length)) return false;
+	}
+	return true;
+}
+
+///Checks that the file holds image[0, length) and nothing more
+static void check_file(uint32_t length)
+{
+	static uint8_t data[IMAGE_SIZE];
+	FIL file;
+	UINT read;
+
+	CHECK_EQ(f_open(&file, FILE_PATH, FA_OPEN_EXISTING | FA_READ), FR_OK);
+	CHECK_EQ(f_size(&file), length);
+	CHECK_EQ(f_read(&file, data, sizeof(data), &read), FR_OK);
+	CHECK_EQ(read, length);
+	CHECK(memcmp(data, image, length) == 0);
+	CHECK_EQ(f_close(&file), FR_OK);
+}
+
+///Checks that every checkpoint is the size and CRC32 of the start of the image, and that they are spaced as set
+static void check_checkpoints(uint32_t first, uint32_t last)
+{
+	CHECK(checkpoints > 0);
+	for(uint32_t i = 0; i < checkpoints; i++)
+	{
+		CHECK(checkpointBytes[i] <= IMAGE_SIZE);
+		CHECK_EQ(checkpointCrc[i], reference_crc(0, image, checkpointBytes[i]));
+		if(i > 0 && i < checkpoints - 1)
+		{
+			CHECK(checkpointBytes[i] - checkpointBytes[i - 1] >= SD_WRITER_CHECKPOINT_BYTES);
+		}
+	}
+	CHECK(checkpointBytes[0] >= first);
+	CHECK_EQ(checkpointBytes[checkpoints - 1], last);
+}
+
+static void test_throughput(void)
+{
+	uint32_t chunks = (IMAGE_SIZE + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	TickType_t start = fake_rtos_tick();
+
+	checkpoints = 0;
+	sectorsWritten = 0;
+	CHECK_EQ(SdWriterBegin(FILE_PATH, checkpoint), FR_OK);
+	CHECK(receive(0, IMAGE_SIZE));
+	CHECK_EQ(SdWriterFinish(), FR_OK);
+	TickType_t elapsed = fake_rtos_tick() - start;
+
+	check_file(IMAGE_SIZE);
+	check_checkpoints(SD_WRITER_CHECKPOINT_BYTES, IMAGE_SIZE);
+	CHECK(!SdWriterIsOpen());
+
+	//Receiving the whole image takes longer than writing it. With the writes behind the receive, only the last
+	//buffer is written after the last chunk came in.
+	uint32_t receiveMs = chunks * RECV_MS, writeMs = sectorsWritten * SECTOR_WRITE_MS;
+	CHECK(receiveMs > writeMs);
+	CHECK(elapsed >= receiveMs);
+	CHECK(elapsed <= receiveMs + (SD_WRITER_BUFFER_SIZE / SECTOR_SIZE + 2) * SECTOR_WRITE_MS);
+	CHECK(elapsed < receiveMs + writeMs);
+
+	//Bytes per ms is kB/s
+	pipelinedRate = IMAGE_SIZE / elapsed;
+	serialRate = IMAGE_SIZE / (receiveMs + writeMs);
+}
+
+static void test_slow_card(void)
+{
+	//Now the card is the slower one: the producer waits for a free buffer, and the download goes at its pace
+	sectorWriteMs = 3 * RECV_MS;
+	sectorsWritten = 0;
+	checkpoints = 0;
+	TickType_t start = fake_rtos_tick();
+	CHECK_EQ(SdWriterBegin(FILE_PATH, checkpoint), FR_OK);
+	CHECK(receive(0, IMAGE_SIZE));
+	CHECK_EQ(SdWriterFinish(), FR_OK);
+	TickType_t elapsed = fake_rtos_tick() - start;
+	sectorWriteMs = SECTOR_WRITE_MS;
+
+	check_file(IMAGE_SIZE);
+	check_checkpoints(SD_WRITER_CHECKPOINT_BYTES, IMAGE_SIZE);
+	uint32_t writeMs = sectorsWritten * 3 * RECV_MS;
+	CHECK(elapsed >= writeMs);
+	CHECK(elapsed <= writeMs + SD_WRITER_BUFFER_COUNT * (SD_WRITER_BUFFER_SIZE / CHUNK_SIZE) * RECV_MS);
+}
+
+static void test_stall(void)
+{
+	//A write that takes longer than the producer waits for a buffer fails the file, but does not lose the buffers
+	checkpoints = 0;
+	CHECK_EQ(SdWriterBegin(FILE_PATH, checkpoint), FR_OK);
+	stallMs = 2 * SD_WRITER_WAIT_MS;
+	TickType_t start = fake_rtos_tick();
+	CHECK(!receive(0, IMAGE_SIZE));
+	CHECK(fake_rtos_tick() - start >= SD_WRITER_WAIT_MS);
+	CHECK(!SdWriterAppend(image, CHUNK_SIZE));
+	CHECK_EQ(SdWriterFinish(), FR_TIMEOUT);
+	CHECK(!SdWriterIsOpen());
+	CHECK_EQ(checkpoints, 0);
+
+	//The next file gets every buffer back
+	checkpoints = 0;
+	CHECK_EQ(SdWriterBegin(FILE_PATH, checkpoint), FR_OK);
+	CHECK(receive(0, IMAGE_SIZE));
+	CHECK_EQ(SdWriterFinish(), FR_OK);
+	check_file(IMAGE_SIZE);
+}
+
+static void test_write_error(void)
+{
+	//The card fails halfway: appends fail from then on and no checkpoint claims the bytes that were lost
+	checkpoints = 0;
+	CHECK_EQ(SdWriterBegin(FILE_PATH, checkpoint), FR_OK);
+	sectorsUntilError = (IMAGE_SIZE / 2) / SECTOR_SIZE;
+	CHECK(!receive(0, IMAGE_SIZE));
+	CHECK_EQ(SdWriterFinish(), FR_DISK_ERR);
+	sectorsUntilError = -1;
+	for(uint32_t i = 0; i < checkpoints; i++)
+	{
+		CHECK(checkpointBytes[i] <= IMAGE_SIZE / 2);
+		CHECK_EQ(checkpointCrc[i], reference_crc(0, image, checkpointBytes[i]));
+	}
+}
+
+static void test_card_full(void)
+{
+	static uint8_t filler[16 * 1024];
+	FIL file;
+	UINT written;
+	DWORD freeClusters;
+	FATFS *volume;
+
+	//Another file leaves room for half the image
+	CHECK_EQ(f_unlink(FILE_PATH), FR_OK);
+	CHECK_EQ(f_getfree("0:", &freeClusters, &volume), FR_OK);
+	uint32_t fill = freeClusters * volume->csize * SECTOR_SIZE - IMAGE_SIZE / 2;
+	CHECK_EQ(f_open(&file, "0:Fill.bin", FA_CREATE_ALWAYS | FA_WRITE), FR_OK);
+	for(uint32_t left = fill; left > 0; left -= written)
+	{
+		CHECK_EQ(f_write(&file, filler, (left < sizeof(filler)) ? left : sizeof(filler), &written), FR_OK);
+		CHECK(written > 0);
+	}
+	CHECK_EQ(f_close(&file), FR_OK);
+
+	//The write that does not fit fails the file, and no checkpoint goes past what is on the card
+	checkpoints = 0;
+	CHECK_EQ(SdWriterBegin(FILE_PATH, checkpoint), FR_OK);
+	CHECK(!receive(0, IMAGE_SIZE));
+	CHECK_EQ(SdWriterFinish(), FR_DENIED);
+	for(uint32_t i = 0; i < checkpoints; i++)
+	{
+		CHECK(checkpointBytes[i] <= IMAGE_SIZE / 2);
+		CHECK_EQ(checkpointCrc[i], reference_crc(0, image, checkpointBytes[i]));
+	}
+	CHECK_EQ(f_unlink("0:Fill.bin"), FR_OK);
+}
+
+static void test_resume(void)
+{
+	//The download is cut after a few checkpoints. Whatever came after the last one is on the card too.
+	checkpoints = 0;
+	CHECK_EQ(SdWriterBegin(FILE_PATH, checkpoint), FR_OK);
+	CHECK(receive(0, 3 * SD_WRITER_CHECKPOINT_BYTES + 5000));
+	CHECK_EQ(SdWriterFinish(), FR_OK);
+	CHECK(checkpoints >= 4);
+	uint32_t offset = checkpointBytes[checkpoints - 2];
+	crc32_t crc = checkpointCrc[checkpoints - 2];
+	CHECK_EQ(offset, 3 * SD_WRITER_CHECKPOINT_BYTES);
+
+	//A journal that does not match the file is refused
+	CHECK_EQ(SdWriterResume(FILE_PATH, offset, crc ^ 1, checkpoint), FR_INT_ERR);
+	CHECK_EQ(SdWriterResume(FILE_PATH, IMAGE_SIZE, crc, checkpoint), FR_INT_ERR);
+	CHECK_EQ(SdWriterResume("0:None.bin", offset, crc, checkpoint), FR_NO_FILE);
+	CHECK(!SdWriterIsOpen());
+
+	//Resumed and cut again before the old end of the file: the bytes after the checkpoint are not kept
+	CHECK_EQ(SdWriterResume(FILE_PATH, offset, crc, checkpoint), FR_OK);
+	CHECK(receive(offset, offset + 1000));
+	CHECK_EQ(SdWriterFinish(), FR_OK);
+	check_file(offset + 1000);
+
+	//The rest is appended from the checkpoint, and the CRC32 carries on over the whole file
+	checkpoints = 0;
+	CHECK_EQ(SdWriterResume(FILE_PATH, offset, crc, checkpoint), FR_OK);
+	CHECK_EQ(SdWriterBytesWritten(), offset);
+	CHECK_EQ(SdWriterBegin(FILE_PATH, checkpoint), FR_NOT_READY);
+	CHECK(receive(offset, IMAGE_SIZE));
+	CHECK_EQ(SdWriterFinish(), FR_OK);
+	check_file(IMAGE_SIZE);
+	check_checkpoints(offset + SD_WRITER_CHECKPOINT_BYTES, IMAGE_SIZE);
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	disk = tmpfile();
+	CHECK(disk != NULL);
+	CHECK(ftruncate(fileno(disk), (off_t)DISK_SECTORS * SECTOR_SIZE) == 0);
+	CHECK_EQ(f_mount(0, &fs), FR_OK);
+	CHECK_EQ(f_mkfs(0, 1, 0), FR_OK);
+
+	for(uint32_t i = 0; i < IMAGE_SIZE; i++) image[i] = (uint8_t)test_rand();
+
+	//Nothing can be written before the thread runs
+	CHECK_EQ(SdWriterBegin(FILE_PATH, checkpoint), FR_NOT_READY);
+	fake_rtos_start(vSdWriterTask, NULL, 0);
+	CHECK(!SdWriterAppend(image, CHUNK_SIZE));
+	CHECK_EQ(SdWriterFinish(), FR_NOT_READY);
+
+	test_throughput();
+	test_slow_card();
+	test_stall();
+	test_write_error();
+	test_card_full();
+	test_resume();
+
+	CHECK_EQ(host_critical_nesting, 0);
+	printf("sd writer: OK (%u kB/s, %u kB/s with each chunk written before the next)\n", (unsigned)pipelinedRate,
+		(unsigned)serialRate);
+	fclose(disk);
+	return 0;
+}
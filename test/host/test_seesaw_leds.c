@@ -0,0 +1,208 @@
+/**************************************************************************//**
+* @file      test_seesaw_leds.c
+* @brief     Host benchmark of the Seesaw NeoPixel updates on the mock I2C bus
+* @details   Runs SeesawDriver.c on mock_i2c.c with a model of the Seesaw NeoPixel buffer behind it, and counts the
+			 transfers and bytes of SeesawCommitLeds for one key, one row and the full board, against the way the
+			 driver used to do it: one SEESAW_NEOPIXEL_BUF write per key as it was set, then a SHOW. After each commit
+			 the pixels the model latched must be the colors that were set. Reports the counts and the time they take
+			 on the wire at 400 kHz.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "host_test.h"
+#include "mock_i2c.h"
+#include "SeesawDriver/Seesaw.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define SEESAW_I2C_BUFFER	32		///<Largest write the Seesaw I2C slave takes
+#define BUS_HZ				400000
+#define RANDOM_ROUNDS		1000
+
+///Time on the wire: START, then 9 bits for each byte with its ACK, then STOP
+#define WIRE_US(transfers, bytes)	((((transfers) * 2 + (bytes) * 9) * 1000000ull) / BUS_HZ)
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+int host_critical_nesting = 0;
+
+static uint8_t pixels[NEO_TRELLIS_LED_BYTES];		///<NeoPixel buffer in the Seesaw
+static uint8_t latched[NEO_TRELLIS_LED_BYTES];		///<Colors on the LEDs, copied from pixels on SHOW
+static uint8_t expected[NEO_TRELLIS_LED_BYTES];		///<Colors the test has set, GRB
+static uint32_t shows;
+
+/******************************************************************************
+* Firmware stubs
+******************************************************************************/
+void SerialConsoleWriteString(const char *string)
+{
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///The Seesaw NeoPixel module: BUF writes land in the buffer, SHOW latches it
+static int32_t seesaw_device(uint8_t address, bool read, uint8_t *data, uint16_t len)
+{
+	CHECK_EQ(address, NEO_TRELLIS_ADDR);
+	CHECK(!read);
+	CHECK(len >= 2 && len <= SEESAW_I2C_BUFFER);
+	CHECK_EQ(data[0], SEESAW_NEOPIXEL_BASE);
+
+	if(data[1] == SEESAW_NEOPIXEL_BUF)
+	{
+		CHECK(len > SEESAW_NEOPIXEL_HEADER_SIZE);
+		uint16_t offset = (uint16_t)(data[2] << 8 | data[3]);
+		uint16_t count = len - SEESAW_NEOPIXEL_HEADER_SIZE;
+		CHECK(offset + count <= NEO_TRELLIS_LED_BYTES);
+		memcpy(&pixels[offset], &data[SEESAW_NEOPIXEL_HEADER_SIZE], count);
+	}
+	else
+	{
+		CHECK_EQ(data[1], SEESAW_NEOPIXEL_SHOW);
+		CHECK_EQ(len, 2);
+		memcpy(latched, pixels, sizeof(latched));
+		shows++;
+	}
+	return ERROR_NONE;
+}
+
+static void set_led(uint8_t key, uint8_t red, uint8_t green, uint8_t blue)
+{
+	CHECK_EQ(SeesawSetLed(key, red, green, blue), ERROR_NONE);
+	expected[3 * key] = green;
+	expected[3 * key + 1] = red;
+	expected[3 * key + 2] = blue;
+}
+
+///Commits and checks the LEDs show what was set. Returns the traffic of the commit.
+static struct mock_i2c_stats commit(void)
+{
+	mockI2cStats = (struct mock_i2c_stats){0};
+	CHECK_EQ(SeesawCommitLeds(), ERROR_NONE);
+	CHECK(memcmp(latched, expected, sizeof(expected)) == 0);
+	CHECK_EQ(mockI2cStats.reads, 0);
+	return mockI2cStats;
+}
+
+///Traffic of the same keys sent the old way: one SEESAW_NEOPIXEL_BUF write of one key each, then a SHOW
+static struct mock_i2c_stats per_key_stats(int keys)
+{
+	struct mock_i2c_stats stats = {0};
+
+	stats.jobs = keys + 1;
+	stats.transfers = keys + 1;
+	stats.bytes = keys * (1 + SEESAW_NEOPIXEL_HEADER_SIZE + 3) + (1 + 2);
+	return stats;
+}
+
+///Sets keys first to first + keys - 1 to a new color, commits, and reports against the per key writes
+static void bench(const char *name, uint8_t first, int keys, uint8_t level, uint32_t expectedTransfers)
+{
+	for(int key = first; key < first + keys; key++) set_led((uint8_t)key, level, (uint8_t)(level + key), 0);
+	struct mock_i2c_stats batched = commit();
+	struct mock_i2c_stats perKey = per_key_stats(keys);
+
+	CHECK_EQ(batched.jobs, expectedTransfers != 0);
+	CHECK_EQ(batched.transfers, expectedTransfers);
+	CHECK(batched.bytes <= perKey.bytes);
+	printf("%-10s: %u transfers, %3u B, %4llu us (per key: %2u transfers, %3u B, %4llu us)\n", name,
+		(unsigned)batched.transfers, (unsigned)batched.bytes, WIRE_US(batched.transfers, batched.bytes),
+		(unsigned)perKey.transfers, (unsigned)perKey.bytes, WIRE_US(perKey.transfers, perKey.bytes));
+}
+
+static void test_first_commit(void)
+{
+	//The shadow starts all dirty, so the first commit writes the whole buffer, off, whatever the Seesaw held
+	memset(pixels, 0x5A, sizeof(pixels));
+	struct mock_i2c_stats stats = commit();
+	CHECK_EQ(stats.transfers, SEESAW_NEOPIXEL_MAX_CHUNKS + 1);
+	CHECK_EQ(shows, 1);
+
+	//Nothing changed: nothing is sent
+	stats = commit();
+	CHECK_EQ(stats.jobs, 0);
+	set_led(7, 0, 0, 0);
+	stats = commit();
+	CHECK_EQ(stats.jobs, 0);
+	CHECK_EQ(shows, 1);
+}
+
+static void test_benchmark(void)
+{
+	bench("one key", 5, 1, 40, 2);
+	bench("one row", 4, NEO_TRELLIS_NUM_COLS, 60, 2);
+	bench("full board", 0, NEO_TRELLIS_NUM_KEYS, 80, SEESAW_NEOPIXEL_MAX_CHUNKS + 1);
+
+	//Setting the colors the keys already have is free
+	bench("same board", 0, NEO_TRELLIS_NUM_KEYS, 80, 0);
+}
+
+static void test_bad_key(void)
+{
+	CHECK_EQ(SeesawSetLed(NEO_TRELLIS_NUM_KEYS, 1, 2, 3), ERROR_INVALID_ARG);
+	CHECK_EQ(commit().jobs, 0);
+}
+
+static void test_failed_commit(void)
+{
+	//A commit that fails stays dirty and goes out whole on the next one
+	set_led(0, 1, 2, 3);
+	set_led(15, 4, 5, 6);
+	mockI2cStats = (struct mock_i2c_stats){0};
+	mockI2cFailTransfer = 2;
+	CHECK_EQ(SeesawCommitLeds(), ERROR_IO);
+	CHECK(memcmp(latched, expected, sizeof(expected)) != 0);
+
+	struct mock_i2c_stats stats = commit();
+	CHECK_EQ(stats.transfers, SEESAW_NEOPIXEL_MAX_CHUNKS + 1);
+}
+
+static void test_random(void)
+{
+	//The span between the first and last change may hold keys that did not change. They go out with their
+	//current color, so the LEDs always match what was set.
+	for(int round = 0; round < RANDOM_ROUNDS; round++)
+	{
+		int changes = test_rand() % 5;
+		for(int i = 0; i < changes; i++)
+		{
+			set_led((uint8_t)(test_rand() % NEO_TRELLIS_NUM_KEYS), (uint8_t)test_rand(), (uint8_t)test_rand(),
+				(uint8_t)test_rand());
+		}
+		struct mock_i2c_stats stats = commit();
+		CHECK(stats.transfers <= SEESAW_NEOPIXEL_MAX_CHUNKS + 1);
+		CHECK(stats.jobs <= 1);
+	}
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	mock_i2c_reset(seesaw_device);
+
+	test_first_commit();
+	test_benchmark();
+	test_bad_key();
+	test_failed_commit();
+	test_random();
+
+	printf("seesaw leds: OK\n");
+	return 0;
+}
@@ -0,0 +1,159 @@
+/**************************************************************************//**
+* @file      test_serial_console.c
+* @brief     Host test of the TX engine of the Serial Console on a fake USART and DMAC
+* @details   Runs SerialConsole.c on fake_uart.c, a model of SERCOM4 at 115200 8N1 and of the DMA channel that feeds
+			 it, which counts the TX interrupts the way the SAMD21 takes them. Log lines are written in bursts faster
+			 than the line and in a trickle, and every byte must come out once and in order, with no gap on the line
+			 while text is waiting. Reports the interrupts and job starts per kB of log output, with the DMAC and
+			 with the usart job fallback, and checks that a full ring drops new text and not the span on the wire.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "host_test.h"
+#include "fake_rtos.h"
+#include "fake_uart.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define BYTE_NS			FAKE_UART_BYTE_NS
+#define TX_RING_SIZE	FAKE_UART_TX_RING_SIZE
+#define WIRE_SIZE		FAKE_UART_WIRE_SIZE
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///Interrupts and job starts of one test
+struct tx_stats
+{
+	uint32_t bytes;
+	uint32_t interrupts;
+	uint32_t starts;
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+int host_critical_nesting = 0;
+
+static uint8_t sent[WIRE_SIZE];			///<Text given to SerialConsoleWriteString
+static uint32_t sentLen;
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///Writes a log line of len random characters
+static void write_line(uint32_t len)
+{
+	char line[128];
+
+	CHECK(len < sizeof(line));
+	for(uint32_t i = 0; i < len; i++)
+	{
+		line[i] = (char)(' ' + test_rand() % 95);
+	}
+	line[len] = '\0';
+	CHECK(sentLen + len <= WIRE_SIZE);
+	memcpy(sent + sentLen, line, len);
+	sentLen += len;
+	SerialConsoleWriteString(line);
+	CHECK_EQ(fakeRtosSchedulerSuspended, 0);
+	CHECK_EQ(host_critical_nesting, 0);
+}
+
+static void start(bool useDma)
+{
+	fake_uart_reset(useDma);
+	InitializeSerialConsole();
+	CHECK(fake_uart_reading());
+	CHECK(useDma == fake_uart_dma_allocated());
+	sentLen = 0;
+}
+
+///Log output in bursts faster than the line, and in a trickle. Checks the text on the line and returns the counts.
+static struct tx_stats run_log(bool useDma)
+{
+	start(useDma);
+
+	for(int burst = 0; burst < 200; burst++)
+	{
+		//A burst of lines from several threads, more than the line can take meanwhile but never more than the ring
+		uint64_t startNs = (fakeUartLineFreeNs > fakeUartNowNs) ? fakeUartLineFreeNs : fakeUartNowNs;
+		uint32_t before = fakeUartWireLen, queued = 0;
+		while(queued < TX_RING_SIZE - 200)
+		{
+			uint32_t len = 20 + test_rand() % 80;
+			write_line(len);
+			queued += len;
+			fake_uart_run(BYTE_NS * (test_rand() % 8));
+		}
+		fake_uart_drain();
+
+		//The next span is started from the completion of the last one, so the line never waits for the writers
+		CHECK_EQ(fakeUartLineFreeNs, startNs + (uint64_t)(fakeUartWireLen - before) * BYTE_NS);
+
+		//Then single lines, each sent on its own
+		for(int i = 0; i < 4; i++)
+		{
+			uint32_t startsBefore = fakeUartStats.starts, len = 20 + test_rand() % 80, at = sentLen % TX_RING_SIZE;
+			write_line(len);
+			fake_uart_drain();
+			CHECK_EQ(fakeUartStats.starts, startsBefore + ((at + len > TX_RING_SIZE) ? 2 : 1));	//Two if it wraps
+			fake_uart_run(BYTE_NS * 100);
+		}
+	}
+
+	CHECK_EQ(fakeUartWireLen, sentLen);
+	CHECK(memcmp(fakeUartWire, sent, sentLen) == 0);
+	CHECK_EQ(SerialConsoleGetTxOverflow(), 0);
+	return (struct tx_stats){sentLen, fakeUartStats.interrupts, fakeUartStats.starts};
+}
+
+static void test_overflow(void)
+{
+	uint8_t first[TX_RING_SIZE];
+
+	//The ring is filled in one go while the line is idle. The text that does not fit is dropped.
+	start(true);
+	for(int i = 0; i < 6; i++)
+	{
+		write_line(100);
+	}
+	memcpy(first, sent, TX_RING_SIZE);
+	CHECK_EQ(SerialConsoleGetTxOverflow(), 600 - TX_RING_SIZE);
+
+	//The span on the line stays in the ring until it is out, so text written meanwhile cannot overwrite it
+	fake_uart_run(BYTE_NS * 10);
+	write_line(100);
+	CHECK_EQ(SerialConsoleGetTxOverflow(), 700 - TX_RING_SIZE);
+	fake_uart_drain();
+	CHECK_EQ(fakeUartWireLen, TX_RING_SIZE);
+	CHECK(memcmp(fakeUartWire, first, TX_RING_SIZE) == 0);
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	struct tx_stats viaDma = run_log(true);
+	struct tx_stats viaJobs = run_log(false);
+	test_overflow();
+
+	//One interrupt per span with the DMAC, one per byte and one per span with usart write jobs
+	CHECK_EQ(viaDma.interrupts, viaDma.starts);
+	CHECK_EQ(viaJobs.interrupts, viaJobs.bytes + viaJobs.starts);
+	CHECK(viaDma.starts * 40 < viaDma.bytes);
+
+	printf("serial console: OK (per kB: %u interrupts and %u DMA starts, %u interrupts and %u usart jobs without the "
+		"DMAC)\n", (unsigned)(viaDma.interrupts * 1024ull / viaDma.bytes), (unsigned)(viaDma.starts * 1024ull / viaDma.bytes),
+		(unsigned)(viaJobs.interrupts * 1024ull / viaJobs.bytes), (unsigned)(viaJobs.starts * 1024ull / viaJobs.bytes));
+	return 0;
+}
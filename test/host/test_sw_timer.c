@@ -0,0 +1,219 @@
+/**************************************************************************//**
+* @file      test_sw_timer.c
+* @brief     Host test of the cached deadline of the software timers
+* @details   sw_timer.c is built into this file, so the test can move its tick counter by hand. Timers are
+			 enabled, disabled and re-armed from their callback at random while the tick advances, starting just
+			 before the counter wraps. Every call of sw_timer_task is checked against a plain model that scans
+			 all the timers on every tick: the same callbacks must fire at the same ticks, and
+			 sw_timer_next_deadline must never report a time later than the next real expiry.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+//More timers than the firmware uses, so the scan for the next deadline has something to pick from
+#define CONF_SW_TIMER_H_INCLUDED
+#define CONF_SW_TIMER_COUNT		4
+
+#include "host_test.h"
+#include "iot/sw_timer.c"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define TEST_ACCURACY	100		///<Milliseconds per tick
+#define TEST_STEPS		200000	///<Random operations
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///What the model expects of one timer
+struct model_timer
+{
+	bool enabled;
+	uint32_t expire;	///<Tick after which it fires
+	uint32_t period;	///<In ticks, 0 for a one shot
+	bool rearm;			///<Callback enables the timer again
+	uint32_t rearmMs;	///<Delay given when it does
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+static struct sw_timer_module timer;
+static struct model_timer model[CONF_SW_TIMER_COUNT];
+static uint32_t firedMask;		///<Timers whose callback ran during the last sw_timer_task
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+static void timer_callback(struct sw_timer_module *const module, int timer_id, void *context, int period)
+{
+	struct model_timer *m = context;
+
+	CHECK(module == &timer);
+	CHECK(m == &model[timer_id]);
+	CHECK(!(firedMask & (1u << timer_id)));	//Once per sw_timer_task
+	firedMask |= 1u << timer_id;
+
+	if(m->rearm)
+	{
+		sw_timer_enable_callback(module, timer_id, m->rearmMs);
+	}
+}
+
+///Time left until the first model timer fires, like sw_timer_next_deadline computes it
+static uint32_t model_next_deadline(void)
+{
+	uint32_t best = SW_TIMER_NO_DEADLINE;
+	for(int i = 0; i < CONF_SW_TIMER_COUNT; i++)
+	{
+		if(!model[i].enabled) continue;
+		int ticks = (int)(model[i].expire - sw_timer_tick) + 1;
+		uint32_t ms = (ticks <= 0) ? 0 : (uint32_t)ticks * TEST_ACCURACY;
+		if(ms < best) best = ms;
+	}
+	return best;
+}
+
+///Runs sw_timer_task and checks it fired exactly the timers the model says are due
+static void run_task(void)
+{
+	uint32_t due = 0;
+
+	for(int i = 0; i < CONF_SW_TIMER_COUNT; i++)
+	{
+		if(model[i].enabled && (int)(model[i].expire - sw_timer_tick) < 0)
+		{
+			due |= 1u << i;
+		}
+	}
+
+	firedMask = 0;
+	sw_timer_task(&timer);
+	CHECK_EQ(firedMask, due);
+
+	for(int i = 0; i < CONF_SW_TIMER_COUNT; i++)
+	{
+		if(!(due & (1u << i))) continue;
+		if(model[i].period > 0)
+		{
+			model[i].expire = sw_timer_tick + model[i].period;
+		}
+		else
+		{
+			model[i].enabled = false;
+		}
+		if(model[i].rearm)
+		{
+			model[i].enabled = true;
+			model[i].expire = sw_timer_tick + model[i].rearmMs / TEST_ACCURACY;
+		}
+	}
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	struct sw_timer_config config;
+	uint32_t firings = 0;
+
+	sw_timer_get_config_defaults(&config);
+	config.accuracy = TEST_ACCURACY;
+	sw_timer_init(&timer, &config);
+	sw_timer_tick = 0xFFFFF000u;	//The tick wraps around 2^32 during the run
+
+	//Nothing enabled: no deadline, nothing to do
+	CHECK_EQ(sw_timer_next_deadline(&timer), SW_TIMER_NO_DEADLINE);
+	run_task();
+
+	//Timers 0 and 1 periodic, 2 one shot, 3 one shot that re-arms itself
+	for(int i = 0; i < CONF_SW_TIMER_COUNT; i++)
+	{
+		uint32_t period = (i < 2) ? (uint32_t)(i + 1) * 300 : 0;
+		CHECK_EQ(sw_timer_register_callback(&timer, timer_callback, &model[i], period), i);
+		model[i].period = period / TEST_ACCURACY;
+		model[i].rearm = (i == 3);
+	}
+	CHECK_EQ(sw_timer_register_callback(&timer, timer_callback, NULL, 0), -1);	//All used
+
+	//A one shot fires once, on the first task after its expire tick has passed
+	sw_timer_enable_callback(&timer, 2, 500);
+	model[2].enabled = true;
+	model[2].expire = sw_timer_tick + 5;
+	CHECK_EQ(sw_timer_next_deadline(&timer), 600);
+	for(int i = 0; i < 5; i++)
+	{
+		sw_timer_tick++;
+		run_task();
+	}
+	CHECK(model[2].enabled);
+	sw_timer_tick++;
+	run_task();
+	CHECK(!model[2].enabled);
+	CHECK_EQ(sw_timer_next_deadline(&timer), SW_TIMER_NO_DEADLINE);
+
+	for(int step = 0; step < TEST_STEPS; step++)
+	{
+		int id = test_rand() % CONF_SW_TIMER_COUNT;
+		switch(test_rand() % 8)
+		{
+			case 0:
+			case 1:
+			{
+				uint32_t delayMs = test_rand() % 2000;
+				sw_timer_enable_callback(&timer, id, delayMs);
+				model[id].enabled = true;
+				model[id].expire = sw_timer_tick + delayMs / TEST_ACCURACY;
+				if(model[id].rearm) model[id].rearmMs = test_rand() % 1000;
+				break;
+			}
+			case 2:
+				sw_timer_disable_callback(&timer, id);
+				model[id].enabled = false;
+				break;
+			case 3:
+				if(model[3].rearm && (test_rand() % 8) == 0)
+				{
+					model[3].rearm = false;	//Let the re-arming timer stop at its next firing now and then
+				}
+				else
+				{
+					model[3].rearm = true;
+				}
+				break;
+			default:
+				sw_timer_tick += test_rand() % 4;
+				break;
+		}
+
+		//The cached deadline may be early (a timer was disabled since), never late
+		uint32_t reported = sw_timer_next_deadline(&timer);
+		uint32_t real = model_next_deadline();
+		CHECK(reported <= real);
+
+		//sw_timer_task only scans the timers once the cached deadline has passed. The scan makes it exact again.
+		bool scans = timer.deadline_valid && (int)(timer.deadline - sw_timer_tick) < 0;
+		run_task();
+		firings += __builtin_popcount(firedMask);
+		if(scans)
+		{
+			CHECK_EQ(sw_timer_next_deadline(&timer), model_next_deadline());
+		}
+		else
+		{
+			CHECK(sw_timer_next_deadline(&timer) <= model_next_deadline());
+		}
+	}
+
+	CHECK(sw_timer_tick < 0xFFFFF000u);	//Really wrapped
+	CHECK(firings > TEST_STEPS / 10);		//The timers did fire a lot
+	printf("sw timer: OK (%u callbacks)\n", firings);
+	return 0;
+}
@@ -0,0 +1,279 @@
+/**************************************************************************//**
+* @file      test_ui_keypad.c
+* @brief     Host test of the UI thread keypad latency, polled and woken by the Seesaw INT line
+* @details   Runs vUiHandlerTask on fake_rtos.c against a model of the Seesaw keypad FIFO. In the INT mode the model
+			 notifies the task when the FIFO goes from empty to non-empty, as the EIC callback does on the falling
+			 edge of INT, and never again until the FIFO has been read empty. Presses come at random ticks during
+			 the player's turn; the test checks the tick the key is lit against the tick it was pressed, that events
+			 arriving while the FIFO is read are not left behind for want of a new edge, and that the releases end up
+			 in gamePacketOut in order. Reports the press latency and the keypad reads made while idle.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "host_test.h"
+#include "fake_rtos.h"
+#include "FreeRTOS_Threads/UiHandlerThread/UiHandlerThread.h"
+#include "SeesawDriver/Seesaw.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define FIFO_SIZE		32		///<Events the Seesaw keypad FIFO holds
+#define TURN_KEYS		8		///<Moves the player enters in one turn
+#define TURN_ROUNDS		20
+#define PRESS_TICKS		100		///<Time a key is held down
+#define PRESS_GAP_MAX	200		///<Longest time between the release of a key and the next press
+#define IDLE_TICKS		10000
+
+#define EVENT_PRESS(key)	((uint8_t)((NEO_TRELLIS_KEY(key) << 2) | SEESAW_KEYPAD_EDGE_RISING))
+#define EVENT_RELEASE(key)	((uint8_t)((NEO_TRELLIS_KEY(key) << 2) | SEESAW_KEYPAD_EDGE_FALLING))
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+int host_critical_nesting = 0;
+
+extern uiStateMachine_state uiState;
+extern struct GameDataPacket gamePacketOut;
+extern uint8_t pressedKeys;
+extern uint8_t keysToPress;
+
+static uint8_t fifo[FIFO_SIZE];
+static int fifoCount;
+static bool intMode;					///<The INT line wakes the task
+static TaskHandle_t keypadTask;			///<Task given to SeesawRegisterKeypadNotify
+static uint8_t lateEvents[2];			///<Events that reach the FIFO while the next read is on the bus
+static int lateCount;
+
+static bool ledPending[NEO_TRELLIS_NUM_KEYS];
+static bool ledOn[NEO_TRELLIS_NUM_KEYS];
+static TickType_t litTick[NEO_TRELLIS_NUM_KEYS];	///<Tick at which each key was last lit
+
+static uint32_t countReads, fifoReads, edges, playDone;
+
+/******************************************************************************
+* Seesaw and firmware stubs
+******************************************************************************/
+void SeesawRegisterKeypadNotify(TaskHandle_t task)
+{
+	keypadTask = task;
+}
+
+bool SeesawKeypadHasEvents(void)
+{
+	//Without the INT line the driver cannot know, as in the firmware
+	return intMode && fifoCount != 0;
+}
+
+uint8_t SeesawGetKeypadCount(void)
+{
+	countReads++;
+	return (uint8_t)fifoCount;
+}
+
+int32_t SeesawReadKeypad(uint8_t *buffer, uint8_t count)
+{
+	fifoReads++;
+	CHECK(count <= fifoCount);
+
+	//The late events land behind the ones being read, while INT is still low: no new edge
+	for(int i = 0; i < lateCount; i++) fifo[fifoCount++] = lateEvents[i];
+	lateCount = 0;
+
+	memcpy(buffer, fifo, count);
+	fifoCount -= count;
+	memmove(fifo, fifo + count, fifoCount);
+	return ERROR_NONE;
+}
+
+int32_t SeesawSetLed(uint8_t key, uint8_t red, uint8_t green, uint8_t blue)
+{
+	CHECK(key < NEO_TRELLIS_NUM_KEYS);
+	ledPending[key] = (red | green | blue) != 0;
+	return ERROR_NONE;
+}
+
+int32_t SeesawOrderLedUpdate(void)
+{
+	for(int key = 0; key < NEO_TRELLIS_NUM_KEYS; key++)
+	{
+		if(ledPending[key] && !ledOn[key]) litTick[key] = xTaskGetTickCount();
+		ledOn[key] = ledPending[key];
+	}
+	return ERROR_NONE;
+}
+
+int32_t SeesawCommitLeds(void)
+{
+	return SeesawOrderLedUpdate();
+}
+
+void ControlNotifyPlayDone(void)
+{
+	playDone++;
+}
+
+void SerialConsoleWriteString(const char *string)
+{
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///An event enters the FIFO. The INT line only falls, and the EIC callback only notifies, if the FIFO was empty.
+static void keypad_event(uint8_t event)
+{
+	CHECK(fifoCount < FIFO_SIZE);
+	fifo[fifoCount++] = event;
+	if(intMode && fifoCount == 1)
+	{
+		BaseType_t woken = pdFALSE;
+		edges++;
+		vTaskNotifyGiveFromISR(keypadTask, &woken);
+	}
+}
+
+///Starts a turn of TURN_KEYS moves, as UiPlaybackStart leaves it once the moves have been shown
+static void start_turn(void)
+{
+	memset(gamePacketOut.game, 0xff, sizeof(gamePacketOut.game));
+	pressedKeys = 0;
+	keysToPress = TURN_KEYS;
+	uiState = UI_STATE_HANDLE_BUTTONS;
+}
+
+///Plays TURN_ROUNDS turns with presses at random ticks. Returns the worst press to LED latency.
+static TickType_t play_turns(bool useInt, uint32_t *totalLatency)
+{
+	TickType_t worst = 0;
+
+	intMode = useInt;
+	*totalLatency = 0;
+	for(int round = 0; round < TURN_ROUNDS; round++)
+	{
+		uint32_t doneBefore = playDone;
+		start_turn();
+
+		for(int i = 0; i < TURN_KEYS; i++)
+		{
+			uint8_t key = (uint8_t)((round + i) % NEO_TRELLIS_NUM_KEYS);
+
+			fake_rtos_run_for(1 + test_rand() % PRESS_GAP_MAX);
+			TickType_t pressed = fake_rtos_tick();
+			keypad_event(EVENT_PRESS(key));
+
+			//Run to the release and check the key came on in between
+			fake_rtos_run_for(PRESS_TICKS);
+			CHECK(ledOn[key]);
+			TickType_t latency = litTick[key] - pressed;
+			CHECK(latency <= UI_KEYPAD_POLL_MS);
+			if(useInt) CHECK_EQ(latency, 0);
+			if(latency > worst) worst = latency;
+			*totalLatency += latency;
+
+			keypad_event(EVENT_RELEASE(key));
+		}
+		fake_rtos_run_for(UI_KEYPAD_POLL_MS);
+
+		//Every release counts, in order, and the turn ends once
+		CHECK_EQ(playDone, doneBefore + 1);
+		CHECK_EQ(uiState, UI_STATE_IGNORE_PRESSES);
+		CHECK_EQ(pressedKeys, TURN_KEYS);
+		for(int i = 0; i < TURN_KEYS; i++) CHECK_EQ(gamePacketOut.game[i], (round + i) % NEO_TRELLIS_NUM_KEYS);
+		CHECK_EQ(gamePacketOut.game[TURN_KEYS], 0xff);
+		for(int key = 0; key < NEO_TRELLIS_NUM_KEYS; key++) CHECK(!ledOn[key]);
+		CHECK_EQ(fifoCount, 0);
+	}
+	return worst;
+}
+
+static void test_latency(void)
+{
+	uint32_t pollTotal, intTotal;
+
+	TickType_t pollWorst = play_turns(false, &pollTotal);
+	TickType_t intWorst = play_turns(true, &intTotal);
+
+	printf("press to LED: polled %u ms worst, %u ms mean; INT %u ms worst, %u ms mean\n", (unsigned)pollWorst,
+		(unsigned)(pollTotal / (TURN_ROUNDS * TURN_KEYS)), (unsigned)intWorst, (unsigned)(intTotal / (TURN_ROUNDS * TURN_KEYS)));
+}
+
+static void test_events_during_read(void)
+{
+	//A press and its release land in the FIFO while the press before them is read. INT never goes high in between,
+	//so there is no new edge: the task must go around again on its own, at the same tick.
+	intMode = true;
+	start_turn();
+	keysToPress = 2;
+	fake_rtos_run_for(10);
+
+	uint32_t edgesBefore = edges;
+	TickType_t pressed = fake_rtos_tick();
+	lateEvents[0] = EVENT_RELEASE(3);
+	lateEvents[1] = EVENT_PRESS(4);
+	lateCount = 2;
+	keypad_event(EVENT_PRESS(3));
+	fake_rtos_run_for(0);
+	CHECK_EQ(edges, edgesBefore + 1);
+	CHECK_EQ(fifoCount, 0);
+	CHECK_EQ(litTick[4], pressed);
+	CHECK(ledOn[4]);
+	CHECK_EQ(pressedKeys, 1);
+
+	keypad_event(EVENT_RELEASE(4));
+	fake_rtos_run_for(0);
+	CHECK_EQ(uiState, UI_STATE_IGNORE_PRESSES);
+	CHECK_EQ(gamePacketOut.game[0], 3);
+	CHECK_EQ(gamePacketOut.game[1], 4);
+}
+
+static void test_idle(void)
+{
+	//Outside the player's turn the task wakes only to empty the FIFO, and for the poll timeout
+	for(int useInt = 0; useInt < 2; useInt++)
+	{
+		intMode = useInt;
+		uiState = UI_STATE_IGNORE_PRESSES;
+		fake_rtos_run_for(UI_KEYPAD_POLL_MS);
+
+		uint32_t wakeupsBefore = fakeRtosWakeups, readsBefore = countReads;
+		fake_rtos_run_for(IDLE_TICKS);
+		uint32_t wakeups = fakeRtosWakeups - wakeupsBefore, reads = countReads - readsBefore;
+		CHECK_EQ(wakeups, IDLE_TICKS / UI_KEYPAD_POLL_MS);
+		CHECK_EQ(reads, wakeups);
+
+		//Presses while idle are thrown away
+		keypad_event(EVENT_PRESS(5));
+		fake_rtos_run_for(UI_KEYPAD_POLL_MS);
+		CHECK_EQ(fifoCount, 0);
+		CHECK(!ledOn[5]);
+
+		printf("%s idle: %u wakeups/s, %u keypad count reads/s\n", useInt ? "INT   " : "polled",
+			(unsigned)(wakeups * 1000 / IDLE_TICKS), (unsigned)(reads * 1000 / IDLE_TICKS));
+	}
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	fake_rtos_start(vUiHandlerTask, NULL, 0);
+	CHECK(keypadTask == xTaskGetCurrentTaskHandle());
+	CHECK_EQ(uiState, UI_STATE_IGNORE_PRESSES);
+
+	test_latency();
+	test_events_during_read();
+	test_idle();
+
+	printf("ui keypad: OK\n");
+	return 0;
+}
@@ -0,0 +1,295 @@
+/**************************************************************************//**
+* @file      test_ui_playback.c
+* @brief     Host test of the UI thread move playback on a simulated clock
+* @details   Runs vUiHandlerTask on fake_rtos.c and hands it sequences of 1 to GAME_SIZE moves with UiOrderShowMoves.
+			 Every LED change the task commits is logged with its tick, and the log must follow the schedule exactly:
+			 each move lit for the on time, then dark for the off time, both shrinking by UI_PLAYBACK_SPEEDUP_MS per
+			 extra move down to their minimums, and the player's turn starting when the last gap ends. Also checks the
+			 task wakes once per LED change and no more, that presses during the playback do not count, and that a
+			 packet arriving mid-playback turns off the lit move and starts over. Reports the timing per length.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "host_test.h"
+#include "fake_rtos.h"
+#include "FreeRTOS_Threads/UiHandlerThread/UiHandlerThread.h"
+#include "SeesawDriver/Seesaw.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define LOG_SIZE		(2 * GAME_SIZE + 2)
+#define FIFO_SIZE		32
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///One LED change the task sent to the keypad
+struct led_change
+{
+	TickType_t tick;
+	uint8_t key;
+	bool on;
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+int host_critical_nesting = 0;
+
+extern uiStateMachine_state uiState;
+extern uint8_t pressedKeys;
+extern uint8_t keysToPress;
+
+static bool ledPending[NEO_TRELLIS_NUM_KEYS];
+static bool ledOn[NEO_TRELLIS_NUM_KEYS];
+static struct led_change ledLog[LOG_SIZE];
+static int ledLogCount;
+
+static uint8_t fifo[FIFO_SIZE];
+static int fifoCount;
+static TickType_t turnTick;		///<Tick of the first keypad read of the player's turn
+static bool turnStarted;
+
+/******************************************************************************
+* Seesaw and firmware stubs
+******************************************************************************/
+void SeesawRegisterKeypadNotify(TaskHandle_t task)
+{
+}
+
+bool SeesawKeypadHasEvents(void)
+{
+	return false;
+}
+
+uint8_t SeesawGetKeypadCount(void)
+{
+	if(uiState == UI_STATE_HANDLE_BUTTONS && !turnStarted)
+	{
+		turnStarted = true;
+		turnTick = xTaskGetTickCount();
+	}
+	return (uint8_t)fifoCount;
+}
+
+int32_t SeesawReadKeypad(uint8_t *buffer, uint8_t count)
+{
+	CHECK(count <= fifoCount);
+	memcpy(buffer, fifo, count);
+	fifoCount -= count;
+	memmove(fifo, fifo + count, fifoCount);
+	return ERROR_NONE;
+}
+
+int32_t SeesawSetLed(uint8_t key, uint8_t red, uint8_t green, uint8_t blue)
+{
+	CHECK(key < NEO_TRELLIS_NUM_KEYS);
+	ledPending[key] = (red | green | blue) != 0;
+	return ERROR_NONE;
+}
+
+int32_t SeesawCommitLeds(void)
+{
+	for(uint8_t key = 0; key < NEO_TRELLIS_NUM_KEYS; key++)
+	{
+		if(ledPending[key] == ledOn[key]) continue;
+		CHECK(ledLogCount < LOG_SIZE);
+		ledLog[ledLogCount++] = (struct led_change){.tick = xTaskGetTickCount(), .key = key, .on = ledPending[key]};
+		ledOn[key] = ledPending[key];
+	}
+	return ERROR_NONE;
+}
+
+int32_t SeesawOrderLedUpdate(void)
+{
+	return SeesawCommitLeds();
+}
+
+void ControlNotifyPlayDone(void)
+{
+}
+
+void SerialConsoleWriteString(const char *string)
+{
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+///On and off times the playback must use for a sequence of moves
+static void expected_times(int moves, TickType_t *on, TickType_t *off)
+{
+	int speedUp = (moves - 1) * UI_PLAYBACK_SPEEDUP_MS;
+	int onMs = UI_PLAYBACK_ON_MS - speedUp, offMs = UI_PLAYBACK_OFF_MS - speedUp;
+
+	*on = pdMS_TO_TICKS((onMs > UI_PLAYBACK_ON_MIN_MS) ? onMs : UI_PLAYBACK_ON_MIN_MS);
+	*off = pdMS_TO_TICKS((offMs > UI_PLAYBACK_OFF_MIN_MS) ? offMs : UI_PLAYBACK_OFF_MIN_MS);
+}
+
+static void make_packet(struct GameDataPacket *packet, int moves, int seed)
+{
+	memset(packet->game, 0xff, sizeof(packet->game));
+	for(int i = 0; i < moves; i++) packet->game[i] = (uint8_t)((seed + 7 * i) % NEO_TRELLIS_NUM_KEYS);
+}
+
+///Puts the UI back to ignoring presses, as it is after a turn
+static void end_turn(void)
+{
+	uiState = UI_STATE_IGNORE_PRESSES;
+	fake_rtos_run_for(UI_KEYPAD_POLL_MS);
+	ledLogCount = 0;
+	turnStarted = false;
+}
+
+///Checks ledLog from entry first holds the playback of packet started at start. Returns the tick the turn is due.
+static TickType_t check_schedule(const struct GameDataPacket *packet, int moves, int first, TickType_t start)
+{
+	TickType_t on, off;
+
+	expected_times(moves, &on, &off);
+	CHECK_EQ(ledLogCount, first + 2 * moves);
+	for(int i = 0; i < moves; i++)
+	{
+		const struct led_change *lit = &ledLog[first + 2 * i], *dark = &ledLog[first + 2 * i + 1];
+		TickType_t due = start + i * (on + off);
+
+		CHECK(lit->on);
+		CHECK_EQ(lit->key, packet->game[i]);
+		CHECK_EQ(lit->tick, due);
+		CHECK(!dark->on);
+		CHECK_EQ(dark->key, packet->game[i]);
+		CHECK_EQ(dark->tick, due + on);
+	}
+	return start + moves * (on + off);
+}
+
+static void test_schedule(void)
+{
+	struct GameDataPacket packet;
+	TickType_t lastOn = UI_PLAYBACK_ON_MS, lastOff = UI_PLAYBACK_OFF_MS;
+
+	for(int moves = 1; moves <= GAME_SIZE; moves++)
+	{
+		TickType_t on, off;
+		expected_times(moves, &on, &off);
+
+		make_packet(&packet, moves, moves);
+		fake_rtos_run_for(1 + test_rand() % UI_KEYPAD_POLL_MS);
+		TickType_t start = fake_rtos_tick();
+		uint32_t wakeupsBefore = fakeRtosWakeups;
+		UiOrderShowMoves(&packet);
+
+		//Run to one tick before the turn: nothing may start early
+		TickType_t turn = start + moves * (on + off);
+		fake_rtos_run_until(turn - 1);
+		CHECK_EQ(uiState, UI_STATE_SHOW_MOVES);
+		CHECK(!turnStarted);
+
+		//The notification, then one wake up per LED change, then the end of the last gap
+		fake_rtos_run_until(turn);
+		CHECK_EQ(fakeRtosWakeups - wakeupsBefore, 2 * moves + 1);
+		CHECK_EQ(check_schedule(&packet, moves, 0, start), turn);
+		CHECK_EQ(uiState, UI_STATE_HANDLE_BUTTONS);
+		CHECK(turnStarted);
+		CHECK_EQ(turnTick, turn);
+		CHECK_EQ(keysToPress, moves + 1);
+		CHECK_EQ(pressedKeys, 0);
+
+		//Faster as the sequence grows, down to the minimums
+		CHECK(on <= lastOn && off <= lastOff);
+		CHECK(on >= UI_PLAYBACK_ON_MIN_MS && off >= UI_PLAYBACK_OFF_MIN_MS);
+		if(moves == 1) CHECK(on == UI_PLAYBACK_ON_MS && off == UI_PLAYBACK_OFF_MS);
+		lastOn = on;
+		lastOff = off;
+		if(moves == 1 || moves % 5 == 0)
+		{
+			printf("%2d moves: on %4u ms, off %3u ms, playback %5u ms\n", moves, (unsigned)on, (unsigned)off,
+				(unsigned)(turn - start));
+		}
+		end_turn();
+	}
+	CHECK(lastOn == UI_PLAYBACK_ON_MIN_MS && lastOff == UI_PLAYBACK_OFF_MIN_MS);
+}
+
+static void test_presses_ignored(void)
+{
+	//Presses during the playback are read out and thrown away, and do not light anything
+	struct GameDataPacket packet;
+	TickType_t on, off;
+
+	make_packet(&packet, 3, 1);
+	expected_times(3, &on, &off);
+	TickType_t start = fake_rtos_tick();
+	UiOrderShowMoves(&packet);
+
+	fake_rtos_run_for(on / 2);
+	fifo[fifoCount++] = (uint8_t)((NEO_TRELLIS_KEY(15) << 2) | SEESAW_KEYPAD_EDGE_RISING);
+	fifo[fifoCount++] = (uint8_t)((NEO_TRELLIS_KEY(15) << 2) | SEESAW_KEYPAD_EDGE_FALLING);
+
+	TickType_t turn = start + 3 * (on + off);
+	fake_rtos_run_until(turn);
+	CHECK_EQ(fifoCount, 0);
+	CHECK_EQ(check_schedule(&packet, 3, 0, start), turn);
+	CHECK_EQ(uiState, UI_STATE_HANDLE_BUTTONS);
+	CHECK_EQ(pressedKeys, 0);
+	end_turn();
+}
+
+static void test_restart(void)
+{
+	//A new packet while a move is lit: the lit move goes dark at once and the new sequence starts from its first move.
+	//The keys are picked so the change to dark comes first in the log of that tick.
+	struct GameDataPacket first, second;
+	TickType_t on, off;
+
+	make_packet(&first, 5, 2);
+	make_packet(&second, 4, 12);
+	expected_times(5, &on, &off);
+
+	TickType_t start = fake_rtos_tick();
+	UiOrderShowMoves(&first);
+	fake_rtos_run_for(on + off + on / 2);
+	CHECK_EQ(ledLogCount, 3);
+	CHECK(ledOn[first.game[1]]);
+
+	TickType_t restart = fake_rtos_tick();
+	UiOrderShowMoves(&second);
+	expected_times(4, &on, &off);
+	TickType_t turn = restart + 4 * (on + off);
+	fake_rtos_run_until(turn);
+
+	CHECK_EQ(ledLog[3].tick, restart);
+	CHECK_EQ(ledLog[3].key, first.game[1]);
+	CHECK(!ledLog[3].on);
+	CHECK_EQ(check_schedule(&second, 4, 4, restart), turn);
+	CHECK(restart > start);
+	CHECK_EQ(uiState, UI_STATE_HANDLE_BUTTONS);
+	CHECK_EQ(keysToPress, 5);
+	end_turn();
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	fake_rtos_start(vUiHandlerTask, NULL, 0);
+	CHECK_EQ(uiState, UI_STATE_IGNORE_PRESSES);
+	end_turn();
+
+	test_schedule();
+	test_presses_ignored();
+	test_restart();
+
+	printf("ui playback: OK\n");
+	return 0;
+}
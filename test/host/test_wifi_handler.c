@@ -0,0 +1,1021 @@
+/**************************************************************************//**
+* @file      test_wifi_handler.c
+* @brief     Host test of the WiFi thread with the MQTT and HTTP clients on their sockets side by side
+* @details   Runs vWifiTask on fake_rtos.c against stubs of the WINC driver, the MQTT wrapper, the HTTP client, the
+			 SD writer and the card, with the MQTT platform layer, the publish ring, the game codec and the manifest
+			 checks linked in. m2m_wifi_handle_events hands out the WiFi, socket and DNS events the test has queued,
+			 through the callbacks the thread registered, and the HTTP client stub turns an event on its socket
+			 into the callback the test attached to it. Checks that every socket event reaches the client that owns
+			 the socket and no other, that a DNS answer reaches both, that a download with no card ready is canceled
+			 without holding up the thread, and that a firmware download runs to its end
+			 while the broker session stays up and game packets keep going out. Then drops the broker link in each way
+			 the thread detects, and checks the jittered backoff between reconnect attempts, that the session is
+			 resumed and subscribed again, and that no game queued while the broker was away is lost.
+* @author    Kenny Zhang and Chen Chen
+* @date      2021-05-14
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <string.h>
+#include "host_test.h"
+#include "fake_rtos.h"
+#include "FreeRTOS_Threads/WifiHandlerThread/WifiHandler.h"
+#include "FreeRTOS_Threads/WifiHandlerThread/GameCodec.h"
+#include "FreeRTOS_Threads/WifiHandlerThread/MqttPublishQueue.h"
+#include "FreeRTOS_Threads/SdWriterThread/SdWriterThread.h"
+#include "FreeRTOS_Threads/WifiHandlerThread/DownloadJournal.h"
+#include "FreeRTOS_Threads/ControlThread/ControlThread.h"
+#include "FreeRTOS_Threads/LogThread/LogThread.h"
+#include "MQTTClient/Wrapper/mqtt.h"
+#include "iot/http/http_client.h"
+#include "driver/include/m2m_wifi.h"
+#include "bsp/include/nm_bsp.h"
+#include "SerialConsole.h"
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define MQTT_SOCK			0
+#define HTTP_SOCK			1
+#define OTHER_SOCK			2		///<Open, but owned by neither client
+#define EVENT_QUEUE_SIZE	16
+
+#define START_DELAY_MS		100		///<vWifiTask waits this long before it starts
+#define CONNECT_DELAY_MS	1000	///<and this long once the WiFi is up
+#define YIELD_MS			100		///<Time of one mqtt_yield of the thread
+
+#define IMAGE_SIZE			5000
+#define CHUNK_SIZE			MAIN_BUFFER_MAX_SIZE
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+enum winc_event_type
+{
+	EVENT_WIFI_CONNECTED,
+	EVENT_WIFI_DHCP,
+	EVENT_WIFI_DISCONNECTED,
+	EVENT_SOCKET,
+	EVENT_DNS
+};
+
+///Event the WINC has ready for the next m2m_wifi_handle_events
+struct winc_event
+{
+	enum winc_event_type type;
+	SOCKET sock;
+	uint8_t msg;						///<SOCKET_MSG_xxx of an EVENT_SOCKET
+	tstrSocketRecvMsg recv;				///<Message of a SOCKET_MSG_RECV
+	int httpType;						///<HTTP client callback the event on its socket leads to, -1 for none
+	union http_client_data http;
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+int host_critical_nesting = 0;
+enum eDebugLogLevels currentDebugLevel = LOG_INFO_LVL;
+enum eDebugLogLevels moduleDebugLevel[N_LOG_MODULES];
+struct mqtt_client_pool mqttClientPool[MQTT_MAX_CLIENTS];
+
+extern int8_t wifiStateMachine;
+extern struct http_client_module http_client_module_inst;
+
+static struct winc_event events[EVENT_QUEUE_SIZE];
+static uint32_t eventHead, eventCount;
+static const struct winc_event *currentEvent;	///<Event m2m_wifi_handle_events is handing out
+
+static tpfAppWifiCb wifiCallback;
+static tpfAppSocketCb socketCallback;
+static tpfAppResolveCb resolveCallback;
+static uint32_t socketInits, dhcpRequests;
+
+static struct mqtt_module *mqtt;				///<MQTT instance of the thread, from mqtt_init
+static bool brokerUp = true;
+static bool brokerAcks = true;					///<Cleared, the broker takes the connection but answers no publish
+static uint32_t mqttConnects, mqttDisconnects, mqttPublishes, mqttPublishFails, mqttSocketEvents, mqttResolves;
+static uint32_t mqttCloses, wifiConnects;
+static TickType_t mqttConnectTick, mqttDisconnectTick;
+static uint8_t lastCleanSession;
+static char lastClientId[64];
+static bool insideHandleEvents;
+static SOCKET mqttLastSock;
+static char lastPublished[GAME_CODEC_MAX_GAME_LEN + 1];
+
+static uint32_t httpRequests, httpCloses, httpSocketEvents, httpResolves;
+static SOCKET httpLastSock;
+static char lastUrl[128];
+static bool lastHadHeader;
+
+static uint8_t image[IMAGE_SIZE];
+static char manifestText[32];
+static char imagePath[MAIN_MAX_FILE_NAME_LENGTH + 1];
+static bool imageOpen;
+static uint32_t imageBytes;
+static crc32_t imageCrc;
+static SdWriterCheckpoint imageCheckpoint;
+static char lastOpened[MAIN_MAX_FILE_NAME_LENGTH + 1];
+static bool ledOn = false;
+static Ctrl_status cardStatus = CTRL_GOOD;
+static uint32_t cardBusyChecks;					///<Checks the card still answers busy to, before cardStatus
+static uint32_t cardChecks;
+
+/******************************************************************************
+* WINC stubs
+******************************************************************************/
+sint8 m2m_wifi_init(tstrWifiInitParam *pWifiInitParam)
+{
+	wifiCallback = pWifiInitParam->pfAppWifiCb;
+	return M2M_SUCCESS;
+}
+
+sint8 m2m_wifi_connect(char *pcSsid, uint8 u8SsidLen, uint8 u8SecType, void *pvAuthInfo, uint16 u16Ch)
+{
+	wifiConnects++;
+	return M2M_SUCCESS;
+}
+
+sint8 m2m_wifi_request_dhcp_client(void)
+{
+	dhcpRequests++;
+	return M2M_SUCCESS;
+}
+
+void socketInit(void)
+{
+	socketInits++;
+}
+
+void registerSocketCallback(tpfAppSocketCb socket_cb, tpfAppResolveCb resolve_cb)
+{
+	socketCallback = socket_cb;
+	resolveCallback = resolve_cb;
+}
+
+sint8 nm_bsp_init(void)
+{
+	return M2M_SUCCESS;
+}
+
+///Same as nm_bsp_samd21.c, on the fake task
+void nm_bsp_wait_for_event(uint32 u32TimeoutMsec)
+{
+	ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(u32TimeoutMsec));
+}
+
+///Hands out the queued events, like the WINC driver does from its event handler
+sint8 m2m_wifi_handle_events(void *arg)
+{
+	while(eventCount > 0)
+	{
+		const struct winc_event *event = &events[eventHead];
+		eventHead = (eventHead + 1) % EVENT_QUEUE_SIZE;
+		eventCount--;
+
+		currentEvent = event;
+		insideHandleEvents = true;
+		switch(event->type)
+		{
+			case EVENT_WIFI_CONNECTED:
+			{
+				tstrM2mWifiStateChanged state = {.u8CurrState = M2M_WIFI_CONNECTED};
+				wifiCallback(M2M_WIFI_RESP_CON_STATE_CHANGED, &state);
+				break;
+			}
+			case EVENT_WIFI_DISCONNECTED:
+			{
+				tstrM2mWifiStateChanged state = {.u8CurrState = M2M_WIFI_DISCONNECTED};
+				wifiCallback(M2M_WIFI_RESP_CON_STATE_CHANGED, &state);
+				break;
+			}
+			case EVENT_WIFI_DHCP:
+			{
+				uint8_t address[4] = {192, 168, 1, 20};
+				wifiCallback(M2M_WIFI_REQ_DHCP_CONF, address);
+				break;
+			}
+			case EVENT_SOCKET:
+				socketCallback(event->sock, event->msg, (void *)&event->recv);
+				break;
+			case EVENT_DNS:
+				resolveCallback((uint8 *)"host.test", 0x0100000A);
+				break;
+		}
+		insideHandleEvents = false;
+		currentEvent = NULL;
+	}
+	return M2M_SUCCESS;
+}
+
+//The MQTT platform layer opens the broker socket itself in the firmware, here the MQTT wrapper stub does
+SOCKET socket(uint16 u16Domain, uint8 u8Type, uint8 u8Flags)
+{
+	return MQTT_SOCK;
+}
+
+sint8 connect(SOCKET sock, struct sockaddr *pstrAddr, uint8 u8AddrLen)
+{
+	return SOCK_ERR_NO_ERROR;
+}
+
+sint16 recv(SOCKET sock, void *pvRecvBuf, uint16 u16BufLen, uint32 u32Timeoutmsec)
+{
+	return SOCK_ERR_NO_ERROR;
+}
+
+sint16 send(SOCKET sock, void *pvSendBuffer, uint16 u16SendLength, uint16 u16Flags)
+{
+	return SOCK_ERR_NO_ERROR;
+}
+
+///The close of a socket waits for the WINC, so it must never be called from one of its callbacks
+sint8 close(SOCKET sock)
+{
+	CHECK(!insideHandleEvents);
+	CHECK_EQ(sock, MQTT_SOCK);
+	mqttCloses++;
+	return SOCK_ERR_NO_ERROR;
+}
+
+sint8 gethostbyname(uint8 *pcHostName)
+{
+	return SOCK_ERR_NO_ERROR;
+}
+
+/******************************************************************************
+* MQTT wrapper stubs
+******************************************************************************/
+void mqtt_get_config_defaults(struct mqtt_config *const config)
+{
+	memset(config, 0, sizeof(*config));
+}
+
+int mqtt_init(struct mqtt_module *module, struct mqtt_config *config)
+{
+	mqtt = module;
+	NetworkInit(&module->network);
+	module->config = *config;
+	module->client = &mqttClientPool[0].client;
+	module->client->ipstack = &module->network;
+	mqttClientPool[0].mqtt_instance = module;
+	return SUCCESS;
+}
+
+int mqtt_register_callback(struct mqtt_module *const module, mqtt_callback_t callback)
+{
+	module->callback = callback;
+	return SUCCESS;
+}
+
+///Opens the broker socket at once, or fails at once while the broker is down
+int mqtt_connect(struct mqtt_module *const module, const char *host)
+{
+	union mqtt_data data = {.sock_connected = {.result = brokerUp ? 0 : -1}};
+
+	CHECK(strcmp(host, main_mqtt_broker) == 0);
+	mqttConnects++;
+	mqttConnectTick = xTaskGetTickCount();
+	if(brokerUp) module->network.socket = MQTT_SOCK;
+	module->callback(module, MQTT_CALLBACK_SOCK_CONNECTED, &data);
+	return SUCCESS;
+}
+
+int mqtt_connect_broker(struct mqtt_module *const module, uint8_t clean_session, const char *id, const char *password,
+	const char *client_id, const char *will_topic, const char *will_msg, uint32_t will_msg_len, uint8_t will_qos,
+	uint8_t will_retain)
+{
+	union mqtt_data data = {.connected = {.result = MQTT_CONN_RESULT_ACCEPT}};
+
+	if(!brokerUp) return FAILURE;
+	lastCleanSession = clean_session;
+	CHECK(strlen(client_id) < sizeof(lastClientId));
+	strcpy(lastClientId, client_id);
+	module->isConnected = true;
+	module->callback(module, MQTT_CALLBACK_CONNECTED, &data);
+	return SUCCESS;
+}
+
+int mqtt_subscribe(struct mqtt_module *const module, const char *topic, uint8_t qos, messageHandler msgHandler)
+{
+	for(int i = 0; i < MAX_MESSAGE_HANDLERS; i++)
+	{
+		if(module->client->messageHandlers[i].topicFilter == NULL)
+		{
+			module->client->messageHandlers[i].topicFilter = topic;
+			module->client->messageHandlers[i].fp = msgHandler;
+			return brokerUp ? SUCCESS : FAILURE;
+		}
+	}
+	return FAILURE;
+}
+
+int mqtt_publish(struct mqtt_module *const module, const char *topic, const char *msg, uint32_t msg_len, uint8_t qos,
+	uint8_t retain)
+{
+	CHECK(module->isConnected);
+	if(!brokerUp || !brokerAcks)
+	{
+		mqttPublishFails++;
+		return FAILURE;
+	}
+	CHECK(msg_len < sizeof(lastPublished));
+	memcpy(lastPublished, msg, msg_len);
+	lastPublished[msg_len] = '\0';
+	mqttPublishes++;
+	return SUCCESS;
+}
+
+///Waits on the WINC for the whole timeout, as a read of the broker socket with nothing to read does
+int mqtt_yield(struct mqtt_module *module, int timeout_ms)
+{
+	TickType_t end = xTaskGetTickCount() + pdMS_TO_TICKS(timeout_ms);
+
+	CHECK(module->isConnected);
+	while((int32_t)(end - xTaskGetTickCount()) > 0)
+	{
+		nm_bsp_wait_for_event(end - xTaskGetTickCount());
+		m2m_wifi_handle_events(NULL);
+	}
+	return SUCCESS;
+}
+
+int mqtt_disconnect(struct mqtt_module *const module, int force_close)
+{
+	//The socket is closed first, so no DISCONNECT reaches the broker and it keeps the session
+	CHECK(module->network.socket < 0);
+	mqttDisconnects++;
+	mqttDisconnectTick = xTaskGetTickCount();
+	module->isConnected = false;
+	return SUCCESS;
+}
+
+void mqtt_socket_event_handler(SOCKET sock, uint8_t msg_type, void *msg_data)
+{
+	mqttSocketEvents++;
+	mqttLastSock = sock;
+}
+
+void mqtt_socket_resolve_handler(uint8_t *doamin_name, uint32_t server_ip)
+{
+	mqttResolves++;
+}
+
+/******************************************************************************
+* HTTP client and timer stubs
+******************************************************************************/
+void http_client_get_config_defaults(struct http_client_config *const config)
+{
+	memset(config, 0, sizeof(*config));
+}
+
+int http_client_init(struct http_client_module *const module, struct http_client_config *config)
+{
+	memset(module, 0, sizeof(*module));
+	module->config = *config;
+	module->sock = -1;
+	return 0;
+}
+
+int http_client_register_callback(struct http_client_module *const module, http_client_callback_t callback)
+{
+	module->cb = callback;
+	return 0;
+}
+
+int http_client_send_request(struct http_client_module *const module, const char *url, enum http_method method,
+	struct http_entity *const entity, const char *ext_header)
+{
+	CHECK(strlen(url) < sizeof(lastUrl));
+	strcpy(lastUrl, url);
+	lastHadHeader = ext_header != NULL;
+	module->sock = HTTP_SOCK;
+	httpRequests++;
+	return 0;
+}
+
+int http_client_close(struct http_client_module *const module)
+{
+	module->sock = -1;
+	httpCloses++;
+	return 0;
+}
+
+///Turns the socket event into the HTTP callback the test attached to it
+void http_client_socket_event_handler(SOCKET sock, uint8_t msg_type, void *msg_data)
+{
+	httpSocketEvents++;
+	httpLastSock = sock;
+	if(currentEvent != NULL && currentEvent->httpType >= 0)
+	{
+		union http_client_data data = currentEvent->http;
+		http_client_module_inst.cb(&http_client_module_inst, currentEvent->httpType, &data);
+	}
+}
+
+void http_client_socket_resolve_handler(uint8_t *doamin_name, uint32_t server_ip)
+{
+	httpResolves++;
+}
+
+void sw_timer_get_config_defaults(struct sw_timer_config *const config)
+{
+	memset(config, 0, sizeof(*config));
+}
+
+void sw_timer_init(struct sw_timer_module *const module_inst, struct sw_timer_config *const config)
+{
+}
+
+void sw_timer_enable(struct sw_timer_module *const module_inst)
+{
+}
+
+void sw_timer_task(struct sw_timer_module *const module_inst)
+{
+}
+
+uint32_t sw_timer_next_deadline(struct sw_timer_module *const module_inst)
+{
+	return UINT32_MAX;
+}
+
+/******************************************************************************
+* Storage stubs
+******************************************************************************/
+///Reference CRC32 of IEEE 802.3, carried on from crc like crc32_recalculate does
+static crc32_t reference_crc(crc32_t crc, const uint8_t *data, uint32_t length)
+{
+	crc = ~crc;
+	for(uint32_t i = 0; i < length; i++)
+	{
+		crc ^= data[i];
+		for(int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320UL : 0);
+	}
+	return ~crc;
+}
+
+FRESULT SdWriterBegin(const char *path, SdWriterCheckpoint checkpoint)
+{
+	CHECK(!imageOpen);
+	CHECK(strlen(path) < sizeof(imagePath));
+	strcpy(imagePath, path);
+	imageOpen = true;
+	imageBytes = 0;
+	imageCrc = 0;
+	imageCheckpoint = checkpoint;
+	return FR_OK;
+}
+
+FRESULT SdWriterResume(const char *path, uint32_t offset, crc32_t crc, SdWriterCheckpoint checkpoint)
+{
+	return FR_INT_ERR;
+}
+
+bool SdWriterAppend(const void *data, uint32_t length)
+{
+	CHECK(imageOpen);
+	imageCrc = reference_crc(imageCrc, data, length);
+	imageBytes += length;
+	return true;
+}
+
+FRESULT SdWriterFinish(void)
+{
+	if(!imageOpen) return FR_NOT_READY;
+	imageOpen = false;
+	imageCheckpoint(imageBytes, imageCrc);
+	return FR_OK;
+}
+
+bool SdWriterIsOpen(void)
+{
+	return imageOpen;
+}
+
+bool DownloadJournalLoad(struct DownloadJournal *journal)
+{
+	return false;
+}
+
+FRESULT DownloadJournalSave(const struct DownloadJournal *journal)
+{
+	return FR_OK;
+}
+
+void DownloadJournalClear(void)
+{
+}
+
+void sd_mmc_init(void)
+{
+}
+
+Ctrl_status sd_mmc_test_unit_ready(uint8_t slot)
+{
+	cardChecks++;
+	if(cardBusyChecks > 0)
+	{
+		cardBusyChecks--;
+		return CTRL_BUSY;
+	}
+	return cardStatus;
+}
+
+FRESULT f_mount(BYTE vol, FATFS *fs)
+{
+	return FR_OK;
+}
+
+///Only the download flag file is created, no other file exists
+FRESULT f_open(FIL *fp, const char *path, BYTE mode)
+{
+	CHECK(strlen(path) < sizeof(lastOpened));
+	strcpy(lastOpened, path);
+	return (mode & FA_CREATE_ALWAYS) ? FR_OK : FR_NO_FILE;
+}
+
+FRESULT f_close(FIL *fp)
+{
+	return FR_OK;
+}
+
+FRESULT f_unlink(const char *path)
+{
+	return FR_OK;
+}
+
+/******************************************************************************
+* Board and firmware stubs
+******************************************************************************/
+void extint_chan_get_config_defaults(struct extint_chan_conf *const config)
+{
+	memset(config, 0, sizeof(*config));
+}
+
+void extint_chan_set_config(const uint8_t channel, const struct extint_chan_conf *const config)
+{
+}
+
+enum status_code extint_register_callback(const extint_callback_t callback, const uint8_t channel,
+	const enum extint_callback_type type)
+{
+	return STATUS_OK;
+}
+
+enum status_code extint_chan_enable_callback(const uint8_t channel, const enum extint_callback_type type)
+{
+	return STATUS_OK;
+}
+
+void port_pin_set_output_level(const uint8_t gpio_pin, const bool level)
+{
+	CHECK_EQ(gpio_pin, LED_0_PIN);
+	ledOn = (level == LED_0_ACTIVE);
+}
+
+int ControlAddGameData(struct GameDataPacket *gameIn)
+{
+	return pdTRUE;
+}
+
+int ControlAddStatusDataToQueue(uint8_t *statusdada)
+{
+	return pdTRUE;
+}
+
+void SerialConsoleWriteString(const char *string)
+{
+}
+
+///Formats the message, so a format that does not match its arguments shows up in the sanitizers
+void LogMessage(enum eDebugLogLevels level, const char *format, ...)
+{
+	char line[256];
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+}
+
+void LogDeferredPost(enum eDebugLogLevels level, const char *format, const uint32_t *args)
+{
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+static struct winc_event *queue_event(enum winc_event_type type)
+{
+	CHECK(eventCount < EVENT_QUEUE_SIZE);
+	struct winc_event *event = &events[(eventHead + eventCount) % EVENT_QUEUE_SIZE];
+	memset(event, 0, sizeof(*event));
+	event->type = type;
+	event->httpType = -1;
+	eventCount++;
+	return event;
+}
+
+///Queues a socket event and fires the WINC interrupt
+static void socket_event(SOCKET sock, uint8_t msg)
+{
+	struct winc_event *event = queue_event(EVENT_SOCKET);
+	event->sock = sock;
+	event->msg = msg;
+	if(msg == SOCKET_MSG_RECV) event->recv.s16BufferSize = 1;
+	fake_rtos_notify();
+}
+
+///Queues the result of a receive on a socket, a byte count or a SOCK_ERR_xxx, and fires the WINC interrupt
+static void socket_recv(SOCKET sock, sint16 size)
+{
+	struct winc_event *event = queue_event(EVENT_SOCKET);
+	event->sock = sock;
+	event->msg = SOCKET_MSG_RECV;
+	event->recv.s16BufferSize = size;
+	fake_rtos_notify();
+}
+
+///Queues an event on the HTTP socket that leads to the given HTTP client callback
+static union http_client_data *http_event(int type)
+{
+	struct winc_event *event = queue_event(EVENT_SOCKET);
+	event->sock = HTTP_SOCK;
+	event->msg = SOCKET_MSG_RECV;
+	event->recv.s16BufferSize = 1;
+	event->httpType = type;
+	fake_rtos_notify();
+	return &event->http;
+}
+
+static void wifi_event(enum winc_event_type type)
+{
+	queue_event(type);
+	fake_rtos_notify();
+}
+
+static void test_connect(void)
+{
+	//The thread sets up the sockets once, with its own dispatchers, then waits for the WiFi
+	fake_rtos_run_for(START_DELAY_MS);
+	CHECK_EQ(socketInits, 1);
+	CHECK(socketCallback != NULL && resolveCallback != NULL);
+
+	wifi_event(EVENT_WIFI_CONNECTED);
+	fake_rtos_run_for(0);
+	CHECK_EQ(dhcpRequests, 1);
+	wifi_event(EVENT_WIFI_DHCP);
+	//The thread sees the address on its next poll, then lets the WiFi settle before it goes to the broker
+	fake_rtos_run_for(YIELD_MS + CONNECT_DELAY_MS);
+	CHECK_EQ(mqttConnects, 1);
+	CHECK(mqtt->isConnected);
+	CHECK_EQ(mqtt->network.socket, MQTT_SOCK);
+	CHECK_EQ(wifiStateMachine, WIFI_MQTT_HANDLE);
+}
+
+static void test_dispatch(void)
+{
+	//An HTTP request is open next to the broker socket
+	http_client_module_inst.sock = HTTP_SOCK;
+
+	socket_event(MQTT_SOCK, SOCKET_MSG_RECV);
+	fake_rtos_run_for(0);
+	CHECK_EQ(mqttSocketEvents, 1);
+	CHECK_EQ(mqttLastSock, MQTT_SOCK);
+	CHECK_EQ(httpSocketEvents, 0);
+
+	socket_event(HTTP_SOCK, SOCKET_MSG_CONNECT);
+	fake_rtos_run_for(0);
+	CHECK_EQ(httpSocketEvents, 1);
+	CHECK_EQ(httpLastSock, HTTP_SOCK);
+	CHECK_EQ(mqttSocketEvents, 1);
+
+	//Sockets that belong to neither client, closed or out of range ones included, are dropped
+	socket_event(OTHER_SOCK, SOCKET_MSG_RECV);
+	socket_event(-1, SOCKET_MSG_RECV);
+	socket_event(TCP_SOCK_MAX, SOCKET_MSG_RECV);
+	fake_rtos_run_for(0);
+	CHECK_EQ(mqttSocketEvents, 1);
+	CHECK_EQ(httpSocketEvents, 1);
+
+	//Once the HTTP socket is closed, its number no longer reaches the HTTP client
+	http_client_module_inst.sock = -1;
+	socket_event(HTTP_SOCK, SOCKET_MSG_RECV);
+	fake_rtos_run_for(0);
+	CHECK_EQ(httpSocketEvents, 1);
+
+	//Both clients match the host name of a DNS answer themselves
+	wifi_event(EVENT_DNS);
+	fake_rtos_run_for(0);
+	CHECK_EQ(mqttResolves, 1);
+	CHECK_EQ(httpResolves, 1);
+
+	CHECK(mqtt->isConnected);
+	CHECK_EQ(host_critical_nesting, 0);
+}
+
+static void test_no_card(void)
+{
+	//An empty slot cancels the download at once: nothing is asked for, and the thread goes back to the broker after
+	//its next pass, which serves MQTT as usual
+	cardStatus = CTRL_NO_PRESENT;
+	WifiHandlerSetState(WIFI_DOWNLOAD_INIT);
+	fake_rtos_run_for(4 * YIELD_MS);
+	CHECK_EQ(cardChecks, 1);
+	CHECK_EQ(httpRequests, 0);
+	CHECK_EQ(httpCloses, 1);
+	CHECK(!imageOpen);
+	CHECK_EQ(wifiStateMachine, WIFI_MQTT_HANDLE);
+
+	//A card that stays busy is given up on after a few checks, the thread does not wait for it
+	cardStatus = CTRL_BUSY;
+	WifiHandlerSetState(WIFI_DOWNLOAD_INIT);
+	fake_rtos_run_for(4 * YIELD_MS);
+	CHECK_EQ(cardChecks, 1 + MAIN_STORAGE_INIT_ATTEMPTS);
+	CHECK_EQ(httpRequests, 0);
+	CHECK_EQ(httpCloses, 2);
+	CHECK_EQ(wifiStateMachine, WIFI_MQTT_HANDLE);
+
+	CHECK_EQ(mqttConnects, 1);
+	CHECK_EQ(mqttDisconnects, 0);
+	CHECK(mqtt->isConnected);
+	CHECK_EQ(host_critical_nesting, 0);
+	cardStatus = CTRL_GOOD;
+}
+
+static void test_download(void)
+{
+	struct GameDataPacket game;
+	uint32_t publishesBefore = mqttPublishes, mqttEventsBefore = mqttSocketEvents, closesBefore = httpCloses;
+	uint32_t checksBefore = cardChecks;
+
+	//The card is still going through its initialization for the first few checks
+	cardBusyChecks = 3;
+
+	for(uint32_t i = 0; i < IMAGE_SIZE; i++) image[i] = (uint8_t)test_rand();
+	snprintf(manifestText, sizeof(manifestText), "%u %08lx\n", IMAGE_SIZE,
+		(unsigned long)reference_crc(0, image, IMAGE_SIZE));
+
+	//The manifest is asked for first, on the HTTP socket, while the broker socket stays open
+	WifiHandlerSetState(WIFI_DOWNLOAD_INIT);
+	fake_rtos_run_for(2 * YIELD_MS);
+	CHECK_EQ(wifiStateMachine, WIFI_DOWNLOAD_HANDLE);
+	CHECK_EQ(cardChecks, checksBefore + 4);
+	CHECK_EQ(httpRequests, 1);
+	CHECK(strcmp(lastUrl, MAIN_HTTP_MANIFEST_URL) == 0);
+
+	http_event(HTTP_CLIENT_CALLBACK_REQUESTED);
+	union http_client_data *data = http_event(HTTP_CLIENT_CALLBACK_RECV_RESPONSE);
+	data->recv_response.response_code = 200;
+	data->recv_response.content = manifestText;
+	data->recv_response.content_length = (uint32_t)strlen(manifestText);
+	fake_rtos_run_for(YIELD_MS);
+
+	//Then the image, in chunks
+	CHECK_EQ(httpRequests, 2);
+	CHECK(strcmp(lastUrl, MAIN_HTTP_FILE_URL) == 0);
+	CHECK(!lastHadHeader);
+	http_event(HTTP_CLIENT_CALLBACK_REQUESTED);
+	data = http_event(HTTP_CLIENT_CALLBACK_RECV_RESPONSE);
+	data->recv_response.response_code = 200;
+	data->recv_response.content_length = IMAGE_SIZE;
+	fake_rtos_run_for(0);
+
+	for(uint32_t pos = 0; pos < IMAGE_SIZE; pos += CHUNK_SIZE)
+	{
+		data = http_event(HTTP_CLIENT_CALLBACK_RECV_CHUNKED_DATA);
+		data->recv_chunked_data.data = (char *)&image[pos];
+		data->recv_chunked_data.length = (pos + CHUNK_SIZE < IMAGE_SIZE) ? CHUNK_SIZE : IMAGE_SIZE - pos;
+		data->recv_chunked_data.is_complete = pos + CHUNK_SIZE >= IMAGE_SIZE;
+
+		//Halfway, a play is made and the opponent sends one: both go through while the image comes in
+		if(pos == CHUNK_SIZE)
+		{
+			memset(&game, 0xFF, sizeof(game));
+			game.game[0] = 3;
+			CHECK_EQ(WifiAddGameDataToQueue(&game), pdTRUE);
+			socket_event(MQTT_SOCK, SOCKET_MSG_RECV);
+			fake_rtos_run_for(YIELD_MS);
+			CHECK_EQ(mqttPublishes, publishesBefore + 1);
+			CHECK(strcmp(lastPublished, "{\"game\":[3]}") == 0);
+			CHECK_EQ(mqttSocketEvents, mqttEventsBefore + 1);
+			CHECK_EQ(wifiStateMachine, WIFI_DOWNLOAD_HANDLE);
+			CHECK(imageOpen);
+		}
+		fake_rtos_run_for(0);
+	}
+	fake_rtos_run_for(2 * YIELD_MS);
+
+	//Written, checked against the manifest, shown on the LED and flagged for the bootloader. The broker never saw a
+	//disconnect.
+	CHECK(!imageOpen);
+	CHECK_EQ(imageBytes, IMAGE_SIZE);
+	CHECK(strcmp(imagePath, "0:IoT.bin") == 0);
+	CHECK(strcmp(lastOpened, "0:Update.txt") == 0);
+	CHECK(ledOn);
+	CHECK_EQ(wifiStateMachine, WIFI_MQTT_HANDLE);
+	CHECK_EQ(mqttConnects, 1);
+	CHECK_EQ(mqttDisconnects, 0);
+	CHECK(mqtt->isConnected);
+	CHECK_EQ(mqtt->network.socket, MQTT_SOCK);
+	CHECK_EQ(socketInits, 1);
+
+	//A finished response leaves the connection to the keep-alive timer of the HTTP client
+	CHECK_EQ(httpCloses, closesBefore);
+	CHECK_EQ(host_critical_nesting, 0);
+}
+
+///Runs the thread until its next attempt to reach the broker, which must come within maxMs. Returns its tick.
+static TickType_t run_until_connect(uint32_t maxMs)
+{
+	uint32_t before = mqttConnects;
+	for(uint32_t waited = 0; mqttConnects == before; waited += YIELD_MS)
+	{
+		CHECK(waited <= maxMs);
+		fake_rtos_run_for(YIELD_MS);
+	}
+	CHECK_EQ(mqttConnects, before + 1);
+	return mqttConnectTick;
+}
+
+///Checks that the session came back as it was: resumed, subscribed again and with the topics handled
+static void check_session(void)
+{
+	MQTTClient *client = mqtt->client;
+
+	CHECK(mqtt->isConnected);
+	CHECK_EQ(mqtt->network.socket, MQTT_SOCK);
+	CHECK_EQ(lastCleanSession, MQTT_CLEAN_SESSION);
+	CHECK_EQ(lastCleanSession, 0);
+	CHECK(strcmp(lastClientId, MQTT_CLIENT_ID) == 0);
+	CHECK(strcmp(client->messageHandlers[0].topicFilter, GAME_TOPIC_IN) == 0);
+	CHECK(strcmp(client->messageHandlers[1].topicFilter, STATUS_TOPIC) == 0);
+	CHECK_EQ(client->ping_outstanding, 0);
+}
+
+static void queue_game(uint8_t move)
+{
+	struct GameDataPacket game;
+
+	memset(&game, 0xFF, sizeof(game));
+	game.game[0] = move;
+	CHECK_EQ(WifiAddGameDataToQueue(&game), pdTRUE);
+}
+
+static void test_publish_failures(void)
+{
+	uint32_t disconnects = mqttDisconnects, closes = mqttCloses, fails = mqttPublishFails;
+
+	//The broker keeps the socket open but acknowledges nothing: the play stays queued and is retried
+	brokerAcks = false;
+	queue_game(5);
+	for(uint32_t waited = 0; mqttDisconnects == disconnects; waited += YIELD_MS)
+	{
+		CHECK(waited <= 20 * YIELD_MS);
+		fake_rtos_run_for(YIELD_MS);
+	}
+	CHECK_EQ(mqttPublishFails, fails + MQTT_MAX_PUBLISH_FAILS);
+	CHECK_EQ(mqttDisconnects, disconnects + 1);
+	CHECK_EQ(mqttCloses, closes + 1);
+	CHECK(!mqtt->isConnected);
+	CHECK_EQ(MqttQueueCount(), 1);
+
+	//The first attempt is drawn from the shortest backoff, and the play goes out on the new session
+	brokerAcks = true;
+	TickType_t attempt = run_until_connect(MQTT_RECONNECT_MIN_MS + YIELD_MS);
+	CHECK(attempt - mqttDisconnectTick >= MQTT_RECONNECT_MIN_MS / 2);
+	check_session();
+	fake_rtos_run_for(0);
+	CHECK(strcmp(lastPublished, "{\"game\":[5]}") == 0);
+	CHECK_EQ(MqttQueueCount(), 0);
+}
+
+static void test_unanswered_ping(void)
+{
+	uint32_t disconnects = mqttDisconnects;
+
+	//Paho sent a ping, which the broker does not answer within the keep alive period
+	mqtt->client->ping_outstanding = 1;
+	TimerCountdownMS(&mqtt->client->ping_timer, MQTT_RECONNECT_MIN_MS);
+	fake_rtos_run_for(MQTT_RECONNECT_MIN_MS - YIELD_MS);
+	CHECK(mqtt->isConnected);
+	fake_rtos_run_for(4 * YIELD_MS);
+	CHECK_EQ(mqttDisconnects, disconnects + 1);
+	CHECK(!mqtt->isConnected);
+
+	run_until_connect(MQTT_RECONNECT_MIN_MS + YIELD_MS);
+	check_session();
+}
+
+static void test_backoff(void)
+{
+	uint32_t publishes = mqttPublishes, delayMs = MQTT_RECONNECT_MIN_MS;
+
+	//The broker goes away: the socket reports the drop, the link is closed on the next pass, after the rest of the
+	//yield and the sleep of the thread, and every attempt fails until the broker is back
+	brokerUp = false;
+	socket_recv(MQTT_SOCK, SOCK_ERR_CONN_ABORTED);
+	fake_rtos_run_for(2 * YIELD_MS);
+	CHECK(!mqtt->isConnected);
+	TickType_t last = mqttDisconnectTick;
+
+	//A play made during the outage waits in the ring
+	queue_game(7);
+
+	//Each wait is drawn between half and all of the backoff, which doubles up to its cap. The thread polls every
+	//YIELD_MS while the broker is away, so an attempt may come that much after its tick.
+	for(int i = 0; i < 9; i++)
+	{
+		TickType_t attempt = run_until_connect(delayMs + YIELD_MS);
+		CHECK(attempt - last >= delayMs / 2);
+		CHECK(attempt - last <= delayMs + YIELD_MS);
+		CHECK(!mqtt->isConnected);
+		last = attempt;
+		delayMs = (2 * delayMs > MQTT_RECONNECT_MAX_MS) ? MQTT_RECONNECT_MAX_MS : 2 * delayMs;
+	}
+	CHECK_EQ(delayMs, MQTT_RECONNECT_MAX_MS);
+	CHECK_EQ(mqttPublishes, publishes);
+	CHECK_EQ(MqttQueueCount(), 1);
+
+	//Back within one capped backoff of the broker returning, and the play is sent
+	brokerUp = true;
+	TickType_t back = fake_rtos_tick();
+	TickType_t attempt = run_until_connect(MQTT_RECONNECT_MAX_MS + YIELD_MS);
+	CHECK(attempt - back <= MQTT_RECONNECT_MAX_MS + YIELD_MS);
+	check_session();
+	fake_rtos_run_for(0);
+	CHECK_EQ(mqttPublishes, publishes + 1);
+	CHECK(strcmp(lastPublished, "{\"game\":[7]}") == 0);
+	CHECK_EQ(MqttQueueCount(), 0);
+
+	//A session that came up resets the backoff
+	socket_recv(MQTT_SOCK, SOCK_ERR_CONN_ABORTED);
+	fake_rtos_run_for(2 * YIELD_MS);
+	CHECK(!mqtt->isConnected);
+	last = mqttDisconnectTick;
+	attempt = run_until_connect(MQTT_RECONNECT_MIN_MS + YIELD_MS);
+	CHECK(attempt - last >= MQTT_RECONNECT_MIN_MS / 2);
+	check_session();
+
+	//A receive that only timed out is not a drop
+	uint32_t disconnects = mqttDisconnects;
+	socket_recv(MQTT_SOCK, SOCK_ERR_TIMEOUT);
+	fake_rtos_run_for(2 * YIELD_MS);
+	CHECK_EQ(mqttDisconnects, disconnects);
+	CHECK(mqtt->isConnected);
+}
+
+static void test_wifi_drop(void)
+{
+	uint32_t disconnects = mqttDisconnects, closes = mqttCloses, connects = mqttConnects, joins = wifiConnects;
+
+	//The callback only flags the link, the thread closes the socket on its next pass (see the close stub)
+	wifi_event(EVENT_WIFI_DISCONNECTED);
+	fake_rtos_run_for(2 * YIELD_MS);
+	CHECK_EQ(wifiConnects, joins + 1);
+	CHECK_EQ(mqttDisconnects, disconnects + 1);
+	CHECK_EQ(mqttCloses, closes + 1);
+	CHECK(!mqtt->isConnected);
+
+	//No attempt to reach the broker without WiFi, however long it takes
+	queue_game(9);
+	fake_rtos_run_for(4 * MQTT_RECONNECT_MAX_MS);
+	CHECK_EQ(mqttConnects, connects);
+
+	//Once the address is back, the broker is tried at once, without waiting for the backoff
+	wifi_event(EVENT_WIFI_CONNECTED);
+	fake_rtos_run_for(0);
+	wifi_event(EVENT_WIFI_DHCP);
+	fake_rtos_run_for(0);
+	CHECK_EQ(mqttConnects, connects + 1);
+	check_session();
+	fake_rtos_run_for(0);
+	CHECK(strcmp(lastPublished, "{\"game\":[9]}") == 0);
+	CHECK_EQ(MqttQueueCount(), 0);
+	CHECK_EQ(socketInits, 1);
+	CHECK_EQ(host_critical_nesting, 0);
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	fake_rtos_start(vWifiTask, NULL, 0);
+
+	test_connect();
+	test_dispatch();
+	test_no_card();
+	test_download();
+	test_publish_failures();
+	test_unanswered_ping();
+	test_backoff();
+	test_wifi_drop();
+
+	printf("wifi handler: OK\n");
+	return 0;
+}